@@ -0,0 +1,307 @@
+﻿/**
+ *madebyYahei
+ *带宽估计的本地环路验证：发送端（按目标码率出帧 + 漏桶平滑）-> 瓶颈链路（容量、单向时延、随机丢包、尾部丢弃队列）-> 接收端
+ *接收端每 50ms 回一份 transport-wide CC 反馈（按 RFC 格式编码，再经 TransportFeedbackHandler 解析）、每秒一份 RR 丢包率，
+ *BandwidthEstimator 的目标码率反过来控制发送端，用虚拟时钟跑完每个场景
+ *每个场景检查最后 10 秒的平均目标码率落在预期区间内（无丢包时要求接近链路容量）、平均排队时延不超过上限，
+ *任一场景不满足时返回非 0
+ *用法：BandwidthEstimatorBench [--verbose]（每秒打印一行 目标码率 / 到达码率 / 排队时延）
+ */
+#include "BandwidthEstimator.h"
+#include "RtpPacer.h"
+#include "TransportFeedbackHandler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr int64_t kTickUs = 1000;
+constexpr int kFps = 25;
+constexpr int kGop = 25;
+constexpr size_t kMaxPayload = 1200;
+constexpr size_t kPacketOverhead = 40;     // RTP/UDP/IP 头
+constexpr int64_t kMaxLinkQueueUs = 500000; // 瓶颈队列最多积压 500ms，再多就尾部丢弃
+constexpr int64_t kFeedbackIntervalUs = 50000;
+constexpr int64_t kReportIntervalUs = 1000000;
+constexpr int kSettleSeconds = 10;
+
+struct Scenario {
+    const char *name;
+    int capacityBps;
+    int delayMs;
+    double loss;
+    int durationS;
+    int changeAtS;         // 0 表示容量不变
+    int capacityAfterBps;
+    int expectMinKbps;
+    int expectMaxKbps;
+    double maxQueueMs;     // 利用率不能靠把瓶颈队列塞满换来
+};
+
+const Scenario kScenarios[] = {
+    {"1.2Mbps / 40ms", 1200000, 40, 0.0, 40, 0, 0, 1020, 1200, 50},
+    {"600kbps / 100ms / 1% loss", 600000, 100, 0.01, 60, 0, 0, 510, 600, 60},
+    {"10Mbps / 20ms / 0.5% loss", 10000000, 20, 0.005, 40, 0, 0, 1950, 2000, 10},
+    {"10Mbps / 20ms / 15% loss", 10000000, 20, 0.15, 40, 0, 0, 150, 250, 10},
+    {"2.5Mbps -> 800kbps at 30s / 50ms", 2500000, 50, 0.0, 70, 30, 800000, 680, 800, 80},
+};
+
+struct InFlight {
+    uint16_t sequence;
+    size_t size;
+    int64_t arrivalUs;
+};
+
+struct Delayed {
+    int64_t dueUs;
+    std::vector<uint8_t> rtcp;    // 非空时是 TWCC 反馈
+    double fractionLost;          // 否则是 RR
+};
+
+void putU16(std::vector<uint8_t> &out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+}
+
+/**
+ * @brief 按 draft-holmer-rmcat-transport-wide-cc-extensions-01 编码一份反馈
+ * 状态块统一用 2 位 status vector（每块 7 个），到达时间按 250us 量化
+ */
+std::vector<uint8_t> buildTransportFeedback(uint16_t baseSequence, const std::vector<int64_t> &arrivals,
+                                            uint8_t feedbackCount) {
+    std::vector<uint8_t> out = {0x8F, 205, 0, 0, 0, 0, 0, 1, 0, 0, 0, 42};
+    putU16(out, baseSequence);
+    putU16(out, static_cast<uint16_t>(arrivals.size()));
+    int64_t firstArrival = -1;
+    for (int64_t arrival : arrivals) {
+        if (arrival >= 0) {
+            firstArrival = arrival;
+            break;
+        }
+    }
+    const int32_t referenceTime = firstArrival >= 0 ? static_cast<int32_t>(firstArrival / 64000) : 0;
+    out.push_back(static_cast<uint8_t>((referenceTime >> 16) & 0xFF));
+    out.push_back(static_cast<uint8_t>((referenceTime >> 8) & 0xFF));
+    out.push_back(static_cast<uint8_t>(referenceTime & 0xFF));
+    out.push_back(feedbackCount);
+
+    std::vector<uint8_t> symbols;
+    std::vector<uint8_t> deltas;
+    int64_t previousUnits = static_cast<int64_t>(referenceTime) * 256;
+    for (int64_t arrival : arrivals) {
+        if (arrival < 0) {
+            symbols.push_back(0);
+            continue;
+        }
+        const int64_t units = (arrival + 125) / 250;
+        const int64_t delta = units - previousUnits;
+        previousUnits = units;
+        if (delta >= 0 && delta <= 255) {
+            symbols.push_back(1);
+            deltas.push_back(static_cast<uint8_t>(delta));
+        } else {
+            symbols.push_back(2);
+            const int16_t clamped = static_cast<int16_t>(std::min<int64_t>(std::max<int64_t>(delta, -32768), 32767));
+            deltas.push_back(static_cast<uint8_t>((clamped >> 8) & 0xFF));
+            deltas.push_back(static_cast<uint8_t>(clamped & 0xFF));
+        }
+    }
+    for (size_t i = 0; i < symbols.size(); i += 7) {
+        uint16_t chunk = 0xC000;
+        for (size_t k = 0; k < 7 && i + k < symbols.size(); ++k) {
+            chunk |= static_cast<uint16_t>(symbols[i + k] << (12 - 2 * k));
+        }
+        putU16(out, chunk);
+    }
+    out.insert(out.end(), deltas.begin(), deltas.end());
+    while (out.size() % 4) {
+        out.push_back(0);
+    }
+    const uint16_t words = static_cast<uint16_t>(out.size() / 4 - 1);
+    out[2] = static_cast<uint8_t>(words >> 8);
+    out[3] = static_cast<uint8_t>(words & 0xFF);
+    return out;
+}
+
+bool runScenario(const Scenario &scenario, bool verbose) {
+    std::mt19937 rng(20240611);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    BandwidthEstimator estimator;
+    std::vector<BandwidthEstimator::PacketFeedback> parsed;
+
+    // 发送端
+    std::deque<size_t> pacerQueue;
+    double pacerBudget = 0;
+    uint16_t nextSequence = 0;
+    int frameIndex = 0;
+    int64_t nextFrameUs = 0;
+
+    // 链路与接收端
+    std::deque<InFlight> inFlight;
+    int64_t linkBusyUntilUs = 0;
+    std::vector<std::pair<uint16_t, int64_t> > receivedSinceFeedback;
+    int32_t nextFeedbackSequence = 0;
+    uint8_t feedbackCount = 0;
+    int64_t nextFeedbackUs = kFeedbackIntervalUs;
+    int64_t nextReportUs = kReportIntervalUs;
+    int sentSinceReport = 0;
+    int lostSinceReport = 0;
+    std::deque<Delayed> backChannel;
+
+    // 统计
+    double settledTargetSum = 0;
+    double settledQueueSum = 0;
+    int settledSamples = 0;
+    size_t deliveredBytes = 0;
+    double queueDelaySumMs = 0;
+    int queueDelaySamples = 0;
+
+    const int64_t endUs = scenario.durationS * 1000000LL;
+    for (int64_t now = 0; now < endUs; now += kTickUs) {
+        const int capacity = scenario.changeAtS > 0 && now >= scenario.changeAtS * 1000000LL
+                             ? scenario.capacityAfterBps : scenario.capacityBps;
+        const int target = estimator.targetBitrate();
+
+        // 编码器：每帧按目标码率出字节，关键帧是平均帧的 3 倍
+        if (now >= nextFrameUs) {
+            const double averageFrame = target / 8.0 / kFps;
+            const bool key = frameIndex % kGop == 0;
+            const double frameBytes = key ? 3 * averageFrame : (kGop * averageFrame - 3 * averageFrame) / (kGop - 1);
+            size_t remaining = static_cast<size_t>(frameBytes);
+            while (remaining > 0) {
+                const size_t payload = std::min(remaining, kMaxPayload);
+                pacerQueue.push_back(payload + kPacketOverhead);
+                remaining -= payload;
+            }
+            ++frameIndex;
+            nextFrameUs += 1000000 / kFps;
+        }
+
+        // 平滑器：与 RtpPacer 相同的漏桶，空闲时最多攒 5ms
+        const double pacingBytesPerUs = target * RtpPacer::kDefaultPacingFactor / 8.0 / 1e6;
+        pacerBudget += pacingBytesPerUs * kTickUs;
+        if (pacerQueue.empty()) {
+            pacerBudget = std::min(pacerBudget, pacingBytesPerUs * RtpPacer::kBurstMs * 1000);
+        }
+        while (!pacerQueue.empty() && pacerBudget >= 0) {
+            const size_t size = pacerQueue.front();
+            pacerQueue.pop_front();
+            pacerBudget -= static_cast<double>(size);
+            const uint16_t sequence = nextSequence++;
+            estimator.onPacketSent(sequence, size, now);
+            ++sentSinceReport;
+
+            // 瓶颈链路：随机丢包，队列超过上限尾部丢弃，否则按容量串行发出
+            const int64_t queuedUs = std::max<int64_t>(0, linkBusyUntilUs - now);
+            if (uniform(rng) < scenario.loss || queuedUs > kMaxLinkQueueUs) {
+                ++lostSinceReport;
+                continue;
+            }
+            const int64_t serializationUs = static_cast<int64_t>(size * 8.0 * 1e6 / capacity);
+            linkBusyUntilUs = std::max(linkBusyUntilUs, now) + serializationUs;
+            inFlight.push_back(InFlight{sequence, size, linkBusyUntilUs + scenario.delayMs * 1000LL});
+            queueDelaySumMs += queuedUs / 1000.0;
+            ++queueDelaySamples;
+        }
+
+        // 接收端
+        while (!inFlight.empty() && inFlight.front().arrivalUs <= now) {
+            receivedSinceFeedback.emplace_back(inFlight.front().sequence, inFlight.front().arrivalUs);
+            deliveredBytes += inFlight.front().size;
+            inFlight.pop_front();
+        }
+        if (now >= nextFeedbackUs) {
+            nextFeedbackUs += kFeedbackIntervalUs;
+            if (!receivedSinceFeedback.empty()) {
+                // 从上次反馈的下一个序号覆盖到本次收到的最大序号，中间没收到的报未收到
+                const uint16_t base = static_cast<uint16_t>(nextFeedbackSequence);
+                uint16_t highest = base;
+                for (const auto &packet : receivedSinceFeedback) {
+                    if (static_cast<int16_t>(packet.first - highest) > 0) {
+                        highest = packet.first;
+                    }
+                }
+                const int count = static_cast<uint16_t>(highest - base) + 1;
+                std::vector<int64_t> arrivals(count, -1);
+                for (const auto &packet : receivedSinceFeedback) {
+                    const int index = static_cast<uint16_t>(packet.first - base);
+                    if (index < count) {
+                        arrivals[index] = packet.second;
+                    }
+                }
+                receivedSinceFeedback.clear();
+                nextFeedbackSequence = static_cast<uint16_t>(highest + 1);
+                backChannel.push_back(Delayed{now + scenario.delayMs * 1000LL,
+                                              buildTransportFeedback(base, arrivals, feedbackCount++), 0});
+            }
+        }
+        if (now >= nextReportUs) {
+            nextReportUs += kReportIntervalUs;
+            const double fraction = sentSinceReport > 0 ? static_cast<double>(lostSinceReport) / sentSinceReport : 0;
+            backChannel.push_back(Delayed{now + scenario.delayMs * 1000LL, {}, fraction});
+            sentSinceReport = 0;
+            lostSinceReport = 0;
+
+            const int seconds = static_cast<int>(now / 1000000);
+            const double queueMs = queueDelaySamples > 0 ? queueDelaySumMs / queueDelaySamples : 0;
+            if (verbose) {
+                std::printf("  t=%3ds capacity=%5d target=%5d delivered=%5d kbps queue=%6.1f ms\n", seconds,
+                            capacity / 1000, estimator.targetBitrate() / 1000,
+                            static_cast<int>(deliveredBytes * 8 / 1000), queueMs);
+            }
+            if (seconds >= scenario.durationS - kSettleSeconds) {
+                settledTargetSum += estimator.targetBitrate();
+                settledQueueSum += queueMs;
+                ++settledSamples;
+            }
+            deliveredBytes = 0;
+            queueDelaySumMs = 0;
+            queueDelaySamples = 0;
+        }
+
+        // 反向通道到达发送端
+        while (!backChannel.empty() && backChannel.front().dueUs <= now) {
+            const Delayed &message = backChannel.front();
+            if (!message.rtcp.empty()) {
+                if (TransportFeedbackHandler::parseTransportFeedback(message.rtcp.data(), message.rtcp.size(), parsed)) {
+                    estimator.onTransportFeedback(parsed, now);
+                } else {
+                    std::printf("  malformed feedback\n");
+                }
+            } else {
+                estimator.onReceiverReport(message.fractionLost, now);
+            }
+            backChannel.pop_front();
+        }
+    }
+
+    const int settledKbps = settledSamples > 0 ? static_cast<int>(settledTargetSum / settledSamples / 1000) : 0;
+    const double settledQueueMs = settledSamples > 0 ? settledQueueSum / settledSamples : 0;
+    const bool pass = settledKbps >= scenario.expectMinKbps && settledKbps <= scenario.expectMaxKbps &&
+                      settledQueueMs <= scenario.maxQueueMs;
+    std::printf("%-36s last %ds: target %5d kbps (expect %d..%d), queue %6.1f ms (max %.0f)  %s\n", scenario.name,
+                kSettleSeconds, settledKbps, scenario.expectMinKbps, scenario.expectMaxKbps, settledQueueMs,
+                scenario.maxQueueMs, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+}
+
+int main(int argc, char **argv) {
+    const bool verbose = argc > 1 && std::strcmp(argv[1], "--verbose") == 0;
+    int failures = 0;
+    for (const Scenario &scenario : kScenarios) {
+        if (verbose) {
+            std::printf("%s\n", scenario.name);
+        }
+        if (!runScenario(scenario, verbose)) {
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+﻿/**
+ *madebyYahei
+ *ColorConverter 基准程序
+ *1. 校验：每种可用指令集、每种格式与缩放倍数、包括奇数宽高，输出必须与标量实现逐字节一致，不一致时返回非 0
+ *2. 计时：与 sws_scale 做同样的转换（含缩小）对比每帧耗时
+ *用法：ColorConvertBench [宽 高]，默认 1920 1080
+ */
+#include "ColorConverter.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+const AVPixelFormat kFormats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_YUYV422};
+const int kScales[] = {1, 2, 4};
+
+AVFrame *makeFrame(AVPixelFormat format, int width, int height, std::mt19937 &rng) {
+    AVFrame *frame = av_frame_alloc();
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    frame->color_range = AVCOL_RANGE_MPEG;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    // 整个缓冲区（含行尾填充）都写随机数，覆盖饱和与钳位的边界
+    for (int p = 0; p < 4 && frame->buf[p]; ++p) {
+        for (size_t i = 0; i < frame->buf[p]->size; ++i) {
+            frame->buf[p]->data[i] = static_cast<uint8_t>(rng());
+        }
+    }
+    return frame;
+}
+
+std::vector<ColorConverter::Isa> availableIsas() {
+    std::vector<ColorConverter::Isa> isas{ColorConverter::Isa::Scalar};
+    const ColorConverter::Isa best = ColorConverter::detectIsa();
+    if (best == ColorConverter::Isa::SSE41 || best == ColorConverter::Isa::AVX2) {
+        isas.push_back(ColorConverter::Isa::SSE41);
+    }
+    if (best == ColorConverter::Isa::AVX2) {
+        isas.push_back(ColorConverter::Isa::AVX2);
+    }
+    return isas;
+}
+
+int verify(const std::vector<ColorConverter::Isa> &isas) {
+    const int sizes[][2] = {{1, 1}, {2, 2}, {7, 5}, {17, 9}, {33, 17}, {64, 36}, {97, 41}, {130, 66}, {641, 361}, {1280, 720}};
+    std::mt19937 rng(20251018);
+    int checked = 0;
+    int failures = 0;
+    for (AVPixelFormat format : kFormats) {
+        for (const auto &size : sizes) {
+            AVFrame *frame = makeFrame(format, size[0], size[1], rng);
+            if (!frame) {
+                std::fprintf(stderr, "av_frame_get_buffer failed\n");
+                return 1;
+            }
+            for (int scale : kScales) {
+                const int outWidth = ColorConverter::outputSize(size[0], scale);
+                const int outHeight = ColorConverter::outputSize(size[1], scale);
+                if (outWidth <= 0 || outHeight <= 0) {
+                    continue;
+                }
+                const int stride = outWidth * 4 + 12;
+                std::vector<uint8_t> reference(static_cast<size_t>(stride) * outHeight);
+                std::vector<uint8_t> output(reference.size());
+                ColorConverter scalar(ColorConverter::Isa::Scalar);
+                scalar.convert(frame, scale, reference.data(), stride);
+                for (ColorConverter::Isa isa : isas) {
+                    if (isa == ColorConverter::Isa::Scalar) {
+                        continue;
+                    }
+                    ColorConverter converter(isa);
+                    std::memset(output.data(), 0, output.size());
+                    converter.convert(frame, scale, output.data(), stride);
+                    ++checked;
+                    for (int y = 0; y < outHeight; ++y) {
+                        if (std::memcmp(&reference[static_cast<size_t>(y) * stride], &output[static_cast<size_t>(y) * stride],
+                                        static_cast<size_t>(outWidth) * 4) != 0) {
+                            std::printf("MISMATCH %s %s %dx%d scale %d row %d\n", ColorConverter::isaName(isa),
+                                        av_get_pix_fmt_name(format), size[0], size[1], scale, y);
+                            ++failures;
+                            break;
+                        }
+                    }
+                }
+            }
+            av_frame_free(&frame);
+        }
+    }
+    std::printf("bit-exact check: %d cases, %d mismatches\n", checked, failures);
+    return failures == 0 ? 0 : 1;
+}
+
+template<typename Fn>
+double nsPerFrame(Fn &&fn) {
+    using clock = std::chrono::steady_clock;
+    fn(); // 预热：分配中间行、填充缓存
+    int iterations = 0;
+    const auto start = clock::now();
+    auto now = start;
+    do {
+        fn();
+        ++iterations;
+        now = clock::now();
+    } while (now - start < std::chrono::milliseconds(500));
+    return std::chrono::duration<double, std::nano>(now - start).count() / iterations;
+}
+
+void benchmark(const std::vector<ColorConverter::Isa> &isas, int width, int height) {
+    std::mt19937 rng(1);
+    std::printf("\n%-8s %-6s %-11s %12s %12s %9s\n", "format", "scale", "impl", "us/frame", "Mpix/s", "vs sws");
+    for (AVPixelFormat format : kFormats) {
+        AVFrame *frame = makeFrame(format, width, height, rng);
+        if (!frame) {
+            continue;
+        }
+        for (int scale : kScales) {
+            const int outWidth = ColorConverter::outputSize(width, scale);
+            const int outHeight = ColorConverter::outputSize(height, scale);
+            const int stride = FFALIGN(outWidth * 4, 64);
+            std::vector<uint8_t> output(static_cast<size_t>(stride) * outHeight + 64);
+            uint8_t *dst = output.data();
+            const double megaPixels = static_cast<double>(width) * height / 1e6;
+
+            // 解码器在没有快速路径时用的就是这个配置
+            SwsContext *sws = sws_getContext(width, height, format, outWidth, outHeight, AV_PIX_FMT_RGB32,
+                                             SWS_BILINEAR, nullptr, nullptr, nullptr);
+            double swsNs = 0;
+            if (sws) {
+                uint8_t *dstData[4] = {dst, nullptr, nullptr, nullptr};
+                int dstLinesize[4] = {stride, 0, 0, 0};
+                swsNs = nsPerFrame([&]() {
+                    sws_scale(sws, frame->data, frame->linesize, 0, height, dstData, dstLinesize);
+                });
+                sws_freeContext(sws);
+                std::printf("%-8s %-6d %-11s %12.1f %12.1f %9s\n", av_get_pix_fmt_name(format), scale, "swscale",
+                            swsNs / 1e3, megaPixels / (swsNs / 1e9), "1.00x");
+            }
+            for (ColorConverter::Isa isa : isas) {
+                ColorConverter converter(isa);
+                const double ns = nsPerFrame([&]() {
+                    converter.convert(frame, scale, dst, stride);
+                });
+                char ratio[16] = "-";
+                if (swsNs > 0) {
+                    std::snprintf(ratio, sizeof(ratio), "%.2fx", swsNs / ns);
+                }
+                std::printf("%-8s %-6d %-11s %12.1f %12.1f %9s\n", av_get_pix_fmt_name(format), scale,
+                            ColorConverter::isaName(isa), ns / 1e3, megaPixels / (ns / 1e9), ratio);
+            }
+        }
+        av_frame_free(&frame);
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    int width = 1920;
+    int height = 1080;
+    if (argc >= 3) {
+        width = std::atoi(argv[1]);
+        height = std::atoi(argv[2]);
+        if (width <= 0 || height <= 0) {
+            std::fprintf(stderr, "usage: %s [width height]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::vector<ColorConverter::Isa> isas = availableIsas();
+    std::printf("cpu: %s\n", ColorConverter::isaName(ColorConverter::detectIsa()));
+    if (verify(isas) != 0) {
+        return 1;
+    }
+    benchmark(isas, width, height);
+    return 0;
+}
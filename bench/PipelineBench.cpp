@@ -0,0 +1,579 @@
+﻿/**
+ *madebyYahei
+ *无界面的整条流水线基准，每次发版跑一遍，ffmpegEncoder / RTPDepacketizer 等模块的退化直接体现为数字
+ *发送：Capture（合成源）-> ffmpegVideoDecoder -> ffmpegEncoder(H.264) -> RtmpPublisher（封装到文件或空设备）
+ *接收：按时间戳节奏读回发送端写出的文件 -> RTP 打包 -> RTPDepacketizer -> ffmpegVideoDecoder
+ *每个阶段输出 fps、处理耗时与输入队列等待的 p50/p99、所在线程 CPU 时间，另附进程 CPU 时间与峰值 RSS，JSON 写到标准输出或 --output
+ *用法：PipelineBench [--source lavfi:testsrc2|file:<路径>] [--size 1280x720] [--fps 25] [--duration 10] [--frames 0]
+ *                    [--max-speed] [--sink pipeline_bench.flv|null] [--skip-receive] [--output report.json]
+ *                    [--record-rtp corpus.rtpc]（把接收阶段喂给 RTPDepacketizer 的 RTP 包录成 RtpReceiveBench 的语料）
+ */
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "Capture.h"
+#include "FrameMailbox.h"
+#include "QueueTelemetry.h"
+#include "RTPDepacketizer.h"
+#include "RtmpPublisher.h"
+#include "ThreadSafeQueue.h"
+#include "ffmpegEncoder.h"
+#include "ffmpegVideoDecoder.h"
+#include "RtpCorpus.h"
+#include "logqueue.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+namespace {
+
+struct Options {
+    QString source = "lavfi:testsrc2";
+    int width = 1280;
+    int height = 720;
+    int fps = 25;
+    double durationSec = 10.0;
+    qint64 frames = 0; // > 0 时以封装写出的视频包数为准提前结束
+    bool maxSpeed = false;
+    QString sink = "pipeline_bench.flv";
+    bool skipReceive = false;
+    QString output;
+    QString recordRtp;
+};
+
+// 进程级资源：用户态 + 内核态 CPU 时间（毫秒）与峰值常驻内存（KB）
+void processUsage(double &cpuMs, qint64 &peakRssKb) {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    cpuMs = 0;
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        const auto toMs = [](const FILETIME &ft) {
+            return ((static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 1e4;
+        };
+        cpuMs = toMs(kernel) + toMs(user);
+    }
+    PROCESS_MEMORY_COUNTERS counters{};
+    peakRssKb = GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))
+                    ? static_cast<qint64>(counters.PeakWorkingSetSize / 1024) : 0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    cpuMs = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3 +
+            usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+    peakRssKb = usage.ru_maxrss; // Linux 上单位就是 KB
+#endif
+}
+
+QJsonObject source(const QJsonObject &snapshot, const QString &name) {
+    return snapshot["sources"].toObject()[name].toObject();
+}
+
+/**
+ * 单个阶段的报告
+ * 时延拆成两段：在输入队列里的等待（队列驻留时间）+ 本阶段处理一个元素的耗时
+ */
+QJsonObject stageReport(const QJsonObject &snapshot, const QString &stageName, const QString &inputQueue,
+                        double seconds) {
+    const QJsonObject stage = source(snapshot, stageName);
+    const QJsonObject process = stage["processUs"].toObject();
+    const double items = stage["items"].toDouble();
+    const double cpuMs = stage["threadCpuMs"].toDouble();
+
+    QJsonObject report;
+    report["items"] = static_cast<qint64>(items);
+    report["fps"] = seconds > 0 ? items / seconds : 0.0;
+    report["processP50Us"] = process["p50"];
+    report["processP99Us"] = process["p99"];
+    report["processMaxUs"] = process["max"];
+    report["threadCpuMs"] = cpuMs;
+    report["threadCpuPercent"] = seconds > 0 ? cpuMs / (seconds * 10.0) : 0.0;
+    if (!inputQueue.isEmpty()) {
+        const QJsonObject queue = source(snapshot, inputQueue);
+        const QJsonObject residence = queue["residenceUs"].toObject();
+        report["queueWaitP50Us"] = residence["p50"];
+        report["queueWaitP99Us"] = residence["p99"];
+        report["queueDropped"] = queue["dropped"];
+        report["latencyP50Us"] = residence["p50"].toDouble() + process["p50"].toDouble();
+        report["latencyP99Us"] = residence["p99"].toDouble() + process["p99"].toDouble();
+    } else {
+        report["latencyP50Us"] = process["p50"];
+        report["latencyP99Us"] = process["p99"];
+    }
+    return report;
+}
+
+void runEventLoopFor(int ms) {
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < ms) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        QThread::msleep(5);
+    }
+}
+
+void stopThread(QThread *thread) {
+    thread->quit();
+    thread->wait();
+    delete thread;
+}
+
+// ---------------- 发送链路 ----------------
+
+QJsonObject runSend(const Options &options, double &seconds) {
+    auto *packetQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::SpscRing, 64);
+    auto *frameQueue = new QUEUE_DATA<AVFramePtr>(QueueBackend::SpscRing, 32);
+    auto *publishQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::Locked);
+    auto *previewMailbox = new ImageMailbox();
+    // 与主窗口相同的溢出策略，压不住时丢帧而不是无限积压
+    packetQueue->setOverflowPolicy(OverflowPolicy::DropOldest, CapacityUnit::Items, 60);
+    frameQueue->setOverflowPolicy(OverflowPolicy::DropOldest, CapacityUnit::DurationUs, 1000000);
+    packetQueue->setName("send.videoPacket");
+    frameQueue->setName("send.videoFrame");
+    publishQueue->setName("send.publishPacket");
+
+    auto *capture = new Capture(packetQueue, nullptr);
+    capture->setVideoCaptureFormat(options.width, options.height, options.fps);
+    capture->setMaxSpeed(options.maxSpeed);
+    capture->setStageName("send.capture");
+    auto *decoder = new ffmpegVideoDecoder(packetQueue, previewMailbox, frameQueue);
+    decoder->setStageName("send.decode");
+    // 主窗口的本地小预览大约这么大，预览转换的开销也算在解码阶段
+    decoder->setTargetSize(QSize(640, 360));
+    auto *encoder = new ffmpegEncoder(frameQueue, publishQueue);
+    encoder->setStageName("send.encode");
+    auto *publisher = new RtmpPublisher(publishQueue);
+    publisher->setStageName("send.mux");
+
+    auto *captureThread = new QThread();
+    auto *decoderThread = new QThread();
+    auto *encoderThread = new QThread();
+    auto *publisherThread = new QThread();
+    capture->moveToThread(captureThread);
+    decoder->moveToThread(decoderThread);
+    encoder->moveToThread(encoderThread);
+    publisher->moveToThread(publisherThread);
+    captureThread->start();
+    decoderThread->start();
+    encoderThread->start();
+    publisherThread->start();
+
+#ifdef _WIN32
+    const QString sinkUrl = options.sink == "null" ? "NUL" : options.sink;
+#else
+    const QString sinkUrl = options.sink == "null" ? "/dev/null" : options.sink;
+#endif
+    std::atomic<bool> failed{false};
+    const auto fail = [&failed](const QString &error) {
+        std::fprintf(stderr, "PipelineBench: %s\n", error.toLocal8Bit().constData());
+        failed = true;
+    };
+    QObject::connect(capture, &Capture::errorOccurred, fail);
+    QObject::connect(decoder, &ffmpegVideoDecoder::errorOccurred, fail);
+    QObject::connect(encoder, &ffmpegEncoder::errorOccurred, fail);
+    QObject::connect(publisher, &RtmpPublisher::errorOccurred, fail);
+
+    // 与 MainWindow 相同的启动顺序：设备打开 -> 解码器 + 编码器初始化 -> 编码器就绪后开始封装
+    QObject::connect(capture, &Capture::videoDeviceOpenSuccessfully, decoder,
+                     [decoder, encoder](AVCodecParameters *params, AVRational timeBase) {
+                         decoder->init(params, timeBase);
+                         decoder->ChangeDecodingState(true);
+                         QMetaObject::invokeMethod(encoder, "initVideoEncoderH264", Qt::QueuedConnection,
+                                                   Q_ARG(AVCodecParameters*, params));
+                     });
+    QObject::connect(encoder, &ffmpegEncoder::initializationSuccess, publisher,
+                     [encoder, publisher, sinkUrl, fail]() {
+                         if (!publisher->init(sinkUrl, encoder->getCodecContext(), nullptr)) {
+                             fail(QString("Failed to open sink %1").arg(sinkUrl));
+                             return;
+                         }
+                         publisher->ChangeRtmpPublishingState(true);
+                         QMetaObject::invokeMethod(encoder, "ChangeEncodingState", Qt::QueuedConnection,
+                                                   Q_ARG(bool, true));
+                     });
+
+    QElapsedTimer timer;
+    timer.start();
+    QMetaObject::invokeMethod(capture, "openVideo", Qt::QueuedConnection, Q_ARG(QString, options.source));
+    while (!failed && timer.elapsed() < options.durationSec * 1000) {
+        runEventLoopFor(100);
+        if (options.frames > 0 &&
+            source(TelemetryRegistry::instance().snapshot(), "send.mux")["items"].toDouble() >= options.frames) {
+            break;
+        }
+    }
+    seconds = timer.elapsed() / 1000.0;
+
+    // 先停源头，再逐级停下游；每一级都等当前这次处理结束
+    QMetaObject::invokeMethod(capture, "closeDevice", Qt::BlockingQueuedConnection);
+    QMetaObject::invokeMethod(decoder, "ChangeDecodingState", Qt::BlockingQueuedConnection, Q_ARG(bool, false));
+    QMetaObject::invokeMethod(encoder, "ChangeEncodingState", Qt::BlockingQueuedConnection, Q_ARG(bool, false));
+    QMetaObject::invokeMethod(publisher, "ChangeRtmpPublishingState", Qt::BlockingQueuedConnection,
+                              Q_ARG(bool, false));
+    const QJsonObject snapshot = TelemetryRegistry::instance().snapshot();
+
+    stopThread(captureThread);
+    stopThread(decoderThread);
+    stopThread(encoderThread);
+    stopThread(publisherThread);
+    delete capture;
+    delete decoder;
+    delete encoder;
+    delete publisher; // 关闭输出文件，接收阶段从头读
+    delete previewMailbox;
+    delete publishQueue;
+    delete frameQueue;
+    delete packetQueue;
+
+    QJsonObject stages;
+    stages["capture"] = stageReport(snapshot, "send.capture.video", QString(), seconds);
+    stages["decode"] = stageReport(snapshot, "send.decode", "send.videoPacket", seconds);
+    stages["encode"] = stageReport(snapshot, "send.encode", "send.videoFrame", seconds);
+    stages["mux"] = stageReport(snapshot, "send.mux", "send.publishPacket", seconds);
+    QJsonObject report;
+    report["seconds"] = seconds;
+    report["failed"] = failed.load();
+    report["stages"] = stages;
+    return report;
+}
+
+// ---------------- 接收链路 ----------------
+
+constexpr size_t kRtpMtu = 1200;
+constexpr int kPayloadType = 96;
+constexpr uint32_t kSsrc = 0x43424e43;
+
+// 封装层可能把 Annex-B 转成了 4 字节长度前缀（FLV），统一拆成 NAL 列表
+void splitNals(const uint8_t *data, int size, std::vector<std::pair<const uint8_t *, int> > &nals) {
+    nals.clear();
+    const bool annexB = size >= 3 && data[0] == 0 && data[1] == 0 && (data[2] == 1 || (size >= 4 && data[2] == 0 && data[3] == 1));
+    if (!annexB) {
+        int pos = 0;
+        while (pos + 4 <= size) {
+            const int length = (data[pos] << 24) | (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+            pos += 4;
+            if (length <= 0 || length > size - pos) {
+                break;
+            }
+            nals.emplace_back(data + pos, length);
+            pos += length;
+        }
+        return;
+    }
+    int start = -1;
+    for (int i = 0; i + 2 < size; ++i) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (start >= 0) {
+                int end = i;
+                while (end > start && data[end - 1] == 0) {
+                    --end;
+                }
+                nals.emplace_back(data + start, end - start);
+            }
+            start = i + 3;
+            i += 2;
+        }
+    }
+    if (start >= 0 && start < size) {
+        nals.emplace_back(data + start, size - start);
+    }
+}
+
+void writeRtpHeader(uint8_t *out, bool marker, uint16_t seq, uint32_t timestamp) {
+    out[0] = 0x80;
+    out[1] = static_cast<uint8_t>((marker ? 0x80 : 0) | kPayloadType);
+    out[2] = static_cast<uint8_t>(seq >> 8);
+    out[3] = static_cast<uint8_t>(seq);
+    out[4] = static_cast<uint8_t>(timestamp >> 24);
+    out[5] = static_cast<uint8_t>(timestamp >> 16);
+    out[6] = static_cast<uint8_t>(timestamp >> 8);
+    out[7] = static_cast<uint8_t>(timestamp);
+    out[8] = static_cast<uint8_t>(kSsrc >> 24);
+    out[9] = static_cast<uint8_t>(kSsrc >> 16);
+    out[10] = static_cast<uint8_t>(kSsrc >> 8);
+    out[11] = static_cast<uint8_t>(kSsrc);
+}
+
+// RFC 6184：放得下的 NAL 单包发送，放不下的切成 FU-A；一帧的最后一个包置 marker
+void packetizeAccessUnit(const std::vector<std::pair<const uint8_t *, int> > &nals, uint32_t timestamp, uint16_t &seq,
+                         std::vector<uint8_t> &scratch, const std::function<void(const std::vector<uint8_t> &)> &send) {
+    const size_t maxPayload = kRtpMtu - 12;
+    for (size_t n = 0; n < nals.size(); ++n) {
+        const uint8_t *nal = nals[n].first;
+        const size_t size = static_cast<size_t>(nals[n].second);
+        const bool lastNal = n + 1 == nals.size();
+        if (size <= maxPayload) {
+            scratch.resize(12 + size);
+            writeRtpHeader(scratch.data(), lastNal, seq++, timestamp);
+            memcpy(scratch.data() + 12, nal, size);
+            send(scratch);
+            continue;
+        }
+        const uint8_t indicator = static_cast<uint8_t>((nal[0] & 0xE0) | 28);
+        const uint8_t type = static_cast<uint8_t>(nal[0] & 0x1F);
+        size_t offset = 1;
+        while (offset < size) {
+            const size_t chunk = std::min(maxPayload - 2, size - offset);
+            const bool first = offset == 1;
+            const bool last = offset + chunk == size;
+            scratch.resize(14 + chunk);
+            writeRtpHeader(scratch.data(), lastNal && last, seq++, timestamp);
+            scratch[12] = indicator;
+            scratch[13] = static_cast<uint8_t>((first ? 0x80 : 0) | (last ? 0x40 : 0) | type);
+            memcpy(scratch.data() + 14, nal + offset, chunk);
+            send(scratch);
+            offset += chunk;
+        }
+    }
+}
+
+/**
+ * 拉流线程：按 dts 对齐墙钟读包（抖动缓冲按到达时间估计时延，灌得比实时快会被当成网络突发）
+ * 每个视频包切成 RTP 推给 RTPDepacketizer，与 WebRTC 网络线程的调用方式一致
+ */
+void pullLoop(const QString &path, RTPDepacketizer *depacketizer, double durationSec, StageStats *stats,
+              RtpCorpus *recorder, std::atomic<bool> *stop, std::atomic<bool> *failed) {
+    AVFormatContext *ctx = nullptr;
+    if (avformat_open_input(&ctx, path.toStdString().c_str(), nullptr, nullptr) < 0 ||
+        avformat_find_stream_info(ctx, nullptr) < 0) {
+        std::fprintf(stderr, "PipelineBench: cannot read back %s\n", path.toLocal8Bit().constData());
+        avformat_close_input(&ctx);
+        *failed = true;
+        return;
+    }
+    const int videoIndex = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (videoIndex < 0) {
+        avformat_close_input(&ctx);
+        *failed = true;
+        return;
+    }
+    const AVRational timeBase = ctx->streams[videoIndex]->time_base;
+    AVPacket *packet = av_packet_alloc();
+    std::vector<std::pair<const uint8_t *, int> > nals;
+    std::vector<uint8_t> scratch;
+    uint16_t seq = 0;
+    int64_t clockStart = AV_NOPTS_VALUE;
+    const int64_t deadline = av_gettime_relative() + static_cast<int64_t>(durationSec * 1e6);
+    const auto send = [depacketizer, recorder, &clockStart](const std::vector<uint8_t> &rtp) {
+        depacketizer->pushPacket(rtp.data(), rtp.size());
+        if (recorder) {
+            recorder->packets.push_back({av_gettime_relative() - clockStart, rtp});
+        }
+    };
+    while (!*stop && av_gettime_relative() < deadline && av_read_frame(ctx, packet) >= 0) {
+        if (packet->stream_index != videoIndex) {
+            av_packet_unref(packet);
+            continue;
+        }
+        const int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+        const int64_t dueUs = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, timeBase, AVRational{1, 1000000}) : 0;
+        if (clockStart == AV_NOPTS_VALUE) {
+            clockStart = av_gettime_relative() - dueUs;
+        }
+        const int64_t waitUs = clockStart + dueUs - av_gettime_relative();
+        if (waitUs > 0) {
+            av_usleep(static_cast<unsigned int>(waitUs));
+        }
+        const int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : ts;
+        const uint32_t rtpTimestamp = static_cast<uint32_t>(av_rescale_q(pts, timeBase, AVRational{1, 90000}));
+
+        const int64_t stageBegin = stats->begin();
+        splitNals(packet->data, packet->size, nals);
+        packetizeAccessUnit(nals, rtpTimestamp, seq, scratch, send);
+        stats->end(stageBegin);
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&ctx);
+}
+
+QJsonObject runReceive(const Options &options, double maxSeconds) {
+    auto *packetQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::SpscRing, 128);
+    auto *dummyFrameQueue = new QUEUE_DATA<AVFramePtr>();
+    auto *imageMailbox = new ImageMailbox();
+    // 与 WebRTCPuller 相同的队列配置
+    packetQueue->setOverflowPolicy(OverflowPolicy::DropUntilKeyframe, CapacityUnit::Items, 60);
+    dummyFrameQueue->setOverflowPolicy(OverflowPolicy::DropNewest, CapacityUnit::Items, 0);
+    packetQueue->setName("recv.videoPacket");
+
+    auto *decoder = new ffmpegVideoDecoder(packetQueue, imageMailbox, dummyFrameQueue);
+    decoder->setThreading(ffmpegVideoDecoder::Threading::Slice);
+    decoder->setStageName("recv.decode");
+    decoder->setTargetSize(QSize(options.width, options.height));
+    auto *decoderThread = new QThread();
+    decoder->moveToThread(decoderThread);
+    decoderThread->start();
+
+    AVCodecParameters *params = avcodec_parameters_alloc();
+    params->codec_type = AVMEDIA_TYPE_VIDEO;
+    params->codec_id = AV_CODEC_ID_H264;
+    params->width = options.width;
+    params->height = options.height;
+    QMetaObject::invokeMethod(decoder, "init", Qt::BlockingQueuedConnection,
+                              Q_ARG(AVCodecParameters*, params), Q_ARG(AVRational, AVRational{1, 90000}));
+    QMetaObject::invokeMethod(decoder, "ChangeDecodingState", Qt::QueuedConnection, Q_ARG(bool, true));
+
+    auto *depacketizer = new RTPDepacketizer(90000, packetQueue, true);
+    depacketizer->setStageName("recv.depacketize");
+    StageStats pullStats;
+    pullStats.setName("recv.pull");
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> failed{false};
+    QElapsedTimer timer;
+    timer.start();
+    RtpCorpus corpus;
+    std::thread puller(pullLoop, options.sink, depacketizer, maxSeconds, &pullStats,
+                       options.recordRtp.isEmpty() ? nullptr : &corpus, &stop, &failed);
+    puller.join();
+    if (!options.recordRtp.isEmpty() && !corpus.save(options.recordRtp.toStdString())) {
+        std::fprintf(stderr, "PipelineBench: cannot write %s\n", options.recordRtp.toLocal8Bit().constData());
+        failed = true;
+    }
+    // 抖动缓冲里还压着最后一段，等它放完
+    runEventLoopFor(300);
+    const double seconds = timer.elapsed() / 1000.0;
+
+    QMetaObject::invokeMethod(decoder, "ChangeDecodingState", Qt::BlockingQueuedConnection, Q_ARG(bool, false));
+    const QJsonObject snapshot = TelemetryRegistry::instance().snapshot();
+    delete depacketizer;
+    stopThread(decoderThread);
+    delete decoder;
+    avcodec_parameters_free(&params);
+    delete imageMailbox;
+    delete dummyFrameQueue;
+    delete packetQueue;
+
+    QJsonObject stages;
+    stages["pull"] = stageReport(snapshot, "recv.pull", QString(), seconds);
+    QJsonObject depacketize = stageReport(snapshot, "recv.depacketize", QString(), seconds);
+    // 抖动缓冲的调度滞后（实际出队相对到期时间）单列，等待本身是有意为之的缓冲深度
+    depacketize["playoutLatenessUs"] = source(snapshot, "rtp.video.playout")["latenessUs"];
+    stages["depacketize"] = depacketize;
+    stages["decode"] = stageReport(snapshot, "recv.decode", "recv.videoPacket", seconds);
+    QJsonObject report;
+    report["seconds"] = seconds;
+    report["failed"] = failed.load();
+    report["stages"] = stages;
+    return report;
+}
+
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+    LogQueue::GetInstance().start();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless capture/encode/mux and pull/depacketize/decode benchmark");
+    parser.addHelpOption();
+    QCommandLineOption sourceOption("source", "Capture source spec (lavfi:... or file:...).", "spec", "lavfi:testsrc2");
+    QCommandLineOption sizeOption("size", "Capture size WxH.", "size", "1280x720");
+    QCommandLineOption fpsOption("fps", "Capture frame rate.", "fps", "25");
+    QCommandLineOption durationOption("duration", "Seconds to run each direction.", "seconds", "10");
+    QCommandLineOption framesOption("frames", "Stop the send side after this many muxed frames.", "count", "0");
+    QCommandLineOption maxSpeedOption("max-speed", "Do not pace the source to the wall clock.");
+    QCommandLineOption sinkOption("sink", "Mux output file, or null.", "path", "pipeline_bench.flv");
+    QCommandLineOption skipReceiveOption("skip-receive", "Only run the send side.");
+    QCommandLineOption outputOption("output", "Write the JSON report here instead of stdout.", "path");
+    QCommandLineOption recordRtpOption("record-rtp", "Save the received RTP packets as a RtpReceiveBench corpus.", "path");
+    parser.addOptions({sourceOption, sizeOption, fpsOption, durationOption, framesOption, maxSpeedOption,
+                       sinkOption, skipReceiveOption, outputOption, recordRtpOption});
+    parser.process(app);
+
+    Options options;
+    options.source = parser.value(sourceOption);
+    const QStringList size = parser.value(sizeOption).split('x');
+    if (size.size() == 2) {
+        options.width = size[0].toInt();
+        options.height = size[1].toInt();
+    }
+    options.fps = parser.value(fpsOption).toInt();
+    options.durationSec = parser.value(durationOption).toDouble();
+    options.frames = parser.value(framesOption).toLongLong();
+    options.maxSpeed = parser.isSet(maxSpeedOption);
+    options.sink = parser.value(sinkOption);
+    options.skipReceive = parser.isSet(skipReceiveOption);
+    options.output = parser.value(outputOption);
+    options.recordRtp = parser.value(recordRtpOption);
+    if (options.width <= 0 || options.height <= 0 || options.fps <= 0 || options.durationSec <= 0) {
+        std::fprintf(stderr, "PipelineBench: invalid --size/--fps/--duration\n");
+        return 2;
+    }
+
+    QJsonObject config;
+    config["source"] = options.source;
+    config["width"] = options.width;
+    config["height"] = options.height;
+    config["fps"] = options.fps;
+    config["durationSec"] = options.durationSec;
+    config["frames"] = options.frames;
+    config["maxSpeed"] = options.maxSpeed;
+    config["sink"] = options.sink;
+
+    QJsonObject root;
+    root["config"] = config;
+    double sendSeconds = 0;
+    const QJsonObject send = runSend(options, sendSeconds);
+    root["send"] = send;
+    bool ok = !send["failed"].toBool() && send["stages"].toObject()["mux"].toObject()["items"].toDouble() > 0;
+    if (options.skipReceive) {
+        root["receive"] = QJsonObject{{"skipped", "--skip-receive"}};
+    } else if (options.sink == "null") {
+        // 没有落盘的码流可读回
+        root["receive"] = QJsonObject{{"skipped", "sink is null"}};
+    } else if (ok) {
+        const QJsonObject receive = runReceive(options, options.durationSec);
+        root["receive"] = receive;
+        ok = !receive["failed"].toBool();
+    }
+
+    double cpuMs = 0;
+    qint64 peakRssKb = 0;
+    processUsage(cpuMs, peakRssKb);
+    QJsonObject process;
+    process["cpuMs"] = cpuMs;
+    process["peakRssKb"] = peakRssKb;
+    process["idealThreads"] = QThread::idealThreadCount();
+    root["process"] = process;
+
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+    if (options.output.isEmpty()) {
+        std::fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+    } else {
+        QFile file(options.output);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            std::fprintf(stderr, "PipelineBench: cannot write %s\n", options.output.toLocal8Bit().constData());
+            ok = false;
+        } else {
+            file.write(json);
+        }
+    }
+
+    LogQueue::GetInstance().stopImmediately();
+    LogQueue::GetInstance().wait();
+    return ok ? 0 : 1;
+}
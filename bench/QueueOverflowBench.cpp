@@ -0,0 +1,118 @@
+﻿/**
+ *madebyYahei
+ *发送队列 DropUntilKeyframe 策略的验证：音视频混在一个队列里（流 0 视频 40ms/帧、每 30 帧一个关键帧，流 1 音频 20ms/包，
+ *与 mainwindow 的发送队列一样按 DurationUs 限 2 秒），消费者中途停摆几次让队列溢出，Locked / SpscRing 两种后端各跑一遍
+ *检查：出队的每个视频非关键帧都紧跟在上一个出队视频帧之后（清空后到下一个关键帧之间没有 P 帧漏出来）、
+ *确实发生过清空、等待关键帧期间音频照常出队；任一项不满足时返回非 0
+ */
+#include "ThreadSafeQueue.h"
+#include "AVSmartPtrs.h"
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+constexpr int64_t kTickMs = 20;
+constexpr int kGop = 30;
+constexpr int64_t kLimitUs = 2000000;
+constexpr int kTicks = 1500;
+
+// 消费者停摆的区间（单位 tick），长度不同，使触发清空的既有视频也有音频
+struct Stall {
+    int from;
+    int to;
+};
+constexpr Stall kStalls[] = {{100, 260}, {400, 513}, {700, 901}, {1100, 1207}};
+
+AVPacketPtr makePacket(int streamIndex, int64_t seq, bool key) {
+    AVPacketPtr packet(av_packet_alloc());
+    av_new_packet(packet.get(), 100);
+    packet->stream_index = streamIndex;
+    packet->pts = seq;
+    packet->duration = streamIndex == 0 ? 2 * kTickMs : kTickMs;
+    packet->time_base = AVRational{1, 1000};
+    if (key) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+    return packet;
+}
+
+bool stalled(int tick) {
+    for (const Stall &stall : kStalls) {
+        if (tick >= stall.from && tick < stall.to) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool runBackend(QueueBackend backend, const char *name) {
+    QUEUE_DATA<AVPacketPtr> queue(backend, 1024);
+    queue.setOverflowPolicy(OverflowPolicy::DropUntilKeyframe, CapacityUnit::DurationUs, kLimitUs);
+
+    int64_t videoSeq = 0;
+    int64_t audioSeq = 0;
+    int64_t lastVideo = -1;
+    int brokenChains = 0;
+    int videoOut = 0;
+    int audioOut = 0;
+    int audioWhileWaiting = 0;
+    int audioSinceVideo = 0; // 上一个出队视频帧之后、媒体时间也晚于它的音频包
+    std::vector<AVPacketPtr> batch;
+
+    for (int tick = 0; tick < kTicks; ++tick) {
+        queue.enqueue(makePacket(1, audioSeq++, false));
+        if (tick % 2 == 0) {
+            queue.enqueue(makePacket(0, videoSeq, videoSeq % kGop == 0));
+            ++videoSeq;
+        }
+        if (stalled(tick)) {
+            continue;
+        }
+        batch.clear();
+        queue.dequeue_batch(batch, 1024, 0);
+        for (AVPacketPtr &packet : batch) {
+            if (packet->stream_index == 1) {
+                ++audioOut;
+                if (packet->pts >= (lastVideo + 1) * 2) {
+                    ++audioSinceVideo;
+                }
+                continue;
+            }
+            ++videoOut;
+            const bool key = packet->flags & AV_PKT_FLAG_KEY;
+            const bool gap = packet->pts != lastVideo + 1;
+            if (gap && !key) {
+                ++brokenChains;
+            }
+            if (gap) {
+                // 断档期间（清空之后、关键帧之前）出队的音频
+                audioWhileWaiting += audioSinceVideo;
+            }
+            audioSinceVideo = 0;
+            lastVideo = packet->pts;
+        }
+    }
+
+    const bool flushed = queue.droppedCount() > 0;
+    const bool pass = brokenChains == 0 && flushed && audioWhileWaiting > 0;
+    std::printf("%-8s video out %4d/%lld, audio out %4d/%lld, dropped %llu, P-frames after a gap %d, "
+                "audio while waiting %d  %s\n",
+                name, videoOut, static_cast<long long>(videoSeq), audioOut, static_cast<long long>(audioSeq),
+                static_cast<unsigned long long>(queue.droppedCount()), brokenChains, audioWhileWaiting,
+                pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+}
+
+int main() {
+    int failures = 0;
+    if (!runBackend(QueueBackend::Locked, "locked")) {
+        ++failures;
+    }
+    if (!runBackend(QueueBackend::SpscRing, "spsc")) {
+        ++failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/**
+ *madebyYahei
+ *RTP 包语料：按到达顺序保存的 (到达时间, 完整 RTP 包)，供接收链路基准回放
+ *文件格式（小端）："CMRTPC01" | uint32 时钟频率 | uint32 包数 | 每包 int64 到达时间(微秒) + uint16 长度 + 数据
+ *内置语料由固定种子的生成器产出（与平台、标准库实现无关，逐字节可复现）；
+ *PipelineBench --record-rtp 可以录下真实编码器输出的语料，RtpReceiveBench --corpus 回放
+ */
+#ifndef RTPCORPUS_H
+#define RTPCORPUS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct RtpCorpusPacket {
+    int64_t arrivalUs = 0;
+    std::vector<uint8_t> data;
+};
+
+struct RtpCorpus {
+    uint32_t clockRate = 90000;
+    std::vector<RtpCorpusPacket> packets;
+    // 生成语料时保留的原始 Annex-B 访问单元（起始码 3/4 字节混用，与编码器输出一致），录制的语料为空
+    std::vector<std::vector<uint8_t> > accessUnits;
+
+    size_t bytes() const {
+        size_t total = 0;
+        for (const RtpCorpusPacket &packet : packets) {
+            total += packet.data.size();
+        }
+        return total;
+    }
+
+    bool save(const std::string &path) const {
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        std::vector<uint8_t> out(8);
+        std::copy_n("CMRTPC01", 8, out.begin());
+        putLe(out, clockRate, 4);
+        putLe(out, static_cast<uint64_t>(packets.size()), 4);
+        for (const RtpCorpusPacket &packet : packets) {
+            putLe(out, static_cast<uint64_t>(packet.arrivalUs), 8);
+            putLe(out, packet.data.size(), 2);
+            out.insert(out.end(), packet.data.begin(), packet.data.end());
+        }
+        const bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+        std::fclose(file);
+        return ok;
+    }
+
+    bool load(const std::string &path) {
+        FILE *file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        std::vector<uint8_t> in;
+        uint8_t chunk[64 * 1024];
+        size_t got;
+        while ((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            in.insert(in.end(), chunk, chunk + got);
+        }
+        std::fclose(file);
+        if (in.size() < 16 || !std::equal(in.begin(), in.begin() + 8, "CMRTPC01")) {
+            return false;
+        }
+        size_t pos = 8;
+        clockRate = static_cast<uint32_t>(getLe(in, pos, 4));
+        const uint64_t count = getLe(in, pos, 4);
+        packets.clear();
+        accessUnits.clear();
+        for (uint64_t i = 0; i < count; ++i) {
+            if (pos + 10 > in.size()) {
+                return false;
+            }
+            RtpCorpusPacket packet;
+            packet.arrivalUs = static_cast<int64_t>(getLe(in, pos, 8));
+            const size_t size = static_cast<size_t>(getLe(in, pos, 2));
+            if (pos + size > in.size()) {
+                return false;
+            }
+            packet.data.assign(in.begin() + pos, in.begin() + pos + size);
+            pos += size;
+            packets.push_back(std::move(packet));
+        }
+        return true;
+    }
+
+private:
+    static void putLe(std::vector<uint8_t> &out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    static uint64_t getLe(const std::vector<uint8_t> &in, size_t &pos, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(in[pos++]) << (8 * i);
+        }
+        return value;
+    }
+};
+
+#endif // RTPCORPUS_H
@@ -0,0 +1,546 @@
+﻿/**
+ *madebyYahei
+ *接收热路径微基准（Google Benchmark）：RTPJitter push/pop、H.264 组帧（RTPDepacketizer 的 H264AccessUnitAssembler）、
+ *两者串起来的完整解包路径，以及推流端 Annex-B 转长度前缀（H264Bitstream 的 NAL 索引 + 原地改写 / 拼接）
+ *每个场景回放同一份语料：顺序、乱序、丢包、突发，视频按 1200 字节 MTU 切片（STAP-A / FU-A），音频为 20ms Opus 大小
+ *包的处理方式与 RTPDepacketizer::pushPacket / processPop 相同（池化拷贝、payload_ms、到期即取），只是不起调度线程：
+ *语料里到达时间相隔超过 kBatchGapUs 的地方代表一次调度唤醒，把到期的包全部取出
+ *用法：RtpReceiveBench [--corpus=<PipelineBench --record-rtp 录下的文件>] [Google Benchmark 参数]
+ */
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "H264AccessUnitAssembler.h"
+#include "H264Bitstream.h"
+#include "RtpCorpus.h"
+#include "RtpPacketPool.h"
+#include "rtp_jitter.h"
+
+namespace {
+
+constexpr size_t kRtpMtu = 1200;
+constexpr size_t kRtpHeaderSize = 12;
+constexpr int kFps = 25;
+constexpr int kGop = 50;
+constexpr int kCorpusSeconds = 20;
+constexpr int64_t kBatchGapUs = 1000;
+// 基准里不让播放时钟压住包：目标深度 0，最大深度放宽到不会触发溢出丢弃
+constexpr unsigned kMaxDepthMs = 10000;
+
+// xorshift64*：不依赖标准库分布的实现，保证各平台生成的语料逐字节一致
+class Prng {
+public:
+    explicit Prng(uint64_t seed) : m_state(seed ? seed : 1) {}
+
+    uint64_t next() {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 2685821657736338717ULL;
+    }
+
+    uint32_t below(uint32_t n) { return static_cast<uint32_t>((next() >> 32) % n); }
+
+    bool chance(double p) { return (next() >> 11) * (1.0 / 9007199254740992.0) < p; }
+
+private:
+    uint64_t m_state;
+};
+
+void appendRtpHeader(std::vector<uint8_t> &out, bool marker, uint8_t payloadType, uint16_t seq, uint32_t timestamp,
+                     uint32_t ssrc) {
+    const uint8_t header[kRtpHeaderSize] = {
+        0x80, static_cast<uint8_t>((marker ? 0x80 : 0) | payloadType),
+        static_cast<uint8_t>(seq >> 8), static_cast<uint8_t>(seq),
+        static_cast<uint8_t>(timestamp >> 24), static_cast<uint8_t>(timestamp >> 16),
+        static_cast<uint8_t>(timestamp >> 8), static_cast<uint8_t>(timestamp),
+        static_cast<uint8_t>(ssrc >> 24), static_cast<uint8_t>(ssrc >> 16),
+        static_cast<uint8_t>(ssrc >> 8), static_cast<uint8_t>(ssrc)
+    };
+    out.insert(out.end(), header, header + kRtpHeaderSize);
+}
+
+// 随机内容的 NAL，按规范插入防竞争字节，保证负载里不会出现伪起始码
+std::vector<uint8_t> makeNal(Prng &rng, uint8_t header, size_t size) {
+    std::vector<uint8_t> nal;
+    nal.reserve(size + size / 64);
+    nal.push_back(header);
+    int zeros = 0;
+    while (nal.size() < size) {
+        const uint8_t b = static_cast<uint8_t>(rng.next() >> 56);
+        if (zeros >= 2 && b <= 3) {
+            nal.push_back(0x03);
+            zeros = 0;
+        }
+        nal.push_back(b);
+        zeros = b == 0 ? zeros + 1 : 0;
+    }
+    if (nal.back() == 0) {
+        nal.back() = 0x80; // rbsp_stop_one_bit
+    }
+    return nal;
+}
+
+/**
+ * 视频语料：25fps、GOP 50，IDR 约 35~50KB，P 帧 3~9KB（每 10 帧一个 12KB 左右的大 P 帧）
+ * 关键帧前的 SPS/PPS 用 STAP-A 聚合，超过 MTU 的 slice 切 FU-A；序号从 65000 起，覆盖 16 位回绕
+ * 同一帧的包间隔 12us 背靠背到达，帧间 40ms，另加最多 2ms 的帧级抖动
+ */
+RtpCorpus makeVideoCorpus() {
+    Prng rng(0x20261018u);
+    RtpCorpus corpus;
+    corpus.clockRate = 90000;
+    uint16_t seq = 65000;
+    uint32_t timestamp = 0x7fff0000u;
+    const uint32_t ssrc = 42;
+    const size_t maxPayload = kRtpMtu - kRtpHeaderSize;
+
+    for (int f = 0; f < kFps * kCorpusSeconds; ++f) {
+        const bool key = f % kGop == 0;
+        std::vector<std::vector<uint8_t> > nals;
+        if (key) {
+            nals.push_back(makeNal(rng, 0x67, 24));
+            nals.push_back(makeNal(rng, 0x68, 6));
+            nals.push_back(makeNal(rng, 0x65, 35000 + rng.below(15000)));
+        } else {
+            const size_t size = f % 10 == 5 ? 11000 + rng.below(3000) : 3000 + rng.below(6000);
+            nals.push_back(makeNal(rng, 0x41, size));
+        }
+
+        // 编码器原样输出：参数集和首个 NAL 用 4 字节起始码，其后的 slice 用 3 字节
+        std::vector<uint8_t> au;
+        for (size_t n = 0; n < nals.size(); ++n) {
+            static const uint8_t kLong[4] = {0, 0, 0, 1};
+            const bool shortCode = key && n == nals.size() - 1;
+            au.insert(au.end(), shortCode ? kLong + 1 : kLong, kLong + 4);
+            au.insert(au.end(), nals[n].begin(), nals[n].end());
+        }
+        corpus.accessUnits.push_back(std::move(au));
+
+        std::vector<std::vector<uint8_t> > payloads;
+        size_t first = 0;
+        if (key) {
+            std::vector<uint8_t> stap{0x78};
+            for (int n = 0; n < 2; ++n) {
+                stap.push_back(static_cast<uint8_t>(nals[n].size() >> 8));
+                stap.push_back(static_cast<uint8_t>(nals[n].size()));
+                stap.insert(stap.end(), nals[n].begin(), nals[n].end());
+            }
+            payloads.push_back(std::move(stap));
+            first = 2;
+        }
+        for (size_t n = first; n < nals.size(); ++n) {
+            const std::vector<uint8_t> &nal = nals[n];
+            if (nal.size() <= maxPayload) {
+                payloads.push_back(nal);
+                continue;
+            }
+            for (size_t offset = 1; offset < nal.size();) {
+                const size_t chunk = std::min(maxPayload - 2, nal.size() - offset);
+                std::vector<uint8_t> fu{static_cast<uint8_t>((nal[0] & 0xE0) | 28),
+                                        static_cast<uint8_t>((offset == 1 ? 0x80 : 0) |
+                                                             (offset + chunk == nal.size() ? 0x40 : 0) |
+                                                             (nal[0] & 0x1F))};
+                fu.insert(fu.end(), nal.begin() + offset, nal.begin() + offset + chunk);
+                payloads.push_back(std::move(fu));
+                offset += chunk;
+            }
+        }
+
+        int64_t arrivalUs = static_cast<int64_t>(f) * 1000000 / kFps + rng.below(2000);
+        for (size_t p = 0; p < payloads.size(); ++p) {
+            RtpCorpusPacket packet;
+            packet.arrivalUs = arrivalUs;
+            appendRtpHeader(packet.data, p + 1 == payloads.size(), 96, seq++, timestamp, ssrc);
+            packet.data.insert(packet.data.end(), payloads[p].begin(), payloads[p].end());
+            corpus.packets.push_back(std::move(packet));
+            arrivalUs += 12;
+        }
+        timestamp += 90000 / kFps;
+    }
+    return corpus;
+}
+
+// 音频语料：48kHz、20ms 一包，负载 60~180 字节（Opus 语音到音乐的常见范围），每包最多 1.5ms 到达抖动
+RtpCorpus makeAudioCorpus() {
+    Prng rng(0x0b05a11du);
+    RtpCorpus corpus;
+    corpus.clockRate = 48000;
+    uint16_t seq = 65300;
+    uint32_t timestamp = 0x12345678u;
+    for (int i = 0; i < 50 * kCorpusSeconds; ++i) {
+        RtpCorpusPacket packet;
+        packet.arrivalUs = static_cast<int64_t>(i) * 20000 + rng.below(1500);
+        appendRtpHeader(packet.data, false, 111, seq++, timestamp, 43);
+        const size_t size = 60 + rng.below(120);
+        for (size_t b = 0; b < size; ++b) {
+            packet.data.push_back(static_cast<uint8_t>(rng.next() >> 56));
+        }
+        corpus.packets.push_back(std::move(packet));
+        timestamp += 960;
+    }
+    return corpus;
+}
+
+enum class Scenario { InOrder, Reordered, Lossy, Bursty };
+
+const char *scenarioName(Scenario scenario) {
+    switch (scenario) {
+        case Scenario::InOrder: return "InOrder";
+        case Scenario::Reordered: return "Reordered";
+        case Scenario::Lossy: return "Lossy";
+        case Scenario::Bursty: return "Bursty";
+    }
+    return "";
+}
+
+/**
+ * 从顺序语料派生各场景，种子固定
+ * 乱序：5% 相邻两包互换，1% 一个包晚到 3 个位置；被换位的包归到同一次到达，回放时不会被当成迟到包丢掉
+ * 丢包：2% 随机丢包，外加约每 500 包一次连续丢 5 包
+ * 突发：每秒最后 200ms 的包被压住，到整秒时一起到达（Wi-Fi 漫游、上行排队的典型形态）
+ */
+RtpCorpus applyScenario(const RtpCorpus &base, Scenario scenario) {
+    RtpCorpus corpus = base;
+    std::vector<RtpCorpusPacket> &packets = corpus.packets;
+    Prng rng(0xc0ffee00u + static_cast<uint64_t>(scenario));
+    switch (scenario) {
+        case Scenario::InOrder:
+            break;
+        case Scenario::Reordered:
+            for (size_t i = 0; i + 3 < packets.size(); ++i) {
+                if (rng.chance(0.01)) {
+                    std::rotate(packets.begin() + i, packets.begin() + i + 1, packets.begin() + i + 4);
+                    const int64_t arrivalUs = std::max(packets[i + 2].arrivalUs, packets[i + 3].arrivalUs);
+                    for (size_t k = i; k < i + 4; ++k) {
+                        packets[k].arrivalUs = arrivalUs;
+                    }
+                    i += 3;
+                } else if (rng.chance(0.05)) {
+                    std::swap(packets[i], packets[i + 1]);
+                    const int64_t arrivalUs = std::max(packets[i].arrivalUs, packets[i + 1].arrivalUs);
+                    packets[i].arrivalUs = packets[i + 1].arrivalUs = arrivalUs;
+                    i += 1;
+                }
+            }
+            break;
+        case Scenario::Lossy: {
+            std::vector<RtpCorpusPacket> kept;
+            for (size_t i = 0; i < packets.size(); ++i) {
+                if (rng.chance(1.0 / 500)) {
+                    i += 4;
+                    continue;
+                }
+                if (!rng.chance(0.02)) {
+                    kept.push_back(std::move(packets[i]));
+                }
+            }
+            packets.swap(kept);
+            break;
+        }
+        case Scenario::Bursty:
+            for (RtpCorpusPacket &packet : packets) {
+                if (packet.arrivalUs % 1000000 >= 800000) {
+                    packet.arrivalUs = (packet.arrivalUs / 1000000 + 1) * 1000000;
+                }
+            }
+            break;
+    }
+    return corpus;
+}
+
+/**
+ * 接收端状态：抖动缓冲 + 接收池，每轮回放前复位
+ * 与 RTPDepacketizer 一致：每包拷一次进池化缓冲区，payload_ms 按时间戳差计算
+ */
+class ReceiveReplay {
+public:
+    explicit ReceiveReplay(uint32_t clockRate)
+        : m_clockRate(clockRate), m_jitter(0, clockRate) {
+        m_jitter.set_depth(0, kMaxDepthMs);
+    }
+
+    void reset() {
+        m_jitter.reset();
+        m_jitter.set_depth(0, kMaxDepthMs);
+        m_hasLastTimestamp = false;
+    }
+
+    // onPop(packet)：packet 为空表示抖动缓冲宣告丢包
+    template<typename OnPop>
+    void run(const RtpCorpus &corpus, OnPop &&onPop) {
+        const std::vector<RtpCorpusPacket> &packets = corpus.packets;
+        for (size_t i = 0; i < packets.size(); ++i) {
+            push(packets[i].data);
+            if (i + 1 == packets.size() || packets[i + 1].arrivalUs - packets[i].arrivalUs >= kBatchGapUs) {
+                drain(onPop);
+            }
+        }
+        drain(onPop);
+    }
+
+private:
+    void push(const std::vector<uint8_t> &data) {
+        AVBufferRef *buffer = m_pool.acquire(data.data(), data.size());
+        rawrtp_ptr packet = std::make_shared<RTPPacket>(buffer, static_cast<uint16>(data.size()));
+        const uint32_t timestamp = rtp_timestamp(packet->pData);
+        uint32_t payloadMs = 20;
+        if (m_hasLastTimestamp) {
+            const int32_t delta = static_cast<int32_t>(timestamp - m_lastTimestamp);
+            payloadMs = 0;
+            if (delta > 0) {
+                payloadMs = static_cast<uint32_t>(static_cast<uint64_t>(delta) * 1000 / m_clockRate);
+                m_lastTimestamp = timestamp;
+            }
+        } else {
+            m_hasLastTimestamp = true;
+            m_lastTimestamp = timestamp;
+        }
+        packet->payload_ms = static_cast<uint16_t>(payloadMs);
+        m_jitter.push(packet);
+    }
+
+    template<typename OnPop>
+    void drain(OnPop &&onPop) {
+        rawrtp_ptr packet;
+        while (true) {
+            const RTPJitter::RESULT res = m_jitter.pop(packet);
+            if (res == RTPJitter::SUCCESS) {
+                onPop(packet);
+                packet.reset();
+            } else if (res == RTPJitter::DROPPED_PACKET) {
+                onPop(rawrtp_ptr());
+            } else {
+                break;
+            }
+        }
+    }
+
+    uint32_t m_clockRate;
+    RTPJitter m_jitter;
+    RtpPacketPool m_pool;
+    bool m_hasLastTimestamp = false;
+    uint32_t m_lastTimestamp = 0;
+};
+
+void setThroughput(benchmark::State &state, const RtpCorpus &corpus) {
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(corpus.packets.size()));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(corpus.bytes()));
+}
+
+void BM_JitterPushPop(benchmark::State &state, const RtpCorpus *corpus) {
+    ReceiveReplay replay(corpus->clockRate);
+    int64_t popped = 0;
+    int64_t lost = 0;
+    for (auto _ : state) {
+        replay.reset();
+        popped = 0;
+        lost = 0;
+        replay.run(*corpus, [&](const rawrtp_ptr &packet) {
+            packet ? ++popped : ++lost;
+            benchmark::DoNotOptimize(packet.get());
+        });
+    }
+    setThroughput(state, *corpus);
+    state.counters["popped"] = static_cast<double>(popped);
+    state.counters["lossEvents"] = static_cast<double>(lost);
+}
+
+/**
+ * 只测组帧：抖动缓冲的输出序列（含丢包事件）预先算好，每轮按顺序喂给组帧器
+ * 单 NAL 帧会把起始码写进同一个池化缓冲区里 RTP 头的 SSRC 位置，复用这些包不影响序号和时间戳
+ */
+void BM_H264Assemble(benchmark::State &state, const RtpCorpus *corpus) {
+    std::vector<rawrtp_ptr> ordered;
+    ReceiveReplay replay(corpus->clockRate);
+    replay.run(*corpus, [&](const rawrtp_ptr &packet) { ordered.push_back(packet); });
+
+    H264AccessUnitAssembler assembler;
+    std::vector<AVPacketPtr> frames;
+    int64_t accessUnits = 0;
+    uint64_t corrupt = 0;
+    for (auto _ : state) {
+        assembler.reset();
+        accessUnits = 0;
+        const uint64_t corruptBefore = assembler.stats().corruptUnits;
+        for (const rawrtp_ptr &packet : ordered) {
+            if (!packet) {
+                assembler.markLoss();
+                continue;
+            }
+            assembler.push(packet, frames);
+            accessUnits += static_cast<int64_t>(frames.size());
+            frames.clear();
+        }
+        corrupt = assembler.stats().corruptUnits - corruptBefore;
+    }
+    setThroughput(state, *corpus);
+    state.counters["accessUnits"] = static_cast<double>(accessUnits);
+    state.counters["corrupt"] = static_cast<double>(corrupt);
+}
+
+// 完整解包路径：RTPDepacketizer 网络线程 + 调度线程上做的全部工作，去掉线程间唤醒
+void BM_ReceivePath(benchmark::State &state, const RtpCorpus *corpus) {
+    ReceiveReplay replay(corpus->clockRate);
+    H264AccessUnitAssembler assembler;
+    std::vector<AVPacketPtr> frames;
+    int64_t accessUnits = 0;
+    for (auto _ : state) {
+        replay.reset();
+        assembler.reset();
+        accessUnits = 0;
+        replay.run(*corpus, [&](const rawrtp_ptr &packet) {
+            if (!packet) {
+                assembler.markLoss();
+                return;
+            }
+            assembler.push(packet, frames);
+            accessUnits += static_cast<int64_t>(frames.size());
+            frames.clear();
+        });
+    }
+    setThroughput(state, *corpus);
+    state.counters["accessUnits"] = static_cast<double>(accessUnits);
+}
+
+int64_t totalBytes(const std::vector<std::vector<uint8_t> > &accessUnits) {
+    int64_t bytes = 0;
+    for (const std::vector<uint8_t> &au : accessUnits) {
+        bytes += static_cast<int64_t>(au.size());
+    }
+    return bytes;
+}
+
+void BM_IndexNals(benchmark::State &state, const std::vector<std::vector<uint8_t> > *accessUnits) {
+    std::vector<H264NalUnit> nals;
+    int64_t nalCount = 0;
+    for (auto _ : state) {
+        nalCount = 0;
+        for (const std::vector<uint8_t> &au : *accessUnits) {
+            nalCount += indexH264Nals(au.data(), static_cast<int>(au.size()), nals);
+            benchmark::DoNotOptimize(nals.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(accessUnits->size()));
+    state.SetBytesProcessed(state.iterations() * totalBytes(*accessUnits));
+    state.counters["nals"] = static_cast<double>(nalCount);
+}
+
+// 与 WebRTCPublisher::sendVideoPacket 相同的转换；原地改写会破坏输入，每帧先复制到 scratch，
+// 这次复制代表编码器新产出的包，计入耗时
+void BM_ToLengthPrefixed(benchmark::State &state, const std::vector<std::vector<uint8_t> > *accessUnits) {
+    std::vector<H264NalUnit> nals;
+    std::vector<uint8_t> scratch;
+    std::vector<std::byte> rebuilt;
+    int64_t inPlace = 0;
+    for (auto _ : state) {
+        inPlace = 0;
+        for (const std::vector<uint8_t> &au : *accessUnits) {
+            scratch.assign(au.begin(), au.end());
+            const int size = static_cast<int>(scratch.size());
+            if (indexH264Nals(scratch.data(), size, nals) == 0) {
+                continue;
+            }
+            if (rewriteH264StartCodesAsLengths(scratch.data(), size, nals)) {
+                ++inPlace;
+                benchmark::DoNotOptimize(scratch.data());
+                continue;
+            }
+            rebuilt.clear();
+            appendH264LengthPrefixed(scratch.data(), nals, rebuilt);
+            benchmark::DoNotOptimize(rebuilt.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(accessUnits->size()));
+    state.SetBytesProcessed(state.iterations() * totalBytes(*accessUnits));
+    state.counters["inPlace"] = static_cast<double>(inPlace);
+}
+
+// 把每个起始码统一成 4 字节，对应编码器只输出长起始码的情况（全部走原地改写）
+std::vector<std::vector<uint8_t> > withLongStartCodes(const std::vector<std::vector<uint8_t> > &accessUnits) {
+    static const uint8_t kLong[4] = {0, 0, 0, 1};
+    std::vector<std::vector<uint8_t> > out;
+    std::vector<H264NalUnit> nals;
+    for (const std::vector<uint8_t> &au : accessUnits) {
+        indexH264Nals(au.data(), static_cast<int>(au.size()), nals);
+        std::vector<uint8_t> converted;
+        for (const H264NalUnit &nal : nals) {
+            converted.insert(converted.end(), kLong, kLong + 4);
+            converted.insert(converted.end(), au.begin() + nal.offset, au.begin() + nal.offset + nal.size);
+        }
+        out.push_back(std::move(converted));
+    }
+    return out;
+}
+
+// 录制的语料没有原始访问单元，用组帧器的输出代替
+std::vector<std::vector<uint8_t> > assembleAccessUnits(const RtpCorpus &corpus) {
+    std::vector<std::vector<uint8_t> > accessUnits;
+    ReceiveReplay replay(corpus.clockRate);
+    H264AccessUnitAssembler assembler;
+    std::vector<AVPacketPtr> frames;
+    replay.run(corpus, [&](const rawrtp_ptr &packet) {
+        if (!packet) {
+            return;
+        }
+        assembler.push(packet, frames);
+        for (const AVPacketPtr &frame : frames) {
+            accessUnits.emplace_back(frame->data, frame->data + frame->size);
+        }
+        frames.clear();
+    });
+    return accessUnits;
+}
+
+}
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    std::string corpusPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--corpus=", 0) == 0) {
+            corpusPath = arg.substr(9);
+        } else {
+            std::fprintf(stderr, "RtpReceiveBench: unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    RtpCorpus videoBase;
+    if (corpusPath.empty()) {
+        videoBase = makeVideoCorpus();
+    } else if (!videoBase.load(corpusPath)) {
+        std::fprintf(stderr, "RtpReceiveBench: cannot load corpus %s\n", corpusPath.c_str());
+        return 2;
+    }
+    if (videoBase.accessUnits.empty()) {
+        videoBase.accessUnits = assembleAccessUnits(videoBase);
+    }
+    const RtpCorpus audioBase = makeAudioCorpus();
+
+    // 语料在注册前全部生成好，基准运行期间只读
+    static std::map<std::string, RtpCorpus> corpora;
+    const Scenario scenarios[] = {Scenario::InOrder, Scenario::Reordered, Scenario::Lossy, Scenario::Bursty};
+    for (Scenario scenario : scenarios) {
+        const std::string name = scenarioName(scenario);
+        const RtpCorpus *video = &(corpora["video/" + name] = applyScenario(videoBase, scenario));
+        const RtpCorpus *audio = &(corpora["audio/" + name] = applyScenario(audioBase, scenario));
+        benchmark::RegisterBenchmark(("BM_JitterPushPop/video/" + name).c_str(), BM_JitterPushPop, video);
+        benchmark::RegisterBenchmark(("BM_JitterPushPop/audio/" + name).c_str(), BM_JitterPushPop, audio);
+        benchmark::RegisterBenchmark(("BM_H264Assemble/" + name).c_str(), BM_H264Assemble, video);
+        benchmark::RegisterBenchmark(("BM_ReceivePath/" + name).c_str(), BM_ReceivePath, video);
+    }
+    static const std::vector<std::vector<uint8_t> > mixedCodes = corpora["video/InOrder"].accessUnits;
+    static const std::vector<std::vector<uint8_t> > longCodes = withLongStartCodes(mixedCodes);
+    benchmark::RegisterBenchmark("BM_IndexNals/mixed", BM_IndexNals, &mixedCodes);
+    benchmark::RegisterBenchmark("BM_ToLengthPrefixed/mixed", BM_ToLengthPrefixed, &mixedCodes);
+    benchmark::RegisterBenchmark("BM_ToLengthPrefixed/long", BM_ToLengthPrefixed, &longCodes);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -6,9 +6,11 @@
 #define AVSMARTPTRS_H
 
 #include <memory>
+#include "QueueItemTraits.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
 }
 
 struct AVPacketDeleter {
@@ -31,4 +33,63 @@ struct AVFrameDeleter {
 using AVPacketPtr = std::unique_ptr<AVPacket, AVPacketDeleter>;
 using AVFramePtr = std::unique_ptr<AVFrame, AVFrameDeleter>;
 
+// 供 QUEUE_DATA 按字节/时长计容量、按关键帧丢包使用
+// 时长依赖生产者填写 time_base + duration，缺失时按 0 计
+template<>
+struct QueueItemTraits<AVPacketPtr> {
+    static int64_t bytes(const AVPacketPtr &pkt) {
+        return pkt ? pkt->size : 0;
+    }
+
+    static int64_t durationUs(const AVPacketPtr &pkt) {
+        if (!pkt || pkt->duration <= 0 || pkt->time_base.num <= 0 || pkt->time_base.den <= 0) {
+            return 0;
+        }
+        return av_rescale_q(pkt->duration, pkt->time_base, AVRational{1, 1000000});
+    }
+
+    static bool isKeyframe(const AVPacketPtr &pkt) {
+        return pkt && (pkt->flags & AV_PKT_FLAG_KEY);
+    }
+
+    // 工程内约定流 0 是视频、流 1 是音频；只有视频帧间有参考关系，音频包不受关键帧等待影响
+    static bool needsKeyframe(const AVPacketPtr &pkt) {
+        return pkt && pkt->stream_index == 0;
+    }
+};
+
+template<>
+struct QueueItemTraits<AVFramePtr> {
+    static int64_t bytes(const AVFramePtr &frame) {
+        if (!frame) {
+            return 0;
+        }
+        int64_t total = 0;
+        for (AVBufferRef *buf: frame->buf) {
+            if (buf) {
+                total += buf->size;
+            }
+        }
+        return total;
+    }
+
+    static int64_t durationUs(const AVFramePtr &frame) {
+        if (!frame) {
+            return 0;
+        }
+        if (frame->nb_samples > 0 && frame->sample_rate > 0) {
+            return av_rescale(frame->nb_samples, 1000000, frame->sample_rate);
+        }
+        if (frame->duration > 0 && frame->time_base.num > 0 && frame->time_base.den > 0) {
+            return av_rescale_q(frame->duration, frame->time_base, AVRational{1, 1000000});
+        }
+        return 0;
+    }
+
+    // 解码后的帧都能独立使用
+    static bool isKeyframe(const AVFramePtr &) { return true; }
+
+    static bool needsKeyframe(const AVFramePtr &) { return false; }
+};
+
 #endif //AVSMARTPTRS_H
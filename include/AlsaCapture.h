@@ -0,0 +1,73 @@
+﻿/**
+ *madebyYahei
+ *Linux ALSA 音频采集
+ *每次 read 取一个周期（period）的 S16 交错样本，周期大小可配：越小延迟越低，但唤醒更频繁、更容易 xrun
+ *xrun 后自动 snd_pcm_prepare 恢复并计数；时间戳按已采样本数累加
+ *编译时没有 ALSA（CLOUDMEETING_HAVE_ALSA）或非 Linux 平台上 open 总是失败
+ */
+#ifndef ALSACAPTURE_H
+#define ALSACAPTURE_H
+
+#include <QJsonObject>
+#include <QString>
+#include <atomic>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+class AlsaCapture {
+public:
+    static constexpr int kDefaultPeriodFrames = 480; // 48kHz 下 10ms
+
+    AlsaCapture() = default;
+
+    ~AlsaCapture();
+
+    AlsaCapture(const AlsaCapture &) = delete;
+
+    AlsaCapture &operator=(const AlsaCapture &) = delete;
+
+    // 设备描述（DeviceEnumerator 给出的）-> ALSA PCM 名；已经是 PCM 名时原样返回
+    static QString resolveDevice(const QString &name);
+
+    /**
+     * @brief 打开 PCM 并开始采集
+     * periodFrames 是期望值，驱动给出的实际周期可能略有不同，以 periodFrames() 为准
+     */
+    bool open(const QString &device, int sampleRate, int channels, int periodFrames, QString &error);
+
+    void close();
+
+    bool isOpen() const;
+
+    /**
+     * @brief 阻塞读取一个周期
+     * @return 0 成功；AVERROR(EAGAIN) 表示发生 xrun 已恢复，重读即可；其他负值为设备错误
+     */
+    int read(AVPacket *packet);
+
+    // pcm_s16le
+    const AVCodecParameters *codecParameters() const { return m_params; }
+
+    AVRational timeBase() const { return {1, m_sampleRate}; }
+
+    int periodFrames() const { return m_periodFrames; }
+
+    QJsonObject telemetrySnapshot() const;
+
+private:
+    void *m_pcm = nullptr; // snd_pcm_t*，头文件里不引入 alsa
+    AVCodecParameters *m_params = nullptr;
+    int m_sampleRate = 48000;
+    int m_channels = 2;
+    int m_periodFrames = kDefaultPeriodFrames;
+    int64_t m_nextPts = 0;
+    QString m_telemetryName;
+
+    std::atomic<uint64_t> m_periods{0};
+    std::atomic<uint64_t> m_xruns{0};
+    std::atomic<uint64_t> m_errors{0};
+};
+
+#endif // ALSACAPTURE_H
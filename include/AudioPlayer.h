@@ -2,13 +2,14 @@
 #define RTMPAUDIOPLAYER_H
 
 #include <QObject>
-#include <QMutex>
-#include <QWaitCondition>
 #include <QAudioSink>
 #include <QIODevice>
 #include <memory>
 #include <atomic>
+#include <functional>
+#include <mutex>
 #include "ThreadSafeQueue.h"
+#include "PipelineWorker.h"
 #include "AVSmartPtrs.h"
 #include "AudioResampleConfig.h"
 extern "C" {
@@ -26,6 +27,11 @@ public:
         QObject* parent = nullptr);
     ~AudioPlayer();
 
+    // ʾԴΪ֡΢룩ʵҪ==ӿ죩
+    // ɶṩ nullptr ȡ̵߳
+    using TimeStretchProvider = std::function<int(int)>;
+    void setTimeStretchProvider(TimeStretchProvider provider);
+
 signals:
     void errorOccurred(const QString& errorText);
 
@@ -35,21 +41,25 @@ public slots:
     void startPlaying();
     void stopPlaying();
     void ChangeDecodingState(bool isDecoding);
-private slots:
-    void doDecodingWork();
 
 private:
     void clear();
+    // ִ߳У롢زд m_fifo֪ͨ߳д
+    void decodePacket(AVPacket* packet);
+    // QAudioSink ڱֻ̣߳ m_fifo ед
+    void feedAudioSink();
     bool initAudioOutput(AVFrame* frame);
+    void applyTimeStretch(const AVFrame* frame);
 
     QUEUE_DATA<AVPacketPtr>* m_packetQueue;
     QUEUE_DATA<AVFramePtr>* m_frameQueue;
-    std::atomic<bool> m_isDecoding = { false };
     std::atomic<bool> m_isConfigReady = false;
 
     AVCodecContext* m_codecCtx = nullptr;
     SwrContext* m_swrCtx = nullptr;
     AVAudioFifo* m_fifo = nullptr;
+    std::mutex m_fifoMutex; // m_fifo ɽ߳д̶߳
+    std::atomic<bool> m_feedPending{ false }; // Ͷݻûִе feedAudioSinkѹʱϲһ
     AVRational m_inputTimeBase;
     int64_t m_frameBasePts = AV_NOPTS_VALUE;
     int64_t m_fifoBasePts = AV_NOPTS_VALUE;
@@ -65,9 +75,12 @@ private:
     int m_resampledLinesize = 0;
 
 
-    QMutex m_workMutex;
-    QWaitCondition m_workCond;
-    std::atomic<bool> m_isDoingWork = { false };
+    // ز 2%ƫԼ 1/3 ²ײ
+    static constexpr int MAX_STRETCH_PERMILLE = 20;
+    std::mutex m_stretchMutex;
+    TimeStretchProvider m_timeStretchProvider;
+
+    PipelineWorker m_worker{ "audioPlayer" };
 };
 
 #endif // RTMPAUDIOPLAYER_H
\ No newline at end of file
@@ -0,0 +1,167 @@
+﻿/**
+ *madebyYahei
+ *发送端带宽估计（GCC 思路）：目标码率 = min(基于时延的估计, 基于丢包的估计, REMB)
+ *基于时延：transport-wide CC 反馈给出每个包的到达时间，按 5ms 发送突发分组求单向时延梯度，
+ *趋势线滤波后与自适应阈值比较得到 过载/正常/欠载，AIMD 调整（过载时降到实际到达码率的 0.85，正常时每秒上调 8%，
+ *接近上次过载时的链路容量后改为加性上调）
+ *基于丢包：丢包率 < 2% 时每秒上调 8%，> 10% 时按 (1 - 0.5 × 丢包率) 下调，中间保持；丢包率取自 TWCC 反馈或 RTCP RR
+ *只做计算，时间都由调用方传入（模拟环路可以用虚拟时钟）；反馈在网络线程、发送记录在平滑线程，内部一把锁
+ */
+#ifndef BANDWIDTHESTIMATOR_H
+#define BANDWIDTHESTIMATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <QJsonObject>
+
+class BandwidthEstimator {
+public:
+    static constexpr int kDefaultStartBps = 1000000;
+    static constexpr int kDefaultMinBps = 150000;
+    static constexpr int kDefaultMaxBps = 2000000; // ffmpegEncoder 原来的固定码率
+
+    enum class Usage {
+        Normal,
+        Overusing,
+        Underusing
+    };
+
+    struct PacketFeedback {
+        uint16_t sequence = 0;  // transport-wide 序号
+        bool received = false;
+        int64_t arrivalUs = 0;  // 接收端时钟，只有差值有意义
+    };
+
+    explicit BandwidthEstimator(int startBps = kDefaultStartBps, int minBps = kDefaultMinBps,
+                                int maxBps = kDefaultMaxBps);
+
+    // 包真正交给传输层时记录（平滑之后的时间，否则平滑造成的间隔会被当成排队时延）
+    void onPacketSent(uint16_t sequence, size_t size, int64_t sendUs);
+
+    /**
+     * @brief 处理一个 TWCC 反馈包里的全部状态（按序号顺序）
+     * @return 更新后的目标码率
+     */
+    int onTransportFeedback(const std::vector<PacketFeedback> &packets, int64_t nowUs);
+
+    // RTCP RR 中本流的 fraction lost（0~1）
+    int onReceiverReport(double fractionLost, int64_t nowUs);
+
+    int onRemb(int64_t bitrateBps, int64_t nowUs);
+
+    int targetBitrate() const;
+
+    QJsonObject stats() const;
+
+private:
+    static constexpr int kHistorySize = 4096;                 // 发送记录环，按序号低位索引
+    static constexpr int64_t kBurstUs = 5000;                 // 发送时间在 5ms 内的包算一组
+    static constexpr int kTrendWindow = 30;                  // 每秒一个关键帧的突发在 20 组窗口里足以单独触发过载
+    static constexpr double kTrendSmoothing = 0.9;
+    static constexpr double kTrendGain = 4.0;
+    static constexpr int64_t kAckedWindowUs = 150000;         // 瓶颈排队时到达速率就是链路容量，窗口短才量得到它
+    static constexpr int64_t kMinDecreaseIntervalUs = 200000; // 两次时延降速至少间隔约一个 RTT
+    static constexpr int64_t kLossIncreaseIntervalUs = 1000000;
+    static constexpr int64_t kLossDecreaseIntervalUs = 300000;
+    static constexpr int kMinLossPackets = 20;                // TWCC 丢包率的最小统计包数
+    static constexpr int64_t kFeedbackTimeoutUs = 2000000;    // 这么久没有 TWCC 时不再用时延估计限速
+    static constexpr int64_t kRembTimeoutUs = 5000000;
+
+    enum class RateState {
+        Hold,
+        Increase
+    };
+
+    struct SentPacket {
+        int32_t sequence = -1; // -1 表示空或已确认
+        size_t size = 0;
+        int64_t sendUs = 0;
+    };
+
+    struct PacketGroup {
+        int64_t firstSendUs = -1;
+        int64_t lastSendUs = 0;
+        int64_t lastArrivalUs = 0;
+    };
+
+    void onPacketArrivalLocked(int64_t sendUs, int64_t arrivalUs, int64_t nowUs);
+
+    void updateTrendLocked(double delayDeltaMs, double sendDeltaMs, int64_t arrivalUs, int64_t nowUs);
+
+    void detectLocked(double trend, double sendDeltaMs, int64_t nowUs);
+
+    void updateThresholdLocked(double modifiedTrend, int64_t nowUs);
+
+    void updateAckedLocked(int64_t arrivalUs, size_t size);
+
+    void updateDelayBasedLocked(int64_t nowUs);
+
+    void updateLossBasedLocked(double lossFraction, int64_t nowUs);
+
+    int updateTargetLocked(int64_t nowUs);
+
+    const int m_minBps;
+    const int m_maxBps;
+
+    mutable std::mutex m_mutex;
+    std::vector<SentPacket> m_sent;
+
+    // 到达分组
+    PacketGroup m_currentGroup;
+    PacketGroup m_previousGroup;
+
+    // 趋势线
+    std::deque<std::pair<double, double> > m_trendSamples; // (到达时间 ms, 平滑后的累计时延 ms)
+    int64_t m_firstArrivalUs = -1;
+    double m_accumulatedDelayMs = 0;
+    double m_smoothedDelayMs = 0;
+    int m_numDeltas = 0;
+    double m_trend = 0;
+    double m_prevTrend = 0;
+
+    // 过载检测
+    double m_thresholdMs = 12.5;
+    double m_modifiedTrend = 0;
+    int64_t m_lastThresholdUpdateUs = -1;
+    double m_timeOverUsingMs = -1;
+    int m_overuseCounter = 0;
+    Usage m_usage = Usage::Normal;
+
+    // 到达码率
+    std::deque<std::pair<int64_t, size_t> > m_ackedWindow;
+    size_t m_ackedWindowBytes = 0;
+    double m_ackedBps = 0;
+
+    // AIMD
+    RateState m_rateState = RateState::Increase;
+    double m_delayBasedBps;
+    double m_linkCapacityBps = 0; // 上次过载时的到达码率（平滑），0 表示未知
+    int64_t m_lastRateUpdateUs = -1;
+    int64_t m_lastDecreaseUs = -1;
+    int64_t m_lastFeedbackUs = -1;
+
+    // 丢包
+    double m_lossBasedBps;
+    double m_lastLossFraction = 0;
+    int m_lossWindowReceived = 0;
+    int m_lossWindowLost = 0;
+    int64_t m_lastLossIncreaseUs = -1;
+    int64_t m_lastLossDecreaseUs = -1;
+
+    double m_rembBps = 0;
+    int64_t m_lastRembUs = -1;
+
+    int m_targetBps;
+
+    uint64_t m_feedbacks = 0;
+    uint64_t m_overuses = 0;
+    uint64_t m_received = 0;
+    uint64_t m_lost = 0;
+};
+
+#endif // BANDWIDTHESTIMATOR_H
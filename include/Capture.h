@@ -4,12 +4,18 @@
 #include <QObject>
 #include "AVSmartPtrs.h"
 #include "ThreadSafeQueue.h"
+#include "PipelineWorker.h"
+#include "V4l2Capture.h"
+#include "AlsaCapture.h"
+#include "SyntheticSource.h"
+#include <memory>
 
 extern "C" {
 #include <libavutil/avutil.h>
 #include <libavdevice/avdevice.h>
 #include <libavformat/avformat.h>
 #include <libavutil/time.h>
+#include <libavutil/pixdesc.h>
 }
 
 enum class MediaType {
@@ -25,11 +31,65 @@ public:
 
     ~Capture();
 
+    // 以 name.video / name.audio 分别注册两路采集线程的处理耗时（从读到包开始计，不含等待设备/节奏控制）和 CPU 时间
+    void setStageName(const QString &name) {
+        m_videoStageStats.setName(name + ".video");
+        m_audioStageStats.setName(name + ".audio");
+    }
+
 private:
     static void initializeFFmpeg();
+
+    // 原生后端一次 read 最多阻塞这么久，保证 stopVideoReading 能及时返回
+    static constexpr int kNativeReadTimeoutMs = 100;
+
+    /**
+     * @brief Linux 上优先走原生后端（V4L2 mmap 零拷贝 / ALSA），失败时再用 libavdevice
+     * 其他平台直接返回 false
+     */
+    bool openVideoNative(const QString &deviceName);
+    bool openAudioNative(const QString &deviceName);
+
+    // 设备名是 lavfi: / file: 时走合成源，不碰真实设备
+    bool openVideoSynthetic(const QString &spec);
+    bool openAudioSynthetic(const QString &spec);
+
+    // libavdevice 路径：Windows 用 dshow，Linux 用 v4l2 / alsa
+    bool openVideoDemuxer(const QString &deviceName);
+    bool openAudioDemuxer(const QString &deviceName);
+
+    int readVideoPacket(AVPacket *packet);
+    int readAudioPacket(AVPacket *packet);
+
+    // 读取线程的一次迭代：读一个包放入队列；返回 false 表示设备出错或读到结尾，读取线程随即退出
+    bool doReadVideoFrame();
+    bool doReadAudioFrame();
+
+    /**
+     * @brief 按优先级协商摄像头输出格式并打开设备
+     * 先试原始格式（nv12 / yuyv422 / yuv420p），编码器可以直接吃、预览也不用解码；
+     * 都不支持时才用 mjpeg，最后退回设备默认格式
+     */
+    bool openVideoNegotiated(const QString &deviceUrl, const AVInputFormat *inputFormat);
+
+    // 以一组 dshow 选项尝试打开，失败时 m_VideoFormatCtx 保持为空
+    int tryOpenVideo(const QString &deviceUrl, const AVInputFormat *inputFormat,
+                     const char *pixelFormat, const char *videoCodec, bool withSize);
+
     AVFormatContext* m_VideoFormatCtx = nullptr;
     AVFormatContext* m_AudioFormatCtx = nullptr;
 
+    // 原生后端，与上面的 FormatCtx 二选一
+    std::unique_ptr<V4l2Capture> m_v4l2;
+    std::unique_ptr<AlsaCapture> m_alsa;
+    int m_audioPeriodFrames = AlsaCapture::kDefaultPeriodFrames;
+    std::unique_ptr<SyntheticSource> m_videoSource;
+    std::unique_ptr<SyntheticSource> m_audioSource;
+    bool m_maxSpeed = false;
+    // 视频、音频各在自己的读取线程上计时，不能共用一个（threadCpuMs 是最后写入线程的 CPU 时间）
+    StageStats m_videoStageStats;
+    StageStats m_audioStageStats;
+
     int m_videoStreamIndex = -1;
     int m_audioStreamIndex = -1;
 
@@ -44,8 +104,10 @@ private:
     QString m_videoDeviceName;
     QString m_audioDeviceName;
 
-    std::atomic<bool> m_isReadingVideo = false;
-    std::atomic<bool> m_isReadingAudio = false;
+    // 期望的采集分辨率与帧率，0 表示由设备决定
+    int m_requestedWidth = 0;
+    int m_requestedHeight = 0;
+    int m_requestedFps = 0;
 
     int64_t m_videoStartTime = 0;
     int64_t m_audioStartTime = 0;
@@ -53,14 +115,9 @@ private:
     QUEUE_DATA<AVPacketPtr> *m_videoPacketQueue = nullptr;
     QUEUE_DATA<AVPacketPtr> *m_audioPacketQueue = nullptr;
 
-    // --- 两个独立的线程同步 ---
-    QMutex m_videoWorkMutex;
-    QWaitCondition m_videoWorkCond;
-    std::atomic<bool> m_isDoingVideoWork = false;
-
-    QMutex m_audioWorkMutex;
-    QWaitCondition m_audioWorkCond;
-    std::atomic<bool> m_isDoingAudioWork = false;
+    // 音视频各一个读取线程；stop 最多等一次读取（原生后端 kNativeReadTimeoutMs，dshow 一帧间隔）
+    PipelineWorker m_videoWorker{"videoCapture"};
+    PipelineWorker m_audioWorker{"audioCapture"};
 
     void startVideoReading();
     void startAudioReading();
@@ -76,14 +133,21 @@ public slots:
     void closeDevice();
 
     void configReadingStatus(bool openVideo, bool openAudio);
-    void doReadVideoFrame();
-    void doReadAudioFrame();
 
     void stopReading();
 
     void openAudio(const QString &audioDeviceName);
     void openVideo(const QString &videoDeviceName);
 
+    // 在 openVideo 之前调用；设备没有这个规格时退回设备默认值
+    void setVideoCaptureFormat(int width, int height, int fps);
+
+    // 在 openAudio 之前调用；ALSA 每次读取的帧数，只对原生 ALSA 后端生效
+    void setAudioPeriodFrames(int frames);
+
+    // 在 open 之前调用；只对合成源生效，true 时不按墙钟节奏出包
+    void setMaxSpeed(bool enabled);
+
     void closeAudio();
     void closeVideo();
 };
@@ -0,0 +1,74 @@
+﻿/**
+ *madebyYahei
+ *ColorConverter 的行级内核，每种指令集一张函数表
+ *标量版本是参考实现：SIMD 版本只处理整块，尾部交给标量函数，结果逐字节一致
+ */
+#ifndef COLORCONVERTKERNELS_H
+#define COLORCONVERTKERNELS_H
+
+#include <cstdint>
+
+namespace ColorConvertKernels {
+
+/*
+ * BT.601 有限范围，6 位定点（系数 x64），所有中间值都在 int16 内，
+ * 只有 B 通道可能在饱和加法里触顶，而触顶时结果本来就会被钳到 255：
+ *   Y' = (Y - 16) * 74 + ((Y - 16) >> 1)        （增益 74.5 = 1.164 x 64，白电平 235 正好到 255）
+ *   R = clamp((Y' + 102 * (V - 128) + 32) >> 6)
+ *   G = clamp((Y' - 25 * (U - 128) - 52 * (V - 128) + 32) >> 6)
+ *   B = clamp((Y' + 129 * (U - 128) + 32) >> 6)
+ */
+constexpr int kYOffset = 16;
+constexpr int kYGain = 74;
+constexpr int kVToR = 102;
+constexpr int kUToG = 25;
+constexpr int kVToG = 52;
+constexpr int kUToB = 129;
+constexpr int kRound = 32;
+constexpr int kShift = 6;
+
+// 一行平面 YUV -> RGB32；chromaShared 为 true 时每 2 个像素共用一个色度样本（4:2:0 / 4:2:2 原始宽度）
+using RowFn = void (*)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool chromaShared);
+
+// rowCount 个输入行、每 factor 列求平均（四舍五入），rowCount x factor 为 1/2/4/8/16
+using BoxFn = void (*)(const uint8_t *const *rows, int rowCount, int factor, uint8_t *out, int outWidth);
+
+// NV12 交织色度 UVUV... -> U / V 两个平面行
+using SplitUVFn = void (*)(const uint8_t *uv, uint8_t *u, uint8_t *v, int pairs);
+
+// YUYV 4:2:2 交织行 -> Y / U / V，pairs 为像素对数
+using SplitYuyvFn = void (*)(const uint8_t *yuyv, uint8_t *y, uint8_t *u, uint8_t *v, int pairs);
+
+struct Table {
+    RowFn row;
+    BoxFn box;
+    SplitUVFn splitUV;
+    SplitYuyvFn splitYuyv;
+};
+
+// 标量参考实现，供 SIMD 内核处理尾部；start 之前的部分已由调用方处理
+void rowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int start, int width, bool chromaShared);
+
+void boxScalar(const uint8_t *const *rows, int rowCount, int factor, uint8_t *out, int start, int outWidth);
+
+void splitUVScalar(const uint8_t *uv, uint8_t *u, uint8_t *v, int start, int pairs);
+
+void splitYuyvScalar(const uint8_t *yuyv, uint8_t *y, uint8_t *u, uint8_t *v, int start, int pairs);
+
+const Table &scalarTable();
+
+// 非 x86 平台上返回标量表
+const Table &sse41Table();
+
+const Table &avx2Table();
+
+// AVX2 表复用的 SSE4.1 平均/拆分内核（仅 x86）
+BoxFn sse41Box();
+
+SplitUVFn sse41SplitUV();
+
+SplitYuyvFn sse41SplitYuyv();
+
+}
+
+#endif // COLORCONVERTKERNELS_H
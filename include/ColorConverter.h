@@ -0,0 +1,65 @@
+﻿/**
+ *madebyYahei
+ *YUV -> RGB32 色彩转换（yuv420p / nv12 / yuyv422，BT.601 有限范围）
+ *SSE4.1 / AVX2 手写内核，运行时按 CPU 选择，标量实现兼作参考（SIMD 结果与之逐字节一致）；
+ *可在同一遍里融合 2x / 4x 盒式缩小：逐行把若干输入行平均成一行再转换，中间行只在 L1 里停留
+ *输出字节序 B,G,R,0xFF，即 QImage::Format_RGB32 / AV_PIX_FMT_RGB32（小端）
+ *不依赖 Qt，基准程序可以单独链接
+ */
+#ifndef COLORCONVERTER_H
+#define COLORCONVERTER_H
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+class ColorConverter {
+public:
+    enum class Isa {
+        Scalar,
+        SSE41,
+        AVX2
+    };
+
+    // 当前 CPU 支持的最快实现
+    static Isa detectIsa();
+
+    static const char *isaName(Isa isa);
+
+    // 像素格式与色彩范围都支持时返回 true（全范围的 yuvj 格式交给 swscale）
+    static bool isSupported(const AVFrame *frame);
+
+    static bool isSupportedFormat(AVPixelFormat format);
+
+    // scale 为 1 时保留奇数宽高，2 / 4 时向下取整
+    static int outputSize(int size, int scale) { return scale <= 1 ? size : size / scale; }
+
+    explicit ColorConverter(Isa isa = detectIsa());
+
+    ColorConverter(const ColorConverter &) = delete;
+
+    ColorConverter &operator=(const ColorConverter &) = delete;
+
+    Isa isa() const { return m_isa; }
+
+    /**
+     * @brief 转换一帧
+     * @param scale 1 / 2 / 4，输出尺寸为 outputSize(width/height, scale)
+     * @param dst 输出缓冲区，dstStride 为行字节数（不小于输出宽度 x 4）
+     * @return 格式或参数不支持时返回 false
+     */
+    bool convert(const AVFrame *frame, int scale, uint8_t *dst, int dstStride);
+
+    bool convert(AVPixelFormat format, const uint8_t *const data[3], const int linesize[3],
+                 int width, int height, int scale, uint8_t *dst, int dstStride);
+
+private:
+    Isa m_isa;
+    std::vector<uint8_t> m_scratch; // 拆分/平均后的中间行，按帧宽度增长后复用
+};
+
+#endif // COLORCONVERTER_H
@@ -0,0 +1,63 @@
+﻿/**
+ *madebyYahei
+ *进程级解码线程预算（单例）
+ *所有视频解码器（本地预览、RTMP 拉流、WebRTC 拉流……）打开解码器前从这里申请线程数，关闭时归还；
+ *FFmpeg 的线程数在 avcodec_open2 之后不能改，已打开的解码器不会被回收线程，所以先开的一路不能占满：
+ *按预期同时解码的路数（默认 3 路）给还没打开的每一路预留一份，剩余额度在它们之间平分；
+ *超过预期路数后新开的一路只能拿剩下的（至少 1 个）。8 核时三路依次分到 2、3、3 个线程，
+ *只开一路时它最多用到总数的 1/3。关闭后空出的额度留给之后打开的解码器
+ */
+#ifndef DECODERTHREADBUDGET_H
+#define DECODERTHREADBUDGET_H
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <cstdint>
+
+class DecoderThreadBudget {
+public:
+    static DecoderThreadBudget &instance();
+
+    DecoderThreadBudget(const DecoderThreadBudget &) = delete;
+
+    DecoderThreadBudget &operator=(const DecoderThreadBudget &) = delete;
+
+    // 总预算，threads <= 0 时恢复为 CPU 逻辑核数；只影响之后的申请
+    void setTotal(int threads);
+
+    int total() const;
+
+    // 预期同时解码的路数，决定先开的解码器给后开的预留多少；<= 0 时恢复默认值
+    void setExpectedDecoders(int decoders);
+
+    /**
+     * @brief 申请线程
+     * @param requested 期望的线程数，<= 0 表示不设上限（取平分额度）
+     * @return 实际分到的线程数，至少为 1（解码本身总要有一个线程），用完必须 release 同样的数目
+     */
+    int acquire(int requested);
+
+    void release(int threads);
+
+    QJsonObject telemetrySnapshot() const;
+
+private:
+    // 本地预览、RTMP 拉流、WebRTC 拉流
+    static constexpr int kDefaultExpectedDecoders = 3;
+
+    DecoderThreadBudget();
+
+    ~DecoderThreadBudget();
+
+    mutable QMutex m_mutex;
+    int m_total = 1;
+    int m_inUse = 0;
+    int m_decoders = 0;
+    int m_expectedDecoders = kDefaultExpectedDecoders;
+    uint64_t m_granted = 0;      // 累计申请次数
+    uint64_t m_shortfalls = 0;   // 分到的少于期望值的次数
+    QString m_telemetryName;
+};
+
+#endif // DECODERTHREADBUDGET_H
@@ -0,0 +1,110 @@
+﻿/**
+ *madebyYahei
+ *显示用的"最新帧信箱"（三缓冲）
+ *生产者（解码线程）和消费者（界面线程）各持有一个槽位，第三个槽位在两者之间交换，
+ *双方都只做一次原子交换，从不阻塞；消费者总是拿到最新一帧，来不及显示的旧帧直接被覆盖
+ *只允许一个生产者线程和一个消费者线程
+ */
+#ifndef FRAMEMAILBOX_H
+#define FRAMEMAILBOX_H
+
+#include <QImage>
+#include <QJsonObject>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "QueueTelemetry.h"
+
+template<typename T>
+class FrameMailbox {
+public:
+    FrameMailbox() = default;
+
+    ~FrameMailbox() {
+        if (!m_telemetryName.isEmpty()) {
+            TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+        }
+    }
+
+    FrameMailbox(const FrameMailbox &) = delete;
+
+    FrameMailbox &operator=(const FrameMailbox &) = delete;
+
+    // 以 name 注册到 TelemetryRegistry
+    void setName(const QString &name) {
+        if (!m_telemetryName.isEmpty()) {
+            TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+        }
+        m_telemetryName = TelemetryRegistry::instance().registerSource(name, [this]() {
+            return telemetrySnapshot();
+        });
+    }
+
+    /**
+     * @brief 放入一帧（生产者）
+     * @return 覆盖了一帧尚未被取走的旧帧时返回 false
+     */
+    bool publish(T frame) {
+        m_slots[m_writeIndex] = std::move(frame);
+        const uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_writeIndex | kFresh), std::memory_order_acq_rel);
+        m_writeIndex = previous & kIndexMask;
+        // 换回来的槽位要么是被覆盖的旧帧，要么是消费者已经用完的帧，在生产者线程上释放
+        m_slots[m_writeIndex] = T();
+        m_published.fetch_add(1, std::memory_order_relaxed);
+        if (previous & kFresh) {
+            m_superseded.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 取出最新一帧（消费者），没有新帧时立即返回 false
+     */
+    bool take(T &frame) {
+        if (!(m_middle.load(std::memory_order_acquire) & kFresh)) {
+            return false;
+        }
+        const uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_readIndex), std::memory_order_acq_rel);
+        m_readIndex = previous & kIndexMask;
+        frame = std::move(m_slots[m_readIndex]);
+        m_taken.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    uint64_t publishedCount() const { return m_published.load(std::memory_order_relaxed); }
+
+    uint64_t takenCount() const { return m_taken.load(std::memory_order_relaxed); }
+
+    // 还没显示就被新帧覆盖的帧数
+    uint64_t supersededCount() const { return m_superseded.load(std::memory_order_relaxed); }
+
+    QJsonObject telemetrySnapshot() const {
+        QJsonObject obj;
+        obj["published"] = static_cast<qint64>(publishedCount());
+        obj["presented"] = static_cast<qint64>(takenCount());
+        obj["superseded"] = static_cast<qint64>(supersededCount());
+        return obj;
+    }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x03;
+    static constexpr uint8_t kFresh = 0x04; // 中间槽位里是消费者还没取过的新帧
+
+    T m_slots[3];
+    int m_writeIndex = 0;                 // 仅生产者访问
+    int m_readIndex = 1;                  // 仅消费者访问
+    std::atomic<uint8_t> m_middle{2};     // 交换槽位的下标 | kFresh
+
+    std::atomic<uint64_t> m_published{0};
+    std::atomic<uint64_t> m_taken{0};
+    std::atomic<uint64_t> m_superseded{0};
+    QString m_telemetryName;
+};
+
+// 解码线程 -> 界面线程的显示帧；QImage 引用 ImageBufferPool 的缓冲区，在信箱里传递不拷贝像素
+using ImageMailbox = FrameMailbox<QImage>;
+
+#endif // FRAMEMAILBOX_H
@@ -0,0 +1,97 @@
+﻿/**
+ *madebyYahei
+ *RFC 6184 H.264 RTP 解包 + 访问单元（帧）组装
+ *支持 Single NAL、STAP-A/STAP-B、MTAP16/MTAP24、FU-A/FU-B；以 marker 位和时间戳变化切分帧，
+ *每帧输出一个 Annex-B AVPacket，含 IDR 时打 AV_PKT_FLAG_KEY，帧内有丢包时打 AV_PKT_FLAG_CORRUPT
+ *WebRTC 只协商 packetization-mode=1（非交织），因此 DON 字段只跳过不做重排
+ */
+#ifndef H264ACCESSUNITASSEMBLER_H
+#define H264ACCESSUNITASSEMBLER_H
+
+#include <cstdint>
+#include <vector>
+#include "rtp.h"
+#include "AVSmartPtrs.h"
+
+class H264AccessUnitAssembler {
+public:
+    struct Stats {
+        uint64_t accessUnits = 0;   // 输出的帧数
+        uint64_t keyframes = 0;     // 其中含 IDR 的帧数
+        uint64_t corruptUnits = 0;  // 帧内发生过丢包的帧数
+        uint64_t droppedNals = 0;   // 分片不完整而整体丢弃的 NAL 数
+        uint64_t sequenceGaps = 0;  // 检测到的 RTP 序号不连续次数
+        uint64_t badPackets = 0;    // 头部或聚合包格式错误
+    };
+
+    H264AccessUnitAssembler() = default;
+
+    ~H264AccessUnitAssembler();
+
+    H264AccessUnitAssembler(const H264AccessUnitAssembler &) = delete;
+
+    H264AccessUnitAssembler &operator=(const H264AccessUnitAssembler &) = delete;
+
+    /**
+     * @brief 输入一个按序号排好的完整 RTP 包
+     * @param out 凑齐的帧追加到这里（一次调用最多两帧：上一帧因时间戳变化结束 + 本包 marker 结束的帧）
+     */
+    void push(const rawrtp_ptr &packet, std::vector<AVPacketPtr> &out);
+
+    // jitter buffer 宣告丢包：丢弃正在拼接的分片 NAL，当前帧标记为损坏
+    void markLoss();
+
+    // 丢弃所有状态（重新协商或重连后调用）
+    void reset();
+
+    const Stats &stats() const { return m_stats; }
+
+private:
+    void handleSingleNal(const rawrtp_ptr &packet, uint8_t *nal, size_t size);
+
+    void handleAggregation(const uint8_t *payload, size_t size, uint8_t type);
+
+    void handleFragment(const uint8_t *payload, size_t size, uint8_t type);
+
+    bool appendNal(const uint8_t *nal, size_t size);
+
+    bool appendBytes(const uint8_t *data, size_t size);
+
+    void flushPending();
+
+    void dropFragment();
+
+    void noteNalType(uint8_t nalType);
+
+    void finishAccessUnit(std::vector<AVPacketPtr> &out);
+
+    void clearAccessUnit();
+
+    // 帧缓冲：多个 NAL 拼成一块引用计数缓冲区，结束时整体交给 AVPacket
+    AVBufferRef *m_auBuffer = nullptr;
+    size_t m_auSize = 0;
+    size_t m_auSizeHint = 64 * 1024;
+    int m_nalCount = 0;
+
+    // 只有一个 Single NAL 的帧不拷贝：先记住它，帧内出现第二个 NAL 时才拷进帧缓冲
+    rawrtp_ptr m_pendingPacket;
+    uint8_t *m_pendingNal = nullptr;
+    size_t m_pendingSize = 0;
+
+    // FU 分片状态，m_fragmentStart 用于丢包时回滚
+    bool m_inFragment = false;
+    size_t m_fragmentStart = 0;
+    uint8_t m_fragmentType = 0;
+
+    bool m_hasTimestamp = false;
+    uint32_t m_timestamp = 0;
+    bool m_isKeyframe = false;
+    bool m_isCorrupt = false;
+
+    bool m_hasSequence = false;
+    uint16_t m_lastSequence = 0;
+
+    Stats m_stats;
+};
+
+#endif // H264ACCESSUNITASSEMBLER_H
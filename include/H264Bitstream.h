@@ -0,0 +1,43 @@
+﻿/**
+ *madebyYahei
+ *H.264 Annex-B 码流工具函数（与网络、Qt 无关，基准程序可以直接链接）
+ *起始码扫描按 AVX2 / SSE2 / memchr 运行时选择，一帧只扫一遍，得到的 NAL 索引直接交给打包器，不再逐字节重建缓冲区
+ */
+#ifndef H264BITSTREAM_H
+#define H264BITSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct H264NalUnit {
+    int offset = 0;            // NAL 头在缓冲区中的偏移（起始码之后）
+    int size = 0;              // NAL 长度，不含起始码，已去掉 trailing_zero_8bits
+    uint8_t startCodeSize = 0; // 3 或 4
+    uint8_t type = 0;          // nal_unit_type
+};
+
+/**
+ * @brief 从 from 开始找下一个 00 00 01
+ * @return 00 00 01 中第一个 00 的位置，找不到返回 -1
+ */
+int findH264StartCode(const uint8_t *data, int size, int from);
+
+/**
+ * @brief 扫描 Annex-B 访问单元，建立 NAL 索引（nals 先清空，复用其容量）
+ * 第一个起始码之前的字节忽略；00 00 00 01 记为 4 字节起始码，更多的前导 0 归上一个 NAL 的尾随填充
+ * @return NAL 个数
+ */
+int indexH264Nals(const uint8_t *data, int size, std::vector<H264NalUnit> &nals);
+
+/**
+ * @brief 原地把 4 字节起始码改写成 4 字节大端长度（AVCC），只写起始码所在的 4 个字节，不移动数据
+ * 要求缓冲区以起始码开头、每个 NAL 都是 4 字节起始码且首尾相接（单 slice 的 x264 annexb=1 输出即如此）；
+ * 不满足时返回 false，缓冲区保持原样，由调用方改用 appendH264LengthPrefixed
+ */
+bool rewriteH264StartCodesAsLengths(uint8_t *data, int size, const std::vector<H264NalUnit> &nals);
+
+// 通用路径：按索引拼出长度前缀格式追加到 out，每个 NAL 一次 memcpy
+void appendH264LengthPrefixed(const uint8_t *data, const std::vector<H264NalUnit> &nals, std::vector<std::byte> &out);
+
+#endif // H264BITSTREAM_H
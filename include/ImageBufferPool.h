@@ -0,0 +1,61 @@
+﻿/**
+ *madebyYahei
+ *显示帧缓冲池：sws_scale 直接写入池中的引用计数缓冲区（AVBufferPool），
+ *再把同一块内存包成 QImage（不拷贝），QImage 的隐式共享就是这块缓冲区的引用计数，
+ *最后一个 QImage 副本析构时缓冲区自动回到池中，解码 -> 信箱 -> 绘制全程零拷贝
+ *get 只在解码线程调用；QImage 可以在任意线程释放
+ */
+#ifndef IMAGEBUFFERPOOL_H
+#define IMAGEBUFFERPOOL_H
+
+#include <QImage>
+#include <atomic>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/buffer.h>
+}
+
+class ImageBufferPool {
+public:
+    // 行对齐，满足 sws_scale 的 SIMD 写入要求
+    static constexpr int kStrideAlign = 64;
+
+    ImageBufferPool() = default;
+
+    ~ImageBufferPool();
+
+    ImageBufferPool(const ImageBufferPool &) = delete;
+
+    ImageBufferPool &operator=(const ImageBufferPool &) = delete;
+
+    /**
+     * @brief 取一块能放下 width x height、每像素 bytesPerPixel 字节的缓冲区
+     * 尺寸变化时重建池，旧池里还被 QImage 引用的缓冲区在释放时才真正销毁
+     * @param stride 输出行字节数
+     * @return 调用方持有返回的引用，交给 wrap 或自行 av_buffer_unref；失败返回 nullptr
+     */
+    AVBufferRef *get(int width, int height, int bytesPerPixel, int &stride);
+
+    /**
+     * @brief 把缓冲区包成 QImage，接管 buffer 的引用，不拷贝像素
+     */
+    static QImage wrap(AVBufferRef *buffer, int width, int height, int stride, QImage::Format format);
+
+    // 池实际分配过的缓冲区个数，稳定后不再增长
+    uint64_t allocatedCount() const { return m_allocated.load(std::memory_order_relaxed); }
+
+private:
+    static AVBufferRef *allocBuffer(void *opaque, size_t size);
+
+    static void releaseImage(void *info);
+
+    AVBufferPool *m_pool = nullptr;
+    int m_width = 0;
+    int m_height = 0;
+    int m_bytesPerPixel = 0;
+    int m_stride = 0;
+    std::atomic<uint64_t> m_allocated{0};
+};
+
+#endif // IMAGEBUFFERPOOL_H
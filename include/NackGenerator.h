@@ -0,0 +1,103 @@
+﻿/**
+ *madebyYahei
+ *接收端丢包跟踪 + RTCP Generic NACK（RFC 4585 6.2.1，PT=205 FMT=1）
+ *按扩展序号记录缺口，包到达时立即请求重传，之后按 RTT 间隔重试；
+ *用"NACK 发出 → RTX 到达"的往返时间估计 RTT（只取第一次请求的样本，避免重试造成的歧义），
+ *抖动缓冲据此把缺口多留约 1.25 个 RTT 再宣告丢包
+ *onPacket 在网络线程上调用；process 在网络线程（收包时）和播放调度线程（断流期间按 nextProcessUs 定时重试）上都会调用，
+ *内部一把锁串行化；统计量可在任意线程读取
+ */
+#ifndef NACKGENERATOR_H
+#define NACKGENERATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+class NackGenerator {
+public:
+    using SendRtcp = std::function<void(const uint8_t *data, size_t len)>;
+
+    static constexpr int kDefaultRttMs = 100;
+    static constexpr int kMaxRetries = 10;
+    static constexpr int kMaxAgeMs = 1000;      // 超过这个时间还没补上的包不再请求
+    static constexpr int kMaxGap = 1000;        // 单次缺口过大视为断流，交给关键帧恢复
+    static constexpr int kMaxListSize = 500;
+
+    /**
+     * @param localSsrc RTCP 发送方 SSRC（本端在 SDP 里声明的 SSRC）
+     * @param send 发送一个完整 RTCP 包，通常是 rtc::Track::send
+     */
+    NackGenerator(uint32_t localSsrc, SendRtcp send);
+
+    NackGenerator(const NackGenerator &) = delete;
+
+    NackGenerator &operator=(const NackGenerator &) = delete;
+
+    /**
+     * @brief 每收到一个媒体包（含 RTX 解出的重传包）调用一次
+     * @param extSeq jitter buffer 给出的扩展序号
+     */
+    void onPacket(int64_t extSeq, uint32_t mediaSsrc, bool retransmitted, int64_t nowUs);
+
+    /**
+     * @brief 发送到期的 NACK
+     * @param readSeq jitter buffer 的读位置，之前的缺口已经放弃，不再请求
+     */
+    void process(int64_t readSeq, int64_t nowUs);
+
+    // 下一次有缺口需要（重新）请求的时刻（与 nowUs 同一时钟），没有待请求的缺口时返回 INT64_MAX
+    int64_t nextProcessUs() const;
+
+    // 丢弃所有缺口（重新协商或重连后调用）
+    void reset();
+
+    int rttMs() const { return m_rttMs.load(std::memory_order_relaxed); }
+
+    uint64_t nacksSent() const { return m_nacksSent.load(std::memory_order_relaxed); }
+
+    uint64_t sequencesRequested() const { return m_requested.load(std::memory_order_relaxed); }
+
+    uint64_t recovered() const { return m_recovered.load(std::memory_order_relaxed); }
+
+    uint64_t givenUp() const { return m_givenUp.load(std::memory_order_relaxed); }
+
+    int pending() const { return m_pending.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        int64_t firstSeenUs = 0;
+        int64_t lastSentUs = 0;
+        int retries = 0;
+    };
+
+    void buildAndSend(const std::vector<uint16_t> &seqs);
+
+    void updateRtt(int64_t sampleUs);
+
+    // 重试间隔跟随 RTT：请求发出后一个 RTT 内重传本来就回不来
+    int64_t retryIntervalUs() const;
+
+    mutable std::mutex m_mutex;         // 保护以下到 m_packet 为止的成员
+    uint32_t m_localSsrc;
+    uint32_t m_mediaSsrc = 0;
+    SendRtcp m_send;
+
+    std::map<int64_t, Entry> m_missing; // 扩展序号 -> 请求状态
+    int64_t m_highest = -1;
+    std::vector<uint16_t> m_batch;      // 复用
+    std::vector<uint8_t> m_packet;      // 复用
+
+    std::atomic<int> m_rttMs{kDefaultRttMs};
+    std::atomic<uint64_t> m_nacksSent{0};
+    std::atomic<uint64_t> m_requested{0};
+    std::atomic<uint64_t> m_recovered{0};
+    std::atomic<uint64_t> m_givenUp{0};
+    std::atomic<int> m_pending{0};
+};
+
+#endif // NACKGENERATOR_H
@@ -0,0 +1,131 @@
+﻿/**
+ *madebyYahei
+ *流水线阶段的工作线程：独占一个线程紧凑地循环执行阶段的处理函数，
+ *取代"每处理一项就向自己投递一次 QueuedConnection 调用"的写法（每项一次按名字查元方法、分配事件、走一趟事件循环）
+ *阶段对象本身仍留在自己的 QThread 上接收 init/start/stop 等控制调用，处理循环跑在这里的线程上；
+ *stop() 置停止标志、打断阻塞中的出队等待后 join，返回时处理函数一定已经退出，可以放心释放编解码器
+ */
+#ifndef PIPELINEWORKER_H
+#define PIPELINEWORKER_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadSafeQueue.h"
+
+class PipelineWorker {
+public:
+    enum class StopMode {
+        Cancel, // 当前这一项处理完就退出，队列里剩下的不再处理
+        Drain   // 先把停止时队列里已有的处理完、调用收尾函数（如冲洗编码器）再退出
+    };
+
+    // 一次迭代；返回 false 表示阶段自行结束（读到 EOF、设备出错），线程随即退出
+    using Step = std::function<bool()>;
+    using Hook = std::function<void()>;
+
+    // 批量出队的默认上限：积压时一次加锁取走多项，空闲时与逐项出队没有区别
+    static constexpr int kDefaultBatch = 8;
+
+    // name 只用于日志
+    explicit PipelineWorker(const char *name);
+
+    ~PipelineWorker();
+
+    PipelineWorker(const PipelineWorker &) = delete;
+
+    PipelineWorker &operator=(const PipelineWorker &) = delete;
+
+    /**
+     * @brief 启动线程，循环调用 step 直到 stop() 或 step 返回 false
+     * @param interrupt stop() 时在调用方线程上执行，用来打断 step 里的阻塞等待
+     * @param drain 以 StopMode::Drain 停止时在工作线程上执行一次
+     * @return 已经在运行时返回 false
+     */
+    bool start(Step step, Hook interrupt = nullptr, Hook drain = nullptr);
+
+    /**
+     * @brief 以 queue 的消费者身份启动：阻塞出队，每次最多取 maxBatch 项逐项交给 process
+     * Cancel 时在两项之间检查停止标志，批里剩下的直接释放；
+     * Drain 时只处理停止那一刻已在队列里的项（生产者还在写也不会无限拖延），之后调用 finish
+     */
+    template<typename T>
+    bool startConsumer(QUEUE_DATA<T> *queue, int maxBatch, std::function<void(T &)> process, Hook finish = nullptr) {
+        if (!queue || !process) {
+            return false;
+        }
+        maxBatch = std::max(1, maxBatch);
+        // 工作线程独占，复用容量避免每批分配
+        auto batch = std::make_shared<std::vector<T> >();
+        batch->reserve(maxBatch);
+        Step step = [this, queue, maxBatch, process, batch]() {
+            // 先取打断代数再查停止标志：run() 查过标志之后 stop() 才置标志并打断时，出队也能看到这次打断
+            const uint64_t interruptGen = queue->interruptGeneration();
+            if (stopRequested()) {
+                return true;
+            }
+            queue->dequeue_batch_since(interruptGen, *batch, maxBatch);
+            for (T &item: *batch) {
+                if (cancelRequested()) {
+                    break;
+                }
+                process(item);
+            }
+            batch->clear();
+            return true;
+        };
+        Hook drain = [queue, maxBatch, process, finish, batch]() {
+            int remaining = queue->size();
+            while (remaining > 0) {
+                const int count = queue->dequeue_batch(*batch, std::min(maxBatch, remaining), 0);
+                if (count <= 0) {
+                    break;
+                }
+                for (T &item: *batch) {
+                    process(item);
+                }
+                batch->clear();
+                remaining -= count;
+            }
+            if (finish) {
+                finish();
+            }
+        };
+        return start(std::move(step), [queue]() { queue->interruptWait(); }, std::move(drain));
+    }
+
+    /**
+     * @brief 停止并 join；没有在运行时直接返回
+     * 在工作线程自己的调用栈里（如 step 内直连的槽）调用时只置标志，join 留到下一次 start/stop
+     */
+    void stop(StopMode mode = StopMode::Cancel);
+
+    bool isRunning() const { return m_running.load(std::memory_order_acquire); }
+
+    // 已要求停止（任一模式）；step 内做长时间处理时可以据此提前返回
+    bool stopRequested() const { return m_stopRequested.load(std::memory_order_acquire); }
+
+    // 已要求以 Cancel 模式停止，未处理的数据应当丢弃
+    bool cancelRequested() const { return stopRequested() && !m_drainOnStop.load(std::memory_order_acquire); }
+
+private:
+    void run();
+
+    const char *m_name;
+    std::mutex m_controlMutex; // 串行化 start/stop
+    std::thread m_thread;
+    // 工作线程运行 run 期间的线程 id；stop 不持锁读取它来判断是否在工作线程里被调用
+    std::atomic<std::thread::id> m_workerId{};
+    Step m_step;
+    Hook m_interrupt;
+    Hook m_drain;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_stopRequested{false};
+    std::atomic<bool> m_drainOnStop{false};
+};
+
+#endif // PIPELINEWORKER_H
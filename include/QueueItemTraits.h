@@ -0,0 +1,26 @@
+﻿/**
+ *madebyYahei
+ *队列元素特征：QUEUE_DATA 按字节/时长计容量、按关键帧丢包时通过它读取元素属性
+ *默认实现只认识“个数”，音视频类型的特化见 AVSmartPtrs.h
+ */
+#ifndef QUEUEITEMTRAITS_H
+#define QUEUEITEMTRAITS_H
+
+#include <cstdint>
+
+template<typename T>
+struct QueueItemTraits {
+    // 元素占用的字节数，未知时返回 0
+    static int64_t bytes(const T &) { return 0; }
+
+    // 元素覆盖的媒体时长（微秒），未知时返回 0
+    static int64_t durationUs(const T &) { return 0; }
+
+    // DropUntilKeyframe 策略用：非媒体元素一律视为可独立解码
+    static bool isKeyframe(const T &) { return true; }
+
+    // DropUntilKeyframe 策略用：元素是否依赖前面的帧（只有这样的流在丢弃后要等关键帧）
+    static bool needsKeyframe(const T &) { return false; }
+};
+
+#endif // QUEUEITEMTRAITS_H
@@ -0,0 +1,174 @@
+﻿/**
+ *madebyYahei
+ *队列/链路遥测：HDR 风格的延迟直方图、每个 QUEUE_DATA 的统计量，以及按名字注册的遥测源
+ *注册表与具体类型无关，任何模块都可以挂一个返回 QJsonObject 的回调，定时整体输出到日志或 JSON 文件
+ */
+#ifndef QUEUETELEMETRY_H
+#define QUEUETELEMETRY_H
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+
+/**
+ * 对数-线性分桶的直方图（HDR Histogram 的简化版），单位由调用方决定（这里统一用微秒）
+ * 0~31 每个值一个桶，之后每个 2 的幂区间再均分 16 个子桶，相对误差不超过 1/16
+ * 所有计数都是原子量，任意线程可并发 record，读取结果是近似快照
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t value);
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    int64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    double mean() const;
+
+    // p 取值 0~100，返回所在桶的中点
+    int64_t percentile(double p) const;
+
+    // {count, mean, p50, p90, p99, p999, max}
+    QJsonObject toJson() const;
+
+    void reset();
+
+private:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kLinearBuckets = 2 * kSubBuckets;
+    static constexpr int kBucketCount = kLinearBuckets + (63 - (kSubBucketBits + 1)) * kSubBuckets;
+
+    static int bucketIndex(int64_t value);
+
+    static int64_t bucketMidpoint(int index);
+
+    std::array<std::atomic<uint64_t>, kBucketCount> m_buckets;
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<int64_t> m_sum{0};
+    std::atomic<int64_t> m_max{0};
+};
+
+/**
+ * 单个队列的运行统计，由 QUEUE_DATA 在入队/出队路径上更新
+ * 速率按两次 snapshot() 之间的增量计算，snapshot() 只由注册表线程调用
+ */
+class QueueStats {
+public:
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void onEnqueue(int64_t depthAfter) {
+        m_enqueued.fetch_add(1, std::memory_order_relaxed);
+        int64_t high = m_highWater.load(std::memory_order_relaxed);
+        while (depthAfter > high && !m_highWater.compare_exchange_weak(high, depthAfter, std::memory_order_relaxed)) {
+        }
+    }
+
+    void onDequeue(int64_t enqueuedNs, int64_t dequeuedNs) {
+        m_dequeued.fetch_add(1, std::memory_order_relaxed);
+        m_residenceUs.record((dequeuedNs - enqueuedNs) / 1000);
+    }
+
+    void addProducerBlocked(int64_t ns) { m_producerBlockedNs.fetch_add(ns, std::memory_order_relaxed); }
+
+    void addConsumerStarved(int64_t ns) { m_consumerStarvedNs.fetch_add(ns, std::memory_order_relaxed); }
+
+    QJsonObject snapshot();
+
+private:
+    std::atomic<uint64_t> m_enqueued{0};
+    std::atomic<uint64_t> m_dequeued{0};
+    std::atomic<int64_t> m_highWater{0};
+    std::atomic<int64_t> m_producerBlockedNs{0};
+    std::atomic<int64_t> m_consumerStarvedNs{0};
+    LatencyHistogram m_residenceUs;
+
+    // 上一次快照，用于计算速率
+    uint64_t m_lastEnqueued = 0;
+    uint64_t m_lastDequeued = 0;
+    int64_t m_lastSnapshotNs = 0;
+};
+
+/**
+ * 流水线单个处理阶段（解码、编码、封装……）的统计：每个元素的处理耗时直方图、累计忙碌时间，
+ * 以及阶段所在线程的累计 CPU 时间（每处理完一个元素在工作线程上采样一次）
+ * 与队列的驻留时间合起来就是这一级的端到端时延；setName 之后才注册到遥测表
+ */
+class StageStats {
+public:
+    StageStats() = default;
+
+    ~StageStats();
+
+    StageStats(const StageStats &) = delete;
+
+    StageStats &operator=(const StageStats &) = delete;
+
+    void setName(const QString &name);
+
+    // 在工作线程上成对调用：begin 返回起始时刻，处理完 items 个元素后 end
+    int64_t begin() const { return QueueStats::nowNs(); }
+
+    void end(int64_t beginNs, int items = 1);
+
+    // 调用线程到目前为止的 CPU 时间（用户态 + 内核态），纳秒
+    static int64_t currentThreadCpuNs();
+
+    QJsonObject snapshot() const;
+
+private:
+    std::atomic<uint64_t> m_items{0};
+    std::atomic<int64_t> m_busyNs{0};
+    std::atomic<int64_t> m_threadCpuNs{0};
+    LatencyHistogram m_processUs;
+    QString m_telemetryName;
+};
+
+/**
+ * 遥测源注册表（单例）
+ * 名字重复时自动追加 #2、#3...，registerSource 返回实际使用的名字，注销时用它
+ * 回调在注册表锁内执行，注销会等待正在进行的快照结束，因此对象析构前注销即可安全释放
+ */
+class TelemetryRegistry {
+public:
+    using Source = std::function<QJsonObject()>;
+
+    static TelemetryRegistry &instance();
+
+    TelemetryRegistry(const TelemetryRegistry &) = delete;
+
+    TelemetryRegistry &operator=(const TelemetryRegistry &) = delete;
+
+    QString registerSource(const QString &name, Source source);
+
+    void unregisterSource(const QString &name);
+
+    // {"timestamp": ..., "sources": {name: {...}}}
+    QJsonObject snapshot();
+
+    /**
+     * @brief 取一次快照并输出
+     * @param toLog 每个源一行写入日志
+     * @param jsonPath 非空时把完整快照覆盖写入该文件
+     */
+    void dump(bool toLog, const QString &jsonPath = QString());
+
+private:
+    TelemetryRegistry() = default;
+
+    QMutex m_mutex;
+    std::map<QString, Source> m_sources;
+};
+
+#endif // QUEUETELEMETRY_H
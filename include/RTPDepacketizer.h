@@ -4,9 +4,16 @@
 
 #include "rtp_jitter.h" // 引入库头文件
 #include <QObject>
-#include <QTimer>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "ThreadSafeQueue.h"
+#include "QueueTelemetry.h"
 #include "AVSmartPtrs.h"
+#include "RtpPacketPool.h"
+#include "H264AccessUnitAssembler.h"
+#include "NackGenerator.h"
 
 extern "C" {
 #include <libavutil/avutil.h>
@@ -25,23 +32,70 @@ public:
     // 【生产者】网络线程调用：推入数据
     void pushPacket(const uint8_t* data, size_t len);
 
-public slots:
-    // 【消费者】定时器调用：取出数据并组帧
-    void processPop();
+    // 开启丢包重传：缺口发 RTCP NACK，RTX 包（rtxPayloadType）还原后按原序号入队
+    // 须在收包开始前调用；send 在网络线程或播放调度线程上被调用
+    void enableRetransmission(uint32_t localSsrc, int rtxPayloadType, NackGenerator::SendRtcp send);
+
+    // 【渲染端】取出抖动缓冲目标深度变化留下的变速量（微秒，正=放慢，负=加快），每次最多 maxUs
+    int takeTimeStretchUs(int maxUs);
+    // 以 name 注册出队组帧耗时（按出队的 RTP 包计数）和调度线程 CPU 时间
+    void setStageName(const QString& name) { m_stageStats.setName(name); }
 
 private:
+    // 【消费者】播放调度线程调用：取出所有到期的包并组帧
+    void processPop();
+
+    // 播放调度线程：睡到队首包的到期时间（RTP 时间戳 + 基准传输时延 + 目标缓冲深度）与下一次 NACK 重试中较早的一个，
+    // 或被 push 提前唤醒（新包落在队首 / 补上了缺口）
+    void playoutLoop();
+
+    // push 之后判断是否需要提前唤醒调度线程
+    void wakePlayoutIfEarlier(const rawrtp_ptr& packet);
+
+    QJsonObject playoutStats();
+
     bool m_isH264;
     RTPJitter* m_jitterBuffer;
-    QTimer* m_consumerTimer;
     QUEUE_DATA<AVPacketPtr>* m_outputQueue;
+    RtpPacketPool m_packetPool; // 接收缓冲池，网络数据只在这里拷贝一次
+
+    // H.264 组帧：按帧输出 AVPacket
+    H264AccessUnitAssembler m_h264Assembler;
+    std::vector<AVPacketPtr> m_assembled; // 复用，避免每包分配
+
+    // 丢包重传
+    static constexpr int kMaxLossWaitMs = 300; // 缺口最多多等这么久，限制重传对时延的影响
+    std::atomic<NackGenerator*> m_nack{nullptr};
+    int m_rtxPayloadType = -1;
+    int m_mediaPayloadType = 0;
+    uint32_t m_mediaSsrc = 0;
+    int m_lossWaitMs = 0;
+    std::vector<uint8_t> m_rtxScratch;
+    AVBufferRef* unwrapRtx(const uint8_t* data, size_t len, size_t& outLen);
 
-    // H.264 组帧状态
-    std::vector<uint8_t> m_fuBuffer;
-    bool m_isReassembling = false;
+    // 不拷贝：AVPacket 引用 RTP 包所在的池化缓冲区
+    AVPacketPtr wrapPayload(const rawrtp_ptr& packet, const uint8_t* data, size_t size);
 
-    void resetH264Assembler();
+    // 播放调度
+    std::thread m_playoutThread;
+    std::mutex m_playoutMutex;
+    std::condition_variable m_playoutCond;
+    bool m_playoutRunning = false;
+    bool m_playoutKick = false;
+    // 调度线程当前计划醒来的时间（steady_clock 纳秒），运行中为 INT64_MAX，使期间所有 push 都会踢醒它
+    std::atomic<int64_t> m_scheduledWakeNs{INT64_MAX};
 
-    void reassembleH264(const std::vector<uint8_t>& payload, uint32_t timestamp);
+    // 调度统计：实际出队时间相对到期时间的滞后（微秒）、唤醒次数、到达时已过期的包
+    LatencyHistogram m_playoutLateness;
+    std::atomic<uint64_t> m_playoutWakeups{0};
+    std::atomic<uint64_t> m_lateArrivals{0};
+    // 接收统计（网络线程）：收到的 RTP 包、长度非法的包、jitter buffer 拒收的包（重复/过期）、缓冲池耗尽
+    std::atomic<uint64_t> m_receivedPackets{0};
+    std::atomic<uint64_t> m_invalidPackets{0};
+    std::atomic<uint64_t> m_rejectedPackets{0};
+    std::atomic<uint64_t> m_poolExhausted{0};
+    StageStats m_stageStats;
+    QString m_telemetryName;
 
     // 新增：用于根据 RTP timestamp 计算 payload_ms
     uint32_t m_payloadSampleRate = 0;   // 构造时传入（90000 或 48000）
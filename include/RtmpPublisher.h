@@ -28,6 +28,9 @@ public:
 
     void clear();
 
+    // 以 name 注册每包封装写出耗时和线程 CPU 时间
+    void setStageName(const QString &name) { m_stageStats.setName(name); }
+
 private:
     QUEUE_DATA<AVPacketPtr> *m_encodedPacketQueue; // 编码后数据包的输入队列
 
@@ -39,6 +42,7 @@ private:
     // 保存编码器的时间基，用于正确的PTS/DTS转换
     AVRational m_videoEncoderTimeBase;
     AVRational m_audioEncoderTimeBase;
+    StageStats m_stageStats;
     // 线程同步
     QMutex m_workMutex;
     QWaitCondition m_workCond;
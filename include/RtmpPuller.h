@@ -21,7 +21,7 @@ class RtmpPuller : public QObject {
     Q_OBJECT
 
 public:
-    explicit RtmpPuller(QUEUE_DATA<std::unique_ptr<QImage> >* MainQimageQueue, QObject* parent = nullptr);
+    explicit RtmpPuller(ImageMailbox* imageMailbox, QObject* parent = nullptr);
 
     ~RtmpPuller();
 
@@ -36,7 +36,7 @@ private:
     AVRational m_vTimeBase = { 0, 1 };
     AVRational m_aTimeBase = { 0, 1 };
 
-    QUEUE_DATA<std::unique_ptr<QImage> >* m_MainQimageQueue;
+    ImageMailbox* m_imageMailbox;
     QUEUE_DATA<AVPacketPtr>* m_videoPacketQueue;
 	QUEUE_DATA<AVPacketPtr>* m_audioPacketQueue;
 	QUEUE_DATA<AVFramePtr>* m_dummyVideoFrameQueue;
@@ -74,6 +74,9 @@ public slots:
 
 	void ChangePullingState(bool isDecoding);
 
+    // 显示控件物理尺寸变化，转给视频解码器调整输出尺寸
+    void setDisplaySize(const QSize& size);
+
     void onStreamOpened_initVideo(AVCodecParameters* vParams, AVRational vTimeBase);
 
     void onStreamOpened_initAudio(AVCodecParameters* aParams, AVRational aTimeBase);
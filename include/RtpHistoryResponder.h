@@ -0,0 +1,101 @@
+﻿/**
+ *madebyYahei
+ *发送端 RTP 历史缓存 + NACK 应答（RFC 4585 Generic NACK）
+ *接在 H264RtpPacketizer 之后：outgoing 方向按序号保存已发送 RTP 包的副本（时间窗口 + 字节上限），
+ *incoming 方向解析对端的 RTCP NACK，从缓存中补发；可选 RTX（RFC 4588）封装，
+ *补发走令牌桶限速，避免在已经拥塞的上行链路上再放大突发
+ *outgoing 在发送线程、incoming 在 libdatachannel 网络线程，两侧共用一把锁；统计量可在任意线程读取
+ */
+#ifndef RTPHISTORYRESPONDER_H
+#define RTPHISTORYRESPONDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <QJsonObject>
+
+#include <rtc/mediahandler.hpp>
+
+class RtpHistoryResponder : public rtc::MediaHandler {
+public:
+    static constexpr int kDefaultWindowMs = 1000;             // 超过这个时间的包不再补发，接收端早已放弃
+    static constexpr size_t kDefaultMaxBytes = 2 * 1024 * 1024;
+    static constexpr int kDefaultMaxKbps = 2000;               // 补发码率上限
+    static constexpr int kBurstMs = 300;                       // 令牌桶容量，足够一次补完一个关键帧的若干分片
+    static constexpr int kMinResendIntervalMs = 20;            // 同一个包两次补发的最小间隔（对端重复 NACK）
+
+    /**
+     * @param ssrc 媒体流 SSRC，只应答针对它的 NACK
+     */
+    explicit RtpHistoryResponder(uint32_t ssrc,
+                                 int windowMs = kDefaultWindowMs,
+                                 size_t maxBytes = kDefaultMaxBytes,
+                                 int maxKbps = kDefaultMaxKbps);
+
+    /**
+     * @brief 改用 RTX 补发（独立 SSRC + 载荷前加原序号）；rtxSsrc 为 0 时恢复为原样重发
+     * 对端在 answer 里接受了 RTX 编码后再打开
+     */
+    void setRtx(uint32_t rtxSsrc, int rtxPayloadType);
+
+    void incoming(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+    void outgoing(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+    QJsonObject stats() const;
+
+private:
+    struct Entry {
+        uint16_t seq = 0;
+        int64_t sentUs = 0;
+        int64_t lastResentUs = 0;
+        std::vector<std::byte> data;
+    };
+
+    void store(const rtc::message_ptr &message, int64_t nowUs);
+
+    void evict(int64_t nowUs);
+
+    Entry *find(uint16_t seq);
+
+    // 解析一个复合 RTCP 包，收集其中针对本流的 NACK 序号
+    void collectNacks(const std::byte *data, size_t len, std::vector<uint16_t> &seqs);
+
+    void resend(Entry &entry, int64_t nowUs, const rtc::message_callback &send);
+
+    bool takeTokens(size_t bytes, int64_t nowUs);
+
+    const uint32_t m_ssrc;
+    const int64_t m_windowUs;
+    const size_t m_maxBytes;
+    const double m_bytesPerUs;
+    const double m_bucketCapacity;
+
+    std::mutex m_mutex;
+    std::deque<Entry> m_history;               // 按发送顺序，序号连续
+    std::vector<std::vector<std::byte>> m_spare; // 淘汰下来的缓冲区，复用避免每包分配
+    size_t m_bytes = 0;
+    double m_tokens = 0;
+    int64_t m_lastRefillUs = 0;
+    std::vector<uint16_t> m_nackSeqs;          // 复用
+
+    uint32_t m_rtxSsrc = 0;
+    uint8_t m_rtxPayloadType = 0;
+    uint16_t m_rtxSeq = 0;
+
+    std::atomic<uint64_t> m_nacksReceived{0};
+    std::atomic<uint64_t> m_requested{0};
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_rateLimited{0};
+    std::atomic<uint64_t> m_suppressed{0};
+    std::atomic<uint64_t> m_resentBytes{0};
+    std::atomic<uint64_t> m_historyPackets{0};
+    std::atomic<uint64_t> m_historyBytes{0};
+};
+
+#endif // RTPHISTORYRESPONDER_H
@@ -0,0 +1,119 @@
+﻿/**
+ *madebyYahei
+ *发送端 RTP 平滑器（漏桶）：视频 RTP 包不再随 track->send 一次性全部交给传输层，
+ *而是排进平滑队列，由独立线程按"目标码率 × 平滑系数"放出，关键帧的几十个 MTU 包被摊开到几十毫秒里；
+ *音频包不排队、直接发送，只从桶里扣掉自己的字节，因此总是插到视频前面，音频时延不受关键帧影响
+ *用法：createHandler 得到的处理器挂在各自轨道处理链的最后（打包器、NACK 历史缓存之后）
+ *队列里积压超过 kMaxQueueMs 时临时提速，保证排队时延有上界；setTargetBitrate 可在任意线程调用
+ */
+#ifndef RTPPACER_H
+#define RTPPACER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <QJsonObject>
+
+#include <rtc/mediahandler.hpp>
+
+#include "PipelineWorker.h"
+#include "QueueTelemetry.h"
+
+class RtpPacer {
+public:
+    enum class Lane {
+        Audio, // 直通，只计入桶
+        Video  // 排队平滑
+    };
+
+    // 视频包真正交给传输层之后在平滑线程上调用（带宽估计需要真实发送时间）
+    using SentObserver = std::function<void(const rtc::message_ptr &message, int64_t sentUs)>;
+
+    static constexpr int kDefaultBitrateBps = 2000000;   // 与 ffmpegEncoder 的 bit_rate 一致
+    static constexpr double kDefaultPacingFactor = 2.5;  // 放出速率 = 目标码率的倍数，留出余量给码率波动
+    static constexpr int kBurstMs = 5;                   // 桶容量：空闲之后最多一次放出这么久的量
+    static constexpr int kMaxQueueMs = 2000;             // 排队时延上限，积压超过时按积压量提速
+
+    explicit RtpPacer(int targetBitrateBps = kDefaultBitrateBps, double pacingFactor = kDefaultPacingFactor);
+
+    ~RtpPacer();
+
+    RtpPacer(const RtpPacer &) = delete;
+
+    RtpPacer &operator=(const RtpPacer &) = delete;
+
+    /**
+     * @brief 创建挂到轨道处理链末尾的处理器
+     * 处理器只保存本对象的裸指针，本对象必须比轨道活得久（先 stop 再释放轨道）
+     */
+    std::shared_ptr<rtc::MediaHandler> createHandler(Lane lane);
+
+    bool start();
+
+    // 停止平滑线程，队列里还没放出的包直接丢弃
+    void stop();
+
+    void setTargetBitrate(int bitrateBps);
+
+    void setPacingFactor(double factor);
+
+    // 只能在 start 之前（或 stop 之后）设置
+    void setSentObserver(SentObserver observer) { m_sentObserver = std::move(observer); }
+
+    QJsonObject stats() const;
+
+private:
+    class Handler;
+
+    struct Pending {
+        rtc::message_ptr message;
+        std::shared_ptr<const rtc::message_callback> send; // 所属轨道的传输层发送函数
+        int64_t enqueuedUs = 0;
+    };
+
+    static int64_t nowUs();
+
+    void enqueue(rtc::message_vector &messages, const std::shared_ptr<const rtc::message_callback> &send);
+
+    void charge(size_t bytes);
+
+    // 平滑线程的一次迭代：等到队列非空且桶里有余量，放出一个包
+    bool releaseNext();
+
+    void interrupt();
+
+    // 以下在 m_mutex 内调用
+    void refillLocked(int64_t now);
+
+    double rateLocked() const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Pending> m_queue;
+    size_t m_queuedBytes = 0;
+    double m_budget = 0;           // 字节，可以为负（大包或音频透支）
+    int64_t m_lastRefillUs = 0;
+    int m_targetBitrateBps;
+    double m_pacingFactor;
+    bool m_interrupted = false;
+    uint64_t m_rateGen = 0;        // setTargetBitrate / setPacingFactor 每次加一，唤醒正在还债的平滑线程
+    SentObserver m_sentObserver;
+
+    PipelineWorker m_worker{"rtpPacer"};
+
+    LatencyHistogram m_pacingDelayUs; // 视频包在平滑队列里的停留时间
+    std::atomic<uint64_t> m_videoPackets{0};
+    std::atomic<uint64_t> m_videoBytes{0};
+    std::atomic<uint64_t> m_audioPackets{0};
+    std::atomic<uint64_t> m_audioBytes{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_boosted{0};   // 因积压超过 kMaxQueueMs 而提速放出的包数
+};
+
+#endif // RTPPACER_H
@@ -0,0 +1,54 @@
+﻿/**
+ *madebyYahei
+ *RTP 接收缓冲池：固定 MTU 大小的引用计数缓冲区（AVBufferPool），
+ *网络线程把 rtc::binary 拷入池中缓冲区是整条接收链路上唯一的一次拷贝，
+ *之后 RTPPacket、jitter buffer、解码器的 AVPacket 都只持有同一块缓冲区的引用，
+ *最后一个引用释放时缓冲区自动回到池中
+ */
+#ifndef RTPPACKETPOOL_H
+#define RTPPACKETPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/buffer.h>
+}
+
+class RtpPacketPool {
+public:
+    // 以太网 MTU，SRTP 解密后的 RTP 包不会超过它
+    static constexpr int kMaxPacketSize = 1500;
+
+    /**
+     * @param packetSize 单个缓冲区可容纳的 RTP 包长度（另外自动加 AV_INPUT_BUFFER_PADDING_SIZE）
+     * @param prealloc 预先分配并归还的缓冲区个数，避免开播初期在网络线程上 malloc
+     */
+    explicit RtpPacketPool(int packetSize = kMaxPacketSize, int prealloc = 256);
+
+    ~RtpPacketPool();
+
+    RtpPacketPool(const RtpPacketPool &) = delete;
+
+    RtpPacketPool &operator=(const RtpPacketPool &) = delete;
+
+    /**
+     * @brief 取一个缓冲区并拷入数据，len 之后的填充区已清零，可直接挂到 AVPacket 上
+     * 超过池缓冲区大小的包退化为单独分配
+     * @return 调用方持有返回的引用，失败返回 nullptr
+     */
+    AVBufferRef *acquire(const uint8_t *data, size_t len);
+
+    int packetSize() const { return m_packetSize; }
+
+    // 超长包单独分配的次数
+    uint64_t oversizeCount() const { return m_oversize.load(std::memory_order_relaxed); }
+
+private:
+    int m_packetSize;
+    AVBufferPool *m_pool = nullptr;
+    std::atomic<uint64_t> m_oversize{0};
+};
+
+#endif // RTPPACKETPOOL_H
@@ -0,0 +1,114 @@
+﻿/**
+ *madebyYahei
+ *单生产者/单消费者无锁环形缓冲区
+ *容量向上取整为2的幂，head/tail 分别独占缓存行，避免生产者与消费者互相踢缓存
+ *本类只负责无锁的 try 操作，阻塞等待由 QUEUE_DATA 在空/满时兜底
+ */
+#ifndef SPSCRINGBUFFER_H
+#define SPSCRINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t capacity)
+        : m_mask(roundUpPow2(capacity) - 1), m_slots(new T[m_mask + 1]) {
+    }
+
+    SpscRingBuffer(const SpscRingBuffer &) = delete;
+
+    SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+    /**
+     * @brief 生产者线程调用，成功时 item 被移动进缓冲区
+     * @return 缓冲区已满时返回 false，item 保持不变
+     */
+    bool tryPush(T &item) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead > m_mask) {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = std::move(item);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 消费者线程调用
+     * @return 缓冲区为空时返回 false
+     */
+    bool tryPop(T &result) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail) {
+                return false;
+            }
+        }
+        result = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 消费者线程调用，一次性取出最多 max 个元素，只发布一次 head
+     * @return 实际取出的个数
+     */
+    size_t tryPopBatch(std::vector<T> &out, size_t max) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        size_t available = m_cachedTail - head;
+        if (available < max) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            available = m_cachedTail - head;
+        }
+        const size_t count = available < max ? available : max;
+        for (size_t i = 0; i < count; ++i) {
+            out.push_back(std::move(m_slots[(head + i) & m_mask]));
+        }
+        if (count > 0) {
+            m_head.store(head + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // 任意线程可调用，结果只是近似值
+    size_t sizeApprox() const {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : 0;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    static size_t roundUpPow2(size_t n) {
+        size_t v = 2;
+        while (v < n) {
+            v <<= 1;
+        }
+        return v;
+    }
+
+    // 消费者独占：读指针 + 对写指针的缓存
+    alignas(kCacheLine) std::atomic<size_t> m_head{0};
+    size_t m_cachedTail = 0;
+
+    // 生产者独占：写指针 + 对读指针的缓存
+    alignas(kCacheLine) std::atomic<size_t> m_tail{0};
+    size_t m_cachedHead = 0;
+
+    alignas(kCacheLine) const size_t m_mask;
+    std::unique_ptr<T[]> m_slots;
+};
+
+#endif // SPSCRINGBUFFER_H
@@ -0,0 +1,85 @@
+﻿/**
+ *madebyYahei
+ *无设备的采集源，用于压测：挂在 Capture 后面，对外还是 videoDeviceOpenSuccessfully / audioDeviceOpenSuccessfully
+ *设备名写成下面两种形式时由它接管：
+ *  lavfi:<滤镜图>   例如 lavfi:testsrc2=size=1920x1080:rate=30，只写 lavfi:testsrc2 / lavfi:sine 时用默认参数
+ *  file:<路径>      媒体文件，读到结尾自动从头循环，时间戳接着上一轮往后排，下游看到的是一条连续的流
+ *RealTime 按时间戳对齐墙钟出包；MaxSpeed 不等待，能读多快就多快，用来测整条管线的吞吐上限
+ */
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+#include <QJsonObject>
+#include <QString>
+#include <atomic>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+class SyntheticSource {
+public:
+    enum class Pacing {
+        RealTime,
+        MaxSpeed
+    };
+
+    // 落后墙钟超过这么多、或者要等这么久时，认为时间戳跳变，重新对齐时钟而不是追赶/长睡
+    static constexpr int64_t kMaxDriftUs = 500000;
+
+    SyntheticSource() = default;
+
+    ~SyntheticSource();
+
+    SyntheticSource(const SyntheticSource &) = delete;
+
+    SyntheticSource &operator=(const SyntheticSource &) = delete;
+
+    static bool isSourceSpec(const QString &name);
+
+    /**
+     * @brief 打开源并选出 type 对应的流
+     * width/height/fps 只用于展开 lavfi:testsrc2 这种不带参数的简写，<= 0 时用 1280x720@25
+     */
+    bool open(const QString &spec, AVMediaType type, int width, int height, int fps, Pacing pacing, QString &error);
+
+    void close();
+
+    bool isOpen() const { return m_ctx != nullptr; }
+
+    /**
+     * @brief 取下一个包，RealTime 模式下会睡到包的时间点
+     * @return 0 成功；AVERROR_EOF 只会出现在 lavfi 源有限长时；其他负值为错误
+     */
+    int read(AVPacket *packet);
+
+    const AVCodecParameters *codecParameters() const;
+
+    AVRational timeBase() const;
+
+    QJsonObject telemetrySnapshot() const;
+
+private:
+    // 文件读完后回到开头，下一轮的时间戳从 m_loopEnd 接上
+    int rewind();
+
+    void pace(const AVPacket *packet);
+
+    AVFormatContext *m_ctx = nullptr;
+    int m_streamIndex = -1;
+    bool m_loop = false;
+    Pacing m_pacing = Pacing::RealTime;
+
+    int64_t m_firstTs = AV_NOPTS_VALUE;   // 源里第一个包的时间戳（流时间基）
+    int64_t m_loopOffset = 0;             // 本轮输出时间戳的起点
+    int64_t m_loopEnd = 0;                // 目前输出过的最大结束时间
+    int64_t m_clockStart = AV_NOPTS_VALUE; // 输出时间戳 0 对应的墙钟（av_gettime_relative）
+    QString m_telemetryName;
+
+    std::atomic<uint64_t> m_packets{0};
+    std::atomic<uint64_t> m_loops{0};
+    std::atomic<uint64_t> m_resyncs{0};
+    std::atomic<int64_t> m_lagUs{0};      // 最近一个包比计划时间晚了多少，MaxSpeed 下不统计
+};
+
+#endif // SYNTHETICSOURCE_H
@@ -1,37 +1,188 @@
 ﻿#ifndef THREADSAFEQUEUE_H
 #define THREADSAFEQUEUE_H
+#include <QJsonObject>
 #include <QMutex>
 #include <QQueue>
+#include <QString>
 #include <QWaitCondition>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <queue>
+#include <vector>
+#include "QueueItemTraits.h"
+#include "QueueTelemetry.h"
+#include "SpscRingBuffer.h"
 
 const int QUEUE_MAXSIZE = 1500;
 const int WAIT_MILLISECONDS = 2000;
 
+/**
+ * 队列后端
+ * Locked:   QMutex + std::queue，任意多生产者/消费者
+ * SpscRing: 无锁环形缓冲区，只允许一个生产者线程和一个消费者线程，
+ *           仅在空/满时才退化到 QWaitCondition 阻塞
+ */
+enum class QueueBackend {
+    Locked,
+    SpscRing
+};
+
+/**
+ * 队列满时的处理策略
+ * Block:             阻塞生产者直到有空位（默认，与旧行为一致）
+ * DropOldest:        丢弃队头最旧的元素，为新元素腾位置
+ * DropNewest:        直接丢弃新来的元素
+ * DropUntilKeyframe: 超限时清空队列，之后需要参考帧的元素（QueueItemTraits::needsKeyframe，即视频）
+ *                    一直丢到下一个关键帧（非关键帧单独解码会花屏）；其余元素（音频）照常入队，也不结束等待
+ */
+enum class OverflowPolicy {
+    Block,
+    DropOldest,
+    DropNewest,
+    DropUntilKeyframe
+};
+
+// 容量的计量单位，Bytes/DurationUs 通过 QueueItemTraits<T> 取值
+enum class CapacityUnit {
+    Items,
+    Bytes,
+    DurationUs
+};
+
 template<typename T>
 class QUEUE_DATA {
 public:
-    QUEUE_DATA() = default;
+    explicit QUEUE_DATA(QueueBackend backend = QueueBackend::Locked, int capacity = QUEUE_MAXSIZE)
+        : m_capacity(capacity), m_limit(capacity) {
+        if (backend == QueueBackend::SpscRing) {
+            m_ring = std::make_unique<SpscRingBuffer<Entry> >(capacity);
+        }
+    }
+
+    ~QUEUE_DATA() {
+        if (!m_telemetryName.isEmpty()) {
+            TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+        }
+    }
 
     QUEUE_DATA(const QUEUE_DATA &) = delete;
 
     QUEUE_DATA &operator=(const QUEUE_DATA &) = delete;
 
+    QueueBackend backend() const { return m_ring ? QueueBackend::SpscRing : QueueBackend::Locked; }
+
+    /**
+     * @brief 设置溢出策略和容量上限，需在生产/消费开始前调用
+     * @param limit 按 unit 计量的上限；构造时的 capacity 始终作为元素个数的硬上限
+     * SpscRing 后端的差异：DropOldest 由消费者出队时裁剪，环满时退化为丢新；
+     * DropUntilKeyframe 的清空同样交给消费者：生产者记下截至此刻入队的条数，消费者下次出队前把这些丢掉，
+     * 触发清空的元素本身总是被丢弃（Locked 后端在清空后放得下时会接受音频或关键帧）
+     */
+    void setOverflowPolicy(OverflowPolicy policy, CapacityUnit unit, int64_t limit) {
+        QMutexLocker locker(&m_mutex);
+        m_policy = policy;
+        m_unit = unit;
+        m_limit = limit;
+    }
+
+    OverflowPolicy overflowPolicy() const { return m_policy; }
+
+    /**
+     * @brief 以 name 注册到 TelemetryRegistry，定时快照时输出本队列的统计
+     * 统计本身始终在采集，未命名的队列只是不对外输出
+     */
+    void setName(const QString &name) {
+        if (!m_telemetryName.isEmpty()) {
+            TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+        }
+        m_telemetryName = TelemetryRegistry::instance().registerSource(name, [this]() {
+            return telemetrySnapshot();
+        });
+    }
+
+    QString name() const { return m_telemetryName; }
+
+    QJsonObject telemetrySnapshot() {
+        QJsonObject obj = m_stats.snapshot();
+        obj["backend"] = m_ring ? "spsc" : "locked";
+        obj["depth"] = size();
+        obj["usage"] = static_cast<qint64>(usage());
+        obj["dropped"] = static_cast<qint64>(droppedCount());
+        obj["droppedBytes"] = static_cast<qint64>(droppedBytes());
+        return obj;
+    }
+
     /**
      * @brief 向队列尾部添加一个元素（生产者）
      * @param item 元素的智能指针，所有权将被转移到队列中
+     * @return 元素被接受返回 true；被溢出策略丢弃返回 false
      */
-    void enqueue(T item) //入队无引用
+    bool enqueue(T item) //入队无引用
     {
+        if (m_ring) {
+            return enqueueRing(item);
+        }
         QMutexLocker locker(&m_mutex);
+        const int64_t cost = itemCost(item);
 
-        while (m_queue.size() >= QUEUE_MAXSIZE) {
-            m_notFullCond.wait(&m_mutex);
+        switch (m_policy) {
+            case OverflowPolicy::Block:
+                if (overLimitLocked(cost)) {
+                    const int64_t waitStart = QueueStats::nowNs();
+                    while (overLimitLocked(cost)) {
+                        m_notFullCond.wait(&m_mutex);
+                    }
+                    m_stats.addProducerBlocked(QueueStats::nowNs() - waitStart);
+                }
+                break;
+            case OverflowPolicy::DropNewest:
+                if (overLimitLocked(cost)) {
+                    recordDrop(item);
+                    return false;
+                }
+                break;
+            case OverflowPolicy::DropOldest:
+                while (overLimitLocked(cost) && !m_queue.empty()) {
+                    popFrontLocked(true);
+                }
+                if (overLimitLocked(cost)) {
+                    recordDrop(item);
+                    return false;
+                }
+                break;
+            case OverflowPolicy::DropUntilKeyframe: {
+                // 只有视频需要等关键帧；音频在等待期间照常通过，也不会结束等待
+                const bool gated = QueueItemTraits<T>::needsKeyframe(item);
+                const bool key = QueueItemTraits<T>::isKeyframe(item);
+                if (gated && m_waitKeyframe) {
+                    if (!key) {
+                        recordDrop(item);
+                        return false;
+                    }
+                    m_waitKeyframe = false;
+                }
+                if (overLimitLocked(cost)) {
+                    // 队列里的内容已经过时，整体丢弃；不论是谁触发的，之后的视频都要从关键帧重新开始
+                    while (!m_queue.empty()) {
+                        popFrontLocked(true);
+                    }
+                    m_waitKeyframe = !(gated && key);
+                    if ((gated && !key) || overLimitLocked(cost)) {
+                        m_waitKeyframe = true;
+                        recordDrop(item);
+                        return false;
+                    }
+                }
+                break;
+            }
         }
 
-        m_queue.push(std::move(item));     
+        m_usage.fetch_add(cost, std::memory_order_relaxed);
+        m_queue.push(Entry{std::move(item), QueueStats::nowNs()});
+        m_stats.onEnqueue(static_cast<int64_t>(m_queue.size()));
         m_notEmptyCond.wakeOne();
+        return true;
     }
 
     /**
@@ -41,30 +192,152 @@ public:
      */
     bool dequeue(T &result) //出队有引用
     {
+        const uint64_t interruptGen = interruptGeneration();
+        if (m_ring) {
+            return dequeueRing(result, interruptGen);
+        }
         QMutexLocker locker(&m_mutex);
 
-        while (m_queue.empty()) {
-            if (!m_notEmptyCond.wait(&m_mutex, WAIT_MILLISECONDS)) {
-                return false;
-            }
+        if (!waitNotEmptyLocked(interruptGen)) {
+            return false;
         }
 
-        result = std::move(m_queue.front());
+        m_usage.fetch_sub(itemCost(m_queue.front().item), std::memory_order_relaxed);
+        m_stats.onDequeue(m_queue.front().enqueuedNs, QueueStats::nowNs());
+        result = std::move(m_queue.front().item);
         m_queue.pop();
 
         //唤醒一个可能正在等待的生产者
         m_notFullCond.wakeOne();
         return true;
     }
+
+    /**
+     * @brief 批量出队（消费者）：最多等待 timeoutMs 拿到第一个元素，
+     *        之后不再等待，把当前已有的元素一次性取走（最多 max 个）
+     * @param out 取出的元素追加到 out 尾部
+     * @param timeoutMs 0 表示不等待，只取当前已有的元素
+     * @param enqueuedNs 非空时按 out 的顺序追加每个元素的入队时刻（QueueStats::nowNs），供下游统计端到端时延
+     * @return 本次取出的元素个数，超时或被 interruptWait() 打断返回 0
+     */
+    int dequeue_batch(std::vector<T> &out, int max, int timeoutMs = WAIT_MILLISECONDS,
+                      std::vector<int64_t> *enqueuedNs = nullptr) {
+        return dequeue_batch_since(interruptGeneration(), out, max, timeoutMs, enqueuedNs);
+    }
+
+    /**
+     * @brief 同 dequeue_batch，但以调用方事先取得的 interruptGeneration() 为准：
+     *        此后的任何 interruptWait() 都会让它返回 0，即使打断发生在进入本函数之前。
+     *        消费线程先取代数、再查自己的停止标志、再调用本函数，stop() 的"置标志 + 打断"就不会落在两者之间丢失
+     */
+    int dequeue_batch_since(uint64_t interruptGen, std::vector<T> &out, int max, int timeoutMs = WAIT_MILLISECONDS,
+                            std::vector<int64_t> *enqueuedNs = nullptr) {
+        if (max <= 0) {
+            return 0;
+        }
+        if (m_ring) {
+            T first;
+            int64_t firstEnqueuedNs = 0;
+            if (!dequeueRing(first, interruptGen, timeoutMs, &firstEnqueuedNs)) {
+                return 0;
+            }
+            out.push_back(std::move(first));
+            if (enqueuedNs) {
+                enqueuedNs->push_back(firstEnqueuedNs);
+            }
+            // m_batchScratch 只由消费者线程使用，复用其容量避免每批分配
+            m_batchScratch.clear();
+            const size_t extra = m_ring->tryPopBatch(m_batchScratch, max - 1);
+            m_ringPopped += extra;
+            int count = 1 + static_cast<int>(extra);
+            if (count > 1) {
+                const int64_t now = QueueStats::nowNs();
+                int64_t cost = 0;
+                for (Entry &entry: m_batchScratch) {
+                    cost += itemCost(entry.item);
+                    m_stats.onDequeue(entry.enqueuedNs, now);
+                    if (enqueuedNs) {
+                        enqueuedNs->push_back(entry.enqueuedNs);
+                    }
+                    out.push_back(std::move(entry.item));
+                }
+                m_batchScratch.clear();
+                m_usage.fetch_sub(cost, std::memory_order_relaxed);
+                notifyRingProducer();
+            }
+            return count;
+        }
+        QMutexLocker locker(&m_mutex);
+
+        if (!waitNotEmptyLocked(interruptGen, timeoutMs)) {
+            return 0;
+        }
+
+        const int64_t now = QueueStats::nowNs();
+        int count = 0;
+        while (!m_queue.empty() && count < max) {
+            m_usage.fetch_sub(itemCost(m_queue.front().item), std::memory_order_relaxed);
+            m_stats.onDequeue(m_queue.front().enqueuedNs, now);
+            if (enqueuedNs) {
+                enqueuedNs->push_back(m_queue.front().enqueuedNs);
+            }
+            out.push_back(std::move(m_queue.front().item));
+            m_queue.pop();
+            ++count;
+        }
+        m_notFullCond.wakeAll();
+        return count;
+    }
+
     int size() {
+        if (m_ring) {
+            return static_cast<int>(m_ring->sizeApprox());
+        }
         QMutexLocker locker(&m_mutex);
         return m_queue.size();
     }
 
+    // 当前按 CapacityUnit 计量的占用量（近似值）
+    int64_t usage() const { return m_usage.load(std::memory_order_relaxed); }
+
+    // 被溢出策略丢弃的元素个数 / 字节数（clear() 不计入）
+    uint64_t droppedCount() const { return m_droppedItems.load(std::memory_order_relaxed); }
+
+    uint64_t droppedBytes() const { return m_droppedBytes.load(std::memory_order_relaxed); }
+
+    // 当前打断代数，配合 dequeue_batch_since 使用
+    uint64_t interruptGeneration() const { return m_interruptGen.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 让此刻已进入 dequeue / dequeue_batch 的消费者立即返回 false
+     * 调用方在进入时记下打断代数，等待中发现代数变化就返回；之后新进入的调用不受影响，
+     * 因此没有消费者在等时打断也不会残留到下一次 start。消费线程据此检查自己的停止标志，见 PipelineWorker
+     */
+    void interruptWait() {
+        QMutexLocker locker(&m_mutex);
+        m_interruptGen.fetch_add(1, std::memory_order_release);
+        m_notEmptyCond.wakeAll();
+    }
+
+    /**
+     * @brief 清空队列并唤醒所有等待线程
+     * SpscRing 后端下清空等同于消费，只能在消费者线程或生产/消费都已停止时调用
+     */
     void clear() {
+        if (m_ring) {
+            Entry dropped;
+            while (m_ring->tryPop(dropped)) {
+                ++m_ringPopped;
+                m_usage.fetch_sub(itemCost(dropped.item), std::memory_order_relaxed);
+                dropped = Entry();
+            }
+        }
         QMutexLocker locker(&m_mutex);
-        std::queue<T> empty_queue;
+        std::queue<Entry> empty_queue;
         m_queue.swap(empty_queue);
+        if (!m_ring) {
+            m_usage.store(0, std::memory_order_relaxed);
+        }
 
         // 唤醒所有可能在等待队列变满的生产者线程
         m_notFullCond.wakeAll();
@@ -72,10 +345,275 @@ public:
     }
 
 private:
+    // 元素连同入队时间一起存放，用于统计驻留时间
+    struct Entry {
+        T item;
+        int64_t enqueuedNs = 0;
+    };
+
+    // 持有 m_mutex 调用，等待期间计入消费者饥饿时间；interruptGen 为调用方进入时的打断代数
+    bool waitNotEmptyLocked(uint64_t interruptGen, int timeoutMs = WAIT_MILLISECONDS) {
+        if (!m_queue.empty()) {
+            return true;
+        }
+        if (timeoutMs <= 0) {
+            return false;
+        }
+        const int64_t waitStart = QueueStats::nowNs();
+        bool ok = true;
+        while (m_queue.empty()) {
+            if (m_interruptGen.load(std::memory_order_relaxed) != interruptGen) {
+                ok = false;
+                break;
+            }
+            if (!m_notEmptyCond.wait(&m_mutex, timeoutMs)) {
+                ok = false;
+                break;
+            }
+        }
+        m_stats.addConsumerStarved(QueueStats::nowNs() - waitStart);
+        return ok;
+    }
+
+    int64_t itemCost(const T &item) const {
+        switch (m_unit) {
+            case CapacityUnit::Bytes:
+                return QueueItemTraits<T>::bytes(item);
+            case CapacityUnit::DurationUs:
+                return QueueItemTraits<T>::durationUs(item);
+            case CapacityUnit::Items:
+            default:
+                return 1;
+        }
+    }
+
+    // 空队列总能放下一个超大元素，否则 Block 策略会永久卡死；limit <= 0 表示全部丢弃
+    bool fitsLimit(int64_t cost) const {
+        const int64_t used = m_usage.load(std::memory_order_relaxed);
+        if (m_limit <= 0) {
+            return false;
+        }
+        return used <= 0 || used + cost <= m_limit;
+    }
+
+    bool overLimitLocked(int64_t cost) const {
+        return m_queue.size() >= m_capacity || !fitsLimit(cost);
+    }
+
+    void popFrontLocked(bool countAsDrop) {
+        m_usage.fetch_sub(itemCost(m_queue.front().item), std::memory_order_relaxed);
+        if (countAsDrop) {
+            recordDrop(m_queue.front().item);
+        }
+        m_queue.pop();
+    }
+
+    void recordDrop(const T &item) {
+        m_droppedItems.fetch_add(1, std::memory_order_relaxed);
+        m_droppedBytes.fetch_add(static_cast<uint64_t>(QueueItemTraits<T>::bytes(item)), std::memory_order_relaxed);
+    }
+
+    // --- SpscRing 后端：快速路径无锁，只有空/满时才进入 m_mutex ---
+    bool ringPush(T &item, int64_t cost) {
+        // 失败时 tryPush 不移动 entry，需要把元素还给调用方以便重试或计入丢弃
+        Entry entry{std::move(item), QueueStats::nowNs()};
+        if (!m_ring->tryPush(entry)) {
+            item = std::move(entry.item);
+            return false;
+        }
+        ++m_ringPushed;
+        m_usage.fetch_add(cost, std::memory_order_relaxed);
+        m_stats.onEnqueue(static_cast<int64_t>(m_ring->sizeApprox()));
+        return true;
+    }
+
+    bool enqueueRing(T &item) {
+        const int64_t cost = itemCost(item);
+        switch (m_policy) {
+            case OverflowPolicy::Block:
+                break;
+            case OverflowPolicy::DropNewest:
+                if (!fitsLimit(cost) || !ringPush(item, cost)) {
+                    recordDrop(item);
+                    return false;
+                }
+                notifyRingConsumer();
+                return true;
+            case OverflowPolicy::DropOldest:
+                // 超出上限的部分由消费者在出队时裁掉；环真正满了说明消费者停摆，只能丢新
+                if (!ringPush(item, cost)) {
+                    recordDrop(item);
+                    return false;
+                }
+                notifyRingConsumer();
+                return true;
+            case OverflowPolicy::DropUntilKeyframe: {
+                // m_waitKeyframe 只由生产者线程读写；规则与 Locked 后端相同
+                const bool gated = QueueItemTraits<T>::needsKeyframe(item);
+                if (gated && m_waitKeyframe) {
+                    if (!QueueItemTraits<T>::isKeyframe(item)) {
+                        recordDrop(item);
+                        return false;
+                    }
+                    m_waitKeyframe = false;
+                }
+                if (!fitsLimit(cost) || !ringPush(item, cost)) {
+                    // 生产者不能出队：请消费者丢掉截至目前入队的全部元素（见 dropRingFlushed）
+                    m_ringFlushUntil.store(m_ringPushed, std::memory_order_release);
+                    m_waitKeyframe = true;
+                    recordDrop(item);
+                    return false;
+                }
+                notifyRingConsumer();
+                return true;
+            }
+        }
+
+        if (fitsLimit(cost) && ringPush(item, cost)) {
+            notifyRingConsumer();
+            return true;
+        }
+        QMutexLocker locker(&m_mutex);
+        const int64_t waitStart = QueueStats::nowNs();
+        m_waitingProducers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!(fitsLimit(cost) && ringPush(item, cost))) {
+            m_notFullCond.wait(&m_mutex);
+        }
+        m_waitingProducers.fetch_sub(1);
+        m_stats.addProducerBlocked(QueueStats::nowNs() - waitStart);
+        // 已持有 m_mutex，直接唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waitingConsumers.load(std::memory_order_relaxed) > 0) {
+            m_notEmptyCond.wakeOne();
+        }
+        return true;
+    }
+
+    bool ringPop(T &result, int64_t *enqueuedNs = nullptr) {
+        if (m_policy == OverflowPolicy::DropOldest) {
+            trimRing();
+        } else if (m_policy == OverflowPolicy::DropUntilKeyframe) {
+            dropRingFlushed();
+        }
+        Entry entry;
+        if (!m_ring->tryPop(entry)) {
+            return false;
+        }
+        ++m_ringPopped;
+        m_usage.fetch_sub(itemCost(entry.item), std::memory_order_relaxed);
+        m_stats.onDequeue(entry.enqueuedNs, QueueStats::nowNs());
+        if (enqueuedNs) {
+            *enqueuedNs = entry.enqueuedNs;
+        }
+        result = std::move(entry.item);
+        return true;
+    }
+
+    // 消费者线程调用：丢弃最旧的元素直到回到上限以内，至少保留最新的一个
+    void trimRing() {
+        while (m_usage.load(std::memory_order_relaxed) > m_limit && m_ring->sizeApprox() > 1) {
+            Entry dropped;
+            if (!m_ring->tryPop(dropped)) {
+                break;
+            }
+            ++m_ringPopped;
+            m_usage.fetch_sub(itemCost(dropped.item), std::memory_order_relaxed);
+            recordDrop(dropped.item);
+        }
+    }
+
+    // 消费者线程调用：丢弃生产者请求清空时已在环里的元素（DropUntilKeyframe）
+    void dropRingFlushed() {
+        const uint64_t flushUntil = m_ringFlushUntil.load(std::memory_order_acquire);
+        while (m_ringPopped < flushUntil) {
+            Entry dropped;
+            if (!m_ring->tryPop(dropped)) {
+                break;
+            }
+            ++m_ringPopped;
+            m_usage.fetch_sub(itemCost(dropped.item), std::memory_order_relaxed);
+            recordDrop(dropped.item);
+        }
+    }
+
+    bool dequeueRing(T &result, uint64_t interruptGen, int timeoutMs = WAIT_MILLISECONDS,
+                     int64_t *enqueuedNs = nullptr) {
+        if (ringPop(result, enqueuedNs)) {
+            notifyRingProducer();
+            return true;
+        }
+        if (timeoutMs <= 0) {
+            return false;
+        }
+        QMutexLocker locker(&m_mutex);
+        const int64_t waitStart = QueueStats::nowNs();
+        m_waitingConsumers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = true;
+        while (!ringPop(result, enqueuedNs)) {
+            if (m_interruptGen.load(std::memory_order_relaxed) != interruptGen) {
+                ok = false;
+                break;
+            }
+            if (!m_notEmptyCond.wait(&m_mutex, timeoutMs)) {
+                ok = ringPop(result, enqueuedNs);
+                break;
+            }
+        }
+        m_waitingConsumers.fetch_sub(1);
+        m_stats.addConsumerStarved(QueueStats::nowNs() - waitStart);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ok && m_waitingProducers.load(std::memory_order_relaxed) > 0) {
+            m_notFullCond.wakeOne();
+        }
+        return ok;
+    }
+
+    // 发布之后检查对端是否在睡眠：对端在持锁状态下先登记等待再复查，
+    // 因此这里只要看到计数为 0 就不会丢失唤醒
+    void notifyRingConsumer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waitingConsumers.load(std::memory_order_relaxed) > 0) {
+            QMutexLocker locker(&m_mutex);
+            m_notEmptyCond.wakeOne();
+        }
+    }
+
+    void notifyRingProducer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waitingProducers.load(std::memory_order_relaxed) > 0) {
+            QMutexLocker locker(&m_mutex);
+            m_notFullCond.wakeOne();
+        }
+    }
+
     mutable QMutex m_mutex;
     QWaitCondition m_notEmptyCond; // 条件：队列不为空
     QWaitCondition m_notFullCond; // 条件：队列不满
-    std::queue<T> m_queue;
+    std::queue<Entry> m_queue;
+    size_t m_capacity;
+
+    OverflowPolicy m_policy = OverflowPolicy::Block;
+    CapacityUnit m_unit = CapacityUnit::Items;
+    int64_t m_limit;
+    bool m_waitKeyframe = false;
+    std::atomic<uint64_t> m_interruptGen{0}; // interruptWait() 递增（持 m_mutex），等待方比对进入时的快照
+    std::atomic<int64_t> m_usage{0};
+    std::atomic<uint64_t> m_droppedItems{0};
+    std::atomic<uint64_t> m_droppedBytes{0};
+
+    std::unique_ptr<SpscRingBuffer<Entry> > m_ring;
+    std::vector<Entry> m_batchScratch;
+    std::atomic<int> m_waitingProducers{0};
+    std::atomic<int> m_waitingConsumers{0};
+    // 环的入队/出队累计条数，分别只由生产者/消费者读写；清空请求按入队条数标记截止位置
+    uint64_t m_ringPushed = 0;
+    uint64_t m_ringPopped = 0;
+    std::atomic<uint64_t> m_ringFlushUntil{0};
+
+    QueueStats m_stats;
+    QString m_telemetryName;
 };
 
 
@@ -0,0 +1,98 @@
+﻿/**
+ *madebyYahei
+ *拥塞控制反馈处理器，挂在视频处理链上（NACK 历史缓存之后、平滑器之前）
+ *outgoing：对端在 answer 里接受了扩展后，给每个 RTP 包加 transport-wide 序号头扩展
+ *（draft-holmer-rmcat-transport-wide-cc-extensions-01，one-byte 格式）；没有协商时原样放行，不做任何拷贝；
+ *incoming：解析对端 RTCP 中的 RR（fraction lost）、REMB 和 transport-wide CC 反馈，交给 BandwidthEstimator；
+ *发送时间由平滑器在包真正发出时通过 onPacketSent 补记
+ *目标码率变化超过 kReportStep 或距上次通知超过 kReportIntervalMs 时回调 onTargetBitrate（在网络线程上）
+ */
+#ifndef TRANSPORTFEEDBACKHANDLER_H
+#define TRANSPORTFEEDBACKHANDLER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <QJsonObject>
+
+#include <rtc/mediahandler.hpp>
+
+#include "BandwidthEstimator.h"
+
+class TransportFeedbackHandler : public rtc::MediaHandler {
+public:
+    static constexpr int kDefaultExtensionId = 3;
+    static constexpr const char *kExtensionUri =
+        "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01";
+    static constexpr double kReportStep = 0.05;
+    static constexpr int kReportIntervalMs = 1000;
+
+    using TargetCallback = std::function<void(int bitrateBps)>;
+
+    /**
+     * @param ssrc 媒体流 SSRC，只采用针对它的 RR
+     * 创建时不加序号，协商完成后由 setExtensionId 打开
+     */
+    TransportFeedbackHandler(uint32_t ssrc, std::shared_ptr<BandwidthEstimator> estimator);
+
+    // answer 中协商到的扩展 id，<= 0 表示对端不支持，关闭序号扩展；任意线程调用
+    void setExtensionId(int extensionId);
+
+    // 在 SDP 中找 kExtensionUri 对应的 extmap id，没有时返回 0
+    static int negotiatedExtensionId(const std::string &sdp);
+
+    // 挂到轨道之前设置
+    void onTargetBitrate(TargetCallback callback) { m_onTarget = std::move(callback); }
+
+    void outgoing(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+    void incoming(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+    // 平滑器发出一个包后调用：从头扩展取回序号，记录真实发送时间
+    void onPacketSent(const rtc::message_ptr &message, int64_t sentUs);
+
+    QJsonObject stats() const;
+
+    /**
+     * @brief 解析一个 transport-wide CC 反馈（RTPFB FMT=15），data 指向该 RTCP 包开头
+     * 到达时间 = 参考时间（64ms 单位）+ 逐包增量（250us 单位），只有差值有意义
+     */
+    static bool parseTransportFeedback(const uint8_t *data, size_t len,
+                                       std::vector<BandwidthEstimator::PacketFeedback> &packets);
+
+    // 在 RTP 包的 one-byte 头扩展里找 id 对应的 transport-wide 序号
+    static bool findTransportSequence(const uint8_t *data, size_t len, int extensionId, uint16_t &sequence);
+
+private:
+    rtc::message_ptr stamp(const rtc::message_ptr &message, int extensionId);
+
+    void handleRtcp(const uint8_t *data, size_t len, int64_t nowUs);
+
+    void report(int targetBps, int64_t nowUs);
+
+    const uint32_t m_ssrc;
+    std::atomic<int> m_extensionId{0};
+    std::shared_ptr<BandwidthEstimator> m_estimator;
+    TargetCallback m_onTarget;
+
+    uint16_t m_nextSequence = 0;                       // 只在发送线程上使用
+    std::vector<BandwidthEstimator::PacketFeedback> m_feedback; // 只在网络线程上使用，复用
+
+    std::mutex m_reportMutex;
+    int m_reportedBps = 0;
+    int64_t m_reportedUs = 0;
+
+    std::atomic<uint64_t> m_stamped{0};
+    std::atomic<uint64_t> m_transportFeedbacks{0};
+    std::atomic<uint64_t> m_receiverReports{0};
+    std::atomic<uint64_t> m_rembs{0};
+    std::atomic<uint64_t> m_malformed{0};
+};
+
+#endif // TRANSPORTFEEDBACKHANDLER_H
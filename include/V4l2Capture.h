@@ -0,0 +1,74 @@
+﻿/**
+ *madebyYahei
+ *Linux V4L2 流式采集（mmap 缓冲区，零拷贝）
+ *原始格式出队的驱动缓冲区直接包成引用计数的 AVPacket（av_buffer_create），沿采集队列 -> 解码器（原始格式直通）
+ *-> 编码队列传递，最后一个引用释放时才 VIDIOC_QBUF 还给驱动，全程不拷贝像素；
+ *MJPEG 要交给解码器，包尾必须有 AV_INPUT_BUFFER_PADDING_SIZE 的填充，驱动缓冲区给不了，总是拷贝；
+ *还在驱动里排队的缓冲区少于 kMinQueuedBuffers 时同样退化为拷贝一份并立即归还，避免下游积压把采集卡住
+ *read 只在采集线程调用；缓冲区可以在任意线程释放，关闭后仍在下游的缓冲区释放时才真正 munmap
+ *非 Linux 平台上 open 总是失败
+ */
+#ifndef V4L2CAPTURE_H
+#define V4L2CAPTURE_H
+
+#include <QJsonObject>
+#include <QString>
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+class V4l2Capture {
+public:
+    static constexpr int kBufferCount = 8;
+    static constexpr int kMinQueuedBuffers = 2;
+
+    V4l2Capture();
+
+    ~V4l2Capture();
+
+    V4l2Capture(const V4l2Capture &) = delete;
+
+    V4l2Capture &operator=(const V4l2Capture &) = delete;
+
+    // 设备名（DeviceEnumerator 给出的是设备描述）-> /dev/videoN；已经是路径时原样返回
+    static QString resolveDevice(const QString &name);
+
+    /**
+     * @brief 打开设备并开始流式采集
+     * 依次尝试 NV12 / YUYV / YUV420 / MJPEG，width/height/fps 为 0 时沿用设备当前设置
+     */
+    bool open(const QString &device, int width, int height, int fps, QString &error);
+
+    void close();
+
+    bool isOpen() const;
+
+    /**
+     * @brief 取一帧
+     * @return 0 成功；AVERROR(EAGAIN) 表示 timeoutMs 内没有新帧；其他负值为设备错误
+     */
+    int read(AVPacket *packet, int timeoutMs);
+
+    // rawvideo（带像素格式）或 mjpeg
+    const AVCodecParameters *codecParameters() const { return m_params; }
+
+    // 包的时间戳取自驱动的单调时钟，单位微秒
+    AVRational timeBase() const { return {1, 1000000}; }
+
+    QJsonObject telemetrySnapshot() const;
+
+private:
+    struct Device;
+    struct BufferLease;
+
+    // av_buffer_create 的释放回调：缓冲区还给驱动
+    static void releaseBuffer(void *opaque, uint8_t *data);
+
+    std::shared_ptr<Device> m_device;
+    AVCodecParameters *m_params = nullptr;
+    QString m_telemetryName;
+};
+
+#endif // V4L2CAPTURE_H
@@ -4,6 +4,7 @@
 #include <QWidget>
 #include <QImage>
 #include <QPainter>
+#include "FrameMailbox.h"
 
 class VideoWidget : public QWidget {
     Q_OBJECT
@@ -11,16 +12,40 @@ class VideoWidget : public QWidget {
 public:
     explicit VideoWidget(QWidget *parent = nullptr);
 
+    /**
+     * @brief 设置显示帧来源，重绘时从信箱取最新一帧；切换来源时清空当前画面
+     * 信箱由调用方持有，须比本控件活得久（或在销毁前设回 nullptr）
+     */
+    void setFrameSource(ImageMailbox *mailbox);
+
+    // 当前显示区域的物理像素尺寸（逻辑尺寸 x devicePixelRatio）
+    QSize displaySize() const;
+
+signals:
+    // 物理像素尺寸变化（缩放窗口、移到不同 DPI 的屏幕），解码端据此调整输出尺寸
+    void displaySizeChanged(const QSize &size);
+
 public slots:
-    // 提供一个公共槽，用于接收解码和转换后的QImage
-    void updateFrame(const QImage *frame);
+    // 直接显示一帧；QImage 隐式共享，只增加引用计数，不拷贝像素
+    void updateFrame(const QImage &frame);
+
+    // 信箱里有新帧：只请求重绘，多次请求由 Qt 合并成一次 paintEvent
+    void onFrameReady();
 
 protected:
     // 重写paintEvent来实现自定义绘制
     void paintEvent(QPaintEvent *event) override;
 
+    void resizeEvent(QResizeEvent *event) override;
+
+    void showEvent(QShowEvent *event) override;
+
 private:
-    QImage m_currentFrame;
+    QImage m_currentFrame; // 与解码端共享同一块池化缓冲区，直接绘制
+    ImageMailbox *m_source = nullptr;
+    QSize m_notifiedSize;
+
+    void notifyDisplaySize();
 };
 
 #endif // VIDEOWIDGET_H
@@ -11,6 +11,8 @@
 #include <QMessageBox>
 
 #include "ThreadSafeQueue.h"
+#include "PipelineWorker.h"
+#include "QueueTelemetry.h"
 #include "AVSmartPtrs.h"
 #include "logqueue.h"
 #include "log_global.h"
@@ -19,6 +21,10 @@
 #include "DeviceEnumerator.h"
 
 #include "AudioResampleConfig.h"
+#include "RtpHistoryResponder.h"
+#include "RtpPacer.h"
+#include "TransportFeedbackHandler.h"
+#include "H264Bitstream.h"
 
 #include <rtc/peerconnection.hpp>
 #include <rtc/track.hpp>
@@ -41,14 +47,49 @@ private:
 
     void sendOfferToSignalingServer(const std::string &sdp);
 
+    // 发送线程的一次迭代：阻塞到队列里有包，把当前所有的包一次取走并按顺序交给轨道
+    bool sendPendingPackets();
+
+    // 视频包会被原地改写成长度前缀格式，因此不是 const
+    void sendPacket(AVPacket *packet);
+
+    // 转成打包器要的长度前缀格式并发送
+    void sendVideoPacket(AVPacket *packet);
+
+    QJsonObject sendStats() const;
+
+    // 一批最多取这么多包，与队列的硬上限一致，即"有多少取多少"
+    static constexpr int kMaxSendBatch = QUEUE_MAXSIZE;
+
     QUEUE_DATA<AVPacketPtr> *m_encodedPacketQueue;
-    std::atomic<bool> m_isPublishing = false;
     QTimer * m_pliTimer = nullptr;
 
+    // --- 发送线程 ---
+    PipelineWorker m_sendWorker{"webrtcSend"};
+    std::vector<AVPacketPtr> m_sendBatch; // 只由发送线程使用，复用容量
+    std::vector<int64_t> m_sendEnqueuedNs;
+    LatencyHistogram m_queueToWireUs; // 入队到 track->send 返回（音频已交给传输层，视频进入平滑队列）
+    std::atomic<uint64_t> m_sentPackets{0};
+    std::atomic<uint64_t> m_sentBytes{0};
+    std::atomic<uint64_t> m_sendBatches{0};
+    std::atomic<int> m_maxBatch{0};
+    std::vector<H264NalUnit> m_nalIndex;       // 只由发送线程使用
+    std::vector<std::byte> m_lengthPrefixed;   // 不能原地改写时的拼接缓冲
+    std::atomic<uint64_t> m_videoInPlace{0};   // 原地改写起始码、零拷贝发送的帧数
+    std::atomic<uint64_t> m_videoRebuilt{0};   // 含 3 字节起始码等、需要拼接的帧数
+    QString m_sendTelemetryName;
+    // 视频 RTP 包的平滑器，必须声明在轨道之前（处理器引用它，要比轨道活得久）
+    RtpPacer m_pacer;
+    QString m_pacerTelemetryName;
+
     // --- WebRTC members ---
     std::unique_ptr<rtc::PeerConnection> m_peerConnection;
     std::shared_ptr<rtc::Track> m_videoTrack;
     std::shared_ptr<rtc::Track> m_audioTrack;
+    std::shared_ptr<RtpHistoryResponder> m_videoHistory; // 视频 NACK 重传缓存（挂在打包器之后）
+    QString m_historyTelemetryName;
+    std::shared_ptr<TransportFeedbackHandler> m_transportFeedback; // TWCC 序号 + RR/REMB/TWCC 反馈 -> 带宽估计
+    QString m_bweTelemetryName;
     rtc::Configuration m_rtcConfig;
 
     // --- Signaling members ---
@@ -64,6 +105,9 @@ signals:
     void publisherStopped();
     void PLIReceived();
 
+    // 带宽估计给出的视频目标码率（在 libdatachannel 网络线程上发出）
+    void targetBitrateChanged(int bitrateBps);
+
 public slots:
     bool init(const QString &signalingUrl, const QString &streamUrl);
 
@@ -77,7 +121,6 @@ public slots:
 
 private slots:
     void ChangeWebRtcPublishingState(bool isPublishing);
-    void doPublishingWork();
 
     void onSignalingReply(QNetworkReply *reply);
 };
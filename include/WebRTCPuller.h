@@ -24,7 +24,7 @@ class WebRTCPuller : public QObject {
     Q_OBJECT
 
 public:
-    explicit WebRTCPuller(QUEUE_DATA<std::unique_ptr<QImage> >* MainQimageQueue, QObject* parent = nullptr);
+    explicit WebRTCPuller(ImageMailbox* imageMailbox, QObject* parent = nullptr);
 
     ~WebRTCPuller();
 
@@ -56,7 +56,7 @@ private:
     AVRational m_vTimeBase = { 0, 1 };
     AVRational m_aTimeBase = { 0, 1 };
 
-    QUEUE_DATA<std::unique_ptr<QImage> >* m_MainQimageQueue;
+    ImageMailbox* m_imageMailbox;
     QUEUE_DATA<AVPacketPtr>* m_videoPacketQueue;
     QUEUE_DATA<AVPacketPtr>* m_audioPacketQueue;
     QUEUE_DATA<AVFramePtr>* m_dummyVideoFrameQueue;
@@ -92,6 +92,8 @@ public slots:
     void startPulling(); 
     void onSignalingReply(QNetworkReply* response);
     void ChangePullingState(bool isDecoding);
+    // 显示控件物理尺寸变化，转给视频解码器调整输出尺寸
+    void setDisplaySize(const QSize& size);
     void initializePeerConnection();
     void onStreamOpened_initVideo(AVCodecParameters* vParams, AVRational vTimeBase);
 
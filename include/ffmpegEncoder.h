@@ -2,15 +2,17 @@
 #define FFMPEGENCODER_H
 
 #include <QObject>
-#include <QMutex>
-#include <QWaitCondition>
+#include <mutex>
 #include "ThreadSafeQueue.h"
+#include "PipelineWorker.h"
 #include "AVSmartPtrs.h"
 #include "AudioResampleConfig.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+#include <libavutil/pixdesc.h>
 }
 
 class ffmpegEncoder : public QObject {
@@ -22,29 +24,84 @@ public:
 
     ~ffmpegEncoder();
 
-    AVCodecContext *getCodecContext() const { return m_codecCtx; }
+    // 视频编码器运行中可能因换档被替换，返回值只在下一次换档前有效；RTMP 推流前先关掉换档再取
+    AVCodecContext *getCodecContext() const;
+
+    // 以 name 注册每帧编码耗时（含格式转换）和线程 CPU 时间
+    void setStageName(const QString &name) { m_stageStats.setName(name); }
 
 private:
     void clear();
 
     void flushEncoder(); // 清空编码器缓存
 
+    // 编码一帧并把输出的包放入发送队列，在编码线程上执行
+    void encodeVideoFrame(AVFrame *frame);
+    void encodeAudioFrame(AVFrame *frame);
+
+    /**
+     * @brief 输入帧与编码器像素格式/尺寸不一致时转换（yuyv422 采集、MJPEG 解出的 yuvj422p 等）
+     * @return 可直接送编码器的帧：一致时就是 frame 本身，否则是复用的 m_convertFrame
+     */
+    AVFrame *toEncoderFormat(AVFrame *frame);
+
+    // 自适应码率的分辨率/帧率阶梯，分辨率和帧率都相对采集端协商的值
+    struct VideoLayer {
+        int scaleNum;
+        int scaleDen;
+        int fpsNum;
+        int fpsDen;
+    };
+    static constexpr int kVideoLayerCount = 4;
+    static const VideoLayer kVideoLadder[kVideoLayerCount];
+
+    // 打开新的 x264 编码器，失败返回 nullptr
+    AVCodecContext *openVideoCodec(int width, int height, int fps, int64_t bitRate);
+
+    /**
+     * @brief 用新打开的编码器替换 m_codecCtx，帧计数换算到新的时间基
+     * @param layerSwitch 运行中换档：换档已被关闭（RTMP 已拿走当前上下文）时放弃替换并释放 codecCtx
+     */
+    bool installVideoCodec(AVCodecContext *codecCtx, bool layerSwitch);
+
+    int layerFps(int layer) const;
+
+    // 按码率在阶梯上选档（带迟滞）
+    int chooseVideoLayer(int bitrateBps) const;
+
+    // 编码线程上、每帧编码前执行：码率变化在线生效，需要换档时重开编码器
+    void applyTargetBitrate();
+
     QUEUE_DATA<AVFramePtr> *m_frameQueue;
     QUEUE_DATA<AVPacketPtr> *m_packetQueue;
 
-    std::atomic<bool> m_isEncoding = false;
     std::atomic<bool> m_forceKeyframe = false;
-    AVCodecContext *m_codecCtx = nullptr;
+    AVCodecContext *m_codecCtx = nullptr; // 只在编码线程上替换，替换和其他线程的读取由 m_codecCtxMutex 保护
+    mutable std::mutex m_codecCtxMutex;
     AVMediaType m_mediaType;
 
+    SwsContext *m_swsCtx = nullptr;
+    AVFramePtr m_convertFrame;
+    StageStats m_stageStats;
+
+    // 自适应码率
+    std::atomic<int> m_targetBitrate{0}; // 0 表示没有带宽估计，保持初始化时的码率
+    int m_appliedBitrate = 0;
+    int m_sourceWidth = 0;
+    int m_sourceHeight = 0;
+    int m_captureFps = 0;
+    AVPixelFormat m_videoPixFmt = AV_PIX_FMT_YUV420P;
+    int m_videoLayer = 0;
+    int64_t m_layerSwitchedNs = 0;
+    double m_frameCredit = 0;
+    bool m_layerSwitching = false; // 受 m_codecCtxMutex 保护
+
     // Keep counters for assigning PTS in encoder time_base
     int64_t m_videoFrameCounter =0;
     int64_t m_audioSamplesCount =0;
 
-    // --- 用于线程同步 ---
-    QMutex m_workMutex;
-    QWaitCondition m_workCond;
-    bool m_isDoingWork = false;
+    // 编码循环线程；停止编码时以 Drain 模式收尾，已采集的帧编完并冲洗编码器
+    PipelineWorker m_worker{"encoder"};
 signals:
 
     void errorOccurred(const QString &errorText);
@@ -61,9 +118,16 @@ public slots:
     void startEncoding();
 
     void stopEncoding();
-    void doVideoEncodingWork();
-    void doAudioEncodingWork();
     void requestKeyFrame();
+
+    // 带宽估计给出的目标码率，任意线程调用；下一帧编码前生效，开启换档时码率过低会按阶梯降分辨率/帧率
+    void setTargetBitrate(int bitrateBps);
+
+    /**
+     * @brief 是否允许运行中重开编码器换分辨率/帧率（默认关闭，只改码率）
+     * 只有 WebRTC 推流可以开启：RTMP 封装器持有编码器上下文且已写出序列头，换档会让它失效
+     */
+    void setLayerSwitchingEnabled(bool enabled);
 };
 
 
@@ -10,10 +10,13 @@
 
 #include <QObject>
 #include <QImage>
-#include <QMutex>
-#include <QWaitCondition>
+#include <QSize>
 #include "ThreadSafeQueue.h"
+#include "PipelineWorker.h"
 #include "AVSmartPtrs.h"
+#include "FrameMailbox.h"
+#include "ImageBufferPool.h"
+#include "ColorConverter.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -25,40 +28,105 @@ class ffmpegVideoDecoder : public QObject {
     Q_OBJECT
 
 public:
-    explicit ffmpegVideoDecoder(QUEUE_DATA<AVPacketPtr> *packetQueue, QUEUE_DATA<std::unique_ptr<QImage> > *imageQueue,
+    // 解码器多线程方式；线程数在打开解码器时从 DecoderThreadBudget 申请
+    enum class Threading {
+        Slice, // 一帧内按 slice 并行，不增加延迟（码流只有一个 slice 时退化为单线程）
+        Frame  // 多帧并行，吞吐高，但每多一个线程输出就晚一帧，适合对延迟不敏感的拉流
+    };
+
+    explicit ffmpegVideoDecoder(QUEUE_DATA<AVPacketPtr> *packetQueue, ImageMailbox *imageMailbox,
                                 QUEUE_DATA<AVFramePtr> *frameQueue, QObject *parent = nullptr);
 
     ~ffmpegVideoDecoder();
 
+    /**
+     * @brief 设置多线程方式，在 init 之前调用
+     * @param maxThreads 线程数上限，0 表示由预算平分决定
+     */
+    void setThreading(Threading threading, int maxThreads = 0);
+
+    // 以 name 注册每包解码耗时和线程 CPU 时间
+    void setStageName(const QString &name) { m_stageStats.setName(name); }
+
 private:
     void clear();
 
+    // 释放解码器上下文并归还线程额度
+    void closeCodec();
+
+    // 送入一个包并取出解码器当前能输出的所有帧
+    void decodePacket(const AVPacket *packet);
+
+    void receiveFrames();
+
+    // 原始格式采集：包里就是一整帧图像，直接引用包的缓冲区包装成 AVFrame，不解码也不拷贝
+    bool wrapRawPacket(const AVPacket *packet, AVFrame *frame) const;
+
+    // 一帧解码输出：转发给编码队列并转换显示
+    void handleFrame(AVFrame *frame);
+
     QUEUE_DATA<AVPacketPtr> *m_packetQueue; //采集队列
-    QUEUE_DATA<std::unique_ptr<QImage> > *m_QimageQueue; //QT显示队列
+    ImageMailbox *m_imageMailbox; //QT显示信箱，只保留最新一帧
     QUEUE_DATA<AVFramePtr> *m_frameQueue; //网络传输帧队列
 
-    uint8_t *rgbBuffer = nullptr;
-    std::atomic<bool> m_isDecoding = false;
-
     AVCodecContext *m_codecCtx = nullptr;
     const AVCodec *m_codec = nullptr;
     SwsContext *m_swsCtx = nullptr;
-    AVFramePtr m_rgbFrame = nullptr;
-    // AVFramePtr m_decodedFrame = nullptr;
+    ImageBufferPool m_imagePool; // 显示帧直接转换进池化缓冲区，QImage 引用它而不拷贝
+    ColorConverter m_colorConverter; // yuv420p/nv12/yuyv422 的 SIMD 快速路径，其余格式走 swscale
+    AVFramePtr m_decodedFrame; // receive_frame 的输出，逐帧 unref 后复用
+    StageStats m_stageStats;
+
+    Threading m_threading = Threading::Slice;
+    int m_maxThreads = 0;
+    int m_threadLease = 0; // 从 DecoderThreadBudget 借到的线程数
 
-    // 解决竞态条件问题
-    QMutex m_workMutex;
-    QWaitCondition m_workCond;
-    bool m_isDoingWork = false; // 标志是否正在执行解码核心工作
+    // rawvideo 输入不打开解码器，按这里记录的格式直接包装
+    bool m_rawPassthrough = false;
+    AVPixelFormat m_rawFormat = AV_PIX_FMT_NONE;
+    int m_rawWidth = 0;
+    int m_rawHeight = 0;
 
     // 解决视频参数动态变化问题
     int m_swsSrcWidth = 0;
     int m_swsSrcHeight = 0;
     AVPixelFormat m_swsSrcPixFmt = AV_PIX_FMT_NONE;
+    int m_swsDstWidth = 0;
+    int m_swsDstHeight = 0;
+
+    // 显示控件的物理像素尺寸（已乘 DPR），0 表示按源分辨率输出；任意线程写，解码线程读
+    std::atomic<int> m_targetWidth{0};
+    std::atomic<int> m_targetHeight{0};
+
+    // 按目标尺寸等比缩小（不放大），宽高取偶数
+    QSize displaySizeFor(int srcWidth, int srcHeight) const;
+
+    /**
+     * @brief 为 ColorConverter 选缩放倍数（1 / 2 / 4），不能用快速路径时返回 0
+     * 取输出仍不小于 dstSize 的最大倍数；剩下的缩小交给 QPainter，超过 2 倍面积时改用 swscale
+     */
+    int fastPathScale(const AVFrame *frame, const QSize &dstSize) const;
+
+    // 快速路径：转换进池化缓冲区并投递到信箱
+    bool presentWithConverter(const AVFrame *frame, int scale);
 
     // base pts for video frames (matches audio's m_fifoBasePts logic)
     int64_t m_frameBasePts = AV_NOPTS_VALUE;
 	AVRational m_inputTimeBase;
+    // 送给编码器的帧：流带帧率时时间基取 1/帧率、每帧时长 1；帧率未知时沿用输入时间基，时长取相邻 pts 差
+    AVRational m_frameRate{0, 1};
+    AVRational m_frameTimeBase{0, 1};
+    int64_t m_lastFramePts = AV_NOPTS_VALUE;
+    int64_t m_lastFrameDuration = 0;
+
+    // init 时按参数里的帧率确定输出时间基
+    void setupFrameTiming(const AVCodecParameters *params, AVRational inputTimeBase);
+
+    // 输出帧的时长（m_frameTimeBase 单位），未知时返回 0
+    int64_t frameDuration(const AVFrame *decodedFrame);
+
+    // 解码循环线程；stop 返回时解码一定已经停下，init/clear 才能释放解码器
+    PipelineWorker m_worker{"videoDecoder"};
 
 signals:
     void newFrameAvailable();
@@ -70,11 +138,15 @@ public slots:
 
     void startDecoding();
 
-    void doDecodingPacket();
-
     void stopDecoding();
     
     void ChangeDecodingState(bool isEncoding);
+
+    /**
+     * @brief 显示控件尺寸变化时调用（物理像素），下一帧起直接转换到这个尺寸
+     * 缩略图只付缩略图大小的转换开销；只写原子变量，可从任意线程直接调用
+     */
+    void setTargetSize(const QSize &size);
 };
 
 
@@ -20,6 +20,7 @@
 #include "mytextedit.h"
 #include "screen.h"
 #include "WebRTCPuller.h"
+#include "FrameMailbox.h"
 
 
 namespace Ui {
@@ -52,6 +53,7 @@ private:
     Ui::MainWindow *ui;
     quint32 mainip; //主屏幕显示的IP图像
     QTimer* m_displayTimer;
+    QTimer* m_telemetryTimer = nullptr; //定时输出队列遥测
     // --- 采集 ---
     QUEUE_DATA<AVPacketPtr> *m_packetQueue; //采集队列
     Capture* m_VideoCapture = nullptr;
@@ -63,9 +65,10 @@ private:
     ffmpegVideoDecoder *m_videoDecoder; 
     ffmpegEncoder *m_videoEncoder;
     QUEUE_DATA<AVPacketPtr> *m_videoPacketQueue; //采集队列
-    QUEUE_DATA<std::unique_ptr<QImage> > *m_SmallQimageQueue; //晓萍显示队列
+    ImageMailbox *m_localImageMailbox; //小屏显示信箱（本地预览）
     QUEUE_DATA<AVFramePtr> *m_videoFrameQueue; //网络传输帧队列
-	QUEUE_DATA<std::unique_ptr<QImage> >* m_MainQimageQueue; //主显示队列
+	ImageMailbox* m_rtmpImageMailbox; //主显示信箱（RTMP 拉流）
+	ImageMailbox* m_webrtcImageMailbox; //主显示信箱（WebRTC 拉流）
 
 
     // --- 音频处理链 ---
@@ -104,6 +107,7 @@ private:
     bool m_audioEncoderReady = false;
 
     bool m_isRtmpPublishRequested = false;
+    bool m_rtmpPublishStarted = false; // RTMP 推流用过编码器上下文后不再允许编码器换档
     bool m_isWebRtcPublishRequested = false;
 
 private slots:
@@ -114,8 +118,6 @@ private slots:
 	void on_LiveStreamingBtn_clicked();
 	void on_joinmeetBtn_clicked();
 
-    void onNewLocalFrameAvailable();
-    void onNewRemoteFrameAvailable();
     void videoEncoderReady();
     void audioEncoderReady();
 
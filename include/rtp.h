@@ -27,8 +27,13 @@
 #define RTP_H_a657e19c_e611_413c_86c1_e2263a9d1b07
 
 #include <cstring>
+#include <memory>
 #include "stdinc.h"
 
+extern "C" {
+#include <libavutil/buffer.h>
+}
+
 // from RFC 3550, fixed headers for RTP.  This should be all
 //  that we need to reference from our perspective
 /*
@@ -104,6 +109,89 @@ typedef struct {
 #pragma pack(pop)
 
 
+/******************************************************************************
+*   Locates the payload of a raw RTP packet, skipping the CSRC list and the
+*   header extension (X bit) and removing trailing padding (P bit).
+*
+*   Returns the payload offset, or 0 if the packet is malformed.  On success
+*   payload_len receives the payload size (may be 0 for padding-only packets).
+******************************************************************************/
+inline size_t rtp_payload_offset(const uint8 *p, size_t len, size_t *payload_len)
+{
+    if (!p || len < RTP_HEADER_LENGTH || (p[0] >> 6) != RTP_VERSION) {
+        return 0;
+    }
+    size_t offset = RTP_HEADER_LENGTH + (p[0] & 0x0F) * 4;
+    if (p[0] & 0x10) {
+        if (offset + 4 > len) {
+            return 0;
+        }
+        size_t ext_words = (static_cast<size_t>(p[offset + 2]) << 8) | p[offset + 3];
+        offset += 4 + ext_words * 4;
+    }
+    if (offset > len) {
+        return 0;
+    }
+    size_t end = len;
+    if (p[0] & 0x20) {
+        uint8 padding = p[len - 1];
+        if (padding == 0 || padding > len - offset) {
+            return 0;
+        }
+        end -= padding;
+    }
+    if (payload_len) {
+        *payload_len = end - offset;
+    }
+    return offset;
+}
+
+inline bool rtp_marker(const uint8 *p)      { return (p[1] & 0x80) != 0; }
+inline uint8 rtp_payload_type(const uint8 *p) { return p[1] & 0x7F; }
+inline uint16 rtp_sequence(const uint8 *p)  { return static_cast<uint16>((p[2] << 8) | p[3]); }
+inline uint32 rtp_timestamp(const uint8 *p)
+{
+    return (static_cast<uint32>(p[4]) << 24) | (static_cast<uint32>(p[5]) << 16)
+         | (static_cast<uint32>(p[6]) << 8) | p[7];
+}
+inline uint32 rtp_ssrc(const uint8 *p)
+{
+    return (static_cast<uint32>(p[8]) << 24) | (static_cast<uint32>(p[9]) << 16)
+         | (static_cast<uint32>(p[10]) << 8) | p[11];
+}
+
+// RFC 5761 section 4: with RTP and RTCP on one port, the second byte of an
+//  RTCP packet (its packet type) falls in 192..223, i.e. "payload type" 64..95.
+inline bool rtp_is_rtcp(const uint8 *p, size_t len)
+{
+    return (len >= 2) && (p[1] >= 192) && (p[1] <= 223);
+}
+
+inline uint8 rtcp_count(const uint8 *p)       { return p[0] & 0x1F; }   // RC / FMT
+inline uint8 rtcp_packet_type(const uint8 *p) { return p[1]; }
+
+/******************************************************************************
+*   Walks a compound RTCP packet (RFC 3550 section 6.1) and calls
+*   visit(packet, packet_len) for every packet in it; packet_len includes the
+*   4-byte common header.  Stops at the first packet with a bad version or a
+*   length field running past the end.  Visitors check their own minimum size.
+******************************************************************************/
+template <typename Visitor>
+inline void rtcp_for_each(const uint8 *p, size_t len, Visitor &&visit)
+{
+    size_t offset = 0;
+    while (offset + 4 <= len) {
+        const uint8 *rtcp = p + offset;
+        size_t packet_len = ((static_cast<size_t>(rtcp[2]) << 8 | rtcp[3]) + 1) * 4;
+        if ((rtcp[0] >> 6) != RTP_VERSION || offset + packet_len > len) {
+            break;
+        }
+        visit(rtcp, packet_len);
+        offset += packet_len;
+    }
+}
+
+
 
 class RTPPacket
 {
@@ -115,8 +203,12 @@ public:
     uint8   payload_type;
     uint16  payload_bytes;
     bool    use_redundant_payload;
+    AVBufferRef *buf;                   // non-null when pData lives in a pooled, refcounted buffer
+    int64   ext_timestamp;              // RTP timestamp unwrapped to 64 bits by the jitter buffer
+    int64   ext_sequence;               // RTP sequence unwrapped to 64 bits by the jitter buffer
+    bool    retransmitted;              // unwrapped from an RTX packet -- not a delay sample
 
-    RTPPacket(uint8 *pIn, short nInLen) : pData(NULL), nLen(nInLen)
+    RTPPacket(uint8 *pIn, short nInLen) : pData(NULL), nLen(nInLen), buf(NULL), ext_timestamp(0), ext_sequence(0), retransmitted(false)
     {
         payload_ms = 0;
         payload_type = RTP_PAYLOAD_G711U;
@@ -129,7 +221,27 @@ public:
             };
         }
     }
-    ~RTPPacket() { if (pData) delete[] pData; };
+
+    // takes ownership of one reference to pIn (e.g. from RtpPacketPool), no copy
+    RTPPacket(AVBufferRef *pIn, uint16 nInLen) : pData(pIn ? pIn->data : NULL), nLen(nInLen), buf(pIn), ext_timestamp(0), ext_sequence(0), retransmitted(false)
+    {
+        payload_ms = 0;
+        payload_type = RTP_PAYLOAD_G711U;
+        payload_bytes = 0;
+        use_redundant_payload = false;
+    }
+
+    RTPPacket(const RTPPacket &) = delete;
+    RTPPacket &operator=(const RTPPacket &) = delete;
+
+    ~RTPPacket()
+    {
+        if (buf) {
+            av_buffer_unref(&buf);
+        } else if (pData) {
+            delete[] pData;
+        }
+    };
 };
 
 typedef std::shared_ptr<RTPPacket>  rawrtp_ptr;
@@ -25,13 +25,30 @@
 #ifndef RTP_JITTER_H_cc8e302e_b008_4588_a29a_79a9f555804d
 #define RTP_JITTER_H_cc8e302e_b008_4588_a29a_79a9f555804d
 
-#include <deque>
+#include <atomic>
 #include <memory>
 #include "stdinc.h"
 #include "rtp.h"
 
 
-
+/******************************************************************************
+*   Threading model: exactly one producer thread calls push() (the network
+*   callback) and exactly one consumer thread calls pop()/next_due() (the
+*   playout scheduler).  The two sides share nothing but atomics:
+*
+*   - packets live in a fixed ring of RING_CAPACITY slots indexed by the
+*     extended (unwrapped) sequence number, so insert, lookup and loss
+*     detection are O(1) and 16-bit wraparound is handled by the unwrap.
+*   - each slot carries a tag (ext sequence + 1, 0 = empty).  Whoever wants
+*     to touch the packet in a slot first swaps the tag to SLOT_BUSY, so a
+*     producer recycling a stale slot can never race the consumer taking it.
+*   - the playout clock (base transit, nominal depth) is written by the
+*     producer and read by the consumer through atomics.
+*
+*   Configuration calls (init, reset, set_depth, set_adaptive, eot_detected)
+*   must be made while neither side is running.  Statistics and depth
+*   accessors may be called from any thread.
+******************************************************************************/
 class RTPJitter
 {
 public:
@@ -57,43 +74,114 @@ public:
     int     get_depth();
     int     get_depth_ms();
     int     get_nominal_depth();
-    bool    buffering()         { return _buffering; }
+    bool    buffering()         { return _buffering.load(std::memory_order_relaxed); }
     void    eot_detected();
 
+    // - playout clock: a packet is due at (rtp time + base transit + nominal depth)
+    timepoint next_due();                           // consumer: due time of the next packet, timepoint::max() if empty
+    timepoint due_time(const rawrtp_ptr& packet);   // either side, for a packet it owns
+
+    // - loss wait: with retransmission, a gap is held open until ms after the
+    //  packet behind it arrived (expected ~1.25 x RTT) rather than just until
+    //  that packet is due.  Safe to update from the producer while running.
+    void    set_loss_wait(const unsigned ms)    { _loss_wait_ms.store(ms, std::memory_order_relaxed); }
+    uint64  read_sequence()                     { return _read_seq.load(std::memory_order_acquire); }
+
+    // - adaptive depth: the nominal depth follows the given percentile of the
+    //  relative delay histogram, clamped to [min_ms, max_ms].  It grows quickly
+    //  and shrinks slowly; every step is also booked as time-stretch work for
+    //  the audio renderer (positive = play slower, negative = play faster).
+    void    set_adaptive(bool enable, const unsigned min_ms = 20, const unsigned max_ms = 150, const double percentile = 0.95);
+    bool    adaptive()          { return _adaptive; }
+    int     get_target_depth();
+    int     take_time_stretch_us(const int max_us);
+
     // - statistics retrieval
-    int overflow_count()        { return _stats.overflow_count; }
-    int out_of_order_count()    { return _stats.ooo_count; }
-    int empty_count()           { return _stats.empty_count; }
-    uint32 jitter()             { return (uint32)_stats.jitter; }
-    uint32 max_jitter()         { return (uint32)_stats.max_jitter; }
+    int overflow_count()        { return _stats.overflow_count.load(std::memory_order_relaxed); }
+    int out_of_order_count()    { return _stats.ooo_count.load(std::memory_order_relaxed); }
+    int empty_count()           { return _stats.empty_count.load(std::memory_order_relaxed); }
+    int lost_count()            { return _stats.lost_count.load(std::memory_order_relaxed); }
+    uint32 jitter()             { return _stats.jitter_out.load(std::memory_order_relaxed); }
+    uint32 max_jitter()         { return _stats.max_jitter_out.load(std::memory_order_relaxed); }
 
 private:
-    static const int DEFAULT_BUFFER_ELEMENTS = 18;  // 360ms given 20ms packets
-    static const int DEFAULT_MS_PER_PACKET   = 20;
-
-    // TODO: there should be no need for a recursive mutex unless there
-    //  is a possibility of a single thread calling one function from
-    //  another where it will attempt to get the lock twice, but I don't
-    //  think such a case exists.  Certainly there are probably 2 threads
-    //  accessing an instance of this class i.e. packets are pushed in
-    //  from a socket thread and popped off by an application thread.
-    std::recursive_mutex    _mutex;
-    std::deque<rawrtp_ptr>  _buffer;
-    unsigned                _nominal_depth_ms;      // requested buffer depth - may dynamically adjust
-    int                     _max_buffer_depth;      // as measured in milliseconds
+    static constexpr int    RING_CAPACITY = 2048;           // power of 2; ~40s of 20ms audio, ~1.5s of 10Mbps video
+    static constexpr int    RING_MASK = RING_CAPACITY - 1;
+    static constexpr uint64 SLOT_EMPTY = 0;
+    static constexpr uint64 SLOT_BUSY = UINT64_MAX;
+
+    struct slot {
+        std::atomic<uint64> tag;            // ext sequence + 1, SLOT_EMPTY or SLOT_BUSY
+        std::atomic<int64>  media_us;       // media time of the packet, valid while tag is
+        rawrtp_ptr          packet;         // only touched by the side holding SLOT_BUSY
+    };
+
+    std::unique_ptr<slot[]> _ring;
     unsigned                _payload_sample_rate;   // rate of audio in packet payloads
-    unsigned                _depth_ms;              // actual current buffer depth
-    uint16                  _first_buf_sequence;    // at head of buffer (next to be popped)
-    uint16                  _last_buf_sequence;     // at tail of buffer (most recent arrival)
-    uint16                  _last_pop_sequence;
-    bool                    _buffering;             // while buffering, don't pop packets
+    int                     _max_buffer_depth;      // as measured in milliseconds
+    std::atomic<unsigned>   _nominal_depth_ms;      // requested buffer depth - may dynamically adjust
+    std::atomic<int>        _depth_ms;              // actual current buffer depth
+    std::atomic<int>        _depth_packets;
+    std::atomic<bool>       _buffering;             // no packet has been due since the buffer ran dry
+    std::atomic<unsigned>   _loss_wait_ms;          // minimum time a gap is held open, 0 = until due
+
+    // sequence state.  _read_seq is owned by the consumer (next sequence to
+    //  hand out); _highest_seq by the producer (newest sequence stored).
+    //  _have_sequence publishes both for the first time.
+    std::atomic<bool>       _have_sequence;
+    std::atomic<uint64>     _read_seq;
+    std::atomic<uint64>     _highest_seq;
+
+    // gap tracking.  While the packet at _read_seq is missing, every sequence
+    //  in (_read_seq, _gap_scan_end) is known to be empty, so the search for
+    //  the packet behind the gap resumes at _gap_scan_end instead of rescanning
+    //  the ring.  The producer reports out of order stores through _gap_arrival
+    //  (lowest one since the consumer last looked, UINT64_MAX = none), which is
+    //  the only way a slot inside that range can fill up again.
+    std::atomic<uint64>     _gap_arrival;
+    uint64                  _gap_scan_end;          // consumer only
+
+    // playout clock state.  "transit" is arrival time minus media time, both in
+    //  microseconds; the smallest transit seen recently is the base mapping from
+    //  RTP time to local time (the least delayed packet).
+    static constexpr int PLAYOUT_WINDOW_MS = 5000;
+    bool                    _have_timestamp;
+    uint32                  _last_rtp_timestamp;
+    int64                   _last_ext_timestamp;
+    timepoint               _epoch;
+    int64                   _window_min_transit_us;
+    int64                   _prev_window_min_transit_us;
+    timepoint               _window_start;
+    std::atomic<int64>      _base_transit_us;       // min of the two windows, INT64_MAX until known
 
-    timepoint              _buffering_timestamp;   // the time we start buffering
+    // adaptive depth state (producer side).  The histogram holds the delay of
+    //  each packet relative to the fastest one (transit - base transit) in 5ms
+    //  bins, with exponential forgetting so it follows the current link.
+    static constexpr int    DELAY_BIN_MS = 5;
+    static constexpr int    DELAY_BINS = 100;               // 0 .. 500ms
+    static constexpr int    ADAPT_WARMUP_PACKETS = 50;
+    static constexpr double DELAY_FORGET_FACTOR = 0.998;    // ~500 packet memory
+    static constexpr int    GROW_STEP_MS = 5;               // per packet
+    static constexpr int    SHRINK_INTERVAL_MS = 50;        // 1ms per interval = 2% speed-up
+    static constexpr int    MAX_STRETCH_DEBT_US = 500000;
+    bool                    _adaptive;
+    unsigned                _adaptive_min_ms;
+    unsigned                _adaptive_max_ms;
+    double                  _adaptive_percentile;
+    double                  _delay_hist[DELAY_BINS];
+    double                  _delay_hist_total;
+    uint32                  _delay_samples;
+    std::atomic<unsigned>   _target_depth_ms;
+    timepoint               _last_shrink;
+    std::atomic<int64>      _stretch_debt_us;
 
     struct stats {
-        uint32      ooo_count;          // count of out of order packets
-        uint32      empty_count;        // how many times was buffer empty
-        uint32      overflow_count;     //
+        std::atomic<uint32> ooo_count;          // count of out of order packets
+        std::atomic<uint32> empty_count;        // how many times was buffer empty
+        std::atomic<uint32> overflow_count;     // packets discarded to bound the depth
+        std::atomic<uint32> lost_count;         // sequence numbers skipped by pop
+        std::atomic<uint32> jitter_out;         // published copies of the producer's estimate
+        std::atomic<uint32> max_jitter_out;
         double      jitter;
         double      max_jitter;
         uint32      prev_arrival;
@@ -102,12 +190,25 @@ private:
         int         conversion_factor_timestamp_units;
     } _stats;
 
+    uint64      _unwrap_sequence(uint16 sequence);
+    bool        _claim(slot &s, uint64 expected_tag);
+    bool        _store(slot &s, rawrtp_ptr &p, uint64 ext_seq);
+    void        _skip_to(uint64 from, uint64 to);
+    void        _note_arrival(uint64 ext_seq);
+    uint64      _first_stored_after(uint64 read_seq, uint64 highest, int64 &media_us);
+    bool        _peek_media_us(uint64 ext_seq, int64 &media_us);
+    timepoint   _due_time_us(int64 media_us);
+    timepoint   _gap_deadline_us(int64 media_us);
     void        _calc_jitter(RTPHeader *rtp);
     void        _clean_buffer();
     uint8       _get_payload_type(RTPHeader *packet);
     uint8      *_get_payload(RTPHeader *packet);
     void        _log(std::string s);
     void        _reset_buffer_stats(const uint32 sample_rate);
+    void        _update_playout_base(RTPPacket *p, RTPHeader *rtp, timepoint arrival);
+    void        _reset_adaptive();
+    void        _update_target_depth(int64 relative_delay_us, timepoint arrival);
+    void        _add_stretch_debt(int64 us);
 };
 
 #endif  // RTP_JITTER_H_cc8e302e_b008_4588_a29a_79a9f555804d
@@ -39,6 +39,8 @@ AudioPlayer::~AudioPlayer() {
 
 bool AudioPlayer::init(AVCodecParameters* params, AVRational inputTimeBase) {
     if (!params) return false;
+    // 换流时会重新 init，解码线程还在用旧的解码器和重采样器，先停下，调用方随后 startPlaying
+    stopPlaying();
 
     const AVCodec* codec = avcodec_find_decoder(params->codec_id);
     if (!codec) {
@@ -78,8 +80,10 @@ bool AudioPlayer::init(AVCodecParameters* params, AVRational inputTimeBase) {
         return false;
     }
 
+    std::unique_lock<std::mutex> fifoLock(m_fifoMutex);
     if (m_fifo) av_audio_fifo_free(m_fifo);
     m_fifo = av_audio_fifo_alloc(m_ResampleConfig.sample_fmt, m_ResampleConfig.ch_layout.nb_channels, 1);
+    fifoLock.unlock();
     if (!m_fifo) {
         emit errorOccurred("Failed to allocate audio FIFO in init.");
         return false;
@@ -145,8 +149,33 @@ QAudioDevice AudioPlayer::findDeviceByName(const QString& name) {
     return QMediaDevices::defaultAudioOutput();
 }
 
+void AudioPlayer::setTimeStretchProvider(TimeStretchProvider provider) {
+    std::lock_guard<std::mutex> lock(m_stretchMutex);
+    m_timeStretchProvider = std::move(provider);
+}
+
+// 抖动缓冲目标深度每变化 1ms，后续包的到期时间都整体平移 1ms；
+// 这里用 swr 的采样补偿把这段时间在本帧内均匀地拉长/压缩掉，避免断音或堆积
+void AudioPlayer::applyTimeStretch(const AVFrame* frame) {
+    if (!m_swrCtx || frame->nb_samples <= 0 || frame->sample_rate <= 0) return;
+    int stretchUs = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_stretchMutex);
+        if (!m_timeStretchProvider) return;
+        const int64_t frameUs = av_rescale(frame->nb_samples, 1000000, frame->sample_rate);
+        stretchUs = m_timeStretchProvider(static_cast<int>(frameUs * MAX_STRETCH_PERMILLE / 1000));
+    }
+    if (stretchUs == 0) return;
+
+    const int outSamples = static_cast<int>(av_rescale(frame->nb_samples, m_ResampleConfig.sample_rate, frame->sample_rate));
+    const int sampleDelta = static_cast<int>(av_rescale(stretchUs, m_ResampleConfig.sample_rate, 1000000));
+    if (sampleDelta == 0 || outSamples <= 0) return;
+    if (swr_set_compensation(m_swrCtx, sampleDelta, outSamples) < 0) {
+        WRITE_LOG("AudioPlayer: swr_set_compensation failed (delta=%d)", sampleDelta);
+    }
+}
+
 void AudioPlayer::ChangeDecodingState(bool isDecoding) {
-    m_isDecoding = isDecoding;
     if (isDecoding) {
         startPlaying();
     }
@@ -156,62 +185,36 @@ void AudioPlayer::ChangeDecodingState(bool isDecoding) {
 }
 
 void AudioPlayer::startPlaying() {
-    QMetaObject::invokeMethod(this, "doDecodingWork", Qt::QueuedConnection);
-    WRITE_LOG("AudioPlayer: Decoding process started.");
-}
-//TODO: 如何用线程变量巧妙处理暂停呢？
-void AudioPlayer::stopPlaying() {
-    {
-        QMutexLocker locker(&m_workMutex);
-        while (m_isDoingWork) {
-            m_workCond.wait(&m_workMutex);
-        }
-    }
-    WRITE_LOG("AudioPlayer: Decoding process stopped.");
-}
-
-void AudioPlayer::doDecodingWork() {
-    if (!m_isDecoding) {
-        WRITE_LOG("AudioPlayer: Decoding process stopped.");
+    if (!m_codecCtx) {
+        WRITE_LOG("AudioPlayer: Decoder not initialized, cannot start playing.");
         return;
     }
-
-    AVPacketPtr packet;
-    if (!m_packetQueue->dequeue(packet)) {
-        if (m_isDecoding) {
-            QMetaObject::invokeMethod(this, "doDecodingWork", Qt::QueuedConnection);
-        }
-        WRITE_LOG("AudioPlayer: Dequeue Packet TimeOut");
-        return;
+    if (m_worker.startConsumer<AVPacketPtr>(m_packetQueue, PipelineWorker::kDefaultBatch,
+                                            [this](AVPacketPtr& packet) { decodePacket(packet.get()); })) {
+        WRITE_LOG("AudioPlayer: Decoding process started.");
     }
+}
 
-    {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = true;
+void AudioPlayer::stopPlaying() {
+    if (!m_worker.isRunning()) {
+        return;
     }
-    auto work_guard = [this]() {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = false;
-        m_workCond.wakeAll();
-    };
+    m_worker.stop();
+    WRITE_LOG("AudioPlayer: Decoding process stopped.");
+}
 
+void AudioPlayer::decodePacket(AVPacket* packet) {
     AVFramePtr decodedFrame(av_frame_alloc());
     AVFramePtr resampledFrame(av_frame_alloc());
     if (!decodedFrame || !resampledFrame) {
         emit errorOccurred("AudioPlayer: Failed to allocate frame");
-        m_isDecoding = false;
-        work_guard();
         return;
     }
     if (packet->size <= 0) {
         WRITE_LOG("Warning: Received empty audio packet.");
     }
-    if (avcodec_send_packet(m_codecCtx, packet.get()) != 0) {
+    if (avcodec_send_packet(m_codecCtx, packet) != 0) {
         WRITE_LOG("Fail to send packet to decoder");
-        work_guard();
-        if (m_isDecoding) {
-            QMetaObject::invokeMethod(this, "doDecodingWork", Qt::QueuedConnection);
-        }
         return;
     }
     
@@ -234,6 +237,7 @@ void AudioPlayer::doDecodingWork() {
         }
 
         if (m_fifoBasePts == AV_NOPTS_VALUE && decodedFrame->pts != AV_NOPTS_VALUE) {
+            std::lock_guard<std::mutex> lock(m_fifoMutex);
             if (av_audio_fifo_size(m_fifo) == 0) {
                 m_fifoBasePts = decodedFrame->pts;
                 WRITE_LOG("Audio Decoder Base PTS set to: %lld", m_fifoBasePts);
@@ -258,6 +262,8 @@ void AudioPlayer::doDecodingWork() {
             WRITE_LOG("SwrContext initialized with Frame: %d Hz, Fmt: %d", decodedFrame->sample_rate, decodedFrame->format);
         }
 
+        applyTimeStretch(decodedFrame.get());
+
         resampledFrame->ch_layout = m_ResampleConfig.ch_layout;
         resampledFrame->sample_rate = m_ResampleConfig.sample_rate;
         resampledFrame->format = m_ResampleConfig.sample_fmt;
@@ -275,6 +281,7 @@ void AudioPlayer::doDecodingWork() {
         }
 
         if (resampledFrame->nb_samples > 0) {
+            std::lock_guard<std::mutex> lock(m_fifoMutex);
             int written = av_audio_fifo_write(m_fifo, (void**)resampledFrame->data, resampledFrame->nb_samples);
             if (written < resampledFrame->nb_samples) {
                 WRITE_LOG("Warning: FIFO write truncated (Queue full?).");
@@ -312,43 +319,51 @@ void AudioPlayer::doDecodingWork() {
         //}
         av_frame_unref(decodedFrame.get());
         av_frame_unref(resampledFrame.get());
-
-        // 临时缓冲区用于从 FIFO 读数据送给声卡
-     // S16 双声道 = 4 bytes per sample
-        const int bytes_per_sample = 4;
-        while (av_audio_fifo_size(m_fifo) > 0) {
-            int bytesFree = m_audioSink->bytesFree();
-            if (bytesFree < m_ResampleConfig.frame_size * bytes_per_sample) {
-                // 空间不够，跳出循环，等下一次 slice 再来，或者稍作 sleep
-                // 这里选择直接跳出，让 QTimer/EventLoop 调度下一次任务，避免阻塞解码
-                break;
-            }
-            int samples_to_read = std::min(av_audio_fifo_size(m_fifo), m_ResampleConfig.frame_size);
-
-            // 3. 准备缓冲区 (av_audio_fifo_read 需要 void**)
-            // 因为是 S16 Packed 格式，data[0] 就是全部数据
-            void* data_ptr = nullptr;
-            // 简单的栈上数组或者临时 vector，这里用 av_samples_alloc 比较稳妥但慢
-            // 建议类成员变量复用 buffer，这里为了演示逻辑用 malloc
-            int buffer_size = samples_to_read * bytes_per_sample;
-            uint8_t* pBuffer = (uint8_t*)av_malloc(buffer_size);
-
-            if (av_audio_fifo_read(m_fifo, (void**)&pBuffer, samples_to_read) < samples_to_read) {
-                WRITE_LOG("FIFO Read Error");
-            }
-            else {
-                // 4. 写入声卡
-                m_audioIO->write((const char*)pBuffer, buffer_size);
-            }
-            av_free(pBuffer);
-        }
-
     }
 
-    work_guard();
+    // 按函数对象投递，不走按名字查找的元调用；上一次还没执行时不再重复投递
+    if (!m_feedPending.exchange(true)) {
+        QMetaObject::invokeMethod(this, [this]() { feedAudioSink(); }, Qt::QueuedConnection);
+    }
+}
 
-    if (m_isDecoding) {
-        QMetaObject::invokeMethod(this, "doDecodingWork", Qt::QueuedConnection);
+void AudioPlayer::feedAudioSink() {
+    m_feedPending = false;
+    if (!m_audioSink || !m_audioIO) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_fifoMutex);
+    if (!m_fifo) {
+        return;
+    }
+    // 临时缓冲区用于从 FIFO 读数据送给声卡
+ // S16 双声道 = 4 bytes per sample
+    const int bytes_per_sample = 4;
+    while (av_audio_fifo_size(m_fifo) > 0) {
+        int bytesFree = m_audioSink->bytesFree();
+        if (bytesFree < m_ResampleConfig.frame_size * bytes_per_sample) {
+            // 空间不够，跳出循环，等下一次 slice 再来，或者稍作 sleep
+            // 这里选择直接跳出，剩下的等下一个包解出后再写，避免阻塞本线程的事件循环
+            break;
+        }
+        int samples_to_read = std::min(av_audio_fifo_size(m_fifo), m_ResampleConfig.frame_size);
+
+        // 3. 准备缓冲区 (av_audio_fifo_read 需要 void**)
+        // 因为是 S16 Packed 格式，data[0] 就是全部数据
+        void* data_ptr = nullptr;
+        // 简单的栈上数组或者临时 vector，这里用 av_samples_alloc 比较稳妥但慢
+        // 建议类成员变量复用 buffer，这里为了演示逻辑用 malloc
+        int buffer_size = samples_to_read * bytes_per_sample;
+        uint8_t* pBuffer = (uint8_t*)av_malloc(buffer_size);
+
+        if (av_audio_fifo_read(m_fifo, (void**)&pBuffer, samples_to_read) < samples_to_read) {
+            WRITE_LOG("FIFO Read Error");
+        }
+        else {
+            // 4. 写入声卡
+            m_audioIO->write((const char*)pBuffer, buffer_size);
+        }
+        av_free(pBuffer);
     }
 }
 
@@ -0,0 +1,293 @@
+﻿#include "BandwidthEstimator.h"
+#include <algorithm>
+#include <cmath>
+
+BandwidthEstimator::BandwidthEstimator(int startBps, int minBps, int maxBps)
+    : m_minBps(minBps),
+      m_maxBps(std::max(minBps, maxBps)),
+      m_sent(kHistorySize),
+      m_delayBasedBps(startBps),
+      m_lossBasedBps(startBps),
+      m_targetBps(std::min(std::max(startBps, minBps), std::max(minBps, maxBps))) {
+}
+
+void BandwidthEstimator::onPacketSent(uint16_t sequence, size_t size, int64_t sendUs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SentPacket &slot = m_sent[sequence % kHistorySize];
+    slot.sequence = sequence;
+    slot.size = size;
+    slot.sendUs = sendUs;
+}
+
+int BandwidthEstimator::onTransportFeedback(const std::vector<PacketFeedback> &packets, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_feedbacks;
+    m_lastFeedbackUs = nowUs;
+    int received = 0;
+    int lost = 0;
+    for (const PacketFeedback &feedback : packets) {
+        SentPacket &sent = m_sent[feedback.sequence % kHistorySize];
+        if (sent.sequence != feedback.sequence) {
+            continue; // 不是本端记录的包，或者已经确认过（同一个包可能出现在两份反馈里）
+        }
+        if (!feedback.received) {
+            ++lost;
+            continue;
+        }
+        ++received;
+        sent.sequence = -1;
+        updateAckedLocked(feedback.arrivalUs, sent.size);
+        onPacketArrivalLocked(sent.sendUs, feedback.arrivalUs, nowUs);
+    }
+    m_received += received;
+    m_lost += lost;
+    // 一份反馈往往只有几个包，攒够 kMinLossPackets 个再算丢包率，否则一个随机丢包就是几十个百分点
+    m_lossWindowReceived += received;
+    m_lossWindowLost += lost;
+    if (m_lossWindowReceived + m_lossWindowLost >= kMinLossPackets) {
+        updateLossBasedLocked(static_cast<double>(m_lossWindowLost) / (m_lossWindowReceived + m_lossWindowLost),
+                              nowUs);
+        m_lossWindowReceived = 0;
+        m_lossWindowLost = 0;
+    }
+    updateDelayBasedLocked(nowUs);
+    return updateTargetLocked(nowUs);
+}
+
+int BandwidthEstimator::onReceiverReport(double fractionLost, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    updateLossBasedLocked(fractionLost, nowUs);
+    return updateTargetLocked(nowUs);
+}
+
+int BandwidthEstimator::onRemb(int64_t bitrateBps, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rembBps = static_cast<double>(bitrateBps);
+    m_lastRembUs = nowUs;
+    return updateTargetLocked(nowUs);
+}
+
+int BandwidthEstimator::targetBitrate() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_targetBps;
+}
+
+void BandwidthEstimator::onPacketArrivalLocked(int64_t sendUs, int64_t arrivalUs, int64_t nowUs) {
+    if (m_currentGroup.firstSendUs < 0) {
+        m_currentGroup = PacketGroup{sendUs, sendUs, arrivalUs};
+        return;
+    }
+    if (sendUs < m_currentGroup.firstSendUs) {
+        return; // 乱序到达的旧包，不参与时延梯度
+    }
+    if (sendUs - m_currentGroup.firstSendUs <= kBurstUs) {
+        m_currentGroup.lastSendUs = std::max(m_currentGroup.lastSendUs, sendUs);
+        m_currentGroup.lastArrivalUs = std::max(m_currentGroup.lastArrivalUs, arrivalUs);
+        return;
+    }
+    // 新的一组开始，上一组已完整，比较相邻两组
+    if (m_previousGroup.firstSendUs >= 0) {
+        const int64_t sendDeltaUs = m_currentGroup.lastSendUs - m_previousGroup.lastSendUs;
+        const int64_t arrivalDeltaUs = m_currentGroup.lastArrivalUs - m_previousGroup.lastArrivalUs;
+        if (arrivalDeltaUs >= 0) {
+            updateTrendLocked((arrivalDeltaUs - sendDeltaUs) / 1000.0, sendDeltaUs / 1000.0,
+                              m_currentGroup.lastArrivalUs, nowUs);
+        }
+    }
+    m_previousGroup = m_currentGroup;
+    m_currentGroup = PacketGroup{sendUs, sendUs, arrivalUs};
+}
+
+void BandwidthEstimator::updateTrendLocked(double delayDeltaMs, double sendDeltaMs, int64_t arrivalUs,
+                                           int64_t nowUs) {
+    m_numDeltas = std::min(m_numDeltas + 1, 1000);
+    if (m_firstArrivalUs < 0) {
+        m_firstArrivalUs = arrivalUs;
+    }
+    m_accumulatedDelayMs += delayDeltaMs;
+    m_smoothedDelayMs = kTrendSmoothing * m_smoothedDelayMs + (1 - kTrendSmoothing) * m_accumulatedDelayMs;
+    m_trendSamples.emplace_back((arrivalUs - m_firstArrivalUs) / 1000.0, m_smoothedDelayMs);
+    if (static_cast<int>(m_trendSamples.size()) > kTrendWindow) {
+        m_trendSamples.pop_front();
+    }
+
+    // 窗口满了才做线性回归，斜率即排队时延的增长速度
+    double trend = m_prevTrend;
+    if (static_cast<int>(m_trendSamples.size()) == kTrendWindow) {
+        double meanX = 0;
+        double meanY = 0;
+        for (const auto &sample : m_trendSamples) {
+            meanX += sample.first;
+            meanY += sample.second;
+        }
+        meanX /= kTrendWindow;
+        meanY /= kTrendWindow;
+        double numerator = 0;
+        double denominator = 0;
+        for (const auto &sample : m_trendSamples) {
+            numerator += (sample.first - meanX) * (sample.second - meanY);
+            denominator += (sample.first - meanX) * (sample.first - meanX);
+        }
+        if (denominator != 0) {
+            trend = numerator / denominator;
+        }
+    }
+    m_trend = trend;
+    detectLocked(trend, sendDeltaMs, nowUs);
+}
+
+void BandwidthEstimator::detectLocked(double trend, double sendDeltaMs, int64_t nowUs) {
+    if (m_numDeltas < 2) {
+        m_usage = Usage::Normal;
+        return;
+    }
+    m_modifiedTrend = std::min(m_numDeltas, 60) * trend * kTrendGain;
+    if (m_modifiedTrend > m_thresholdMs) {
+        m_timeOverUsingMs = m_timeOverUsingMs < 0 ? sendDeltaMs / 2 : m_timeOverUsingMs + sendDeltaMs;
+        ++m_overuseCounter;
+        // 持续 10ms 以上且还在变坏才算过载，单个突发不触发
+        if (m_timeOverUsingMs > 10 && m_overuseCounter > 1 && trend >= m_prevTrend) {
+            m_timeOverUsingMs = 0;
+            m_overuseCounter = 0;
+            m_usage = Usage::Overusing;
+        }
+    } else if (m_modifiedTrend < -m_thresholdMs) {
+        m_timeOverUsingMs = -1;
+        m_overuseCounter = 0;
+        m_usage = Usage::Underusing;
+    } else {
+        m_timeOverUsingMs = -1;
+        m_overuseCounter = 0;
+        m_usage = Usage::Normal;
+    }
+    m_prevTrend = trend;
+    updateThresholdLocked(m_modifiedTrend, nowUs);
+}
+
+void BandwidthEstimator::updateThresholdLocked(double modifiedTrend, int64_t nowUs) {
+    if (m_lastThresholdUpdateUs < 0) {
+        m_lastThresholdUpdateUs = nowUs;
+    }
+    const double magnitude = std::fabs(modifiedTrend);
+    // 突变（如路由切换）不拿来调阈值
+    if (magnitude > m_thresholdMs + 15) {
+        m_lastThresholdUpdateUs = nowUs;
+        return;
+    }
+    // 阈值跟随趋势：下降快、上升慢，和 TCP 等基于丢包的流竞争时不会被饿死
+    const double k = magnitude < m_thresholdMs ? 0.039 : 0.0087;
+    const double dtMs = std::min((nowUs - m_lastThresholdUpdateUs) / 1000.0, 100.0);
+    m_thresholdMs += k * (magnitude - m_thresholdMs) * dtMs;
+    m_thresholdMs = std::min(std::max(m_thresholdMs, 6.0), 600.0);
+    m_lastThresholdUpdateUs = nowUs;
+}
+
+void BandwidthEstimator::updateAckedLocked(int64_t arrivalUs, size_t size) {
+    m_ackedWindow.emplace_back(arrivalUs, size);
+    m_ackedWindowBytes += size;
+    while (m_ackedWindow.size() > 1 && arrivalUs - m_ackedWindow.front().first > kAckedWindowUs) {
+        m_ackedWindowBytes -= m_ackedWindow.front().second;
+        m_ackedWindow.pop_front();
+    }
+    const int64_t spanUs = m_ackedWindow.back().first - m_ackedWindow.front().first;
+    if (spanUs >= kAckedWindowUs / 5) {
+        m_ackedBps = m_ackedWindowBytes * 8.0 * 1e6 / spanUs;
+    }
+}
+
+void BandwidthEstimator::updateDelayBasedLocked(int64_t nowUs) {
+    const int64_t dtUs = m_lastRateUpdateUs < 0 ? 0 : std::min<int64_t>(nowUs - m_lastRateUpdateUs, 1000000);
+    m_lastRateUpdateUs = nowUs;
+
+    switch (m_usage) {
+    case Usage::Overusing:
+        if (m_lastDecreaseUs < 0 || nowUs - m_lastDecreaseUs >= kMinDecreaseIntervalUs) {
+            const double decreased = 0.85 * (m_ackedBps > 0 ? m_ackedBps : m_delayBasedBps);
+            if (decreased < m_delayBasedBps) {
+                m_delayBasedBps = decreased;
+            }
+            if (m_ackedBps > 0) {
+                m_linkCapacityBps = m_linkCapacityBps > 0 ? 0.95 * m_linkCapacityBps + 0.05 * m_ackedBps : m_ackedBps;
+            }
+            m_lastDecreaseUs = nowUs;
+            ++m_overuses;
+        }
+        m_rateState = RateState::Hold;
+        break;
+    case Usage::Underusing:
+        // 队列正在排空，等它排完再加速
+        m_rateState = RateState::Hold;
+        break;
+    case Usage::Normal:
+        if (m_rateState == RateState::Hold) {
+            m_rateState = RateState::Increase;
+        } else if (m_ackedBps > 0 && m_delayBasedBps > 1.5 * m_ackedBps + 10000) {
+            // 实际发出的远低于估计（编码器没用满），估计不再往上涨
+        } else {
+            if (m_linkCapacityBps > 0 && m_ackedBps > 1.5 * m_linkCapacityBps) {
+                m_linkCapacityBps = 0; // 链路容量变大了，重新用乘性增长去找
+            }
+            const double dtSeconds = dtUs / 1e6;
+            if (m_linkCapacityBps > 0 && m_delayBasedBps > 0.9 * m_linkCapacityBps) {
+                // 接近上次过载点：每个响应时间（约 RTT + 100ms）加一个包
+                constexpr double kResponseTimeMs = 200;
+                const double perSecond = std::max(1000.0, 1200 * 8 * 1000 / kResponseTimeMs);
+                m_delayBasedBps += perSecond * dtSeconds;
+            } else {
+                m_delayBasedBps *= std::pow(1.08, dtSeconds);
+            }
+        }
+        break;
+    }
+    m_delayBasedBps = std::min(std::max(m_delayBasedBps, static_cast<double>(m_minBps)), static_cast<double>(m_maxBps));
+}
+
+void BandwidthEstimator::updateLossBasedLocked(double lossFraction, int64_t nowUs) {
+    m_lastLossFraction = lossFraction;
+    if (lossFraction < 0.02) {
+        if (m_lastLossIncreaseUs < 0 || nowUs - m_lastLossIncreaseUs >= kLossIncreaseIntervalUs) {
+            // 以当前目标为基准上调，丢包估计不会跑到远高于实际发送的地方
+            m_lossBasedBps = std::max(m_lossBasedBps, m_targetBps * 1.08 + 1000);
+            m_lastLossIncreaseUs = nowUs;
+        }
+    } else if (lossFraction > 0.1) {
+        if (m_lastLossDecreaseUs < 0 || nowUs - m_lastLossDecreaseUs >= kLossDecreaseIntervalUs) {
+            m_lossBasedBps = m_targetBps * (1 - 0.5 * lossFraction);
+            m_lastLossDecreaseUs = nowUs;
+        }
+    }
+    m_lossBasedBps = std::min(std::max(m_lossBasedBps, static_cast<double>(m_minBps)), static_cast<double>(m_maxBps));
+}
+
+int BandwidthEstimator::updateTargetLocked(int64_t nowUs) {
+    double target = m_lossBasedBps;
+    // 对端不支持 TWCC（或反馈中断）时只按丢包和 REMB 估计
+    if (m_lastFeedbackUs >= 0 && nowUs - m_lastFeedbackUs <= kFeedbackTimeoutUs) {
+        target = std::min(target, m_delayBasedBps);
+    }
+    if (m_lastRembUs >= 0 && nowUs - m_lastRembUs <= kRembTimeoutUs && m_rembBps > 0) {
+        target = std::min(target, m_rembBps);
+    }
+    m_targetBps = static_cast<int>(std::min(std::max(target, static_cast<double>(m_minBps)), static_cast<double>(m_maxBps)));
+    return m_targetBps;
+}
+
+QJsonObject BandwidthEstimator::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QJsonObject obj;
+    obj["targetKbps"] = m_targetBps / 1000;
+    obj["delayBasedKbps"] = static_cast<int>(m_delayBasedBps / 1000);
+    obj["lossBasedKbps"] = static_cast<int>(m_lossBasedBps / 1000);
+    obj["ackedKbps"] = static_cast<int>(m_ackedBps / 1000);
+    obj["rembKbps"] = static_cast<int>(m_rembBps / 1000);
+    obj["linkCapacityKbps"] = static_cast<int>(m_linkCapacityBps / 1000);
+    obj["usage"] = m_usage == Usage::Overusing ? "overusing" : (m_usage == Usage::Underusing ? "underusing" : "normal");
+    obj["trend"] = m_modifiedTrend;
+    obj["thresholdMs"] = m_thresholdMs;
+    obj["lossFraction"] = m_lastLossFraction;
+    obj["feedbacks"] = static_cast<qint64>(m_feedbacks);
+    obj["overuses"] = static_cast<qint64>(m_overuses);
+    obj["received"] = static_cast<qint64>(m_received);
+    obj["lost"] = static_cast<qint64>(m_lost);
+    return obj;
+}
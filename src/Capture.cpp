@@ -30,14 +30,81 @@ void Capture::openAudio(const QString& audioDeviceName) {
         WRITE_LOG("Audio device already open.");
         return;
     }
+    const bool opened = SyntheticSource::isSourceSpec(audioDeviceName)
+                            ? openAudioSynthetic(audioDeviceName)
+                            : openAudioNative(audioDeviceName) || openAudioDemuxer(audioDeviceName);
+    if (!opened) {
+        return;
+    }
+
+    m_audioDeviceName = audioDeviceName;
+    m_isAudioOpen = true;
+    m_audioStartTime = av_gettime();
+    WRITE_LOG("Audio device opened successfully.Audio stream Index:", m_audioStreamIndex);
+
+    startAudioReading();
+    emit audioDeviceOpenSuccessfully(m_aParams, m_aTimeBase);
+}
+
+void Capture::setAudioPeriodFrames(int frames) {
+    m_audioPeriodFrames = frames > 0 ? frames : AlsaCapture::kDefaultPeriodFrames;
+}
+
+void Capture::setMaxSpeed(bool enabled) {
+    m_maxSpeed = enabled;
+}
+
+bool Capture::openAudioSynthetic(const QString &spec) {
+    auto source = std::make_unique<SyntheticSource>();
+    QString error;
+    const auto pacing = m_maxSpeed ? SyntheticSource::Pacing::MaxSpeed : SyntheticSource::Pacing::RealTime;
+    if (!source->open(spec, AVMEDIA_TYPE_AUDIO, 0, 0, 0, pacing, error)) {
+        emit errorOccurred(error);
+        return false;
+    }
+    m_aParams = avcodec_parameters_alloc();
+    avcodec_parameters_copy(m_aParams, source->codecParameters());
+    m_aTimeBase = source->timeBase();
+    m_audioStreamIndex = 0;
+    m_audioSource = std::move(source);
+    return true;
+}
+
+bool Capture::openAudioNative(const QString &deviceName) {
+#ifdef Q_OS_LINUX
+    auto alsa = std::make_unique<AlsaCapture>();
+    QString error;
+    if (!alsa->open(AlsaCapture::resolveDevice(deviceName), 48000, 2, m_audioPeriodFrames, error)) {
+        WRITE_LOG("Capture: ALSA backend unavailable (%s), falling back to libavdevice.", error.toStdString().c_str());
+        return false;
+    }
+    m_aParams = avcodec_parameters_alloc();
+    avcodec_parameters_copy(m_aParams, alsa->codecParameters());
+    m_aTimeBase = alsa->timeBase();
+    m_audioStreamIndex = 0;
+    m_alsa = std::move(alsa);
+    return true;
+#else
+    Q_UNUSED(deviceName);
+    return false;
+#endif
+}
+
+bool Capture::openAudioDemuxer(const QString &deviceName) {
+#ifdef Q_OS_LINUX
+    const AVInputFormat* inputFormat = av_find_input_format("alsa");
+    QString deviceUrl = AlsaCapture::resolveDevice(deviceName);
+#else
     const AVInputFormat* inputFormat = av_find_input_format("dshow");
+    QString deviceUrl = QString("audio=%1").arg(deviceName);
+#endif
     AVDictionary* options = nullptr;
-    QString deviceUrl = QString("audio=%1").arg(audioDeviceName);
     av_dict_set(&options, "rtbufsize", "10000000", 0);
 
     if (!inputFormat) {
+        av_dict_free(&options);
         emit errorOccurred("No inputFormat provided.");
-        return;
+        return false;
     }
 
     m_AudioFormatCtx = avformat_alloc_context();
@@ -50,14 +117,14 @@ void Capture::openAudio(const QString& audioDeviceName) {
         emit errorOccurred(QString("Failed to open audio device: %1").arg(errbuf));
         avformat_close_input(&m_AudioFormatCtx);
         m_AudioFormatCtx = nullptr;
-        return;
+        return false;
     }
 
     if (avformat_find_stream_info(m_AudioFormatCtx, nullptr) < 0) {
         emit errorOccurred("Failed to find audio stream information.");
         avformat_close_input(&m_AudioFormatCtx);
         m_AudioFormatCtx = nullptr;
-        return;
+        return false;
     }
 
     m_audioStreamIndex = av_find_best_stream(m_AudioFormatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
@@ -65,20 +132,13 @@ void Capture::openAudio(const QString& audioDeviceName) {
         emit errorOccurred("Failed to find audio stream in device.");
         avformat_close_input(&m_AudioFormatCtx);
         m_AudioFormatCtx = nullptr;
-        return;
+        return false;
     }
 
     m_aParams = avcodec_parameters_alloc();
     avcodec_parameters_copy(m_aParams, m_AudioFormatCtx->streams[m_audioStreamIndex]->codecpar);
     m_aTimeBase = m_AudioFormatCtx->streams[m_audioStreamIndex]->time_base;
-
-    m_audioDeviceName = audioDeviceName;
-    m_isAudioOpen = true;
-    m_audioStartTime = av_gettime();
-    WRITE_LOG("Audio device opened successfully.Audio stream Index:", m_audioStreamIndex);
-
-    startAudioReading();
-    emit audioDeviceOpenSuccessfully(m_aParams, m_aTimeBase);
+    return true;
 }
 
 void Capture::openVideo(const QString &VideoDeviceName) {
@@ -87,35 +147,83 @@ void Capture::openVideo(const QString &VideoDeviceName) {
         WRITE_LOG("Video device already open.");
         return;
     }
+    const bool opened = SyntheticSource::isSourceSpec(VideoDeviceName)
+                            ? openVideoSynthetic(VideoDeviceName)
+                            : openVideoNative(VideoDeviceName) || openVideoDemuxer(VideoDeviceName);
+    if (!opened) {
+        return;
+    }
+
+    m_videoDeviceName = VideoDeviceName;
+    m_isVideoOpen = true;
+    m_videoStartTime = av_gettime();
+    WRITE_LOG("Video device opened successfully: %s %s %dx%d.", avcodec_get_name(m_vParams->codec_id),
+              m_vParams->codec_id == AV_CODEC_ID_RAWVIDEO
+                  ? av_get_pix_fmt_name(static_cast<AVPixelFormat>(m_vParams->format)) : "",
+              m_vParams->width, m_vParams->height);
+    startVideoReading();
+    emit videoDeviceOpenSuccessfully(m_vParams, m_vTimeBase);
+}
+
+bool Capture::openVideoSynthetic(const QString &spec) {
+    auto source = std::make_unique<SyntheticSource>();
+    QString error;
+    const auto pacing = m_maxSpeed ? SyntheticSource::Pacing::MaxSpeed : SyntheticSource::Pacing::RealTime;
+    if (!source->open(spec, AVMEDIA_TYPE_VIDEO, m_requestedWidth, m_requestedHeight, m_requestedFps, pacing, error)) {
+        emit errorOccurred(error);
+        return false;
+    }
+    m_vParams = avcodec_parameters_alloc();
+    avcodec_parameters_copy(m_vParams, source->codecParameters());
+    m_vTimeBase = source->timeBase();
+    m_videoStreamIndex = 0;
+    m_videoSource = std::move(source);
+    return true;
+}
 
+bool Capture::openVideoNative(const QString &deviceName) {
+#ifdef Q_OS_LINUX
+    auto v4l2 = std::make_unique<V4l2Capture>();
+    QString error;
+    if (!v4l2->open(V4l2Capture::resolveDevice(deviceName), m_requestedWidth, m_requestedHeight, m_requestedFps, error)) {
+        WRITE_LOG("Capture: V4L2 backend unavailable (%s), falling back to libavdevice.", error.toStdString().c_str());
+        return false;
+    }
+    m_vParams = avcodec_parameters_alloc();
+    avcodec_parameters_copy(m_vParams, v4l2->codecParameters());
+    m_vTimeBase = v4l2->timeBase();
+    m_videoStreamIndex = 0;
+    m_v4l2 = std::move(v4l2);
+    return true;
+#else
+    Q_UNUSED(deviceName);
+    return false;
+#endif
+}
+
+bool Capture::openVideoDemuxer(const QString &deviceName) {
+#ifdef Q_OS_LINUX
+    const AVInputFormat* inputFormat = av_find_input_format("v4l2");
+    QString deviceUrl = V4l2Capture::resolveDevice(deviceName);
+#else
     const AVInputFormat* inputFormat = av_find_input_format("dshow");
-    AVDictionary* options = nullptr;
-    QString deviceUrl = QString("video=%1").arg(VideoDeviceName);
-    av_dict_set(&options, "rtbufsize", "10000000", 0);
+    QString deviceUrl = QString("video=%1").arg(deviceName);
+#endif
 
     if (!inputFormat) {
         emit errorOccurred("No inputFormat provided.");
-        return;
+        return false;
     }
 
-    m_VideoFormatCtx = avformat_alloc_context();
-    int ret = avformat_open_input(&m_VideoFormatCtx, deviceUrl.toStdString().c_str(), inputFormat, &options);
-    av_dict_free(&options);
-
-    if (ret < 0) {
-        char errbuf[1024] = { 0 };
-        av_strerror(ret, errbuf, sizeof(errbuf));
-        emit errorOccurred(QString("Failed to open video device: %1").arg(errbuf));
-        avformat_close_input(&m_VideoFormatCtx);
-        m_VideoFormatCtx = nullptr;
-        return;
+    if (!openVideoNegotiated(deviceUrl, inputFormat)) {
+        return false;
     }
 
     if (avformat_find_stream_info(m_VideoFormatCtx, nullptr) < 0) {
         emit errorOccurred("Failed to find video stream information.");
         avformat_close_input(&m_VideoFormatCtx);
         m_VideoFormatCtx = nullptr;
-        return;
+        return false;
     }
 
     m_videoStreamIndex = av_find_best_stream(m_VideoFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
@@ -123,19 +231,90 @@ void Capture::openVideo(const QString &VideoDeviceName) {
         emit errorOccurred("Failed to find video stream in device.");
         avformat_close_input(&m_VideoFormatCtx);
         m_VideoFormatCtx = nullptr;
-        return;
+        return false;
     }
 
     m_vParams = avcodec_parameters_alloc();
-    avcodec_parameters_copy(m_vParams, m_VideoFormatCtx->streams[m_videoStreamIndex]->codecpar);
-    m_vTimeBase = m_VideoFormatCtx->streams[m_videoStreamIndex]->time_base;
+    AVStream *stream = m_VideoFormatCtx->streams[m_videoStreamIndex];
+    avcodec_parameters_copy(m_vParams, stream->codecpar);
+    if (m_vParams->framerate.num <= 0) {
+        m_vParams->framerate = av_guess_frame_rate(m_VideoFormatCtx, stream, nullptr); // 设备协商到的帧率
+    }
+    m_vTimeBase = stream->time_base;
+    return true;
+}
 
-    m_videoDeviceName = VideoDeviceName;
-    m_isVideoOpen = true;
-    m_videoStartTime = av_gettime();
-    WRITE_LOG("Video device opened successfully.");
-    startVideoReading();
-    emit videoDeviceOpenSuccessfully(m_vParams, m_vTimeBase);
+void Capture::setVideoCaptureFormat(int width, int height, int fps) {
+    m_requestedWidth = width > 0 ? width : 0;
+    m_requestedHeight = height > 0 ? height : 0;
+    m_requestedFps = fps > 0 ? fps : 0;
+}
+
+bool Capture::openVideoNegotiated(const QString &deviceUrl, const AVInputFormat *inputFormat) {
+    struct Candidate {
+        const char *pixelFormat;
+        const char *videoCodec;
+    };
+    // nv12 / yuv420p 编码器直接使用，yuyv422 只需一次 sws 转换，都比 MJPEG 整帧解码便宜
+    static const Candidate kCandidates[] = {
+        {"nv12", nullptr},
+        {"yuyv422", nullptr},
+        {"yuv420p", nullptr},
+        {nullptr, "mjpeg"},
+    };
+    const bool hasSize = m_requestedWidth > 0 && m_requestedHeight > 0;
+    int ret = AVERROR(EINVAL);
+    // 先按期望规格试各个格式，再不限分辨率试一遍，最后用设备默认
+    for (int pass = hasSize ? 0 : 1; pass < 2 && !m_VideoFormatCtx; ++pass) {
+        for (const Candidate &candidate : kCandidates) {
+            ret = tryOpenVideo(deviceUrl, inputFormat, candidate.pixelFormat, candidate.videoCodec, pass == 0);
+            if (ret >= 0) {
+                break;
+            }
+        }
+    }
+    if (!m_VideoFormatCtx) {
+        WRITE_LOG("Capture: no preferred format accepted, using the device default.");
+        ret = tryOpenVideo(deviceUrl, inputFormat, nullptr, nullptr, false);
+    }
+    if (ret < 0) {
+        char errbuf[1024] = { 0 };
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        emit errorOccurred(QString("Failed to open video device: %1").arg(errbuf));
+        return false;
+    }
+    return true;
+}
+
+int Capture::tryOpenVideo(const QString &deviceUrl, const AVInputFormat *inputFormat,
+                          const char *pixelFormat, const char *videoCodec, bool withSize) {
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "rtbufsize", "10000000", 0);
+    if (pixelFormat) {
+        av_dict_set(&options, "pixel_format", pixelFormat, 0);
+    }
+    if (videoCodec) {
+        av_dict_set(&options, "vcodec", videoCodec, 0);
+    }
+    if (withSize) {
+        av_dict_set(&options, "video_size",
+                    QString("%1x%2").arg(m_requestedWidth).arg(m_requestedHeight).toStdString().c_str(), 0);
+    }
+    if (m_requestedFps > 0 && (pixelFormat || videoCodec)) {
+        av_dict_set_int(&options, "framerate", m_requestedFps, 0);
+    }
+
+    m_VideoFormatCtx = avformat_alloc_context();
+    int ret = avformat_open_input(&m_VideoFormatCtx, deviceUrl.toStdString().c_str(), inputFormat, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        // 设备不支持这组选项时 dshow 直接打开失败，换下一组
+        WRITE_LOG("Capture: %s%s %s rejected.", pixelFormat ? pixelFormat : "", videoCodec ? videoCodec : "",
+                  withSize ? "at requested size" : "");
+        avformat_close_input(&m_VideoFormatCtx);
+        m_VideoFormatCtx = nullptr;
+    }
+    return ret;
 }
 
 void Capture::closeAudio() {
@@ -148,6 +327,8 @@ void Capture::closeAudio() {
         avformat_close_input(&m_AudioFormatCtx);
         m_AudioFormatCtx = nullptr;
     }
+    m_alsa.reset();
+    m_audioSource.reset();
     if (m_aParams) {
         avcodec_parameters_free(&m_aParams);
         m_aParams = nullptr;
@@ -170,6 +351,9 @@ void Capture::closeVideo() {
         avformat_close_input(&m_VideoFormatCtx);
         m_VideoFormatCtx = nullptr;
     }
+    // 还在下游的 mmap 缓冲区各自持有设备引用，释放后才真正 munmap
+    m_v4l2.reset();
+    m_videoSource.reset();
     if (m_vParams) {
         avcodec_parameters_free(&m_vParams);
         m_vParams = nullptr;
@@ -190,10 +374,10 @@ void Capture::closeDevice() {
 void Capture::configReadingStatus(bool openVideo, bool openAudio) {
     m_isVideoOpen = openVideo;
     m_isAudioOpen = openAudio;
-    if (m_isVideoOpen && !m_isReadingVideo) {
+    if (m_isVideoOpen && !m_videoWorker.isRunning()) {
         startVideoReading();
     }
-    if (m_isAudioOpen && !m_isReadingAudio) {
+    if (m_isAudioOpen && !m_audioWorker.isRunning()) {
         startAudioReading();
     }
     if (m_isAudioOpen && m_isVideoOpen) {
@@ -207,69 +391,49 @@ void Capture::stopReading() {
     stopVideoReading();
 }
 void Capture::startVideoReading() {
-    if (!m_VideoFormatCtx) {
+    if (!m_VideoFormatCtx && !m_v4l2 && !m_videoSource) {
         WRITE_LOG("Failed to start video reading - format context is null.");
         return;
     }
-    if (m_isReadingVideo) {
+    if (!m_videoPacketQueue) {
+        WRITE_LOG("Video packet queue NOT SET.");
+        return;
+    }
+    if (!m_videoWorker.start([this]() { return doReadVideoFrame(); })) {
         WRITE_LOG("Already reading video frames.");
         return;
     }
-    m_isReadingVideo = true;
     WRITE_LOG("Starting to read video frames...");
-    QMetaObject::invokeMethod(this, "doReadVideoFrame", Qt::QueuedConnection);
 }
 
 void Capture::stopVideoReading() {
-    m_isReadingVideo = false;
-    // 等待 doReadVideoFrame 循环结束
-    {
-        QMutexLocker locker(&m_videoWorkMutex);
-        while (m_isDoingVideoWork) {
-            m_videoWorkCond.wait(&m_videoWorkMutex);
-        }
-    }
+    // join 读取线程，返回后才能关闭设备
+    m_videoWorker.stop();
 }
 
-void Capture::doReadVideoFrame() {
-    if (!m_isReadingVideo.load()) {
-        WRITE_LOG("Video reading loop gracefully stopped.");
-        return;
-    }
-    {
-        QMutexLocker locker(&m_videoWorkMutex);
-        m_isDoingVideoWork = true;
-    }
-    auto work_guard = [this]() {
-        QMutexLocker locker(&m_videoWorkMutex);
-        m_isDoingVideoWork = false;
-        m_videoWorkCond.wakeAll();
-        };
-    if (!m_videoPacketQueue) {
-        WRITE_LOG("Video packet queue NOT SET.");
-        work_guard();
-        return;
-    }
-
+bool Capture::doReadVideoFrame() {
     AVPacketPtr packet(av_packet_alloc());
     if (!packet) {
         emit errorOccurred("Failed to allocate video packet.");
-        m_isReadingVideo = false;
-        work_guard();
-        return;
+        return false;
     }
 
-    int ret = av_read_frame(m_VideoFormatCtx, packet.get());
+    int ret = readVideoPacket(packet.get());
+    if (ret == AVERROR(EAGAIN)) {
+        // 原生后端本轮没有数据（超时或 xrun 已恢复），下一轮再读
+        return true;
+    }
     if (ret < 0) {
         if (ret != AVERROR_EOF) { // EOF 可能是正常的
             char errbuf[1024] = { 0 };
             av_strerror(ret, errbuf, sizeof(errbuf));
             WRITE_LOG("Failed to read video frame: %s", errbuf);
         }
-        m_isReadingVideo = false;
-        work_guard();
-        return;
+        WRITE_LOG("Video reading loop stopped.");
+        return false;
     }
+    // 读取本身大多是在等设备或节奏控制，从拿到包开始计时
+    const int64_t stageBegin = m_videoStageStats.begin();
 
     if (packet->pts == AV_NOPTS_VALUE) {
         int64_t now_time = av_gettime();
@@ -279,80 +443,66 @@ void Capture::doReadVideoFrame() {
     }
 
     if (packet->stream_index == m_videoStreamIndex) {
+        packet->time_base = m_vTimeBase;
+        m_videoStageStats.end(stageBegin);
         m_videoPacketQueue->enqueue(std::move(packet));
         //WRITE_LOG("Video frame read.");
     }
-
-    work_guard();
-    if (m_isReadingVideo) {
-        QMetaObject::invokeMethod(this, "doReadVideoFrame", Qt::QueuedConnection);
+    return true;
+}
+int Capture::readVideoPacket(AVPacket *packet) {
+    if (m_v4l2) {
+        return m_v4l2->read(packet, kNativeReadTimeoutMs);
+    }
+    if (m_videoSource) {
+        return m_videoSource->read(packet);
     }
+    return av_read_frame(m_VideoFormatCtx, packet);
 }
+
 void Capture::startAudioReading() {
-    if (!m_AudioFormatCtx) {
+    if (!m_AudioFormatCtx && !m_alsa && !m_audioSource) {
         WRITE_LOG("Failed to start audio reading - format context is null.");
         return;
     }
-    if (m_isReadingAudio) {
+    if (!m_audioPacketQueue) {
+        WRITE_LOG("Audio packet queue NOT SET.");
+        return;
+    }
+    if (!m_audioWorker.start([this]() { return doReadAudioFrame(); })) {
         WRITE_LOG("Already reading audio frames.");
         return;
     }
     WRITE_LOG("Starting to read audio frames...");
-    m_isReadingAudio = true;
-    QMetaObject::invokeMethod(this, "doReadAudioFrame", Qt::QueuedConnection);
 }
 
 void Capture::stopAudioReading() {
-    m_isReadingAudio = false;
-    // 等待 doReadAudioFrame 循环结束
-    {
-        QMutexLocker locker(&m_audioWorkMutex);
-        while (m_isDoingAudioWork) {
-            m_audioWorkCond.wait(&m_audioWorkMutex);
-        }
-    }
+    // join 读取线程，返回后才能关闭设备
+    m_audioWorker.stop();
 }
 
-void Capture::doReadAudioFrame() {
-    if (!m_isReadingAudio.load()) {
-        WRITE_LOG("Audio reading loop gracefully stopped.");
-        return;
-    }
-    {
-        QMutexLocker locker(&m_audioWorkMutex);
-        m_isDoingAudioWork = true;
-    }
-    auto work_guard = [this]() {
-        QMutexLocker locker(&m_audioWorkMutex);
-        m_isDoingAudioWork = false;
-        m_audioWorkCond.wakeAll();
-        };
-
-    if (!m_audioPacketQueue) {
-        WRITE_LOG("Audio packet queue NOT SET.");
-        work_guard();
-        return;
-    }
-
+bool Capture::doReadAudioFrame() {
     AVPacketPtr packet(av_packet_alloc());
     if (!packet) {
         emit errorOccurred("Failed to allocate audio packet.");
-        m_isReadingAudio = false;
-        work_guard();
-        return;
+        return false;
     }
 
-    int ret = av_read_frame(m_AudioFormatCtx, packet.get());
+    int ret = readAudioPacket(packet.get());
+    if (ret == AVERROR(EAGAIN)) {
+        // 原生后端本轮没有数据（超时或 xrun 已恢复），下一轮再读
+        return true;
+    }
     if (ret < 0) {
         if (ret != AVERROR_EOF) {
             char errbuf[1024] = { 0 };
             av_strerror(ret, errbuf, sizeof(errbuf));
             WRITE_LOG("Failed to read audio frame: %s", errbuf);
         }
-        m_isReadingAudio = false;
-        work_guard();
-        return;
+        WRITE_LOG("Audio reading loop stopped.");
+        return false;
     }
+    const int64_t stageBegin = m_audioStageStats.begin();
 
     if (packet->pts == AV_NOPTS_VALUE) {
         int64_t now_time = av_gettime();
@@ -362,11 +512,20 @@ void Capture::doReadAudioFrame() {
     }
 
     if (packet->stream_index == m_audioStreamIndex) {
+        packet->time_base = m_aTimeBase;
+        m_audioStageStats.end(stageBegin);
         m_audioPacketQueue->enqueue(std::move(packet));
     }
     //WRITE_LOG("Audio frame read.");
-    work_guard();
-    if (m_isReadingAudio) {
-        QMetaObject::invokeMethod(this, "doReadAudioFrame", Qt::QueuedConnection);
+    return true;
+}
+
+int Capture::readAudioPacket(AVPacket *packet) {
+    if (m_alsa) {
+        return m_alsa->read(packet);
+    }
+    if (m_audioSource) {
+        return m_audioSource->read(packet);
     }
+    return av_read_frame(m_AudioFormatCtx, packet);
 }
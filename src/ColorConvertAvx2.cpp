@@ -0,0 +1,96 @@
+﻿#include "ColorConvertKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace ColorConvertKernels {
+
+namespace {
+
+AVX2_TARGET inline void yuvToRgb16(__m256i y, __m256i u, __m256i v, __m256i &r, __m256i &g, __m256i &b) {
+    const __m256i c128 = _mm256_set1_epi16(128);
+    const __m256i round = _mm256_set1_epi16(kRound);
+    const __m256i ys = _mm256_sub_epi16(y, _mm256_set1_epi16(kYOffset));
+    const __m256i yy = _mm256_add_epi16(_mm256_mullo_epi16(ys, _mm256_set1_epi16(kYGain)), _mm256_srai_epi16(ys, 1));
+    const __m256i d = _mm256_sub_epi16(u, c128);
+    const __m256i e = _mm256_sub_epi16(v, c128);
+    r = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(yy, _mm256_mullo_epi16(e, _mm256_set1_epi16(kVToR))), round), kShift);
+    g = _mm256_srai_epi16(_mm256_add_epi16(_mm256_sub_epi16(_mm256_sub_epi16(yy, _mm256_mullo_epi16(d, _mm256_set1_epi16(kUToG))),
+                                                            _mm256_mullo_epi16(e, _mm256_set1_epi16(kVToG))), round), kShift);
+    b = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(d, _mm256_set1_epi16(kUToB))), round), kShift);
+}
+
+AVX2_TARGET void rowAvx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool chromaShared) {
+    const __m256i alpha = _mm256_set1_epi8(static_cast<char>(0xFF));
+    int x = 0;
+    // 每次 32 个像素；16 位运算按 [0..15] / [16..31] 两组，避免跨 128 位通道的重排
+    for (; x + 32 <= width; x += 32) {
+        const __m128i y0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+        const __m128i y1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x + 16));
+        __m128i u0, u1, v0, v1;
+        if (chromaShared) {
+            const __m128i u8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x / 2));
+            const __m128i v8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x / 2));
+            u0 = _mm_unpacklo_epi8(u8, u8);
+            u1 = _mm_unpackhi_epi8(u8, u8);
+            v0 = _mm_unpacklo_epi8(v8, v8);
+            v1 = _mm_unpackhi_epi8(v8, v8);
+        } else {
+            u0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x));
+            u1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x + 16));
+            v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x));
+            v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x + 16));
+        }
+        __m256i rLo, gLo, bLo, rHi, gHi, bHi;
+        yuvToRgb16(_mm256_cvtepu8_epi16(y0), _mm256_cvtepu8_epi16(u0), _mm256_cvtepu8_epi16(v0), rLo, gLo, bLo);
+        yuvToRgb16(_mm256_cvtepu8_epi16(y1), _mm256_cvtepu8_epi16(u1), _mm256_cvtepu8_epi16(v1), rHi, gHi, bHi);
+
+        // packus 按通道交错：[0..7, 16..23 | 8..15, 24..31]，后面的 unpack 也是通道内的，最后用 permute2x128 归位
+        const __m256i b8 = _mm256_packus_epi16(bLo, bHi);
+        const __m256i g8 = _mm256_packus_epi16(gLo, gHi);
+        const __m256i r8 = _mm256_packus_epi16(rLo, rHi);
+        const __m256i bgLo = _mm256_unpacklo_epi8(b8, g8);   // [0..7 | 8..15]
+        const __m256i bgHi = _mm256_unpackhi_epi8(b8, g8);   // [16..23 | 24..31]
+        const __m256i raLo = _mm256_unpacklo_epi8(r8, alpha);
+        const __m256i raHi = _mm256_unpackhi_epi8(r8, alpha);
+        const __m256i p0 = _mm256_unpacklo_epi16(bgLo, raLo); // [0..3 | 8..11]
+        const __m256i p1 = _mm256_unpackhi_epi16(bgLo, raLo); // [4..7 | 12..15]
+        const __m256i p2 = _mm256_unpacklo_epi16(bgHi, raHi); // [16..19 | 24..27]
+        const __m256i p3 = _mm256_unpackhi_epi16(bgHi, raHi); // [20..23 | 28..31]
+        uint8_t *out = dst + x * 4;
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 64), _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    rowScalar(y, u, v, dst, x, width, chromaShared);
+}
+
+}
+
+// 平均和拆分是访存受限的，256 位版本测不出差别，沿用 SSE4.1 实现
+const Table &avx2Table() {
+    static const Table table = {rowAvx2, sse41Box(), sse41SplitUV(), sse41SplitYuyv()};
+    return table;
+}
+
+}
+
+#else
+
+namespace ColorConvertKernels {
+
+const Table &avx2Table() {
+    return scalarTable();
+}
+
+}
+
+#endif
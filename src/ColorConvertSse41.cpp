@@ -0,0 +1,203 @@
+﻿#include "ColorConvertKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// GCC/Clang 只在函数级打开指令集，整个工程不需要 -msse4.1；MSVC 的内建函数不受编译选项限制
+#if defined(__GNUC__)
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+#else
+#define SSE41_TARGET
+#endif
+
+namespace ColorConvertKernels {
+
+namespace {
+
+struct Coeffs {
+    __m128i yOffset, yGain, vToR, uToG, vToG, uToB, round, c128, alpha;
+};
+
+SSE41_TARGET inline Coeffs loadCoeffs() {
+    Coeffs c;
+    c.yOffset = _mm_set1_epi16(kYOffset);
+    c.yGain = _mm_set1_epi16(kYGain);
+    c.vToR = _mm_set1_epi16(kVToR);
+    c.uToG = _mm_set1_epi16(kUToG);
+    c.vToG = _mm_set1_epi16(kVToG);
+    c.uToB = _mm_set1_epi16(kUToB);
+    c.round = _mm_set1_epi16(kRound);
+    c.c128 = _mm_set1_epi16(128);
+    c.alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    return c;
+}
+
+// 8 个像素：16 位 Y/U/V -> 16 位 R/G/B（未钳位）
+SSE41_TARGET inline void yuvToRgb16(const Coeffs &c, __m128i y, __m128i u, __m128i v,
+                                    __m128i &r, __m128i &g, __m128i &b) {
+    const __m128i ys = _mm_sub_epi16(y, c.yOffset);
+    const __m128i yy = _mm_add_epi16(_mm_mullo_epi16(ys, c.yGain), _mm_srai_epi16(ys, 1));
+    const __m128i d = _mm_sub_epi16(u, c.c128);
+    const __m128i e = _mm_sub_epi16(v, c.c128);
+    r = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(yy, _mm_mullo_epi16(e, c.vToR)), c.round), kShift);
+    g = _mm_srai_epi16(_mm_add_epi16(_mm_sub_epi16(_mm_sub_epi16(yy, _mm_mullo_epi16(d, c.uToG)),
+                                                   _mm_mullo_epi16(e, c.vToG)), c.round), kShift);
+    // 只有 B 可能超出 int16，饱和加法触顶时结果本来就钳到 255
+    b = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(d, c.uToB)), c.round), kShift);
+}
+
+// 16 个像素的 B/G/R 字节 -> 64 字节 BGRA
+SSE41_TARGET inline void storeBgra(const Coeffs &c, __m128i b8, __m128i g8, __m128i r8, uint8_t *dst) {
+    const __m128i bgLo = _mm_unpacklo_epi8(b8, g8);
+    const __m128i bgHi = _mm_unpackhi_epi8(b8, g8);
+    const __m128i raLo = _mm_unpacklo_epi8(r8, c.alpha);
+    const __m128i raHi = _mm_unpackhi_epi8(r8, c.alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi16(bgLo, raLo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpackhi_epi16(bgLo, raLo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_unpacklo_epi16(bgHi, raHi));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 48), _mm_unpackhi_epi16(bgHi, raHi));
+}
+
+SSE41_TARGET void rowSse41(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool chromaShared) {
+    const Coeffs c = loadCoeffs();
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+        const __m128i yLo = _mm_cvtepu8_epi16(y8);
+        const __m128i yHi = _mm_unpackhi_epi8(y8, zero);
+        __m128i uLo, uHi, vLo, vHi;
+        if (chromaShared) {
+            // 8 个色度样本，每个复制给相邻两个像素
+            const __m128i u16 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x / 2)));
+            const __m128i v16 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x / 2)));
+            uLo = _mm_unpacklo_epi16(u16, u16);
+            uHi = _mm_unpackhi_epi16(u16, u16);
+            vLo = _mm_unpacklo_epi16(v16, v16);
+            vHi = _mm_unpackhi_epi16(v16, v16);
+        } else {
+            const __m128i u8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x));
+            const __m128i v8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x));
+            uLo = _mm_cvtepu8_epi16(u8);
+            uHi = _mm_unpackhi_epi8(u8, zero);
+            vLo = _mm_cvtepu8_epi16(v8);
+            vHi = _mm_unpackhi_epi8(v8, zero);
+        }
+        __m128i rLo, gLo, bLo, rHi, gHi, bHi;
+        yuvToRgb16(c, yLo, uLo, vLo, rLo, gLo, bLo);
+        yuvToRgb16(c, yHi, uHi, vHi, rHi, gHi, bHi);
+        // packus 同时完成 0..255 钳位
+        storeBgra(c, _mm_packus_epi16(bLo, bHi), _mm_packus_epi16(gLo, gHi), _mm_packus_epi16(rLo, rHi), dst + x * 4);
+    }
+    rowScalar(y, u, v, dst, x, width, chromaShared);
+}
+
+SSE41_TARGET inline __m128i roundShift(__m128i sum, int count) {
+    const int shift = count == 16 ? 4 : count == 8 ? 3 : count == 4 ? 2 : count == 2 ? 1 : 0;
+    return _mm_srl_epi16(_mm_add_epi16(sum, _mm_set1_epi16(static_cast<short>(count >> 1))), _mm_cvtsi32_si128(shift));
+}
+
+SSE41_TARGET void boxSse41(const uint8_t *const *rows, int rowCount, int factor, uint8_t *out, int outWidth) {
+    const int count = rowCount * factor;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(1);
+    int x = 0;
+    if (factor == 1) {
+        for (; x + 16 <= outWidth; x += 16) {
+            __m128i lo = zero, hi = zero;
+            for (int r = 0; r < rowCount; ++r) {
+                const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[r] + x));
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(p, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(p, zero));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x),
+                             _mm_packus_epi16(roundShift(lo, count), roundShift(hi, count)));
+        }
+    } else if (factor == 2) {
+        // maddubs 把相邻两个字节相加成 16 位
+        for (; x + 16 <= outWidth; x += 16) {
+            __m128i a = zero, b = zero;
+            for (int r = 0; r < rowCount; ++r) {
+                const uint8_t *p = rows[r] + x * 2;
+                a = _mm_add_epi16(a, _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), ones));
+                b = _mm_add_epi16(b, _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)), ones));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x),
+                             _mm_packus_epi16(roundShift(a, count), roundShift(b, count)));
+        }
+    } else if (factor == 4) {
+        // 先两两相加，再用 hadd 合成四个一组
+        for (; x + 8 <= outWidth; x += 8) {
+            __m128i a = zero, b = zero;
+            for (int r = 0; r < rowCount; ++r) {
+                const uint8_t *p = rows[r] + x * 4;
+                a = _mm_add_epi16(a, _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), ones));
+                b = _mm_add_epi16(b, _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)), ones));
+            }
+            const __m128i avg = roundShift(_mm_hadd_epi16(a, b), count);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + x), _mm_packus_epi16(avg, avg));
+        }
+    }
+    boxScalar(rows, rowCount, factor, out, x, outWidth);
+}
+
+SSE41_TARGET void splitUVSse41(const uint8_t *uv, uint8_t *u, uint8_t *v, int pairs) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    int i = 0;
+    for (; i + 16 <= pairs; i += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(uv + 2 * i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(uv + 2 * i + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(u + i),
+                         _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(v + i),
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    splitUVScalar(uv, u, v, i, pairs);
+}
+
+SSE41_TARGET void splitYuyvSse41(const uint8_t *yuyv, uint8_t *y, uint8_t *u, uint8_t *v, int pairs) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    int i = 0;
+    // 每次 8 个像素对（32 字节）：偶数字节是 Y，奇数字节是交替的 U/V
+    for (; i + 8 <= pairs; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(yuyv + 4 * i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(yuyv + 4 * i + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(y + 2 * i),
+                         _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        const __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        const __m128i u16 = _mm_and_si128(uv, lowBytes);
+        const __m128i v16 = _mm_srli_epi16(uv, 8);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(u + i), _mm_packus_epi16(u16, u16));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(v + i), _mm_packus_epi16(v16, v16));
+    }
+    splitYuyvScalar(yuyv, y, u, v, i, pairs);
+}
+
+}
+
+const Table &sse41Table() {
+    static const Table table = {rowSse41, boxSse41, splitUVSse41, splitYuyvSse41};
+    return table;
+}
+
+// 供 avx2Table 复用
+BoxFn sse41Box() { return boxSse41; }
+
+SplitUVFn sse41SplitUV() { return splitUVSse41; }
+
+SplitYuyvFn sse41SplitYuyv() { return splitYuyvSse41; }
+
+}
+
+#else
+
+namespace ColorConvertKernels {
+
+const Table &sse41Table() {
+    return scalarTable();
+}
+
+}
+
+#endif
@@ -0,0 +1,250 @@
+﻿#include "ColorConverter.h"
+#include "ColorConvertKernels.h"
+#include <cstddef>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define COLORCONVERT_X86 1
+#elif defined(__x86_64__) || defined(__i386__)
+#define COLORCONVERT_X86 1
+#endif
+
+// ---------------- 标量参考实现 ----------------
+namespace ColorConvertKernels {
+
+static inline uint8_t clampByte(int value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+void rowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int start, int width, bool chromaShared) {
+    for (int x = start; x < width; ++x) {
+        const int c = chromaShared ? (x >> 1) : x;
+        const int ys = y[x] - kYOffset;
+        const int yy = ys * kYGain + (ys >> 1);
+        const int d = u[c] - 128;
+        const int e = v[c] - 128;
+        uint8_t *p = dst + x * 4;
+        p[0] = clampByte((yy + kUToB * d + kRound) >> kShift);
+        p[1] = clampByte((yy - kUToG * d - kVToG * e + kRound) >> kShift);
+        p[2] = clampByte((yy + kVToR * e + kRound) >> kShift);
+        p[3] = 0xFF;
+    }
+}
+
+void boxScalar(const uint8_t *const *rows, int rowCount, int factor, uint8_t *out, int start, int outWidth) {
+    const int count = rowCount * factor;
+    int shift = 0;
+    while ((1 << shift) < count) {
+        ++shift;
+    }
+    const int round = count >> 1;
+    for (int x = start; x < outWidth; ++x) {
+        int sum = 0;
+        for (int r = 0; r < rowCount; ++r) {
+            const uint8_t *p = rows[r] + x * factor;
+            for (int k = 0; k < factor; ++k) {
+                sum += p[k];
+            }
+        }
+        out[x] = static_cast<uint8_t>((sum + round) >> shift);
+    }
+}
+
+void splitUVScalar(const uint8_t *uv, uint8_t *u, uint8_t *v, int start, int pairs) {
+    for (int i = start; i < pairs; ++i) {
+        u[i] = uv[2 * i];
+        v[i] = uv[2 * i + 1];
+    }
+}
+
+void splitYuyvScalar(const uint8_t *yuyv, uint8_t *y, uint8_t *u, uint8_t *v, int start, int pairs) {
+    for (int i = start; i < pairs; ++i) {
+        const uint8_t *p = yuyv + 4 * i;
+        y[2 * i] = p[0];
+        u[i] = p[1];
+        y[2 * i + 1] = p[2];
+        v[i] = p[3];
+    }
+}
+
+static void rowScalarEntry(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool chromaShared) {
+    rowScalar(y, u, v, dst, 0, width, chromaShared);
+}
+
+static void boxScalarEntry(const uint8_t *const *rows, int rowCount, int factor, uint8_t *out, int outWidth) {
+    boxScalar(rows, rowCount, factor, out, 0, outWidth);
+}
+
+static void splitUVScalarEntry(const uint8_t *uv, uint8_t *u, uint8_t *v, int pairs) {
+    splitUVScalar(uv, u, v, 0, pairs);
+}
+
+static void splitYuyvScalarEntry(const uint8_t *yuyv, uint8_t *y, uint8_t *u, uint8_t *v, int pairs) {
+    splitYuyvScalar(yuyv, y, u, v, 0, pairs);
+}
+
+const Table &scalarTable() {
+    static const Table table = {rowScalarEntry, boxScalarEntry, splitUVScalarEntry, splitYuyvScalarEntry};
+    return table;
+}
+
+}
+
+// ---------------- 运行时选择 ----------------
+ColorConverter::Isa ColorConverter::detectIsa() {
+#if defined(COLORCONVERT_X86) && defined(_MSC_VER)
+    int info[4] = {0};
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx) {
+        // 操作系统必须保存 YMM 寄存器状态
+        const unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        avx2 = (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2) {
+        return Isa::AVX2;
+    }
+    return sse41 ? Isa::SSE41 : Isa::Scalar;
+#elif defined(COLORCONVERT_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Isa::AVX2;
+    }
+    return __builtin_cpu_supports("sse4.1") ? Isa::SSE41 : Isa::Scalar;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+const char *ColorConverter::isaName(Isa isa) {
+    switch (isa) {
+        case Isa::AVX2: return "avx2";
+        case Isa::SSE41: return "sse4.1";
+        default: return "scalar";
+    }
+}
+
+bool ColorConverter::isSupportedFormat(AVPixelFormat format) {
+    return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_NV12 || format == AV_PIX_FMT_YUYV422;
+}
+
+bool ColorConverter::isSupported(const AVFrame *frame) {
+    return frame && isSupportedFormat(static_cast<AVPixelFormat>(frame->format)) &&
+           frame->color_range != AVCOL_RANGE_JPEG;
+}
+
+ColorConverter::ColorConverter(Isa isa) : m_isa(isa) {
+}
+
+bool ColorConverter::convert(const AVFrame *frame, int scale, uint8_t *dst, int dstStride) {
+    if (!frame) {
+        return false;
+    }
+    const uint8_t *data[3] = {frame->data[0], frame->data[1], frame->data[2]};
+    const int linesize[3] = {frame->linesize[0], frame->linesize[1], frame->linesize[2]};
+    return convert(static_cast<AVPixelFormat>(frame->format), data, linesize, frame->width, frame->height,
+                   scale, dst, dstStride);
+}
+
+bool ColorConverter::convert(AVPixelFormat format, const uint8_t *const data[3], const int linesize[3],
+                             int width, int height, int scale, uint8_t *dst, int dstStride) {
+    if (!isSupportedFormat(format) || !data[0] || !dst || width <= 0 || height <= 0 ||
+        (scale != 1 && scale != 2 && scale != 4)) {
+        return false;
+    }
+    const int outWidth = outputSize(width, scale);
+    const int outHeight = outputSize(height, scale);
+    if (outWidth <= 0 || outHeight <= 0 || dstStride < outWidth * 4) {
+        return false;
+    }
+
+    const ColorConvertKernels::Table &k = m_isa == Isa::AVX2 ? ColorConvertKernels::avx2Table()
+                                          : m_isa == Isa::SSE41 ? ColorConvertKernels::sse41Table()
+                                          : ColorConvertKernels::scalarTable();
+
+    // 中间行：拆分后的输入行（最多 scale 行 Y/U/V）+ 平均后的一行 Y/U/V
+    const int chromaWidth = (width + 1) / 2;
+    const int padded = ((width + 63) & ~63) + 64;
+    const size_t need = static_cast<size_t>(padded) * (3 * 4 + 3);
+    if (m_scratch.size() < need) {
+        m_scratch.resize(need);
+    }
+    uint8_t *base = m_scratch.data();
+    uint8_t *splitY[4], *splitU[4], *splitV[4];
+    for (int i = 0; i < 4; ++i) {
+        splitY[i] = base + padded * (3 * i);
+        splitU[i] = base + padded * (3 * i + 1);
+        splitV[i] = base + padded * (3 * i + 2);
+    }
+    uint8_t *lineY = base + padded * 12;
+    uint8_t *lineU = base + padded * 13;
+    uint8_t *lineV = base + padded * 14;
+
+    const bool yuyv = format == AV_PIX_FMT_YUYV422;
+    const bool nv12 = format == AV_PIX_FMT_NV12;
+
+    for (int oy = 0; oy < outHeight; ++oy) {
+        const uint8_t *rowsY[4];
+        const uint8_t *rowsU[4];
+        const uint8_t *rowsV[4];
+        int chromaRows = 0;
+
+        // 1. 取出本输出行用到的输入行，交织格式先拆成平面
+        for (int i = 0; i < scale; ++i) {
+            const int sy = oy * scale + i;
+            if (yuyv) {
+                k.splitYuyv(data[0] + static_cast<ptrdiff_t>(sy) * linesize[0], splitY[i], splitU[i], splitV[i], chromaWidth);
+                rowsY[i] = splitY[i];
+                // 4:2:2 垂直方向不抽样，每个输入行都带色度
+                rowsU[chromaRows] = splitU[i];
+                rowsV[chromaRows] = splitV[i];
+                ++chromaRows;
+            } else {
+                rowsY[i] = data[0] + static_cast<ptrdiff_t>(sy) * linesize[0];
+            }
+        }
+        if (!yuyv) {
+            // 4:2:0：scale 1 时两行共用一行色度，scale 2 时一一对应，scale 4 时两行色度求平均
+            const int firstChroma = scale == 1 ? (oy >> 1) : oy * scale / 2;
+            chromaRows = scale == 4 ? 2 : 1;
+            for (int i = 0; i < chromaRows; ++i) {
+                const int cy = firstChroma + i;
+                if (nv12) {
+                    k.splitUV(data[1] + static_cast<ptrdiff_t>(cy) * linesize[1], splitU[i], splitV[i], chromaWidth);
+                    rowsU[i] = splitU[i];
+                    rowsV[i] = splitV[i];
+                } else {
+                    rowsU[i] = data[1] + static_cast<ptrdiff_t>(cy) * linesize[1];
+                    rowsV[i] = data[2] + static_cast<ptrdiff_t>(cy) * linesize[2];
+                }
+            }
+        }
+
+        // 2. 盒式平均到输出分辨率；scale 1 时直接用输入行，色度保持每 2 像素一个
+        const uint8_t *y = rowsY[0];
+        const uint8_t *u = rowsU[0];
+        const uint8_t *v = rowsV[0];
+        if (scale > 1) {
+            k.box(rowsY, scale, scale, lineY, outWidth);
+            y = lineY;
+            // 色度水平分辨率是亮度的一半，scale 2 时已与输出一致，scale 4 时再两两平均
+            const int chromaFactor = scale / 2;
+            if (chromaRows > 1 || chromaFactor > 1) {
+                k.box(rowsU, chromaRows, chromaFactor, lineU, outWidth);
+                k.box(rowsV, chromaRows, chromaFactor, lineV, outWidth);
+                u = lineU;
+                v = lineV;
+            }
+        }
+
+        // 3. 色彩转换
+        k.row(y, u, v, dst + static_cast<ptrdiff_t>(oy) * dstStride, outWidth, scale == 1);
+    }
+    return true;
+}
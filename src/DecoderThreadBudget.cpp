@@ -0,0 +1,79 @@
+﻿#include "DecoderThreadBudget.h"
+#include "QueueTelemetry.h"
+#include "logqueue.h"
+#include "log_global.h"
+#include <QThread>
+#include <algorithm>
+
+DecoderThreadBudget &DecoderThreadBudget::instance() {
+    static DecoderThreadBudget budget;
+    return budget;
+}
+
+DecoderThreadBudget::DecoderThreadBudget() {
+    m_total = std::max(1, QThread::idealThreadCount());
+    m_telemetryName = TelemetryRegistry::instance().registerSource("decoder.threadBudget", [this]() {
+        return telemetrySnapshot();
+    });
+}
+
+DecoderThreadBudget::~DecoderThreadBudget() {
+    TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+}
+
+void DecoderThreadBudget::setTotal(int threads) {
+    QMutexLocker locker(&m_mutex);
+    m_total = threads > 0 ? threads : std::max(1, QThread::idealThreadCount());
+}
+
+int DecoderThreadBudget::total() const {
+    QMutexLocker locker(&m_mutex);
+    return m_total;
+}
+
+void DecoderThreadBudget::setExpectedDecoders(int decoders) {
+    QMutexLocker locker(&m_mutex);
+    m_expectedDecoders = decoders > 0 ? decoders : kDefaultExpectedDecoders;
+}
+
+int DecoderThreadBudget::acquire(int requested) {
+    QMutexLocker locker(&m_mutex);
+    // 剩余额度在这一路和预期中还没打开的几路之间平分，先开的不会把后开的挤到 1 个线程
+    const int unopened = std::max(1, m_expectedDecoders - m_decoders);
+    const int remaining = std::max(0, m_total - m_inUse);
+    int granted = remaining / unopened;
+    if (requested > 0) {
+        granted = std::min(granted, requested);
+    }
+    granted = std::max(1, granted);
+    if (requested > 0 && granted < requested) {
+        ++m_shortfalls;
+    }
+    ++m_decoders;
+    ++m_granted;
+    m_inUse += granted;
+    WRITE_LOG("DecoderThreadBudget: granted %d thread(s) (requested %d, in use %d/%d, decoders %d)",
+              granted, requested, m_inUse, m_total, m_decoders);
+    return granted;
+}
+
+void DecoderThreadBudget::release(int threads) {
+    if (threads <= 0) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    m_inUse = std::max(0, m_inUse - threads);
+    m_decoders = std::max(0, m_decoders - 1);
+}
+
+QJsonObject DecoderThreadBudget::telemetrySnapshot() const {
+    QMutexLocker locker(&m_mutex);
+    QJsonObject obj;
+    obj["total"] = m_total;
+    obj["inUse"] = m_inUse;
+    obj["decoders"] = m_decoders;
+    obj["expectedDecoders"] = m_expectedDecoders;
+    obj["granted"] = static_cast<qint64>(m_granted);
+    obj["shortfalls"] = static_cast<qint64>(m_shortfalls);
+    return obj;
+}
@@ -0,0 +1,302 @@
+﻿#include "H264AccessUnitAssembler.h"
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace {
+const uint8_t kStartCode[4] = {0x00, 0x00, 0x00, 0x01};
+
+inline uint16_t readU16(const uint8_t *p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+}
+
+H264AccessUnitAssembler::~H264AccessUnitAssembler() {
+    av_buffer_unref(&m_auBuffer);
+}
+
+void H264AccessUnitAssembler::reset() {
+    clearAccessUnit();
+    av_buffer_unref(&m_auBuffer);
+    m_hasTimestamp = false;
+    m_hasSequence = false;
+}
+
+void H264AccessUnitAssembler::push(const rawrtp_ptr &packet, std::vector<AVPacketPtr> &out) {
+    if (!packet || !packet->pData) {
+        return;
+    }
+    const uint8_t *rtp = packet->pData;
+    size_t payloadSize = 0;
+    const size_t offset = rtp_payload_offset(rtp, packet->nLen, &payloadSize);
+    if (offset == 0) {
+        ++m_stats.badPackets;
+        return;
+    }
+
+    const uint16_t sequence = rtp_sequence(rtp);
+    const uint32_t timestamp = rtp_timestamp(rtp);
+    const bool gap = m_hasSequence && sequence != static_cast<uint16_t>(m_lastSequence + 1);
+    if (gap) {
+        ++m_stats.sequenceGaps;
+        markLoss();
+    }
+    m_hasSequence = true;
+    m_lastSequence = sequence;
+
+    // 时间戳变了但上一帧没见到 marker：marker 包丢了或发送端不打 marker，先把上一帧交出去
+    if (m_hasTimestamp && timestamp != m_timestamp) {
+        finishAccessUnit(out);
+        // 丢的包也可能是新一帧的开头，两帧都算损坏
+        m_isCorrupt = gap;
+    }
+    m_hasTimestamp = true;
+    m_timestamp = timestamp;
+
+    if (payloadSize > 0) {
+        uint8_t *payload = packet->pData + offset;
+        const uint8_t type = payload[0] & 0x1F;
+        if (type >= 1 && type <= 23) {
+            handleSingleNal(packet, payload, payloadSize);
+        } else if (type >= 24 && type <= 27) {
+            handleAggregation(payload, payloadSize, type);
+        } else if (type == 28 || type == 29) {
+            handleFragment(payload, payloadSize, type);
+        } else {
+            ++m_stats.badPackets;
+        }
+    }
+
+    if (rtp_marker(rtp)) {
+        finishAccessUnit(out);
+    }
+}
+
+void H264AccessUnitAssembler::markLoss() {
+    if (m_inFragment) {
+        dropFragment();
+    }
+    m_isCorrupt = true;
+}
+
+// ---------------- 各种载荷格式 ----------------
+void H264AccessUnitAssembler::handleSingleNal(const rawrtp_ptr &packet, uint8_t *nal, size_t size) {
+    if (m_inFragment) {
+        // 分片还没结束就来了完整 NAL，说明 FU 结束包丢了
+        dropFragment();
+        m_isCorrupt = true;
+    }
+    noteNalType(nal[0] & 0x1F);
+    if (m_nalCount == 0) {
+        m_pendingPacket = packet;
+        m_pendingNal = nal;
+        m_pendingSize = size;
+        m_nalCount = 1;
+        return;
+    }
+    flushPending();
+    if (appendNal(nal, size)) {
+        ++m_nalCount;
+    }
+}
+
+void H264AccessUnitAssembler::handleAggregation(const uint8_t *payload, size_t size, uint8_t type) {
+    // STAP-A:  [hdr] { [size16][NAL] }*
+    // STAP-B:  [hdr][DON16] { [size16][NAL] }*
+    // MTAP16:  [hdr][DONB16] { [size16][DOND8][TS16][NAL] }*
+    // MTAP24:  [hdr][DONB16] { [size16][DOND8][TS24][NAL] }*
+    size_t pos = (type == 24) ? 1 : 3;
+    const size_t unitHeader = (type == 26) ? 3 : (type == 27) ? 4 : 0;
+    if (m_inFragment) {
+        dropFragment();
+        m_isCorrupt = true;
+    }
+    flushPending();
+    while (pos + 2 <= size) {
+        const size_t unitSize = readU16(payload + pos);
+        pos += 2;
+        if (unitSize <= unitHeader || pos + unitSize > size) {
+            ++m_stats.badPackets;
+            m_isCorrupt = true;
+            return;
+        }
+        const uint8_t *nal = payload + pos + unitHeader;
+        const size_t nalSize = unitSize - unitHeader;
+        noteNalType(nal[0] & 0x1F);
+        if (appendNal(nal, nalSize)) {
+            ++m_nalCount;
+        }
+        pos += unitSize;
+    }
+}
+
+void H264AccessUnitAssembler::handleFragment(const uint8_t *payload, size_t size, uint8_t type) {
+    // FU-A: [FU indicator][FU header][data]；FU-B 在首个分片的 FU header 后多 2 字节 DON
+    if (size < 2) {
+        ++m_stats.badPackets;
+        return;
+    }
+    const uint8_t indicator = payload[0];
+    const uint8_t fuHeader = payload[1];
+    const bool startBit = fuHeader & 0x80;
+    const bool endBit = fuHeader & 0x40;
+    const uint8_t nalType = fuHeader & 0x1F;
+    size_t headerLen = 2;
+    if (type == 29 && startBit) {
+        headerLen += 2;
+    }
+    if (size < headerLen) {
+        ++m_stats.badPackets;
+        return;
+    }
+
+    if (startBit) {
+        if (m_inFragment) {
+            dropFragment();
+            m_isCorrupt = true;
+        }
+        flushPending();
+        m_fragmentStart = m_auSize;
+        m_fragmentType = nalType;
+        const uint8_t nalHeader = static_cast<uint8_t>((indicator & 0xE0) | nalType);
+        if (!appendBytes(kStartCode, sizeof(kStartCode)) || !appendBytes(&nalHeader, 1)) {
+            return;
+        }
+        m_inFragment = true;
+    } else if (!m_inFragment) {
+        // 首个分片丢了，后续分片无从拼接（序号检测已把本帧标记为损坏）
+        return;
+    }
+
+    if (!appendBytes(payload + headerLen, size - headerLen)) {
+        return;
+    }
+    if (endBit) {
+        m_inFragment = false;
+        noteNalType(m_fragmentType);
+        ++m_nalCount;
+    }
+}
+
+// ---------------- 帧缓冲 ----------------
+bool H264AccessUnitAssembler::appendNal(const uint8_t *nal, size_t size) {
+    return appendBytes(kStartCode, sizeof(kStartCode)) && appendBytes(nal, size);
+}
+
+bool H264AccessUnitAssembler::appendBytes(const uint8_t *data, size_t size) {
+    const size_t required = m_auSize + size + AV_INPUT_BUFFER_PADDING_SIZE;
+    if (!m_auBuffer || m_auBuffer->size < required) {
+        // 按上一帧大小预分配，之后几何增长
+        size_t capacity = m_auBuffer ? static_cast<size_t>(m_auBuffer->size) * 2 : m_auSizeHint;
+        if (capacity < required) {
+            capacity = required;
+        }
+        if (av_buffer_realloc(&m_auBuffer, capacity) < 0) {
+            // 内存不足：本帧作废
+            m_isCorrupt = true;
+            m_inFragment = false;
+            return false;
+        }
+    }
+    memcpy(m_auBuffer->data + m_auSize, data, size);
+    m_auSize += size;
+    return true;
+}
+
+void H264AccessUnitAssembler::flushPending() {
+    if (!m_pendingPacket) {
+        return;
+    }
+    appendNal(m_pendingNal, m_pendingSize);
+    m_pendingPacket.reset();
+    m_pendingNal = nullptr;
+    m_pendingSize = 0;
+}
+
+void H264AccessUnitAssembler::dropFragment() {
+    m_auSize = m_fragmentStart;
+    m_inFragment = false;
+    ++m_stats.droppedNals;
+}
+
+void H264AccessUnitAssembler::noteNalType(uint8_t nalType) {
+    if (nalType == 5) {
+        m_isKeyframe = true;
+    }
+}
+
+void H264AccessUnitAssembler::finishAccessUnit(std::vector<AVPacketPtr> &out) {
+    if (m_inFragment) {
+        // 帧结束了分片还没收完：FU 结束包丢失
+        dropFragment();
+        m_isCorrupt = true;
+    }
+    if (m_nalCount == 0) {
+        clearAccessUnit();
+        return;
+    }
+
+    AVPacketPtr packet(av_packet_alloc());
+    if (!packet) {
+        clearAccessUnit();
+        return;
+    }
+    if (m_pendingPacket && m_auSize == 0) {
+        // 整帧只有一个 Single NAL：RTP 头已解析完毕，把 Start Code 写在 NAL 前面的头部字节上，零拷贝
+        uint8_t *data = m_pendingNal - sizeof(kStartCode);
+        memcpy(data, kStartCode, sizeof(kStartCode));
+        // NAL 之后到包尾是 RTP padding（P 位），不是零；清零后连同池里已清零的尾部构成解码器要求的填充区
+        uint8_t *nalEnd = m_pendingNal + m_pendingSize;
+        const uint8_t *packetEnd = m_pendingPacket->pData + m_pendingPacket->nLen;
+        if (packetEnd > nalEnd) {
+            memset(nalEnd, 0, packetEnd - nalEnd);
+        }
+        if (m_pendingPacket->buf) {
+            packet->buf = av_buffer_ref(m_pendingPacket->buf);
+            packet->data = data;
+            packet->size = static_cast<int>(m_pendingSize + sizeof(kStartCode));
+        } else if (av_new_packet(packet.get(), static_cast<int>(m_pendingSize + sizeof(kStartCode))) == 0) {
+            memcpy(packet->data, data, m_pendingSize + sizeof(kStartCode));
+        }
+    } else {
+        flushPending();
+        memset(m_auBuffer->data + m_auSize, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        packet->buf = m_auBuffer;
+        packet->data = m_auBuffer->data;
+        packet->size = static_cast<int>(m_auSize);
+        m_auBuffer = nullptr;
+        m_auSizeHint = m_auSize + AV_INPUT_BUFFER_PADDING_SIZE;
+    }
+    if (!packet->data) {
+        clearAccessUnit();
+        return;
+    }
+
+    packet->pts = m_timestamp;
+    packet->dts = m_timestamp;
+    if (m_isKeyframe) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+        ++m_stats.keyframes;
+    }
+    if (m_isCorrupt) {
+        packet->flags |= AV_PKT_FLAG_CORRUPT;
+        ++m_stats.corruptUnits;
+    }
+    ++m_stats.accessUnits;
+    out.push_back(std::move(packet));
+    clearAccessUnit();
+}
+
+void H264AccessUnitAssembler::clearAccessUnit() {
+    m_auSize = 0;
+    m_nalCount = 0;
+    m_pendingPacket.reset();
+    m_pendingNal = nullptr;
+    m_pendingSize = 0;
+    m_inFragment = false;
+    m_fragmentStart = 0;
+    m_isKeyframe = false;
+    m_isCorrupt = false;
+}
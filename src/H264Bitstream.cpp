@@ -0,0 +1,199 @@
+﻿#include "H264Bitstream.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define H264BITSTREAM_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(H264BITSTREAM_X86) && defined(__GNUC__)
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define SSE2_TARGET
+#define AVX2_TARGET
+#endif
+
+namespace {
+
+using ScanFn = int (*)(const uint8_t *data, int size, int from);
+
+// 可移植路径：memchr 找 01，再回头看前两个字节；非 x86 平台和 SIMD 的尾部都走这里
+int scanMemchr(const uint8_t *data, int size, int from) {
+    int pos = from + 2;
+    while (pos < size) {
+        const void *hit = std::memchr(data + pos, 0x01, static_cast<size_t>(size - pos));
+        if (!hit) {
+            return -1;
+        }
+        pos = static_cast<int>(static_cast<const uint8_t *>(hit) - data);
+        if (data[pos - 1] == 0 && data[pos - 2] == 0) {
+            return pos - 2;
+        }
+        ++pos;
+    }
+    return -1;
+}
+
+#ifdef H264BITSTREAM_X86
+
+inline int lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// 同一块数据错开 0/1/2 字节各读一次，三个比较结果相与，置位的通道就是 00 00 01 的起点
+SSE2_TARGET int scanSse2(const uint8_t *data, int size, int from) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    int i = from;
+    for (; i + 18 <= size; i += 16) {
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 1));
+        const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 2));
+        const __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+                                          _mm_cmpeq_epi8(b2, one));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask) {
+            return i + lowestBit(mask);
+        }
+    }
+    return scanMemchr(data, size, i);
+}
+
+AVX2_TARGET int scanAvx2(const uint8_t *data, int size, int from) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    int i = from;
+    for (; i + 34 <= size; i += 32) {
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 1));
+        const __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 2));
+        const __m256i hit = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)),
+                                             _mm256_cmpeq_epi8(b2, one));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if (mask) {
+            return i + lowestBit(mask);
+        }
+    }
+    return scanSse2(data, size, i);
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4] = {0};
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (maxLeaf < 7 || !osxsave || !avx) {
+        return false;
+    }
+    // 操作系统必须保存 YMM 寄存器状态
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+ScanFn selectScan() {
+#ifdef H264BITSTREAM_X86
+    // SSE2 是 x86-64 的基线，不用检测
+    return cpuHasAvx2() ? scanAvx2 : scanSse2;
+#else
+    return scanMemchr;
+#endif
+}
+
+void putBigEndian32(uint8_t *out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+}
+
+int findH264StartCode(const uint8_t *data, int size, int from) {
+    static const ScanFn scan = selectScan();
+    if (from < 0) {
+        from = 0;
+    }
+    if (!data || size - from < 3) {
+        return -1;
+    }
+    return scan(data, size, from);
+}
+
+int indexH264Nals(const uint8_t *data, int size, std::vector<H264NalUnit> &nals) {
+    nals.clear();
+    int pos = findH264StartCode(data, size, 0);
+    while (pos >= 0) {
+        H264NalUnit nal;
+        nal.startCodeSize = pos > 0 && data[pos - 1] == 0 ? 4 : 3;
+        nal.offset = pos + 3;
+        const int next = findH264StartCode(data, size, nal.offset);
+        // 下一个是 4 字节起始码时它的第一个 0 在 next 之前，和尾随填充一起去掉
+        int end = next >= 0 ? next : size;
+        while (end > nal.offset && data[end - 1] == 0) {
+            --end;
+        }
+        nal.size = end - nal.offset;
+        if (nal.size > 0) {
+            nal.type = data[nal.offset] & 0x1F;
+            nals.push_back(nal);
+        }
+        pos = next;
+    }
+    return static_cast<int>(nals.size());
+}
+
+bool rewriteH264StartCodesAsLengths(uint8_t *data, int size, const std::vector<H264NalUnit> &nals) {
+    if (!data || nals.empty()) {
+        return false;
+    }
+    // 先整体检查再写，不满足条件时缓冲区不能被改了一半
+    int expected = 0;
+    for (const H264NalUnit &nal : nals) {
+        if (nal.startCodeSize != 4 || nal.offset - 4 != expected) {
+            return false;
+        }
+        expected = nal.offset + nal.size;
+    }
+    if (expected != size) {
+        return false;
+    }
+    for (const H264NalUnit &nal : nals) {
+        putBigEndian32(data + nal.offset - 4, static_cast<uint32_t>(nal.size));
+    }
+    return true;
+}
+
+void appendH264LengthPrefixed(const uint8_t *data, const std::vector<H264NalUnit> &nals, std::vector<std::byte> &out) {
+    size_t total = out.size();
+    for (const H264NalUnit &nal : nals) {
+        total += 4 + static_cast<size_t>(nal.size);
+    }
+    size_t pos = out.size();
+    out.resize(total);
+    uint8_t *dst = reinterpret_cast<uint8_t *>(out.data());
+    for (const H264NalUnit &nal : nals) {
+        putBigEndian32(dst + pos, static_cast<uint32_t>(nal.size));
+        std::memcpy(dst + pos + 4, data + nal.offset, static_cast<size_t>(nal.size));
+        pos += 4 + static_cast<size_t>(nal.size);
+    }
+}
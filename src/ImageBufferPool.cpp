@@ -0,0 +1,49 @@
+﻿#include "ImageBufferPool.h"
+#include "logqueue.h"
+#include "log_global.h"
+
+ImageBufferPool::~ImageBufferPool() {
+    // 仍被 QImage 引用的缓冲区会在最后一个引用释放时才真正销毁池
+    av_buffer_pool_uninit(&m_pool);
+}
+
+AVBufferRef *ImageBufferPool::allocBuffer(void *opaque, size_t size) {
+    static_cast<ImageBufferPool *>(opaque)->m_allocated.fetch_add(1, std::memory_order_relaxed);
+    return av_buffer_alloc(size);
+}
+
+AVBufferRef *ImageBufferPool::get(int width, int height, int bytesPerPixel, int &stride) {
+    if (width <= 0 || height <= 0 || bytesPerPixel <= 0) {
+        return nullptr;
+    }
+    if (!m_pool || width != m_width || height != m_height || bytesPerPixel != m_bytesPerPixel) {
+        av_buffer_pool_uninit(&m_pool);
+        m_width = width;
+        m_height = height;
+        m_bytesPerPixel = bytesPerPixel;
+        m_stride = (width * bytesPerPixel + kStrideAlign - 1) / kStrideAlign * kStrideAlign;
+        m_pool = av_buffer_pool_init2(static_cast<size_t>(m_stride) * height, this, &ImageBufferPool::allocBuffer, nullptr);
+        if (!m_pool) {
+            WRITE_LOG("ImageBufferPool: av_buffer_pool_init2 failed (%dx%d)", width, height);
+            return nullptr;
+        }
+    }
+    stride = m_stride;
+    return av_buffer_pool_get(m_pool);
+}
+
+void ImageBufferPool::releaseImage(void *info) {
+    AVBufferRef *buffer = static_cast<AVBufferRef *>(info);
+    av_buffer_unref(&buffer);
+}
+
+QImage ImageBufferPool::wrap(AVBufferRef *buffer, int width, int height, int stride, QImage::Format format) {
+    if (!buffer) {
+        return QImage();
+    }
+    QImage image(buffer->data, width, height, stride, format, &ImageBufferPool::releaseImage, buffer);
+    if (image.isNull()) {
+        av_buffer_unref(&buffer);
+    }
+    return image;
+}
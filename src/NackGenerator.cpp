@@ -0,0 +1,159 @@
+﻿#include "NackGenerator.h"
+#include "logqueue.h"
+#include "log_global.h"
+#include <algorithm>
+
+NackGenerator::NackGenerator(uint32_t localSsrc, SendRtcp send)
+    : m_localSsrc(localSsrc), m_send(std::move(send)) {
+}
+
+void NackGenerator::onPacket(int64_t extSeq, uint32_t mediaSsrc, bool retransmitted, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!retransmitted) {
+        m_mediaSsrc = mediaSsrc;
+    }
+    if (m_highest < 0) {
+        m_highest = extSeq;
+        return;
+    }
+    if (extSeq > m_highest) {
+        const int64_t gap = extSeq - m_highest - 1;
+        if (gap > kMaxGap) {
+            // 断流或发送端重置，逐个请求没有意义
+            WRITE_LOG("NackGenerator: sequence jump of %lld, clearing NACK list", (long long)gap);
+            m_givenUp.fetch_add(m_missing.size(), std::memory_order_relaxed);
+            m_missing.clear();
+        } else {
+            for (int64_t seq = m_highest + 1; seq < extSeq; ++seq) {
+                Entry entry;
+                entry.firstSeenUs = nowUs;
+                m_missing.emplace(seq, entry);
+            }
+        }
+        m_highest = extSeq;
+    } else {
+        auto it = m_missing.find(extSeq);
+        if (it != m_missing.end()) {
+            // 只用第一次请求换回的重传估计 RTT：重试过的包分不清是在回应哪一次
+            if (retransmitted && it->second.retries == 1) {
+                updateRtt(nowUs - it->second.lastSentUs);
+            }
+            m_recovered.fetch_add(1, std::memory_order_relaxed);
+            m_missing.erase(it);
+        }
+    }
+
+    if (m_missing.size() > static_cast<size_t>(kMaxListSize)) {
+        // 丢得太多，留下最新的一段
+        while (m_missing.size() > static_cast<size_t>(kMaxListSize)) {
+            m_missing.erase(m_missing.begin());
+            m_givenUp.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    m_pending.store(static_cast<int>(m_missing.size()), std::memory_order_relaxed);
+}
+
+void NackGenerator::process(int64_t readSeq, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_missing.empty()) {
+        return;
+    }
+    const int64_t retryUs = retryIntervalUs();
+    const int64_t maxAgeUs = kMaxAgeMs * 1000LL;
+
+    m_batch.clear();
+    for (auto it = m_missing.begin(); it != m_missing.end();) {
+        Entry &entry = it->second;
+        if (it->first < readSeq || entry.retries >= kMaxRetries || nowUs - entry.firstSeenUs > maxAgeUs) {
+            m_givenUp.fetch_add(1, std::memory_order_relaxed);
+            it = m_missing.erase(it);
+            continue;
+        }
+        if (entry.retries == 0 || nowUs - entry.lastSentUs >= retryUs) {
+            entry.lastSentUs = nowUs;
+            ++entry.retries;
+            m_batch.push_back(static_cast<uint16_t>(it->first));
+        }
+        ++it;
+    }
+    m_pending.store(static_cast<int>(m_missing.size()), std::memory_order_relaxed);
+
+    if (!m_batch.empty() && m_mediaSsrc != 0) {
+        buildAndSend(m_batch);
+    }
+}
+
+int64_t NackGenerator::nextProcessUs() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int64_t retryUs = retryIntervalUs();
+    int64_t next = INT64_MAX;
+    for (const auto &item : m_missing) {
+        const Entry &entry = item.second;
+        // 未请求过的缺口立即到期；已到重试上限的等 process 清理，不再安排唤醒
+        if (entry.retries == 0) {
+            return 0;
+        }
+        if (entry.retries < kMaxRetries) {
+            next = std::min(next, entry.lastSentUs + retryUs);
+        }
+    }
+    return next;
+}
+
+int64_t NackGenerator::retryIntervalUs() const {
+    return std::max<int64_t>(10000, m_rttMs.load(std::memory_order_relaxed) * 1250LL);
+}
+
+void NackGenerator::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_missing.clear();
+    m_highest = -1;
+    m_pending.store(0, std::memory_order_relaxed);
+}
+
+// RFC 4585 6.2.1 Generic NACK：每个 FCI 是 PID（首个丢失序号）+ BLP（其后 16 个序号的位图）
+void NackGenerator::buildAndSend(const std::vector<uint16_t> &seqs) {
+    m_packet.assign(12, 0);
+    size_t i = 0;
+    while (i < seqs.size()) {
+        const uint16_t pid = seqs[i];
+        uint16_t blp = 0;
+        size_t j = i + 1;
+        while (j < seqs.size()) {
+            const uint16_t diff = static_cast<uint16_t>(seqs[j] - pid);
+            if (diff == 0 || diff > 16) {
+                break;
+            }
+            blp |= static_cast<uint16_t>(1u << (diff - 1));
+            ++j;
+        }
+        m_packet.push_back(static_cast<uint8_t>(pid >> 8));
+        m_packet.push_back(static_cast<uint8_t>(pid & 0xFF));
+        m_packet.push_back(static_cast<uint8_t>(blp >> 8));
+        m_packet.push_back(static_cast<uint8_t>(blp & 0xFF));
+        i = j;
+    }
+
+    const size_t lengthWords = m_packet.size() / 4 - 1;
+    m_packet[0] = 0x80 | 1;     // V=2, P=0, FMT=1 (Generic NACK)
+    m_packet[1] = 205;          // RTPFB
+    m_packet[2] = static_cast<uint8_t>(lengthWords >> 8);
+    m_packet[3] = static_cast<uint8_t>(lengthWords & 0xFF);
+    for (int k = 0; k < 4; ++k) {
+        m_packet[4 + k] = static_cast<uint8_t>(m_localSsrc >> (24 - 8 * k));
+        m_packet[8 + k] = static_cast<uint8_t>(m_mediaSsrc >> (24 - 8 * k));
+    }
+
+    if (m_send) {
+        m_send(m_packet.data(), m_packet.size());
+    }
+    m_nacksSent.fetch_add(1, std::memory_order_relaxed);
+    m_requested.fetch_add(seqs.size(), std::memory_order_relaxed);
+}
+
+void NackGenerator::updateRtt(int64_t sampleUs) {
+    const int sampleMs = static_cast<int>(std::min<int64_t>(std::max<int64_t>(sampleUs / 1000, 1), 1000));
+    const int rtt = m_rttMs.load(std::memory_order_relaxed);
+    // RFC 6298 风格的平滑，1/8 新样本
+    m_rttMs.store(rtt + (sampleMs - rtt) / 8, std::memory_order_relaxed);
+}
@@ -0,0 +1,74 @@
+﻿#include "PipelineWorker.h"
+#include "logqueue.h"
+#include "log_global.h"
+
+PipelineWorker::PipelineWorker(const char *name)
+    : m_name(name ? name : "") {
+}
+
+PipelineWorker::~PipelineWorker() {
+    stop();
+}
+
+bool PipelineWorker::start(Step step, Hook interrupt, Hook drain) {
+    if (!step) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    if (m_running.load(std::memory_order_acquire)) {
+        return false;
+    }
+    // 上一轮由 step 自行结束或在工作线程里要求停止的线程还没 join
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_step = std::move(step);
+    m_interrupt = std::move(interrupt);
+    m_drain = std::move(drain);
+    m_stopRequested.store(false, std::memory_order_release);
+    m_drainOnStop.store(false, std::memory_order_release);
+    m_running.store(true, std::memory_order_release);
+    m_thread = std::thread(&PipelineWorker::run, this);
+    WRITE_LOG("PipelineWorker[%s] started.", m_name);
+    return true;
+}
+
+void PipelineWorker::stop(StopMode mode) {
+    // 不能先拿 m_controlMutex：另一个线程可能正持锁 join 本工作线程
+    if (std::this_thread::get_id() == m_workerId.load(std::memory_order_acquire)) {
+        m_drainOnStop.store(mode == StopMode::Drain, std::memory_order_release);
+        m_stopRequested.store(true, std::memory_order_release);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    if (!m_thread.joinable()) {
+        return;
+    }
+    // 先定模式再置停止标志，工作线程看到停止时模式已经确定
+    m_drainOnStop.store(mode == StopMode::Drain, std::memory_order_release);
+    m_stopRequested.store(true, std::memory_order_release);
+    if (m_interrupt) {
+        m_interrupt();
+    }
+    m_thread.join();
+    // 释放处理函数捕获的状态（批缓冲里可能还引用着帧）
+    m_step = nullptr;
+    m_interrupt = nullptr;
+    m_drain = nullptr;
+    WRITE_LOG("PipelineWorker[%s] stopped (%s).", m_name, mode == StopMode::Drain ? "drain" : "cancel");
+}
+
+void PipelineWorker::run() {
+    m_workerId.store(std::this_thread::get_id(), std::memory_order_release);
+    while (!m_stopRequested.load(std::memory_order_acquire)) {
+        if (!m_step()) {
+            break;
+        }
+    }
+    if (m_stopRequested.load(std::memory_order_acquire) && m_drainOnStop.load(std::memory_order_acquire) && m_drain) {
+        m_drain();
+    }
+    // 线程 id 会被复用，退出前清掉，避免之后恰好拿到同一 id 的线程被误判为工作线程
+    m_workerId.store(std::thread::id(), std::memory_order_release);
+    m_running.store(false, std::memory_order_release);
+}
@@ -0,0 +1,255 @@
+﻿#include "QueueTelemetry.h"
+#include "logqueue.h"
+#include "log_global.h"
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QMutexLocker>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+int highestBit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanReverse64(&index, v);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+}
+
+// ---------------- LatencyHistogram ----------------
+LatencyHistogram::LatencyHistogram() {
+    for (auto &bucket: m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucketIndex(int64_t value) {
+    if (value < kLinearBuckets) {
+        return value < 0 ? 0 : static_cast<int>(value);
+    }
+    const int msb = highestBit(static_cast<uint64_t>(value));
+    const int sub = static_cast<int>((value >> (msb - kSubBucketBits)) & (kSubBuckets - 1));
+    return kLinearBuckets + (msb - (kSubBucketBits + 1)) * kSubBuckets + sub;
+}
+
+int64_t LatencyHistogram::bucketMidpoint(int index) {
+    if (index < kLinearBuckets) {
+        return index;
+    }
+    const int group = (index - kLinearBuckets) / kSubBuckets;
+    const int sub = (index - kLinearBuckets) % kSubBuckets;
+    const int shift = group + 1; // msb - kSubBucketBits
+    const int64_t lower = static_cast<int64_t>(kSubBuckets + sub) << shift;
+    return lower + ((int64_t(1) << shift) >> 1);
+}
+
+void LatencyHistogram::record(int64_t value) {
+    if (value < 0) {
+        value = 0;
+    }
+    m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    int64_t prev = m_max.load(std::memory_order_relaxed);
+    while (value > prev && !m_max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::mean() const {
+    const uint64_t n = count();
+    return n ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+int64_t LatencyHistogram::percentile(double p) const {
+    uint64_t total = 0;
+    for (const auto &bucket: m_buckets) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            const int64_t mid = bucketMidpoint(i);
+            const int64_t top = max();
+            return mid < top ? mid : top;
+        }
+    }
+    return max();
+}
+
+QJsonObject LatencyHistogram::toJson() const {
+    QJsonObject obj;
+    obj["count"] = static_cast<qint64>(count());
+    obj["mean"] = mean();
+    obj["p50"] = static_cast<qint64>(percentile(50.0));
+    obj["p90"] = static_cast<qint64>(percentile(90.0));
+    obj["p99"] = static_cast<qint64>(percentile(99.0));
+    obj["p999"] = static_cast<qint64>(percentile(99.9));
+    obj["max"] = static_cast<qint64>(max());
+    return obj;
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket: m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+// ---------------- QueueStats ----------------
+QJsonObject QueueStats::snapshot() {
+    const int64_t now = nowNs();
+    const uint64_t enqueued = m_enqueued.load(std::memory_order_relaxed);
+    const uint64_t dequeued = m_dequeued.load(std::memory_order_relaxed);
+
+    double enqueueRate = 0.0;
+    double dequeueRate = 0.0;
+    if (m_lastSnapshotNs > 0 && now > m_lastSnapshotNs) {
+        const double seconds = (now - m_lastSnapshotNs) / 1e9;
+        enqueueRate = (enqueued - m_lastEnqueued) / seconds;
+        dequeueRate = (dequeued - m_lastDequeued) / seconds;
+    }
+    m_lastEnqueued = enqueued;
+    m_lastDequeued = dequeued;
+    m_lastSnapshotNs = now;
+
+    QJsonObject obj;
+    obj["enqueued"] = static_cast<qint64>(enqueued);
+    obj["dequeued"] = static_cast<qint64>(dequeued);
+    obj["enqueuePerSec"] = enqueueRate;
+    obj["dequeuePerSec"] = dequeueRate;
+    obj["highWater"] = static_cast<qint64>(m_highWater.load(std::memory_order_relaxed));
+    obj["producerBlockedMs"] = m_producerBlockedNs.load(std::memory_order_relaxed) / 1e6;
+    obj["consumerStarvedMs"] = m_consumerStarvedNs.load(std::memory_order_relaxed) / 1e6;
+    obj["residenceUs"] = m_residenceUs.toJson();
+    return obj;
+}
+
+// ---------------- StageStats ----------------
+StageStats::~StageStats() {
+    if (!m_telemetryName.isEmpty()) {
+        TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+    }
+}
+
+void StageStats::setName(const QString &name) {
+    if (!m_telemetryName.isEmpty()) {
+        TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+    }
+    m_telemetryName = TelemetryRegistry::instance().registerSource(name, [this]() {
+        return snapshot();
+    });
+}
+
+void StageStats::end(int64_t beginNs, int items) {
+    const int64_t elapsedNs = QueueStats::nowNs() - beginNs;
+    m_items.fetch_add(static_cast<uint64_t>(items), std::memory_order_relaxed);
+    m_busyNs.fetch_add(elapsedNs, std::memory_order_relaxed);
+    m_processUs.record(elapsedNs / 1000);
+    m_threadCpuNs.store(currentThreadCpuNs(), std::memory_order_relaxed);
+}
+
+int64_t StageStats::currentThreadCpuNs() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    const auto toNs = [](const FILETIME &ft) {
+        return ((static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) * 100;
+    };
+    return toNs(kernel) + toNs(user);
+#else
+    timespec ts{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+QJsonObject StageStats::snapshot() const {
+    QJsonObject obj;
+    obj["items"] = static_cast<qint64>(m_items.load(std::memory_order_relaxed));
+    obj["busyMs"] = m_busyNs.load(std::memory_order_relaxed) / 1e6;
+    obj["threadCpuMs"] = m_threadCpuNs.load(std::memory_order_relaxed) / 1e6;
+    obj["processUs"] = m_processUs.toJson();
+    return obj;
+}
+
+// ---------------- TelemetryRegistry ----------------
+TelemetryRegistry &TelemetryRegistry::instance() {
+    static TelemetryRegistry registry;
+    return registry;
+}
+
+QString TelemetryRegistry::registerSource(const QString &name, Source source) {
+    QMutexLocker locker(&m_mutex);
+    QString unique = name;
+    for (int suffix = 2; m_sources.count(unique); ++suffix) {
+        unique = QString("%1#%2").arg(name).arg(suffix);
+    }
+    m_sources[unique] = std::move(source);
+    return unique;
+}
+
+void TelemetryRegistry::unregisterSource(const QString &name) {
+    QMutexLocker locker(&m_mutex);
+    m_sources.erase(name);
+}
+
+QJsonObject TelemetryRegistry::snapshot() {
+    QJsonObject sources;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto &entry: m_sources) {
+            sources[entry.first] = entry.second();
+        }
+    }
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    root["sources"] = sources;
+    return root;
+}
+
+void TelemetryRegistry::dump(bool toLog, const QString &jsonPath) {
+    const QJsonObject root = snapshot();
+    if (toLog) {
+        const QJsonObject sources = root["sources"].toObject();
+        for (auto it = sources.begin(); it != sources.end(); ++it) {
+            const QByteArray line = QJsonDocument(it.value().toObject()).toJson(QJsonDocument::Compact);
+            WRITE_LOG("[telemetry] %s %s", it.key().toUtf8().constData(), line.constData());
+        }
+    }
+    if (!jsonPath.isEmpty()) {
+        QFile file(jsonPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            WRITE_LOG("Failed to open telemetry file %s", jsonPath.toUtf8().constData());
+            return;
+        }
+        file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+    }
+}
@@ -1,60 +1,215 @@
 ﻿#include "RTPDepacketizer.h"
-#include <winsock2.h>
 #include "log_global.h"
 #include "logqueue.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#endif
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
 RTPDepacketizer::RTPDepacketizer(int sampleRate, QUEUE_DATA<AVPacketPtr>* outputQueue, bool isH264, QObject* parent)
-    : QObject(parent), m_outputQueue(outputQueue),m_isH264(isH264)
+    : QObject(parent), m_isH264(isH264), m_outputQueue(outputQueue)
 {
     // 保存 sample rate，用于将 RTP timestamp 差值转换为毫秒
     m_payloadSampleRate = sampleRate;
     m_lastTimestamp = 0;
     m_hasLastTimestamp = false;
 
-    // 设定缓冲深度，降低到 80ms 以减少首次进入 BUFFERING 的延迟
+    // 初始缓冲深度 80ms，之后按到达时延直方图的 95 分位自适应：
+    // 局域网收敛到 20ms 左右，抖动大的无线网络最多放宽到 150ms
     const unsigned nominalDepthMs = 80;
     m_jitterBuffer = new RTPJitter(nominalDepthMs, sampleRate);
-    if (m_jitterBuffer) {
-        WRITE_LOG("jitterBuffer init (nominal=%d ms)", nominalDepthMs);
+    m_jitterBuffer->set_adaptive(true, 20, 150, 0.95);
+    WRITE_LOG("jitterBuffer init (nominal=%d ms, adaptive 20-150 ms)", nominalDepthMs);
+    // Jitter Buffer 的核心是 "延时输出"：由独立的调度线程按每个包的到期时间精确取出，
+    // 不再用固定周期的定时器轮询（最多引入一个周期的量化延迟，空闲时也在空转）
+    m_telemetryName = TelemetryRegistry::instance().registerSource(
+        m_isH264 ? "rtp.video.playout" : "rtp.audio.playout", [this]() { return playoutStats(); });
+    m_playoutRunning = true;
+    m_playoutThread = std::thread(&RTPDepacketizer::playoutLoop, this);
+}
+
+RTPDepacketizer::~RTPDepacketizer() {
+    {
+        std::lock_guard<std::mutex> lock(m_playoutMutex);
+        m_playoutRunning = false;
     }
-    // 启动一个定时器来驱动数据 "流出"
-    // Jitter Buffer 的核心是 "延时输出"，所以需要定时去取
-    m_consumerTimer = new QTimer(this);
-    if (m_consumerTimer) {
-        WRITE_LOG("Timer init");
+    m_playoutCond.notify_one();
+    if (m_playoutThread.joinable()) {
+        m_playoutThread.join();
     }
-    connect(m_consumerTimer, &QTimer::timeout, this, &RTPDepacketizer::processPop);
+    TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+    delete m_nack.exchange(nullptr);
+    delete m_jitterBuffer;
+}
 
 
-    m_consumerTimer->start(10); // 每 10ms 尝试取一次数据
+void RTPDepacketizer::playoutLoop() {
+#ifdef _WIN32
+    // 默认系统时钟粒度 15.6ms，调度线程运行期间提高到 1ms
+    timeBeginPeriod(1);
+#endif
+    std::unique_lock<std::mutex> lock(m_playoutMutex);
+    while (m_playoutRunning) {
+        lock.unlock();
+        processPop();
+        timepoint nextDue = m_jitterBuffer->next_due();
+        if (NackGenerator* nack = m_nack.load(std::memory_order_relaxed)) {
+            // 断流时没有新包触发 pushPacket 里的 process，重试由这里按到期时间驱动
+            const int64_t nowUs = clocks::duration_cast<clocks::microseconds>(stdclock::now().time_since_epoch()).count();
+            nack->process(static_cast<int64_t>(m_jitterBuffer->read_sequence()), nowUs);
+            const int64_t nackUs = nack->nextProcessUs();
+            if (nackUs != INT64_MAX) {
+                nextDue = (std::min)(nextDue, timepoint(clocks::microseconds(nackUs)));
+            }
+        }
+        lock.lock();
+        if (!m_playoutRunning) {
+            break;
+        }
+        if (m_playoutKick) {
+            // 取包期间有新包到达，重新计算
+            m_playoutKick = false;
+            continue;
+        }
+        auto wakeCondition = [this]() { return m_playoutKick || !m_playoutRunning; };
+        if (nextDue == (timepoint::max)()) {
+            m_scheduledWakeNs.store(INT64_MAX - 1);
+            m_playoutCond.wait(lock, wakeCondition);
+        } else {
+            m_scheduledWakeNs.store(clocks::duration_cast<clocks::nanoseconds>(nextDue.time_since_epoch()).count());
+            m_playoutCond.wait_until(lock, nextDue, wakeCondition);
+        }
+        m_scheduledWakeNs.store(INT64_MAX);
+        m_playoutKick = false;
+        m_playoutWakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
 }
 
-RTPDepacketizer::~RTPDepacketizer() {
-    delete m_jitterBuffer;
+
+void RTPDepacketizer::wakePlayoutIfEarlier(const rawrtp_ptr& packet) {
+    // 只有消费端可以遍历缓冲区；新包让队首提前的唯一可能是它自己更早到期
+    const timepoint nextDue = m_jitterBuffer->due_time(packet);
+    const int64_t dueNs = clocks::duration_cast<clocks::nanoseconds>(nextDue.time_since_epoch()).count();
+    if (dueNs >= m_scheduledWakeNs.load()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_playoutMutex);
+        m_playoutKick = true;
+    }
+    m_playoutCond.notify_one();
+}
+
+
+void RTPDepacketizer::enableRetransmission(uint32_t localSsrc, int rtxPayloadType, NackGenerator::SendRtcp send) {
+    m_rtxPayloadType = rtxPayloadType;
+    NackGenerator* nack = new NackGenerator(localSsrc, std::move(send));
+    delete m_nack.exchange(nack);
+}
+
+
+// RFC 4588：RTX 负载 = 原始序号 OSN（2 字节）+ 原始负载，头部换回媒体流的 SSRC/PT/序号
+AVBufferRef* RTPDepacketizer::unwrapRtx(const uint8_t* data, size_t len, size_t& outLen) {
+    size_t payloadSize = 0;
+    const size_t headerLen = rtp_payload_offset(data, len, &payloadSize);
+    if (headerLen == 0 || payloadSize <= 2 || m_mediaSsrc == 0) {
+        return nullptr;
+    }
+    const uint8_t* rtxPayload = data + headerLen;
+    m_rtxScratch.assign(data, data + headerLen);
+    m_rtxScratch.insert(m_rtxScratch.end(), rtxPayload + 2, rtxPayload + payloadSize);
+
+    uint8_t* p = m_rtxScratch.data();
+    p[0] &= ~0x20;                                                          // padding 已去掉
+    p[1] = static_cast<uint8_t>((p[1] & 0x80) | (m_mediaPayloadType & 0x7F));
+    p[2] = rtxPayload[0];                                                   // OSN
+    p[3] = rtxPayload[1];
+    p[8] = static_cast<uint8_t>(m_mediaSsrc >> 24);
+    p[9] = static_cast<uint8_t>(m_mediaSsrc >> 16);
+    p[10] = static_cast<uint8_t>(m_mediaSsrc >> 8);
+    p[11] = static_cast<uint8_t>(m_mediaSsrc);
+    outLen = m_rtxScratch.size();
+    return m_packetPool.acquire(m_rtxScratch.data(), outLen);
+}
+
+
+int RTPDepacketizer::takeTimeStretchUs(int maxUs) {
+    return m_jitterBuffer->take_time_stretch_us(maxUs);
+}
+
+
+QJsonObject RTPDepacketizer::playoutStats() {
+    QJsonObject obj;
+    obj["latenessUs"] = m_playoutLateness.toJson();
+    obj["wakeups"] = static_cast<qint64>(m_playoutWakeups.load(std::memory_order_relaxed));
+    obj["lateArrivals"] = static_cast<qint64>(m_lateArrivals.load(std::memory_order_relaxed));
+    obj["received"] = static_cast<qint64>(m_receivedPackets.load(std::memory_order_relaxed));
+    obj["invalid"] = static_cast<qint64>(m_invalidPackets.load(std::memory_order_relaxed));
+    obj["rejected"] = static_cast<qint64>(m_rejectedPackets.load(std::memory_order_relaxed));
+    obj["poolExhausted"] = static_cast<qint64>(m_poolExhausted.load(std::memory_order_relaxed));
+    obj["nominalDepthMs"] = m_jitterBuffer->get_nominal_depth();
+    obj["targetDepthMs"] = m_jitterBuffer->get_target_depth();
+    obj["depthMs"] = m_jitterBuffer->get_depth_ms();
+    obj["jitter"] = static_cast<qint64>(m_jitterBuffer->jitter());
+    obj["lost"] = m_jitterBuffer->lost_count();
+    obj["outOfOrder"] = m_jitterBuffer->out_of_order_count();
+    obj["overflow"] = m_jitterBuffer->overflow_count();
+    if (NackGenerator* nack = m_nack.load(std::memory_order_relaxed)) {
+        QJsonObject nackObj;
+        nackObj["rttMs"] = nack->rttMs();
+        nackObj["nacksSent"] = static_cast<qint64>(nack->nacksSent());
+        nackObj["requested"] = static_cast<qint64>(nack->sequencesRequested());
+        nackObj["recovered"] = static_cast<qint64>(nack->recovered());
+        nackObj["givenUp"] = static_cast<qint64>(nack->givenUp());
+        nackObj["pending"] = nack->pending();
+        obj["nack"] = nackObj;
+    }
+    return obj;
 }
 
 // 【生产者】网络线程调用：推入数据
 void RTPDepacketizer::pushPacket(const uint8_t* data, size_t len) {
-    WRITE_LOG("push packet to jitterBuffer");
-    if (!data || len < sizeof(RTPHeader)) {
-        WRITE_LOG("pushPacket: invalid data or too short for RTP header (len=%d)", (int)len);
+    if (!data || len < sizeof(RTPHeader) || len > UINT16_MAX) {
+        m_invalidPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_receivedPackets.fetch_add(1, std::memory_order_relaxed);
+    // 同一端口上复用的 RTCP（SR/SDES 等）不是媒体包，不进 jitter buffer
+    if (rtp_is_rtcp(data, len)) {
         return;
     }
-    // 1. 封装成库需要的对象
-    // 注意：RTPPacket 构造函数会发生一次内存拷贝，这是必要的
-    rawrtp_ptr packet = std::make_shared<RTPPacket>((uint8_t*)data, len);
-    if (packet == NULL) {
-        WRITE_LOG("Packetizer failed");
+    // 1. 拷入池化缓冲区，这是整条接收链路上唯一的一次拷贝
+    //    RTX 包先还原成原始序号空间里的媒体包
+    const bool retransmitted = (m_rtxPayloadType >= 0 && rtp_payload_type(data) == m_rtxPayloadType);
+    AVBufferRef* buffer = nullptr;
+    size_t packetLen = len;
+    if (retransmitted) {
+        buffer = unwrapRtx(data, len, packetLen);
+        if (!buffer) {
+            return; // 纯 padding 的带宽探测包或格式错误
+        }
+    }
+    else {
+        m_mediaSsrc = rtp_ssrc(data);
+        m_mediaPayloadType = rtp_payload_type(data);
+        buffer = m_packetPool.acquire(data, len);
+    }
+    if (!buffer) {
+        m_poolExhausted.fetch_add(1, std::memory_order_relaxed);
         return;
     }
+    rawrtp_ptr packet = std::make_shared<RTPPacket>(buffer, static_cast<uint16>(packetLen));
+    packet->retransmitted = retransmitted;
 
     // 解析 RTP header 的 timestamp（用于估算 payload_ms）
-    uint32_t timestamp = 0;
-    RTPHeader* rtpHeader = reinterpret_cast<RTPHeader*>(packet->pData);
-    timestamp = ntohl(rtpHeader->timestamp);
+    uint32_t timestamp = rtp_timestamp(packet->pData);
 
     uint32_t payload_ms = 0;
     if (!m_hasLastTimestamp) {
@@ -63,195 +218,134 @@ void RTPDepacketizer::pushPacket(const uint8_t* data, size_t len) {
         int nominal = 0;
         if (m_jitterBuffer) nominal = m_jitterBuffer->get_nominal_depth();
         payload_ms = (nominal > 0) ? static_cast<uint32_t>(nominal) : 20;
+        m_lastTimestamp = timestamp;
     }
     else {
-        uint32_t delta = timestamp - m_lastTimestamp; // 无符号处理 wrap
-        if (m_payloadSampleRate > 0) {
-            payload_ms = static_cast<uint32_t>((static_cast<uint64_t>(delta) * 1000ULL) / static_cast<uint64_t>(m_payloadSampleRate));
-            if (payload_ms > 10000) payload_ms = 10000;
-        } else {
-            payload_ms = 0;
+        // 有符号差值处理 wrap；乱序包和重传包比上一个包旧，不计时长
+        const int32_t delta = static_cast<int32_t>(timestamp - m_lastTimestamp);
+        if (delta > 0) {
+            if (m_payloadSampleRate > 0) {
+                payload_ms = static_cast<uint32_t>((static_cast<uint64_t>(delta) * 1000ULL) / static_cast<uint64_t>(m_payloadSampleRate));
+                if (payload_ms > 10000) payload_ms = 10000;
+            }
+            m_lastTimestamp = timestamp;
         }
     }
-    m_lastTimestamp = timestamp;
 
     // 关键：设置 Payload 时间，供 jitter buffer depth 计算使用。
     packet->payload_ms = static_cast<uint16_t>(payload_ms);
 
-    // 3. 推入 Jitter Buffer
+    // 3. 推入 Jitter Buffer（成功路径不打日志，这里是每个包都会走的热路径）
     RTPJitter::RESULT  res = m_jitterBuffer->push(packet);
-    if (res == RTPJitter::SUCCESS) {
-        WRITE_LOG("push packet in the jitterbuffer (payload_ms=%d)", packet->payload_ms);
-    } else if (res == RTPJitter::BUFFER_OVERFLOW) {
-        WRITE_LOG("push packet failed: BUFFER_OVERFLOW (payload_ms=%d)", packet->payload_ms);
-    } else if (res == RTPJitter::BAD_PACKET) {
-        WRITE_LOG("push packet failed: BAD_PACKET (payload_ms=%d)", packet->payload_ms);
-    } else {
-        WRITE_LOG("push packet failed: result=%d (payload_ms=%d)", (int)res, packet->payload_ms);
+    if (res == RTPJitter::SUCCESS || res == RTPJitter::BUFFER_OVERFLOW) {
+        if (m_jitterBuffer->due_time(packet) < stdclock::now()) {
+            m_lateArrivals.fetch_add(1, std::memory_order_relaxed);
+        }
+        wakePlayoutIfEarlier(packet);
+    }
+    if (NackGenerator* nack = m_nack.load(std::memory_order_relaxed)) {
+        // 缺口立即请求重传，之后按 RTT 重试；jitter buffer 把缺口多留约 1.25 个 RTT
+        const int64_t nowUs = clocks::duration_cast<clocks::microseconds>(stdclock::now().time_since_epoch()).count();
+        nack->onPacket(packet->ext_sequence, rtp_ssrc(packet->pData), retransmitted, nowUs);
+        nack->process(static_cast<int64_t>(m_jitterBuffer->read_sequence()), nowUs);
+        const int lossWaitMs = (std::min)(nack->rttMs() * 5 / 4, kMaxLossWaitMs);
+        if (lossWaitMs != m_lossWaitMs) {
+            m_lossWaitMs = lossWaitMs;
+            m_jitterBuffer->set_loss_wait(lossWaitMs);
+        }
+    }
+
+    // 异常结果只计数，由遥测输出：重复包、重传晚到的包在有 RTX 时是常态，逐包写日志会拖慢网络线程
+    // BUFFER_OVERFLOW：包已存入，但环形缓冲绕了一圈，覆盖了一个还没播放的旧包（jitter buffer 的 overflow 计数）
+    if (res != RTPJitter::SUCCESS && res != RTPJitter::BUFFER_OVERFLOW) {
+        m_rejectedPackets.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
 
 void RTPDepacketizer ::processPop() {
     rawrtp_ptr packet;
+    const int64_t stageBegin = m_stageStats.begin();
+    int popped = 0;
 
     // 循环取出所有可用的包
     while (true) {
         RTPJitter::RESULT res = m_jitterBuffer->pop(packet);
 
         if (res == RTPJitter::SUCCESS) {
-            WRITE_LOG("pop a packet from jitterBuffer");
+            ++popped;
+            // 记录调度滞后：实际出队时间 - 到期时间
+            const auto lateness = stdclock::now() - m_jitterBuffer->due_time(packet);
+            m_playoutLateness.record(clocks::duration_cast<clocks::microseconds>(lateness).count());
             // === 成功取出一个有序包 ===
             // packet->pData 是完整的 RTP 包（含 Header）
-            // packet->nLen 是长度
-
-            // 1. 跳过 RTP Header 获取 Payload
-            // 该库提供了 helper 但我们手动算更稳：RTP Header 最小 12 字节
-            // 严谨做法是解析 Header 看是否有 Extension (CC, X bit)
-            // 这里简单复用之前的逻辑，或者解析第一个字节
-            size_t headerLen = 12;
-            if (packet->nLen > 0) {
-                uint8_t vpxcc = packet->pData[0];
-                int csrcCount = vpxcc & 0x0F;
-                headerLen += (csrcCount * 4);
-                // 暂不处理 Extension bit (X) 的复杂情况，通常 WebRTC 视频流会有 Extension
-                // 建议使用库自带的 helper (虽然它是 private 的，可能需要稍微改一下库暴露出来，或者自己写)
-            }
-
-            if (packet->nLen > headerLen) {
-                uint32_t timestamp = 0;
-                RTPHeader* rtpHeader = (RTPHeader*)packet->pData;
-                timestamp = ntohl(rtpHeader->timestamp);
-                // 构造 vector 传给 reassembleH264
-                                // 指针运算：跳过 Header
-                const uint8_t* payloadPtr = packet->pData + headerLen;
-                size_t payloadSize = packet->nLen - headerLen;
-
-                std::vector<uint8_t> payloadVec(payloadPtr, payloadPtr + payloadSize);
-                if (m_isH264) {
-                    // 视频：需要复杂的 FU-A 组帧
-                    reassembleH264(payloadVec, timestamp);
+            if (m_isH264) {
+                // 视频：按 RFC 6184 解包并组成完整的一帧
+                m_h264Assembler.push(packet, m_assembled);
+                for (AVPacketPtr& frame : m_assembled) {
+                    m_outputQueue->enqueue(move(frame));
                 }
-                else {
-                    // 音频 (Opus)：不需要组帧，直接打包入队！
-                    AVPacketPtr packet(av_packet_alloc());
-
-                    av_new_packet(packet.get(), payloadVec.size());
-                    memcpy(packet->data, payloadVec.data(), payloadVec.size());
-
-                    packet->pts = timestamp;
-                    packet->dts = timestamp;
-
-                    // 直接推给 Audio Packet Queue
-                    m_outputQueue->enqueue(move(packet));
-                    WRITE_LOG("pop a audio packet to decoder");
-                    
+                m_assembled.clear();
+            }
+            else {
+                // 音频 (Opus)：不需要组帧，AVPacket 直接引用 RTP 包里的 payload
+                // 头部解析跳过 CSRC、扩展头（X 位），并去掉尾部 padding
+                size_t payloadSize = 0;
+                const size_t headerLen = rtp_payload_offset(packet->pData, packet->nLen, &payloadSize);
+                if (headerLen > 0 && payloadSize > 0) {
+                    // RTP padding 落在 AVPacket 的填充区里，清零以满足 FFmpeg 的要求
+                    memset(packet->pData + headerLen + payloadSize, 0, packet->nLen - headerLen - payloadSize);
+                    AVPacketPtr audioPacket = wrapPayload(packet, packet->pData + headerLen, payloadSize);
+                    if (audioPacket) {
+                        const uint32_t timestamp = rtp_timestamp(packet->pData);
+                        audioPacket->pts = timestamp;
+                        audioPacket->dts = timestamp;
+                        // 直接推给 Audio Packet Queue
+                        m_outputQueue->enqueue(move(audioPacket));
+                    }
                 }
             }
         }
         else if (res == RTPJitter::DROPPED_PACKET) {
             // === 丢包处理 ===
             // 库告诉我们要跳过一个包（中间缺货超时了）
-            // 这意味着 FU-A 组帧肯定失败了，必须重置组帧器状态
-            resetH264Assembler();
+            // 正在拼接的分片 NAL 作废，当前帧标记为损坏
+            if (m_isH264) {
+                m_h264Assembler.markLoss();
+            }
             // 继续循环，看后面有没有包
         }
         else {
-            // BUFFERING 或 EMPTY，跳出循环等待下次 Timer
+            // BUFFERING（队首未到期）或 EMPTY，回到调度线程睡到下一个到期时间
             break;
         }
     }
+    // 空转唤醒不计入，否则直方图被大量 0 耗时稀释
+    if (popped > 0) {
+        m_stageStats.end(stageBegin, popped);
+    }
 }
 
 
-void RTPDepacketizer ::resetH264Assembler() {
-    m_isReassembling = false;
-    m_fuBuffer.clear();
-}
-
-
-void RTPDepacketizer ::reassembleH264(const std::vector<uint8_t>& payload, uint32_t timestamp) {
-    if (payload.empty()) return;
-
-    uint8_t nalHeader = payload[0];
-    uint8_t type = nalHeader & 0x1F;
-
-    // H.264 Start Code
-    const uint8_t startCode[] = { 0x00, 0x00, 0x00, 0x01 };
-
-    if (type >= 1 && type <= 23) {
-        // === Single NAL Unit ===
-        // 这是一个完整的包 (如 SPS, PPS, SEI, 或小切片)
-        // 只有这种时候才可能是完整的一帧，或者是参数集
-
-        AVPacketPtr packet(av_packet_alloc());
-
-        int totalSize = 4 + payload.size();
-        av_new_packet(packet.get(), totalSize);
-
-        // 写入 Start Code
-        memcpy(packet->data, startCode, 4);
-        // 写入 Payload
-        memcpy(packet->data + 4, payload.data(), payload.size());
-
-        packet->pts = timestamp; // 注意：这里的时间戳通常需要转换时间基
-        packet->dts = timestamp;
-
-        // 5. 入队
-        m_outputQueue->enqueue(move(packet));
-        WRITE_LOG("pop a video packet to decoder (Single NAL Unit)");
-        // 如果正在组装 FU-A 却来了个 Single NAL，说明之前的 FU-A 丢包了，重置状态
-        m_isReassembling = false;
-        m_fuBuffer.clear();
+AVPacketPtr RTPDepacketizer::wrapPayload(const rawrtp_ptr& packet, const uint8_t* data, size_t size) {
+    AVPacketPtr out(av_packet_alloc());
+    if (!out) {
+        return nullptr;
     }
-    else if (type == 28) {
-        // === FU-A (Fragmentation Unit A) ===
-        if (payload.size() < 2) return;
-
-        uint8_t fuHeader = payload[1];
-        bool startBit = fuHeader & 0x80;
-        bool endBit = fuHeader & 0x40;
-        // uint8_t forbidden = nalHeader & 0x80;
-        uint8_t nri = nalHeader & 0x60;
-        uint8_t originalType = fuHeader & 0x1F;
-
-        if (startBit) {
-            // 分片开始
-            m_fuBuffer.clear();
-            m_isReassembling = true;
-
-            // 还原原始 NAL Header
-            uint8_t reconstructedHeader = nri | originalType;
-
-            // 写入 Start Code + 原始 Header
-            m_fuBuffer.insert(m_fuBuffer.end(), startCode, startCode + 4);
-            m_fuBuffer.push_back(reconstructedHeader);
-
-            // 写入数据 (跳过 FU-A 的两个头字节)
-            m_fuBuffer.insert(m_fuBuffer.end(), payload.begin() + 2, payload.end());
+    if (packet->buf) {
+        // 池化缓冲区在包尾已经清零了 padding，满足 AVPacket 的要求
+        out->buf = av_buffer_ref(packet->buf);
+        if (!out->buf) {
+            return nullptr;
         }
-        else if (m_isReassembling) {
-            // 分片中间 或 结束
-            m_fuBuffer.insert(m_fuBuffer.end(), payload.begin() + 2, payload.end());
-
-            if (endBit) {
-                // 分片结束，打包发送
-                AVPacketPtr packet(av_packet_alloc());
-
-                av_new_packet(packet.get(), m_fuBuffer.size());
-                memcpy(packet->data, m_fuBuffer.data(), m_fuBuffer.size());
-
-                packet->pts = timestamp;
-                packet->dts = timestamp;
-
-                m_outputQueue->enqueue(move(packet));
-                WRITE_LOG("pop a video packet to decoder (Fragmentation Unit)");
-                // 重置
-                m_fuBuffer.clear();
-                m_isReassembling = false;
-            }
+        out->data = const_cast<uint8_t*>(data);
+        out->size = static_cast<int>(size);
+    }
+    else {
+        if (av_new_packet(out.get(), static_cast<int>(size)) < 0) {
+            return nullptr;
         }
+        memcpy(out->data, data, size);
     }
-    // 其他类型如 STAP-A (Type 24) 如果需要支持多 NAL 聚合，也需要处理
+    return out;
 }
-
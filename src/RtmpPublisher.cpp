@@ -196,7 +196,9 @@ void RtmpPublisher::doPublishingWork() {
     bool is_video = (dest_stream == m_videoStream);
     const char* media_type = is_video ? "VIDEO" : "AUDIO";
     //WRITE_LOG("Writing Packet: %s PTS: %lld DTS: %lld Size: %d",media_type, packet->pts, packet->dts, packet->size);
+    const int64_t stageBegin = m_stageStats.begin();
     int ret = av_interleaved_write_frame(m_outputFmtCtx, packet.get());
+    m_stageStats.end(stageBegin);
     if (ret < 0) {
         char errbuf[1024] = {0};
         av_strerror(ret, errbuf, sizeof(errbuf));
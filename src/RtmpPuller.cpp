@@ -6,17 +6,26 @@
 #include <QScreen>
 #include <QDebug>
 
-RtmpPuller::RtmpPuller(QUEUE_DATA<std::unique_ptr<QImage> >* MainQimageQueue, 
+RtmpPuller::RtmpPuller(ImageMailbox* imageMailbox,
 	QObject* parent)
-	: QObject{parent}, m_MainQimageQueue(MainQimageQueue)
+	: QObject{parent}, m_imageMailbox(imageMailbox)
 {
 	m_videoPacketQueue = new QUEUE_DATA<AVPacketPtr>();
 	m_audioPacketQueue = new QUEUE_DATA<AVPacketPtr>();
 	m_dummyVideoFrameQueue = new QUEUE_DATA<AVFramePtr>();
+	// 解码跟不上时视频丢到下一个关键帧，音频丢最旧的，避免拉流线程被阻塞导致延迟越积越大
+	m_videoPacketQueue->setOverflowPolicy(OverflowPolicy::DropUntilKeyframe, CapacityUnit::Items, 300);
+	m_audioPacketQueue->setOverflowPolicy(OverflowPolicy::DropOldest, CapacityUnit::Items, 200);
+	// 拉流端不转码，解码出的帧没有消费者，上限为 0 即全部丢弃
+	m_dummyVideoFrameQueue->setOverflowPolicy(OverflowPolicy::DropNewest, CapacityUnit::Items, 0);
+	m_videoPacketQueue->setName("rtmpPull.videoPacket");
+	m_audioPacketQueue->setName("rtmpPull.audioPacket");
 
 	m_videoDecoder = new ffmpegVideoDecoder(m_videoPacketQueue,
-											m_MainQimageQueue, // 使用外部 QImage 队列
+											m_imageMailbox, // 使用外部显示信箱
 											m_dummyVideoFrameQueue);
+	// RTMP 本身有秒级缓冲，多出几帧解码延迟换吞吐
+	m_videoDecoder->setThreading(ffmpegVideoDecoder::Threading::Frame);
 
 	m_audioPlayer = new AudioPlayer(m_audioPacketQueue);
 
@@ -205,6 +214,8 @@ void RtmpPuller::doPullingWork() {
 
 	// 将包放入正确的内部队列
 	if (packet->stream_index == m_videoStreamIndex) {
+		// 内部约定视频为流 0，视频队列的关键帧等待按它识别（QueueItemTraits::needsKeyframe）
+		packet->stream_index = 0;
 		m_videoPacketQueue->enqueue(std::move(packet));
 	}
 	else if (packet->stream_index == m_audioStreamIndex) {
@@ -256,6 +267,13 @@ void RtmpPuller::stopPulling() {
 	WRITE_LOG("RtmpPuller: All threads stopped.");
 }
 
+void RtmpPuller::setDisplaySize(const QSize& size) {
+	// 与 clear() 同在拉流线程执行，解码器不会在这期间被释放
+	if (m_videoDecoder) {
+		m_videoDecoder->setTargetSize(size);
+	}
+}
+
 void RtmpPuller::clear() {
 	stopPulling();
 	// 确保在退出前清理 Demuxer 资源
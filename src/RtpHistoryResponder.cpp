@@ -0,0 +1,208 @@
+﻿#include "RtpHistoryResponder.h"
+#include "logqueue.h"
+#include "log_global.h"
+#include "rtp.h"
+#include <algorithm>
+#include <cstring>
+
+#include <rtc/message.hpp>
+
+RtpHistoryResponder::RtpHistoryResponder(uint32_t ssrc, int windowMs, size_t maxBytes, int maxKbps)
+    : m_ssrc(ssrc),
+      m_windowUs(windowMs * 1000LL),
+      m_maxBytes(maxBytes),
+      m_bytesPerUs(maxKbps * 1000.0 / 8.0 / 1e6),
+      m_bucketCapacity(maxKbps * 1000.0 / 8.0 * kBurstMs / 1000.0) {
+    m_tokens = m_bucketCapacity;
+}
+
+void RtpHistoryResponder::setRtx(uint32_t rtxSsrc, int rtxPayloadType) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rtxSsrc = rtxSsrc;
+    m_rtxPayloadType = static_cast<uint8_t>(rtxPayloadType & 0x7F);
+}
+
+void RtpHistoryResponder::outgoing(rtc::message_vector &messages, const rtc::message_callback &send) {
+    (void)send;
+    const int64_t nowUs = clocks::duration_cast<clocks::microseconds>(stdclock::now().time_since_epoch()).count();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto &message : messages) {
+        if (!message || message->type == rtc::Message::Control) {
+            continue;
+        }
+        const auto *p = reinterpret_cast<const uint8_t *>(message->data());
+        if (message->size() < RTP_HEADER_LENGTH || rtp_is_rtcp(p, message->size()) || rtp_ssrc(p) != m_ssrc) {
+            continue;
+        }
+        // 必须拷贝：下游 SRTP 会在原缓冲区上就地加密
+        store(message, nowUs);
+    }
+    evict(nowUs);
+}
+
+void RtpHistoryResponder::incoming(rtc::message_vector &messages, const rtc::message_callback &send) {
+    m_nackSeqs.clear();
+    for (const auto &message : messages) {
+        if (message && message->type == rtc::Message::Control) {
+            collectNacks(message->data(), message->size(), m_nackSeqs);
+        }
+    }
+    if (m_nackSeqs.empty()) {
+        return; // NACK 仍留在 messages 里，后面的处理器照常能看到
+    }
+    m_requested.fetch_add(m_nackSeqs.size(), std::memory_order_relaxed);
+
+    const int64_t nowUs = clocks::duration_cast<clocks::microseconds>(stdclock::now().time_since_epoch()).count();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    evict(nowUs);
+    for (uint16_t seq : m_nackSeqs) {
+        Entry *entry = find(seq);
+        if (!entry) {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (entry->lastResentUs != 0 && nowUs - entry->lastResentUs < kMinResendIntervalMs * 1000LL) {
+            // 对端在重传到达前又请求了一次，再发只会加重拥塞
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (!takeTokens(entry->data.size(), nowUs)) {
+            m_rateLimited.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        resend(*entry, nowUs, send);
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RtpHistoryResponder::store(const rtc::message_ptr &message, int64_t nowUs) {
+    const uint16_t seq = rtp_sequence(reinterpret_cast<const uint8_t *>(message->data()));
+    if (!m_history.empty() && seq != static_cast<uint16_t>(m_history.back().seq + 1)) {
+        // 打包器重置了序号，旧历史按序号已经无法定位
+        WRITE_LOG("RtpHistoryResponder: sequence discontinuity %u -> %u, history cleared",
+                  m_history.back().seq, seq);
+        while (!m_history.empty()) {
+            m_spare.push_back(std::move(m_history.front().data));
+            m_history.pop_front();
+        }
+        m_bytes = 0;
+    }
+
+    Entry entry;
+    entry.seq = seq;
+    entry.sentUs = nowUs;
+    if (!m_spare.empty()) {
+        entry.data = std::move(m_spare.back());
+        m_spare.pop_back();
+    }
+    entry.data.assign(message->begin(), message->end());
+    m_bytes += entry.data.size();
+    m_history.push_back(std::move(entry));
+}
+
+void RtpHistoryResponder::evict(int64_t nowUs) {
+    while (!m_history.empty() &&
+           (nowUs - m_history.front().sentUs > m_windowUs || m_bytes > m_maxBytes)) {
+        m_bytes -= m_history.front().data.size();
+        if (m_spare.size() < 256) {
+            m_spare.push_back(std::move(m_history.front().data));
+        }
+        m_history.pop_front();
+    }
+    m_historyPackets.store(m_history.size(), std::memory_order_relaxed);
+    m_historyBytes.store(m_bytes, std::memory_order_relaxed);
+}
+
+RtpHistoryResponder::Entry *RtpHistoryResponder::find(uint16_t seq) {
+    if (m_history.empty()) {
+        return nullptr;
+    }
+    // 序号连续，直接按与队首的距离定位（自然处理 16 位回绕）
+    const size_t index = static_cast<uint16_t>(seq - m_history.front().seq);
+    if (index >= m_history.size() || m_history[index].seq != seq) {
+        return nullptr;
+    }
+    return &m_history[index];
+}
+
+// RFC 4585 6.2.1 Generic NACK：复合包里可能有 SR/RR/SDES 等，逐个按长度字段跳过
+void RtpHistoryResponder::collectNacks(const std::byte *data, size_t len, std::vector<uint16_t> &seqs) {
+    rtcp_for_each(reinterpret_cast<const uint8_t *>(data), len, [&](const uint8_t *rtcp, size_t packetLen) {
+        // 媒体源 SSRC 与 RTP 头里的 SSRC 位置相同
+        if (packetLen < 12 || rtcp_packet_type(rtcp) != 205 || rtcp_count(rtcp) != 1 || rtp_ssrc(rtcp) != m_ssrc) {
+            return;
+        }
+        m_nacksReceived.fetch_add(1, std::memory_order_relaxed);
+        for (size_t fci = 12; fci + 4 <= packetLen; fci += 4) {
+            const uint16_t pid = static_cast<uint16_t>((rtcp[fci] << 8) | rtcp[fci + 1]);
+            const uint16_t blp = static_cast<uint16_t>((rtcp[fci + 2] << 8) | rtcp[fci + 3]);
+            seqs.push_back(pid);
+            for (int bit = 0; bit < 16; ++bit) {
+                if (blp & (1u << bit)) {
+                    seqs.push_back(static_cast<uint16_t>(pid + bit + 1));
+                }
+            }
+        }
+    });
+}
+
+void RtpHistoryResponder::resend(Entry &entry, int64_t nowUs, const rtc::message_callback &send) {
+    entry.lastResentUs = nowUs;
+    const auto *src = reinterpret_cast<const uint8_t *>(entry.data.data());
+    rtc::message_ptr out;
+
+    if (m_rtxSsrc == 0) {
+        // 原样重发（同 SSRC、同序号），不支持 RTX 的服务端（如 SRS）按普通乱序包处理
+        out = rtc::make_message(entry.data.begin(), entry.data.end());
+    } else {
+        // RFC 4588：RTX 载荷 = 原序号（OSN）+ 原载荷，头部换成 RTX 的 PT/SSRC/序号
+        size_t payloadSize = 0;
+        const size_t headerLen = rtp_payload_offset(src, entry.data.size(), &payloadSize);
+        if (headerLen == 0) {
+            return;
+        }
+        out = rtc::make_message(headerLen + 2 + payloadSize);
+        auto *dst = reinterpret_cast<uint8_t *>(out->data());
+        std::memcpy(dst, src, headerLen);
+        dst[0] &= ~0x20;                                                    // padding 不带过去
+        dst[1] = static_cast<uint8_t>((src[1] & 0x80) | m_rtxPayloadType);
+        dst[2] = static_cast<uint8_t>(m_rtxSeq >> 8);
+        dst[3] = static_cast<uint8_t>(m_rtxSeq & 0xFF);
+        for (int k = 0; k < 4; ++k) {
+            dst[8 + k] = static_cast<uint8_t>(m_rtxSsrc >> (24 - 8 * k));
+        }
+        dst[headerLen] = src[2];                                            // OSN
+        dst[headerLen + 1] = src[3];
+        std::memcpy(dst + headerLen + 2, src + headerLen, payloadSize);
+        ++m_rtxSeq;
+    }
+
+    m_resentBytes.fetch_add(out->size(), std::memory_order_relaxed);
+    send(out);
+}
+
+bool RtpHistoryResponder::takeTokens(size_t bytes, int64_t nowUs) {
+    if (m_lastRefillUs != 0) {
+        m_tokens = std::min(m_bucketCapacity, m_tokens + (nowUs - m_lastRefillUs) * m_bytesPerUs);
+    }
+    m_lastRefillUs = nowUs;
+    if (m_tokens < static_cast<double>(bytes)) {
+        return false;
+    }
+    m_tokens -= static_cast<double>(bytes);
+    return true;
+}
+
+QJsonObject RtpHistoryResponder::stats() const {
+    QJsonObject obj;
+    obj["historyPackets"] = static_cast<qint64>(m_historyPackets.load(std::memory_order_relaxed));
+    obj["historyBytes"] = static_cast<qint64>(m_historyBytes.load(std::memory_order_relaxed));
+    obj["nacksReceived"] = static_cast<qint64>(m_nacksReceived.load(std::memory_order_relaxed));
+    obj["requested"] = static_cast<qint64>(m_requested.load(std::memory_order_relaxed));
+    obj["hits"] = static_cast<qint64>(m_hits.load(std::memory_order_relaxed));
+    obj["misses"] = static_cast<qint64>(m_misses.load(std::memory_order_relaxed));
+    obj["rateLimited"] = static_cast<qint64>(m_rateLimited.load(std::memory_order_relaxed));
+    obj["suppressed"] = static_cast<qint64>(m_suppressed.load(std::memory_order_relaxed));
+    obj["resentBytes"] = static_cast<qint64>(m_resentBytes.load(std::memory_order_relaxed));
+    return obj;
+}
@@ -0,0 +1,229 @@
+﻿#include "RtpPacer.h"
+#include "logqueue.h"
+#include "log_global.h"
+#include <algorithm>
+#include <chrono>
+
+#include <rtc/message.hpp>
+
+class RtpPacer::Handler : public rtc::MediaHandler {
+public:
+    Handler(RtpPacer *pacer, Lane lane)
+        : m_pacer(pacer), m_lane(lane) {
+    }
+
+    // outgoing 只在发送线程上（track->send 的调用栈里）执行
+    void outgoing(rtc::message_vector &messages, const rtc::message_callback &send) override {
+        if (m_lane == Lane::Audio) {
+            size_t bytes = 0;
+            for (const auto &message : messages) {
+                if (message && message->type != rtc::Message::Control) {
+                    bytes += message->size();
+                    m_pacer->m_audioPackets.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            m_pacer->charge(bytes);
+            return;
+        }
+        if (!m_send) {
+            m_send = std::make_shared<const rtc::message_callback>(send);
+        }
+        m_pacer->enqueue(messages, m_send);
+    }
+
+private:
+    RtpPacer *m_pacer;
+    const Lane m_lane;
+    std::shared_ptr<const rtc::message_callback> m_send;
+};
+
+RtpPacer::RtpPacer(int targetBitrateBps, double pacingFactor)
+    : m_targetBitrateBps(targetBitrateBps),
+      m_pacingFactor(pacingFactor) {
+}
+
+RtpPacer::~RtpPacer() {
+    stop();
+}
+
+std::shared_ptr<rtc::MediaHandler> RtpPacer::createHandler(Lane lane) {
+    return std::make_shared<Handler>(this, lane);
+}
+
+bool RtpPacer::start() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = 0;
+        m_lastRefillUs = 0;
+        m_interrupted = false;
+    }
+    return m_worker.start([this]() { return releaseNext(); }, [this]() { interrupt(); });
+}
+
+void RtpPacer::stop() {
+    m_worker.stop();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_queue.empty()) {
+        m_dropped.fetch_add(m_queue.size(), std::memory_order_relaxed);
+        WRITE_LOG("RtpPacer: dropped %d queued packets on stop", static_cast<int>(m_queue.size()));
+    }
+    m_queue.clear();
+    m_queuedBytes = 0;
+}
+
+void RtpPacer::setTargetBitrate(int bitrateBps) {
+    if (bitrateBps <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    refillLocked(nowUs()); // 已经过去的时间按旧速率结算
+    m_targetBitrateBps = bitrateBps;
+    ++m_rateGen;
+    m_cond.notify_all();
+}
+
+void RtpPacer::setPacingFactor(double factor) {
+    if (factor <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    refillLocked(nowUs());
+    m_pacingFactor = factor;
+    ++m_rateGen;
+    m_cond.notify_all();
+}
+
+int64_t RtpPacer::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RtpPacer::enqueue(rtc::message_vector &messages, const std::shared_ptr<const rtc::message_callback> &send) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_worker.isRunning()) {
+        return; // 没有平滑线程时原样留给轨道直接发送
+    }
+    const int64_t now = nowUs();
+    refillLocked(now); // 在入队前结算，空闲期间攒下的量按桶容量截断
+    size_t kept = 0;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        if (!messages[i]) {
+            continue;
+        }
+        if (messages[i]->type == rtc::Message::Control) {
+            // RTCP 不占媒体码率，照常随轨道发出
+            if (kept != i) {
+                messages[kept] = std::move(messages[i]);
+            }
+            ++kept;
+            continue;
+        }
+        m_queuedBytes += messages[i]->size();
+        m_queue.push_back(Pending{std::move(messages[i]), send, now});
+    }
+    messages.resize(kept);
+    m_cond.notify_one();
+}
+
+void RtpPacer::charge(size_t bytes) {
+    m_audioBytes.fetch_add(bytes, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    refillLocked(nowUs());
+    m_budget -= static_cast<double>(bytes);
+}
+
+bool RtpPacer::releaseNext() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_queue.empty()) {
+        m_cond.wait(lock, [this]() { return !m_queue.empty() || m_interrupted; });
+        m_interrupted = false;
+        return true;
+    }
+    int64_t now = nowUs();
+    refillLocked(now);
+    double rate = rateLocked();
+    while (m_budget < 0) {
+        // 睡到桶里补回欠下的量；码率变化时醒来按新速率重算等待时间，停止时直接返回
+        const uint64_t gen = m_rateGen;
+        const int64_t waitUs = static_cast<int64_t>(-m_budget / rate) + 1;
+        m_cond.wait_for(lock, std::chrono::microseconds(waitUs),
+                        [this, gen]() { return m_interrupted || m_rateGen != gen; });
+        if (m_interrupted) {
+            m_interrupted = false;
+            return true;
+        }
+        now = nowUs();
+        refillLocked(now);
+        rate = rateLocked();
+        if (m_queue.empty()) {
+            return true; // stop() 已清空队列
+        }
+    }
+    Pending pending = std::move(m_queue.front());
+    m_queue.pop_front();
+    const size_t size = pending.message->size();
+    m_queuedBytes -= size;
+    m_budget -= static_cast<double>(size);
+    const bool boosted = rate > m_targetBitrateBps * m_pacingFactor / 8.0 / 1e6;
+    lock.unlock();
+
+    m_pacingDelayUs.record(now - pending.enqueuedUs);
+    try {
+        (*pending.send)(pending.message);
+        if (m_sentObserver) {
+            m_sentObserver(pending.message, nowUs());
+        }
+    } catch (const std::exception &e) {
+        WRITE_LOG("RtpPacer: exception while sending packet: %s", e.what());
+    }
+    m_videoPackets.fetch_add(1, std::memory_order_relaxed);
+    m_videoBytes.fetch_add(size, std::memory_order_relaxed);
+    if (boosted) {
+        m_boosted.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void RtpPacer::interrupt() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_interrupted = true;
+    m_cond.notify_all();
+}
+
+void RtpPacer::refillLocked(int64_t now) {
+    if (m_lastRefillUs != 0) {
+        m_budget += static_cast<double>(now - m_lastRefillUs) * rateLocked();
+        // 空闲时最多攒 kBurstMs 的量；有积压时不截断，定时器睡过头（Windows 粒度 15.6ms）少放的要补上
+        if (m_queue.empty()) {
+            m_budget = std::min(m_budget, rateLocked() * kBurstMs * 1000.0);
+        }
+    }
+    m_lastRefillUs = now;
+}
+
+double RtpPacer::rateLocked() const {
+    // 字节/微秒
+    const double paced = m_targetBitrateBps * m_pacingFactor / 8.0 / 1e6;
+    const double drain = static_cast<double>(m_queuedBytes) / (kMaxQueueMs * 1000.0);
+    return std::max(paced, drain);
+}
+
+QJsonObject RtpPacer::stats() const {
+    QJsonObject obj;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        obj["queuedPackets"] = static_cast<int>(m_queue.size());
+        obj["queuedBytes"] = static_cast<qint64>(m_queuedBytes);
+        obj["targetKbps"] = m_targetBitrateBps / 1000;
+        obj["pacingKbps"] = static_cast<qint64>(rateLocked() * 8.0 * 1000.0);
+        obj["budgetBytes"] = static_cast<qint64>(m_budget);
+    }
+    obj["videoPackets"] = static_cast<qint64>(m_videoPackets.load(std::memory_order_relaxed));
+    obj["videoBytes"] = static_cast<qint64>(m_videoBytes.load(std::memory_order_relaxed));
+    obj["audioPackets"] = static_cast<qint64>(m_audioPackets.load(std::memory_order_relaxed));
+    obj["audioBytes"] = static_cast<qint64>(m_audioBytes.load(std::memory_order_relaxed));
+    obj["dropped"] = static_cast<qint64>(m_dropped.load(std::memory_order_relaxed));
+    obj["boosted"] = static_cast<qint64>(m_boosted.load(std::memory_order_relaxed));
+    obj["pacingDelayUs"] = m_pacingDelayUs.toJson();
+    return obj;
+}
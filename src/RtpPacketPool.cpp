@@ -0,0 +1,55 @@
+﻿#include "RtpPacketPool.h"
+#include "logqueue.h"
+#include "log_global.h"
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+RtpPacketPool::RtpPacketPool(int packetSize, int prealloc)
+    : m_packetSize(packetSize) {
+    m_pool = av_buffer_pool_init(m_packetSize + AV_INPUT_BUFFER_PADDING_SIZE, nullptr);
+    if (!m_pool) {
+        WRITE_LOG("RtpPacketPool: av_buffer_pool_init failed");
+        return;
+    }
+    // 预热：一次性取出再全部归还，池内部会缓存这些缓冲区
+    std::vector<AVBufferRef *> warm;
+    warm.reserve(prealloc);
+    for (int i = 0; i < prealloc; ++i) {
+        AVBufferRef *ref = av_buffer_pool_get(m_pool);
+        if (!ref) {
+            break;
+        }
+        warm.push_back(ref);
+    }
+    for (AVBufferRef *ref: warm) {
+        av_buffer_unref(&ref);
+    }
+}
+
+RtpPacketPool::~RtpPacketPool() {
+    // 仍被 AVPacket 引用的缓冲区会在最后一个引用释放时才真正销毁池
+    av_buffer_pool_uninit(&m_pool);
+}
+
+AVBufferRef *RtpPacketPool::acquire(const uint8_t *data, size_t len) {
+    if (!data || len == 0) {
+        return nullptr;
+    }
+    AVBufferRef *ref = nullptr;
+    if (m_pool && len <= static_cast<size_t>(m_packetSize)) {
+        ref = av_buffer_pool_get(m_pool);
+    } else {
+        m_oversize.fetch_add(1, std::memory_order_relaxed);
+        ref = av_buffer_alloc(len + AV_INPUT_BUFFER_PADDING_SIZE);
+    }
+    if (!ref) {
+        return nullptr;
+    }
+    memcpy(ref->data, data, len);
+    memset(ref->data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return ref;
+}
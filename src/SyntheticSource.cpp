@@ -0,0 +1,222 @@
+﻿#include "SyntheticSource.h"
+#include "QueueTelemetry.h"
+#include "logqueue.h"
+#include "log_global.h"
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include <libavdevice/avdevice.h>
+#include <libavutil/time.h>
+}
+
+namespace {
+
+const char kLavfiPrefix[] = "lavfi:";
+const char kFilePrefix[] = "file:";
+
+// 不带参数的简写展开成完整的滤镜图；固定输出格式，免得 lavfi 按滤镜支持列表随便挑一个
+QString expandLavfi(const QString &graph, AVMediaType type, int width, int height, int fps) {
+    if (graph.contains('=') || graph.contains(',')) {
+        return graph;
+    }
+    if (type == AVMEDIA_TYPE_VIDEO && (graph == "testsrc2" || graph == "testsrc" || graph == "smptebars")) {
+        return QString("%1=size=%2x%3:rate=%4,format=yuv420p")
+                .arg(graph)
+                .arg(width > 0 ? width : 1280)
+                .arg(height > 0 ? height : 720)
+                .arg(fps > 0 ? fps : 25);
+    }
+    if (type == AVMEDIA_TYPE_AUDIO && graph == "sine") {
+        return "sine=frequency=440:sample_rate=48000,aformat=sample_fmts=s16:channel_layouts=stereo";
+    }
+    return graph;
+}
+
+}
+
+SyntheticSource::~SyntheticSource() {
+    close();
+}
+
+bool SyntheticSource::isSourceSpec(const QString &name) {
+    return name.startsWith(kLavfiPrefix) || name.startsWith(kFilePrefix);
+}
+
+bool SyntheticSource::open(const QString &spec, AVMediaType type, int width, int height, int fps, Pacing pacing,
+                           QString &error) {
+    close();
+    const AVInputFormat *inputFormat = nullptr;
+    QString url;
+    if (spec.startsWith(kLavfiPrefix)) {
+        inputFormat = av_find_input_format("lavfi");
+        if (!inputFormat) {
+            error = "lavfi input format is not available";
+            return false;
+        }
+        url = expandLavfi(spec.mid(static_cast<int>(strlen(kLavfiPrefix))), type, width, height, fps);
+        m_loop = false;
+    } else if (spec.startsWith(kFilePrefix)) {
+        url = spec.mid(static_cast<int>(strlen(kFilePrefix)));
+        m_loop = true;
+    } else {
+        error = QString("Not a synthetic source: %1").arg(spec);
+        return false;
+    }
+
+    int ret = avformat_open_input(&m_ctx, url.toStdString().c_str(), inputFormat, nullptr);
+    if (ret < 0) {
+        char errbuf[1024] = { 0 };
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        error = QString("Failed to open %1: %2").arg(url, errbuf);
+        m_ctx = nullptr;
+        return false;
+    }
+    if ((ret = avformat_find_stream_info(m_ctx, nullptr)) < 0 ||
+        (ret = av_find_best_stream(m_ctx, type, -1, -1, nullptr, 0)) < 0) {
+        error = QString("No %1 stream in %2").arg(av_get_media_type_string(type), url);
+        close();
+        return false;
+    }
+    m_streamIndex = ret;
+    // 解复用器一般不填 codecpar->framerate，下游编码/解码按它定帧率
+    AVStream *stream = m_ctx->streams[m_streamIndex];
+    if (type == AVMEDIA_TYPE_VIDEO && stream->codecpar->framerate.num <= 0) {
+        stream->codecpar->framerate = av_guess_frame_rate(m_ctx, stream, nullptr);
+    }
+    // 只读一路，其余流在解复用阶段直接丢掉
+    for (unsigned int i = 0; i < m_ctx->nb_streams; ++i) {
+        if (static_cast<int>(i) != m_streamIndex) {
+            m_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    m_pacing = pacing;
+    m_firstTs = AV_NOPTS_VALUE;
+    m_loopOffset = 0;
+    m_loopEnd = 0;
+    m_clockStart = AV_NOPTS_VALUE;
+    const char *kind = type == AVMEDIA_TYPE_VIDEO ? "capture.synthetic.video" : "capture.synthetic.audio";
+    m_telemetryName = TelemetryRegistry::instance().registerSource(kind, [this]() {
+        return telemetrySnapshot();
+    });
+    WRITE_LOG("SyntheticSource: %s opened (%s, %s%s).", url.toStdString().c_str(),
+              avcodec_get_name(m_ctx->streams[m_streamIndex]->codecpar->codec_id),
+              pacing == Pacing::MaxSpeed ? "max speed" : "real time", m_loop ? ", looping" : "");
+    return true;
+}
+
+void SyntheticSource::close() {
+    if (!m_telemetryName.isEmpty()) {
+        TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+        m_telemetryName.clear();
+    }
+    if (m_ctx) {
+        avformat_close_input(&m_ctx);
+        m_ctx = nullptr;
+    }
+    m_streamIndex = -1;
+}
+
+const AVCodecParameters *SyntheticSource::codecParameters() const {
+    return m_ctx ? m_ctx->streams[m_streamIndex]->codecpar : nullptr;
+}
+
+AVRational SyntheticSource::timeBase() const {
+    return m_ctx ? m_ctx->streams[m_streamIndex]->time_base : AVRational{0, 1};
+}
+
+int SyntheticSource::rewind() {
+    const int64_t start = m_firstTs != AV_NOPTS_VALUE ? m_firstTs : 0;
+    const int ret = avformat_seek_file(m_ctx, m_streamIndex, INT64_MIN, start, start, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    m_loopOffset = m_loopEnd;
+    m_loops.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+int SyntheticSource::read(AVPacket *packet) {
+    if (!m_ctx) {
+        return AVERROR(EINVAL);
+    }
+    bool rewound = false;
+    for (;;) {
+        int ret = av_read_frame(m_ctx, packet);
+        if (ret == AVERROR_EOF && m_loop && !rewound) {
+            // 连续两次 EOF（文件里没有这一路的包）时不再死循环
+            if ((ret = rewind()) < 0) {
+                return ret;
+            }
+            rewound = true;
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        if (packet->stream_index != m_streamIndex) {
+            av_packet_unref(packet);
+            continue;
+        }
+        break;
+    }
+
+    // 平移到从 0 开始的连续时间轴：第 N 轮的包接在第 N-1 轮最后一个包之后
+    const int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (m_firstTs == AV_NOPTS_VALUE) {
+        m_firstTs = ts != AV_NOPTS_VALUE ? ts : 0;
+    }
+    const int64_t shift = m_loopOffset - m_firstTs;
+    if (packet->pts != AV_NOPTS_VALUE) {
+        packet->pts += shift;
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+        packet->dts += shift;
+    }
+    const int64_t last = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (last != AV_NOPTS_VALUE) {
+        m_loopEnd = std::max(m_loopEnd, last + std::max<int64_t>(packet->duration, 1));
+    }
+    packet->stream_index = 0;
+
+    if (m_pacing == Pacing::RealTime) {
+        pace(packet);
+    }
+    m_packets.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+void SyntheticSource::pace(const AVPacket *packet) {
+    // 按解码顺序（dts）出包，B 帧的 pts 乱序不影响节奏
+    const int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (ts == AV_NOPTS_VALUE) {
+        return;
+    }
+    const int64_t dueUs = av_rescale_q(ts, timeBase(), AVRational{1, 1000000});
+    const int64_t now = av_gettime_relative();
+    if (m_clockStart == AV_NOPTS_VALUE) {
+        m_clockStart = now - dueUs;
+    }
+    const int64_t waitUs = m_clockStart + dueUs - now;
+    if (waitUs > kMaxDriftUs || waitUs < -kMaxDriftUs) {
+        m_clockStart = now - dueUs;
+        m_resyncs.fetch_add(1, std::memory_order_relaxed);
+        m_lagUs.store(0, std::memory_order_relaxed);
+        return;
+    }
+    m_lagUs.store(waitUs < 0 ? -waitUs : 0, std::memory_order_relaxed);
+    if (waitUs > 0) {
+        av_usleep(static_cast<unsigned int>(waitUs));
+    }
+}
+
+QJsonObject SyntheticSource::telemetrySnapshot() const {
+    QJsonObject obj;
+    obj["packets"] = static_cast<qint64>(m_packets.load(std::memory_order_relaxed));
+    obj["loops"] = static_cast<qint64>(m_loops.load(std::memory_order_relaxed));
+    obj["resyncs"] = static_cast<qint64>(m_resyncs.load(std::memory_order_relaxed));
+    obj["lagUs"] = static_cast<qint64>(m_lagUs.load(std::memory_order_relaxed));
+    obj["maxSpeed"] = m_pacing == Pacing::MaxSpeed;
+    return obj;
+}
@@ -0,0 +1,317 @@
+﻿#include "TransportFeedbackHandler.h"
+#include "rtp.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <rtc/message.hpp>
+
+namespace {
+
+constexpr uint16_t kOneByteProfile = 0xBEDE;
+
+uint16_t readU16(const uint8_t *p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t readU32(const uint8_t *p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+         | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+int64_t steadyNowUs() {
+    return clocks::duration_cast<clocks::microseconds>(stdclock::now().time_since_epoch()).count();
+}
+
+}
+
+TransportFeedbackHandler::TransportFeedbackHandler(uint32_t ssrc, std::shared_ptr<BandwidthEstimator> estimator)
+    : m_ssrc(ssrc),
+      m_estimator(std::move(estimator)) {
+    m_reportedBps = m_estimator->targetBitrate();
+}
+
+void TransportFeedbackHandler::setExtensionId(int extensionId) {
+    // one-byte 格式的 id 只有 1~14
+    m_extensionId.store(extensionId >= 1 && extensionId <= 14 ? extensionId : 0, std::memory_order_relaxed);
+}
+
+int TransportFeedbackHandler::negotiatedExtensionId(const std::string &sdp) {
+    // a=extmap:<id>[/<direction>] <uri>
+    static const std::string kPrefix = "a=extmap:";
+    for (size_t pos = sdp.find(kPrefix); pos != std::string::npos; pos = sdp.find(kPrefix, pos + 1)) {
+        const size_t lineEnd = std::min(sdp.find_first_of("\r\n", pos), sdp.size());
+        const std::string line = sdp.substr(pos + kPrefix.size(), lineEnd - pos - kPrefix.size());
+        const size_t space = line.find(' ');
+        if (space == std::string::npos || line.compare(space + 1, std::string::npos, kExtensionUri) != 0) {
+            continue;
+        }
+        return std::atoi(line.c_str());
+    }
+    return 0;
+}
+
+void TransportFeedbackHandler::outgoing(rtc::message_vector &messages, const rtc::message_callback &send) {
+    (void)send;
+    const int extensionId = m_extensionId.load(std::memory_order_relaxed);
+    if (extensionId == 0) {
+        return;
+    }
+    for (auto &message : messages) {
+        if (!message || message->type == rtc::Message::Control) {
+            continue;
+        }
+        const auto *p = reinterpret_cast<const uint8_t *>(message->data());
+        if (message->size() < RTP_HEADER_LENGTH || rtp_is_rtcp(p, message->size()) || rtp_ssrc(p) != m_ssrc) {
+            continue;
+        }
+        if (rtc::message_ptr stamped = stamp(message, extensionId)) {
+            message = std::move(stamped);
+        }
+    }
+}
+
+// 插入头扩展需要挪动载荷，只能新建一个包；历史缓存在前面已经保存了不带扩展的副本
+rtc::message_ptr TransportFeedbackHandler::stamp(const rtc::message_ptr &message, int extensionId) {
+    const auto *src = reinterpret_cast<const uint8_t *>(message->data());
+    const size_t len = message->size();
+    const size_t headerLen = RTP_HEADER_LENGTH + (src[0] & 0x0F) * 4;
+    if ((src[0] >> 6) != RTP_VERSION || headerLen > len) {
+        return nullptr;
+    }
+
+    rtc::message_ptr out;
+    size_t elementOffset = 0;
+    if (!(src[0] & 0x10)) {
+        // 没有扩展：加一个 one-byte 扩展头 + 一个字（元素 3 字节 + 1 字节填充）
+        out = rtc::make_message(len + 8);
+        auto *dst = reinterpret_cast<uint8_t *>(out->data());
+        std::memcpy(dst, src, headerLen);
+        dst[0] |= 0x10;
+        dst[headerLen] = static_cast<uint8_t>(kOneByteProfile >> 8);
+        dst[headerLen + 1] = static_cast<uint8_t>(kOneByteProfile & 0xFF);
+        dst[headerLen + 2] = 0;
+        dst[headerLen + 3] = 1;
+        elementOffset = headerLen + 4;
+        std::memcpy(dst + headerLen + 8, src + headerLen, len - headerLen);
+    } else {
+        if (headerLen + 4 > len || readU16(src + headerLen) != kOneByteProfile) {
+            return nullptr; // two-byte 格式的扩展不改动，这个包不参与带宽估计
+        }
+        const size_t words = readU16(src + headerLen + 2);
+        const size_t extEnd = headerLen + 4 + words * 4;
+        if (extEnd > len) {
+            return nullptr;
+        }
+        // 已有 one-byte 扩展：在末尾追加一个字，之前的填充字节是合法的元素间隔
+        out = rtc::make_message(len + 4);
+        auto *dst = reinterpret_cast<uint8_t *>(out->data());
+        std::memcpy(dst, src, extEnd);
+        dst[headerLen + 2] = static_cast<uint8_t>((words + 1) >> 8);
+        dst[headerLen + 3] = static_cast<uint8_t>((words + 1) & 0xFF);
+        elementOffset = extEnd;
+        std::memcpy(dst + extEnd + 4, src + extEnd, len - extEnd);
+    }
+
+    auto *element = reinterpret_cast<uint8_t *>(out->data()) + elementOffset;
+    const uint16_t sequence = m_nextSequence++;
+    element[0] = static_cast<uint8_t>((extensionId << 4) | 1); // 长度字段为 数据字节数 - 1
+    element[1] = static_cast<uint8_t>(sequence >> 8);
+    element[2] = static_cast<uint8_t>(sequence & 0xFF);
+    element[3] = 0;
+    m_stamped.fetch_add(1, std::memory_order_relaxed);
+    return out;
+}
+
+void TransportFeedbackHandler::onPacketSent(const rtc::message_ptr &message, int64_t sentUs) {
+    const int extensionId = m_extensionId.load(std::memory_order_relaxed);
+    if (!message || extensionId == 0) {
+        return;
+    }
+    uint16_t sequence = 0;
+    if (findTransportSequence(reinterpret_cast<const uint8_t *>(message->data()), message->size(), extensionId,
+                              sequence)) {
+        m_estimator->onPacketSent(sequence, message->size(), sentUs);
+    }
+}
+
+bool TransportFeedbackHandler::findTransportSequence(const uint8_t *data, size_t len, int extensionId,
+                                                     uint16_t &sequence) {
+    if (len < RTP_HEADER_LENGTH || (data[0] >> 6) != RTP_VERSION || !(data[0] & 0x10)) {
+        return false;
+    }
+    const size_t headerLen = RTP_HEADER_LENGTH + (data[0] & 0x0F) * 4;
+    if (headerLen + 4 > len || readU16(data + headerLen) != kOneByteProfile) {
+        return false;
+    }
+    const size_t extEnd = headerLen + 4 + readU16(data + headerLen + 2) * 4;
+    if (extEnd > len) {
+        return false;
+    }
+    size_t pos = headerLen + 4;
+    while (pos < extEnd) {
+        const int id = data[pos] >> 4;
+        if (id == 0) {
+            ++pos; // 填充
+            continue;
+        }
+        if (id == 15) {
+            break;
+        }
+        const size_t size = (data[pos] & 0x0F) + 1;
+        if (pos + 1 + size > extEnd) {
+            break;
+        }
+        if (id == extensionId && size == 2) {
+            sequence = readU16(data + pos + 1);
+            return true;
+        }
+        pos += 1 + size;
+    }
+    return false;
+}
+
+void TransportFeedbackHandler::incoming(rtc::message_vector &messages, const rtc::message_callback &send) {
+    (void)send;
+    int64_t nowUs = 0;
+    for (const auto &message : messages) {
+        if (message && message->type == rtc::Message::Control) {
+            if (nowUs == 0) {
+                nowUs = steadyNowUs();
+            }
+            // 只读不删，后面的处理器（NACK、PLI）照常能看到
+            handleRtcp(reinterpret_cast<const uint8_t *>(message->data()), message->size(), nowUs);
+        }
+    }
+}
+
+void TransportFeedbackHandler::handleRtcp(const uint8_t *data, size_t len, int64_t nowUs) {
+    rtcp_for_each(data, len, [&](const uint8_t *rtcp, size_t packetLen) {
+        if (packetLen < 8) {
+            return;
+        }
+        const uint8_t count = rtcp_count(rtcp);
+        const uint8_t type = rtcp_packet_type(rtcp);
+        if (type == 200 || type == 201) {
+            // SR / RR 的 report block：SR 多 20 字节发送者信息
+            size_t block = type == 200 ? 28 : 8;
+            for (int i = 0; i < count && block + 24 <= packetLen; ++i, block += 24) {
+                if (readU32(rtcp + block) == m_ssrc) {
+                    m_receiverReports.fetch_add(1, std::memory_order_relaxed);
+                    report(m_estimator->onReceiverReport(rtcp[block + 4] / 256.0, nowUs), nowUs);
+                }
+            }
+        } else if (type == 205 && count == 15) {
+            if (parseTransportFeedback(rtcp, packetLen, m_feedback)) {
+                m_transportFeedbacks.fetch_add(1, std::memory_order_relaxed);
+                report(m_estimator->onTransportFeedback(m_feedback, nowUs), nowUs);
+            } else {
+                m_malformed.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else if (type == 206 && count == 15 && packetLen >= 20 && std::memcmp(rtcp + 12, "REMB", 4) == 0) {
+            // REMB：6 位指数 + 18 位尾数
+            const int exponent = rtcp[17] >> 2;
+            const uint64_t mantissa = (static_cast<uint64_t>(rtcp[17] & 0x03) << 16) | readU16(rtcp + 18);
+            if (exponent < 46) {
+                m_rembs.fetch_add(1, std::memory_order_relaxed);
+                report(m_estimator->onRemb(static_cast<int64_t>(mantissa << exponent), nowUs), nowUs);
+            }
+        }
+    });
+}
+
+bool TransportFeedbackHandler::parseTransportFeedback(const uint8_t *data, size_t len,
+                                                      std::vector<BandwidthEstimator::PacketFeedback> &packets) {
+    packets.clear();
+    if (len < 20) {
+        return false;
+    }
+    const uint16_t baseSequence = readU16(data + 12);
+    const int statusCount = readU16(data + 14);
+    int32_t referenceTime = (static_cast<int32_t>(data[16]) << 16) | (data[17] << 8) | data[18];
+    if (referenceTime & 0x800000) {
+        referenceTime -= 0x1000000; // 24 位有符号
+    }
+
+    // 先展开状态块：0 未收到，1 小增量（1 字节），2 大增量（2 字节有符号）
+    std::vector<uint8_t> symbols;
+    symbols.reserve(statusCount);
+    size_t pos = 20;
+    while (static_cast<int>(symbols.size()) < statusCount) {
+        if (pos + 2 > len) {
+            return false;
+        }
+        const uint16_t chunk = readU16(data + pos);
+        pos += 2;
+        const int remaining = statusCount - static_cast<int>(symbols.size());
+        if (!(chunk & 0x8000)) {
+            // run length chunk
+            const int run = std::min<int>(chunk & 0x1FFF, remaining);
+            symbols.insert(symbols.end(), run, static_cast<uint8_t>((chunk >> 13) & 0x03));
+        } else if (!(chunk & 0x4000)) {
+            // status vector，14 个 1 位符号
+            for (int i = 0; i < 14 && i < remaining; ++i) {
+                symbols.push_back(static_cast<uint8_t>((chunk >> (13 - i)) & 0x01));
+            }
+        } else {
+            // status vector，7 个 2 位符号
+            for (int i = 0; i < 7 && i < remaining; ++i) {
+                symbols.push_back(static_cast<uint8_t>((chunk >> (12 - 2 * i)) & 0x03));
+            }
+        }
+    }
+
+    int64_t arrivalUs = static_cast<int64_t>(referenceTime) * 64000;
+    packets.reserve(symbols.size());
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        BandwidthEstimator::PacketFeedback feedback;
+        feedback.sequence = static_cast<uint16_t>(baseSequence + i);
+        if (symbols[i] == 1) {
+            if (pos + 1 > len) {
+                return false;
+            }
+            arrivalUs += data[pos] * 250;
+            pos += 1;
+            feedback.received = true;
+        } else if (symbols[i] == 2) {
+            if (pos + 2 > len) {
+                return false;
+            }
+            arrivalUs += static_cast<int16_t>(readU16(data + pos)) * 250;
+            pos += 2;
+            feedback.received = true;
+        } else if (symbols[i] == 3) {
+            return false;
+        }
+        feedback.arrivalUs = arrivalUs;
+        packets.push_back(feedback);
+    }
+    return true;
+}
+
+void TransportFeedbackHandler::report(int targetBps, int64_t nowUs) {
+    {
+        std::lock_guard<std::mutex> lock(m_reportMutex);
+        const int change = std::abs(targetBps - m_reportedBps);
+        const bool large = change >= m_reportedBps * kReportStep;
+        const bool stale = change > 0 && nowUs - m_reportedUs >= kReportIntervalMs * 1000LL;
+        if (!large && !stale) {
+            return;
+        }
+        m_reportedBps = targetBps;
+        m_reportedUs = nowUs;
+    }
+    if (m_onTarget) {
+        m_onTarget(targetBps);
+    }
+}
+
+QJsonObject TransportFeedbackHandler::stats() const {
+    QJsonObject obj = m_estimator->stats();
+    obj["stamped"] = static_cast<qint64>(m_stamped.load(std::memory_order_relaxed));
+    obj["transportFeedbacks"] = static_cast<qint64>(m_transportFeedbacks.load(std::memory_order_relaxed));
+    obj["receiverReports"] = static_cast<qint64>(m_receiverReports.load(std::memory_order_relaxed));
+    obj["rembs"] = static_cast<qint64>(m_rembs.load(std::memory_order_relaxed));
+    obj["malformed"] = static_cast<qint64>(m_malformed.load(std::memory_order_relaxed));
+    return obj;
+}
@@ -0,0 +1,471 @@
+﻿#include "V4l2Capture.h"
+#include "QueueTelemetry.h"
+#include "logqueue.h"
+#include "log_global.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#if defined(__linux__)
+
+#include <QDir>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+int xioctl(int fd, unsigned long request, void *arg) {
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+struct FormatCandidate {
+    uint32_t fourcc;
+    AVCodecID codecId;
+    AVPixelFormat pixelFormat;
+};
+
+// 与 dshow 协商顺序一致：编码器能直接吃的原始格式优先，MJPEG 最后
+const FormatCandidate kFormats[] = {
+    {V4L2_PIX_FMT_NV12, AV_CODEC_ID_RAWVIDEO, AV_PIX_FMT_NV12},
+    {V4L2_PIX_FMT_YUYV, AV_CODEC_ID_RAWVIDEO, AV_PIX_FMT_YUYV422},
+    {V4L2_PIX_FMT_YUV420, AV_CODEC_ID_RAWVIDEO, AV_PIX_FMT_YUV420P},
+    {V4L2_PIX_FMT_MJPEG, AV_CODEC_ID_MJPEG, AV_PIX_FMT_NONE},
+};
+
+}
+
+struct V4l2Capture::Device {
+    struct Buffer {
+        void *start = MAP_FAILED;
+        size_t length = 0;
+    };
+
+    int fd = -1;
+    Buffer buffers[kBufferCount];
+    int bufferCount = 0;
+
+    FormatCandidate format{};
+    int width = 0;
+    int height = 0;
+    int bytesPerLine = 0;
+    bool tight = true; // 行间无填充，原始帧可以按 av_image_fill_arrays(align=1) 直接解释
+
+    std::mutex mutex;  // streaming / queued，以及与下游线程并发的 QBUF
+    bool streaming = false;
+    int queued = 0;    // 当前在驱动队列里的缓冲区数
+
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> zeroCopy{0};
+    std::atomic<uint64_t> copied{0};
+    std::atomic<uint64_t> errors{0};
+
+    ~Device() {
+        for (int i = 0; i < bufferCount; ++i) {
+            if (buffers[i].start != MAP_FAILED) {
+                munmap(buffers[i].start, buffers[i].length);
+            }
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // 调用方持有 mutex
+    bool queueBuffer(int index) {
+        v4l2_buffer buf{};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = static_cast<uint32_t>(index);
+        if (xioctl(fd, VIDIOC_QBUF, &buf) < 0) {
+            errors.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        ++queued;
+        return true;
+    }
+};
+
+// 每个零拷贝包持有一份，保证设备在最后一个缓冲区归还前不被释放
+struct V4l2Capture::BufferLease {
+    std::shared_ptr<Device> device;
+    int index;
+};
+
+void V4l2Capture::releaseBuffer(void *opaque, uint8_t *data) {
+    (void)data;
+    auto *lease = static_cast<BufferLease *>(opaque);
+    {
+        std::lock_guard<std::mutex> lock(lease->device->mutex);
+        // 已经停流时不再入队，缓冲区随 Device 一起 munmap
+        if (lease->device->streaming) {
+            lease->device->queueBuffer(lease->index);
+        }
+    }
+    delete lease;
+}
+
+V4l2Capture::V4l2Capture() = default;
+
+V4l2Capture::~V4l2Capture() {
+    close();
+}
+
+QString V4l2Capture::resolveDevice(const QString &name) {
+    if (name.startsWith("/dev/")) {
+        return name;
+    }
+    const QStringList nodes = QDir("/dev").entryList(QStringList() << "video*", QDir::System, QDir::Name);
+    for (const QString &node : nodes) {
+        const QString path = "/dev/" + node;
+        const int fd = ::open(path.toLocal8Bit().constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        v4l2_capability cap{};
+        const bool ok = xioctl(fd, VIDIOC_QUERYCAP, &cap) == 0;
+        ::close(fd);
+        const uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+        // 同一个摄像头往往有多个节点（元数据节点不能采集），只认能采集的那个
+        if (ok && (caps & V4L2_CAP_VIDEO_CAPTURE) && name == QString::fromLocal8Bit(reinterpret_cast<const char *>(cap.card))) {
+            return path;
+        }
+    }
+    return name;
+}
+
+bool V4l2Capture::open(const QString &device, int width, int height, int fps, QString &error) {
+    close();
+    auto dev = std::make_shared<Device>();
+    dev->fd = ::open(device.toLocal8Bit().constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (dev->fd < 0) {
+        error = QString("open %1: %2").arg(device, strerror(errno));
+        return false;
+    }
+
+    v4l2_capability cap{};
+    if (xioctl(dev->fd, VIDIOC_QUERYCAP, &cap) < 0) {
+        error = QString("VIDIOC_QUERYCAP: %1").arg(strerror(errno));
+        return false;
+    }
+    const uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+        error = QString("%1 does not support streaming capture").arg(device);
+        return false;
+    }
+
+    // 格式协商：驱动不支持时 S_FMT 会换成别的格式，以返回值为准
+    bool negotiated = false;
+    for (const FormatCandidate &candidate : kFormats) {
+        v4l2_format fmt{};
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (xioctl(dev->fd, VIDIOC_G_FMT, &fmt) < 0) {
+            error = QString("VIDIOC_G_FMT: %1").arg(strerror(errno));
+            return false;
+        }
+        if (width > 0 && height > 0) {
+            fmt.fmt.pix.width = static_cast<uint32_t>(width);
+            fmt.fmt.pix.height = static_cast<uint32_t>(height);
+        }
+        fmt.fmt.pix.pixelformat = candidate.fourcc;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        if (xioctl(dev->fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != candidate.fourcc) {
+            continue;
+        }
+        dev->format = candidate;
+        dev->width = static_cast<int>(fmt.fmt.pix.width);
+        dev->height = static_cast<int>(fmt.fmt.pix.height);
+        dev->bytesPerLine = static_cast<int>(fmt.fmt.pix.bytesperline);
+        if (candidate.codecId == AV_CODEC_ID_RAWVIDEO) {
+            dev->tight = dev->bytesPerLine == av_image_get_linesize(candidate.pixelFormat, dev->width, 0);
+        }
+        negotiated = true;
+        break;
+    }
+    if (!negotiated) {
+        error = QString("%1 offers none of NV12/YUYV/YUV420/MJPEG").arg(device);
+        return false;
+    }
+
+    v4l2_streamparm parm{};
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    const bool haveParm = xioctl(dev->fd, VIDIOC_G_PARM, &parm) == 0;
+    if (fps > 0 && haveParm && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = static_cast<uint32_t>(fps);
+        if (xioctl(dev->fd, VIDIOC_S_PARM, &parm) < 0) {
+            WRITE_LOG("V4l2Capture: VIDIOC_S_PARM %d fps failed: %s", fps, strerror(errno));
+        }
+    }
+    // 驱动实际采用的帧间隔（S_PARM 会把它写回 parm）
+    AVRational frameRate{0, 1};
+    if (haveParm && parm.parm.capture.timeperframe.numerator > 0 && parm.parm.capture.timeperframe.denominator > 0) {
+        frameRate = {static_cast<int>(parm.parm.capture.timeperframe.denominator),
+                     static_cast<int>(parm.parm.capture.timeperframe.numerator)};
+    } else if (fps > 0) {
+        frameRate = {fps, 1};
+    }
+
+    v4l2_requestbuffers req{};
+    req.count = kBufferCount;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(dev->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < static_cast<uint32_t>(kMinQueuedBuffers + 1)) {
+        error = QString("VIDIOC_REQBUFS: got %1 buffers (%2)").arg(req.count).arg(strerror(errno));
+        return false;
+    }
+    dev->bufferCount = std::min(static_cast<int>(req.count), static_cast<int>(kBufferCount));
+    for (int i = 0; i < dev->bufferCount; ++i) {
+        v4l2_buffer buf{};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = static_cast<uint32_t>(i);
+        if (xioctl(dev->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            error = QString("VIDIOC_QUERYBUF: %1").arg(strerror(errno));
+            return false;
+        }
+        dev->buffers[i].length = buf.length;
+        dev->buffers[i].start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, buf.m.offset);
+        if (dev->buffers[i].start == MAP_FAILED) {
+            error = QString("mmap: %1").arg(strerror(errno));
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(dev->mutex);
+        for (int i = 0; i < dev->bufferCount; ++i) {
+            if (!dev->queueBuffer(i)) {
+                error = QString("VIDIOC_QBUF: %1").arg(strerror(errno));
+                return false;
+            }
+        }
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (xioctl(dev->fd, VIDIOC_STREAMON, &type) < 0) {
+            error = QString("VIDIOC_STREAMON: %1").arg(strerror(errno));
+            return false;
+        }
+        dev->streaming = true;
+    }
+
+    m_params = avcodec_parameters_alloc();
+    m_params->codec_type = AVMEDIA_TYPE_VIDEO;
+    m_params->codec_id = dev->format.codecId;
+    m_params->format = dev->format.pixelFormat;
+    m_params->width = dev->width;
+    m_params->height = dev->height;
+    m_params->framerate = frameRate;
+
+    m_device = dev;
+    m_telemetryName = TelemetryRegistry::instance().registerSource("capture.v4l2", [this]() {
+        return telemetrySnapshot();
+    });
+    WRITE_LOG("V4l2Capture: %s opened, %s %dx%d, %d mmap buffers%s.", device.toLocal8Bit().constData(),
+              avcodec_get_name(dev->format.codecId), dev->width, dev->height, dev->bufferCount,
+              dev->tight ? "" : " (padded rows, frames will be copied)");
+    return true;
+}
+
+void V4l2Capture::close() {
+    if (!m_telemetryName.isEmpty()) {
+        TelemetryRegistry::instance().unregisterSource(m_telemetryName);
+        m_telemetryName.clear();
+    }
+    if (m_device) {
+        {
+            std::lock_guard<std::mutex> lock(m_device->mutex);
+            m_device->streaming = false;
+            v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            xioctl(m_device->fd, VIDIOC_STREAMOFF, &type);
+            m_device->queued = 0;
+        }
+        // 还在下游的缓冲区各持有一份引用，最后一个释放时才 munmap / close
+        m_device.reset();
+    }
+    if (m_params) {
+        avcodec_parameters_free(&m_params);
+    }
+}
+
+bool V4l2Capture::isOpen() const {
+    return m_device != nullptr;
+}
+
+int V4l2Capture::read(AVPacket *packet, int timeoutMs) {
+    if (!m_device) {
+        return AVERROR(EINVAL);
+    }
+    Device &dev = *m_device;
+    pollfd pfd{dev.fd, POLLIN, 0};
+    const int ready = poll(&pfd, 1, timeoutMs);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+        return AVERROR(EAGAIN);
+    }
+    if (ready < 0) {
+        return AVERROR(errno);
+    }
+
+    v4l2_buffer buf{};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    int queuedAfter = 0;
+    {
+        std::lock_guard<std::mutex> lock(dev.mutex);
+        if (xioctl(dev.fd, VIDIOC_DQBUF, &buf) < 0) {
+            return errno == EAGAIN ? AVERROR(EAGAIN) : AVERROR(errno);
+        }
+        queuedAfter = --dev.queued;
+    }
+    if (buf.index >= static_cast<uint32_t>(dev.bufferCount)) {
+        // 驱动给了不存在的下标：没法归还，也不能拿它去 QBUF
+        dev.errors.fetch_add(1, std::memory_order_relaxed);
+        WRITE_LOG("V4l2Capture: VIDIOC_DQBUF returned invalid buffer index %u.", buf.index);
+        return AVERROR(EAGAIN);
+    }
+    const int index = static_cast<int>(buf.index);
+    if ((buf.flags & V4L2_BUF_FLAG_ERROR) || buf.bytesused == 0) {
+        dev.errors.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(dev.mutex);
+        dev.queueBuffer(index);
+        return AVERROR(EAGAIN);
+    }
+    const auto *start = static_cast<const uint8_t *>(dev.buffers[index].start);
+    const int used = static_cast<int>(buf.bytesused);
+
+    // 压缩格式（MJPEG）交给解码器前包尾要有填充，驱动缓冲区没有，只有原始格式能零拷贝
+    const bool raw = dev.format.codecId == AV_CODEC_ID_RAWVIDEO;
+    if (!raw || queuedAfter < kMinQueuedBuffers || !dev.tight) {
+        // 下游攥着太多缓冲区（或行有填充）：拷贝一份并立即归还，宁可多一次拷贝也不让驱动丢帧
+        // av_new_packet 分配的包尾自带 AV_INPUT_BUFFER_PADDING_SIZE 的清零填充
+        int ret;
+        if (dev.tight) {
+            ret = av_new_packet(packet, used);
+            if (ret == 0) {
+                memcpy(packet->data, start, used);
+            }
+        } else {
+            const AVPixelFormat format = dev.format.pixelFormat;
+            ret = av_new_packet(packet, av_image_get_buffer_size(format, dev.width, dev.height, 1));
+            if (ret == 0) {
+                const uint8_t *srcData[4] = {nullptr};
+                int srcLinesize[4] = {0};
+                av_image_fill_linesizes(srcLinesize, format, dev.width);
+                // 驱动按 bytesperline 排布，色度平面行宽按同样比例放大
+                const int lumaLinesize = srcLinesize[0];
+                for (int p = 0; p < 4 && srcLinesize[p]; ++p) {
+                    srcLinesize[p] = static_cast<int>(static_cast<int64_t>(srcLinesize[p]) * dev.bytesPerLine / lumaLinesize);
+                }
+                av_image_fill_pointers(const_cast<uint8_t **>(srcData), format, dev.height, const_cast<uint8_t *>(start), srcLinesize);
+                uint8_t *dstData[4] = {nullptr};
+                int dstLinesize[4] = {0};
+                av_image_fill_arrays(dstData, dstLinesize, packet->data, format, dev.width, dev.height, 1);
+                av_image_copy(dstData, dstLinesize, srcData, srcLinesize, format, dev.width, dev.height);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(dev.mutex);
+            dev.queueBuffer(index);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        dev.copied.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        auto *lease = new BufferLease{m_device, index};
+        AVBufferRef *ref = av_buffer_create(const_cast<uint8_t *>(start), used, releaseBuffer, lease,
+                                            AV_BUFFER_FLAG_READONLY);
+        if (!ref) {
+            delete lease;
+            std::lock_guard<std::mutex> lock(dev.mutex);
+            dev.queueBuffer(index);
+            return AVERROR(ENOMEM);
+        }
+        packet->buf = ref;
+        packet->data = ref->data;
+        packet->size = used;
+        dev.zeroCopy.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    packet->pts = static_cast<int64_t>(buf.timestamp.tv_sec) * 1000000 + buf.timestamp.tv_usec;
+    packet->dts = packet->pts;
+    packet->flags |= AV_PKT_FLAG_KEY;
+    packet->stream_index = 0;
+    dev.frames.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+QJsonObject V4l2Capture::telemetrySnapshot() const {
+    QJsonObject obj;
+    if (!m_device) {
+        return obj;
+    }
+    obj["frames"] = static_cast<qint64>(m_device->frames.load(std::memory_order_relaxed));
+    obj["zeroCopy"] = static_cast<qint64>(m_device->zeroCopy.load(std::memory_order_relaxed));
+    obj["copied"] = static_cast<qint64>(m_device->copied.load(std::memory_order_relaxed));
+    obj["errors"] = static_cast<qint64>(m_device->errors.load(std::memory_order_relaxed));
+    {
+        std::lock_guard<std::mutex> lock(m_device->mutex);
+        obj["queued"] = m_device->queued;
+    }
+    obj["buffers"] = m_device->bufferCount;
+    return obj;
+}
+
+#else
+
+struct V4l2Capture::Device {
+};
+
+V4l2Capture::V4l2Capture() = default;
+
+V4l2Capture::~V4l2Capture() {
+    close();
+}
+
+QString V4l2Capture::resolveDevice(const QString &name) {
+    return name;
+}
+
+bool V4l2Capture::open(const QString &device, int width, int height, int fps, QString &error) {
+    (void)device;
+    (void)width;
+    (void)height;
+    (void)fps;
+    error = "V4L2 capture is only available on Linux";
+    return false;
+}
+
+void V4l2Capture::close() {
+    if (m_params) {
+        avcodec_parameters_free(&m_params);
+    }
+}
+
+bool V4l2Capture::isOpen() const {
+    return false;
+}
+
+int V4l2Capture::read(AVPacket *packet, int timeoutMs) {
+    (void)packet;
+    (void)timeoutMs;
+    return AVERROR(ENOSYS);
+}
+
+QJsonObject V4l2Capture::telemetrySnapshot() const {
+    return QJsonObject();
+}
+
+#endif
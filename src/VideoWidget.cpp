@@ -7,16 +7,45 @@ VideoWidget::VideoWidget(QWidget *parent) : QWidget(parent) {
     setStyleSheet("background-color: black;");
 }
 
-void VideoWidget::updateFrame(const QImage *frame) {
-    // 安全检查：frame 可能为 nullptr
-    if (!frame || frame->isNull()) {
-        m_currentFrame = QImage();
-        update();
+void VideoWidget::setFrameSource(ImageMailbox *mailbox) {
+    if (m_source == mailbox) {
         return;
     }
-    
-    // 拷贝图像，因为发送者可能在发出信号后就销毁了原图像
-    m_currentFrame = frame->copy();
+    m_source = mailbox;
+    m_currentFrame = QImage();
+    update();
+}
+
+QSize VideoWidget::displaySize() const {
+    const qreal dpr = devicePixelRatioF();
+    return QSize(qRound(width() * dpr), qRound(height() * dpr));
+}
+
+void VideoWidget::notifyDisplaySize() {
+    const QSize size = displaySize();
+    if (size != m_notifiedSize && !size.isEmpty()) {
+        m_notifiedSize = size;
+        emit displaySizeChanged(size);
+    }
+}
+
+void VideoWidget::resizeEvent(QResizeEvent *event) {
+    QWidget::resizeEvent(event);
+    notifyDisplaySize();
+}
+
+void VideoWidget::showEvent(QShowEvent *event) {
+    QWidget::showEvent(event);
+    notifyDisplaySize();
+}
+
+void VideoWidget::onFrameReady() {
+    update();
+}
+
+void VideoWidget::updateFrame(const QImage &frame) {
+    // 共享而不是拷贝：绘制只读像素，发送者释放自己的副本不影响这里
+    m_currentFrame = frame;
     // 触发重绘事件，但不会立即执行，而是由Qt的事件循环在适当的时候调用paintEvent
     update();
 }
@@ -24,6 +53,14 @@ void VideoWidget::updateFrame(const QImage *frame) {
 void VideoWidget::paintEvent(QPaintEvent *event) {
     Q_UNUSED(event);
 
+    // 移到 DPI 不同的屏幕时尺寸不变但 DPR 变了，没有 resizeEvent，在重绘时补上通知
+    notifyDisplaySize();
+
+    // 取最新一帧；没有新帧就重画上一帧（窗口遮挡、缩放引起的重绘）
+    QImage fresh;
+    if (m_source && m_source->take(fresh) && !fresh.isNull()) {
+        m_currentFrame = std::move(fresh);
+    }
     if (m_currentFrame.isNull()) {
         return;
     }
@@ -37,6 +74,10 @@ void VideoWidget::paintEvent(QPaintEvent *event) {
     int y = (widgetSize.height() - targetSize.height()) / 2;
     QRect targetRect(x, y, targetSize.width(), targetSize.height());
 
-    // 将图像绘制到Widget上，保持长宽比
+    // 解码端的快速路径只做 2x/4x 整数倍缩小，剩下的一点由这里平滑缩放
+    if (m_currentFrame.size() != (QSizeF(targetSize) * devicePixelRatioF()).toSize()) {
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    }
+    // 将图像绘制到Widget上，保持长宽比；解码端已按物理像素尺寸输出时这里是 1:1 拷贝，不再缩放
     painter.drawImage(targetRect, m_currentFrame);
 }
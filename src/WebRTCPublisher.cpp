@@ -1,6 +1,8 @@
 ﻿#include "WebRTCPublisher.h"
 #include "logqueue.h"
 #include "log_global.h"
+#include "QueueTelemetry.h"
+#include "H264Bitstream.h"
 #include <rtc/common.hpp>
 #include <rtc/rtc.hpp>
 #include <QTimer>
@@ -13,6 +15,14 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+namespace {
+// 与 SDP 中声明的保持一致
+constexpr uint32_t kVideoSsrc = 42;
+constexpr uint32_t kVideoRtxSsrc = 44;
+constexpr int kH264PayloadType = 96;
+constexpr int kH264RtxPayloadType = 97;
+}
+
 WebRTCPublisher::WebRTCPublisher(QUEUE_DATA<AVPacketPtr> *encodedPacketQueue, QObject *parent)
     : QObject(parent), 
       m_encodedPacketQueue(encodedPacketQueue)
@@ -20,11 +30,27 @@ WebRTCPublisher::WebRTCPublisher(QUEUE_DATA<AVPacketPtr> *encodedPacketQueue, QO
     m_networkManager = nullptr;
     m_networkManager = new QNetworkAccessManager(this);
     rtcPreload();
+    m_sendBatch.reserve(kMaxSendBatch);
+    m_sendEnqueuedNs.reserve(kMaxSendBatch);
+    m_sendTelemetryName = TelemetryRegistry::instance().registerSource("webrtc.send", [this]() {
+        return sendStats();
+    });
+    m_pacerTelemetryName = TelemetryRegistry::instance().registerSource("webrtc.pacer", [this]() {
+        return m_pacer.stats();
+    });
     //connect(m_networkManager, &QNetworkAccessManager::finished, this, &WebRTCPublisher::onSignalingReply);
 }
 
 
 WebRTCPublisher::~WebRTCPublisher() {
+    if (!m_historyTelemetryName.isEmpty()) {
+        TelemetryRegistry::instance().unregisterSource(m_historyTelemetryName);
+    }
+    if (!m_bweTelemetryName.isEmpty()) {
+        TelemetryRegistry::instance().unregisterSource(m_bweTelemetryName);
+    }
+    TelemetryRegistry::instance().unregisterSource(m_sendTelemetryName);
+    TelemetryRegistry::instance().unregisterSource(m_pacerTelemetryName);
     clear();
 }
 
@@ -56,6 +82,9 @@ bool WebRTCPublisher::init(const QString &signalingUrl, const QString &streamUrl
 }
 
 void WebRTCPublisher::initializePeerConnection() {
+    // 重新 init 会替换轨道，发送线程和平滑线程必须先停
+    m_sendWorker.stop();
+    m_pacer.stop();
     try {
         m_peerConnection = std::make_unique<rtc::PeerConnection>(m_rtcConfig);
 
@@ -63,9 +92,16 @@ void WebRTCPublisher::initializePeerConnection() {
         // video part
         rtc::Description::Video video("video");
         //rtc::Description::Video video("video", rtc::Description::Direction::SendOnly);
-        video.addH264Codec(96);
-        video.addRtxCodec(97, 96, 90000);
-        video.addSSRC(42, "video-send", "video-stream", "video-track");
+        video.addH264Codec(kH264PayloadType);
+        video.addRtxCodec(kH264RtxPayloadType, kH264PayloadType, 90000);
+        video.addSSRC(kVideoSsrc, "video-send", "video-stream", "video-track");
+        // RTX 流与媒体流配对（RFC 4588），对端接受 RTX 时补发走这个 SSRC
+        video.addSSRC(kVideoRtxSsrc, "video-send", "video-stream", "video-track");
+        video.addAttribute("ssrc-group:FID " + std::to_string(kVideoSsrc) + " " + std::to_string(kVideoRtxSsrc));
+        // transport-wide CC：每个包带全局序号，对端按序号回报到达时间
+        video.addAttribute("extmap:" + std::to_string(TransportFeedbackHandler::kDefaultExtensionId) + " " +
+                           TransportFeedbackHandler::kExtensionUri);
+        video.addAttribute("rtcp-fb:" + std::to_string(kH264PayloadType) + " transport-cc");
         video.setDirection(rtc::Description::Direction::SendOnly);
         m_videoTrack = m_peerConnection->addTrack(video);
         WRITE_LOG("Video track (H.264) added.");
@@ -82,19 +118,53 @@ void WebRTCPublisher::initializePeerConnection() {
 
 		//// video_rtp打包配置
         auto VideortpConfig = std::make_shared<rtc::RtpPacketizationConfig>(
-            42,           // SSRC  
+            kVideoSsrc,           // SSRC  
             "video-send",   // CNAME  
-            96,             // Payload Type  
+            kH264PayloadType,             // Payload Type  
             90000           // Clock Rate (H.264 固定为 90000)  
         );
         // 创建 H.264 打包器  
         auto h264Packetizer = std::make_shared<rtc::H264RtpPacketizer>(
-            rtc::NalUnit::Separator::StartSequence,  // NAL 单元分隔符  (00 00 00 01)
+            rtc::NalUnit::Separator::Length,  // 4 字节大端长度前缀，按长度直接跳到下一个 NAL，不再逐字节找起始码
             VideortpConfig,
             rtc::H264RtpPacketizer::DefaultMaxFragmentSize  // 最大分片大小  
         );
+        // 打包后的 RTP 包进入历史缓存，用来应答服务端的 NACK（丢一个分片不必等下一个关键帧）
+        auto videoHistory = std::make_shared<RtpHistoryResponder>(kVideoSsrc);
+        h264Packetizer->addToChain(videoHistory);
+        // 带宽估计：加 TWCC 序号、解析反馈；发送时间由平滑器在真正发出时回报
+        auto transportFeedback = std::make_shared<TransportFeedbackHandler>(
+            kVideoSsrc, std::make_shared<BandwidthEstimator>());
+        transportFeedback->onTargetBitrate([this](int bitrateBps) {
+            m_pacer.setTargetBitrate(bitrateBps);
+            emit targetBitrateChanged(bitrateBps);
+        });
+        videoHistory->addToChain(transportFeedback);
+        m_pacer.setSentObserver([transportFeedback](const rtc::message_ptr &message, int64_t sentUs) {
+            transportFeedback->onPacketSent(message, sentUs);
+        });
+        std::atomic_store(&m_transportFeedback, transportFeedback);
+        if (m_bweTelemetryName.isEmpty()) {
+            m_bweTelemetryName = TelemetryRegistry::instance().registerSource(
+                "webrtc.bwe", [this]() {
+                    std::shared_ptr<TransportFeedbackHandler> feedback = std::atomic_load(&m_transportFeedback);
+                    return feedback ? feedback->stats() : QJsonObject();
+                });
+        }
+        // 平滑器放在最后：历史缓存按打包顺序保存，平滑只推迟真正上线的时间
+        transportFeedback->addToChain(m_pacer.createHandler(RtpPacer::Lane::Video));
+        m_pacer.setTargetBitrate(BandwidthEstimator::kDefaultStartBps);
+        emit targetBitrateChanged(BandwidthEstimator::kDefaultStartBps);
+        std::atomic_store(&m_videoHistory, videoHistory);
         // 设置打包器到轨道  
         m_videoTrack->setMediaHandler(h264Packetizer);
+        if (m_historyTelemetryName.isEmpty()) {
+            m_historyTelemetryName = TelemetryRegistry::instance().registerSource(
+                "rtp.video.history", [this]() {
+                    std::shared_ptr<RtpHistoryResponder> history = std::atomic_load(&m_videoHistory);
+                    return history ? history->stats() : QJsonObject();
+                });
+        }
 
 		//// audio_rtp打包配置
         auto AudiortpConfig = std::make_shared<rtc::RtpPacketizationConfig>(
@@ -105,6 +175,8 @@ void WebRTCPublisher::initializePeerConnection() {
         );
         // 创建 Opus 打包器  
         auto opusPacketizer = std::make_shared<rtc::OpusRtpPacketizer>(AudiortpConfig);
+        // 音频不排队，只把字节记到平滑器的桶里，视频据此让路
+        opusPacketizer->addToChain(m_pacer.createHandler(RtpPacer::Lane::Audio));
         // 设置打包器到轨道  
         m_audioTrack->setMediaHandler(opusPacketizer);
 
@@ -206,8 +278,7 @@ void WebRTCPublisher::initializePeerConnection() {
 }
 
 void WebRTCPublisher::ChangeWebRtcPublishingState(bool isPublishing) {
-    m_isPublishing = isPublishing;
-    if (m_isPublishing) {
+    if (isPublishing) {
         if (!m_peerConnection) {
             emit errorOccurred("WebRTC publisher not initialized.");
             return;
@@ -219,7 +290,15 @@ void WebRTCPublisher::ChangeWebRtcPublishingState(bool isPublishing) {
 }
 
 void WebRTCPublisher::startPublishing() {
-    QMetaObject::invokeMethod(this, "doPublishingWork", Qt::QueuedConnection);
+    if (!m_encodedPacketQueue) {
+        WRITE_LOG("Encoded packet queue is null, cannot start WebRTC publishing.");
+        return;
+    }
+    m_pacer.start();
+    if (!m_sendWorker.start([this]() { return sendPendingPackets(); },
+                            [this]() { m_encodedPacketQueue->interruptWait(); })) {
+        return;
+    }
     WRITE_LOG("Starting WebRTC Publishing");
 }
 
@@ -322,6 +401,22 @@ void WebRTCPublisher::onSignalingReply(QNetworkReply *response) {
         if (m_peerConnection) {
             m_peerConnection->setRemoteDescription(rtc::Description(sdpAnswer.toStdString(), "answer"));
             WRITE_LOG("Remote description set successfully.");
+            // 服务端没有接受 RTX 时（SRS 只回 H264），补发保持原 SSRC/序号
+            const QString rtxMap = QString("a=rtpmap:%1 rtx/90000").arg(kH264RtxPayloadType);
+            if (m_videoHistory && sdpAnswer.contains(rtxMap, Qt::CaseInsensitive)) {
+                m_videoHistory->setRtx(kVideoRtxSsrc, kH264RtxPayloadType);
+                WRITE_LOG("RTX accepted by remote, retransmissions use SSRC %u", kVideoRtxSsrc);
+            }
+            // 对端没接受扩展时不加序号（免得每个包都重新拷贝），带宽估计只用 RR 丢包率和 REMB
+            const int twccId = TransportFeedbackHandler::negotiatedExtensionId(sdpAnswer.toStdString());
+            if (m_transportFeedback) {
+                m_transportFeedback->setExtensionId(twccId);
+            }
+            if (twccId > 0) {
+                WRITE_LOG("Transport-wide CC accepted by remote (extmap %d).", twccId);
+            } else {
+                WRITE_LOG("Transport-wide CC not accepted by remote, stamping disabled.");
+            }
         }
         else {
             WRITE_LOG("ERROR: PeerConnection is null when trying to set remote description.");
@@ -341,86 +436,90 @@ void WebRTCPublisher::onSignalingReply(QNetworkReply *response) {
     });
 
 }
-std::vector<std::byte> normalizeH264StartCodes(const uint8_t* data, int size) {
-    std::vector<std::byte> buffer;
-    buffer.reserve(size + 16);
-
-    for (int i = 0; i < size; ) {
-        // 1. 优先检查 4 字节起始码 (00 00 00 01)
-        // 如果已经是 4 字节，直接拷贝，不做修改
-        if (i + 3 < size &&
-            data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] == 0x00 && data[i + 3] == 0x01) {
-
-            buffer.push_back(std::byte(0x00));
-            buffer.push_back(std::byte(0x00));
-            buffer.push_back(std::byte(0x00));
-            buffer.push_back(std::byte(0x01));
-            i += 4; // 跳过这 4 个字节
-        }
-        // 2. 检查 3 字节起始码 (00 00 01)
-        // 只有是 3 字节时，才补一个 00
-        else if (i + 2 < size &&
-            data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] == 0x01) {
-
-            buffer.push_back(std::byte(0x00));
-            buffer.push_back(std::byte(0x00));
-            buffer.push_back(std::byte(0x00)); // 补入 00
-            buffer.push_back(std::byte(0x01));
-            i += 3; // 跳过这 3 个字节
+bool WebRTCPublisher::sendPendingPackets() {
+    // 以前每个 1ms 定时器只发一个包：Windows 定时器粒度 15.6ms，关键帧的几十个包要在音频后面排好几轮
+    m_sendBatch.clear();
+    m_sendEnqueuedNs.clear();
+    // 与 PipelineWorker::startConsumer 相同：先取打断代数再查停止标志，避免 stop() 的打断落空
+    const uint64_t interruptGen = m_encodedPacketQueue->interruptGeneration();
+    if (m_sendWorker.stopRequested()) {
+        return true;
+    }
+    const int count = m_encodedPacketQueue->dequeue_batch_since(interruptGen, m_sendBatch, kMaxSendBatch,
+                                                                WAIT_MILLISECONDS, &m_sendEnqueuedNs);
+    if (count <= 0) {
+        return true;
+    }
+    m_sendBatches.fetch_add(1, std::memory_order_relaxed);
+    if (count > m_maxBatch.load(std::memory_order_relaxed)) {
+        m_maxBatch.store(count, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < count; ++i) {
+        if (m_sendWorker.cancelRequested()) {
+            break;
         }
-        // 3. 普通数据
-        else {
-            buffer.push_back(std::byte(data[i]));
-            i++;
+        sendPacket(m_sendBatch[i].get());
+        m_queueToWireUs.record((QueueStats::nowNs() - m_sendEnqueuedNs[i]) / 1000);
+    }
+    m_sendBatch.clear();
+    return true;
+}
+
+void WebRTCPublisher::sendPacket(AVPacket *packet) {
+    try {
+        if (packet->stream_index ==0 && m_videoTrack && m_videoTrack->isOpen()) {
+            sendVideoPacket(packet);
+        } else if (packet->stream_index ==1 && m_audioTrack && m_audioTrack->isOpen()) {
+            m_audioTrack->send(
+                reinterpret_cast<const std::byte*>(packet->data),
+                packet->size
+            );
+        } else {
+            return;
         }
+        m_sentPackets.fetch_add(1, std::memory_order_relaxed);
+        m_sentBytes.fetch_add(static_cast<uint64_t>(packet->size), std::memory_order_relaxed);
+    } catch (const std::exception &e) {
+        WRITE_LOG("Exception while sending packet: %s", e.what());
     }
-    return buffer;
 }
-//TODO:使用m_isDoingWork+cond条件保护推流线程
-void WebRTCPublisher::doPublishingWork() {
-    if (!m_isPublishing.load()) {
-        WRITE_LOG("WebRTC publishing loop finished.");
+
+void WebRTCPublisher::sendVideoPacket(AVPacket *packet) {
+    // 编码器输出 Annex-B，一遍向量化扫描建立 NAL 索引，偏移在 make_writable 复制后仍然有效
+    if (indexH264Nals(packet->data, packet->size, m_nalIndex) == 0) {
         return;
     }
-    if (!m_encodedPacketQueue) {
-        WRITE_LOG("Encoded packet queue is null in doPublishingWork. Stopping publisher.");
+    // 全是首尾相接的 4 字节起始码时把起始码原地改成长度，整帧零拷贝交给打包器；
+    // 编码器刚产出的包引用计数为 1，make_writable 不会复制
+    if (av_packet_make_writable(packet) >= 0 &&
+        rewriteH264StartCodesAsLengths(packet->data, packet->size, m_nalIndex)) {
+        m_videoTrack->send(reinterpret_cast<const std::byte*>(packet->data), packet->size);
+        m_videoInPlace.fetch_add(1, std::memory_order_relaxed);
         return;
     }
-    AVPacketPtr packet;
-    if (m_encodedPacketQueue->dequeue(packet)) {
-        // 使用 try_dequeue 避免阻塞
-        try {
-            if (packet->stream_index ==0 && m_videoTrack && m_videoTrack->isOpen()) {
-                auto normalizedData = normalizeH264StartCodes(packet->data, packet->size);
-                //m_videoTrack->send(
-                //    reinterpret_cast<const std::byte*>(packet->data),
-                //    packet->size
-                //);
-                m_videoTrack->send(normalizedData);
- /*               if (packet->flags & AV_PKT_FLAG_KEY) {
-                    WRITE_LOG("WebRTC: Sent Video Keyframe (Original Size: %d, Sent: %d)",
-                        packet->size, normalizedData.size());
-                }*/
-                //WRITE_LOG("sending Video frame, Size: %d, frame = %s", packet->size, packet->flags);
-                //WRITE_LOG("sending Video frame");
-             
-            } else if (packet->stream_index ==1 && m_audioTrack && m_audioTrack->isOpen()) {
-                //WRITE_LOG("sending audio packet, size: %d", packet->size);
-                m_audioTrack->send(
-                    reinterpret_cast<const std::byte*>(packet->data),
-                    packet->size
-                );
-            }
-        } catch (const std::exception &e) {
-            WRITE_LOG("Exception while sending packet: %s", e.what());
-        }
-    }
+    // zerolatency 的多 slice 帧里会出现 3 字节起始码，按索引每个 NAL 一次 memcpy 拼出来
+    m_lengthPrefixed.clear();
+    appendH264LengthPrefixed(packet->data, m_nalIndex, m_lengthPrefixed);
+    m_videoTrack->send(m_lengthPrefixed.data(), m_lengthPrefixed.size());
+    m_videoRebuilt.fetch_add(1, std::memory_order_relaxed);
+}
 
-    // 使用 QTimer 来避免堆栈溢出和实现非阻塞循环
-    QTimer::singleShot(1, this, &WebRTCPublisher::doPublishingWork);
+QJsonObject WebRTCPublisher::sendStats() const {
+    QJsonObject obj;
+    obj["packets"] = static_cast<qint64>(m_sentPackets.load(std::memory_order_relaxed));
+    obj["bytes"] = static_cast<qint64>(m_sentBytes.load(std::memory_order_relaxed));
+    obj["batches"] = static_cast<qint64>(m_sendBatches.load(std::memory_order_relaxed));
+    obj["maxBatch"] = m_maxBatch.load(std::memory_order_relaxed);
+    obj["videoInPlace"] = static_cast<qint64>(m_videoInPlace.load(std::memory_order_relaxed));
+    obj["videoRebuilt"] = static_cast<qint64>(m_videoRebuilt.load(std::memory_order_relaxed));
+    obj["queueToWireUs"] = m_queueToWireUs.toJson();
+    return obj;
 }
 
 void WebRTCPublisher::clear() {
+    // join 发送线程和平滑线程，之后才能释放轨道
+    m_sendWorker.stop();
+    m_pacer.stop();
 
     if (m_peerConnection) {
         m_peerConnection->close();
@@ -429,6 +528,8 @@ void WebRTCPublisher::clear() {
     m_peerConnection.reset();
     m_videoTrack.reset();
     m_audioTrack.reset();
+    std::atomic_store(&m_videoHistory, std::shared_ptr<RtpHistoryResponder>());
+    std::atomic_store(&m_transportFeedback, std::shared_ptr<TransportFeedbackHandler>());
 
     WRITE_LOG("WebRTCPublisher cleared.");
 }
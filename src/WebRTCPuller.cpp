@@ -1,22 +1,39 @@
 ﻿#include "WebRTCPuller.h"
 
+namespace {
+// 与 SDP 中声明的保持一致
+constexpr uint32_t kLocalVideoSsrc = 42;
+constexpr int kH264PayloadType = 96;
+constexpr int kH264RtxPayloadType = 97;
+}
 
-WebRTCPuller::WebRTCPuller(QUEUE_DATA<std::unique_ptr<QImage> >* MainQimageQueue,
+WebRTCPuller::WebRTCPuller(ImageMailbox* imageMailbox,
 	QObject *parent)
-	: QObject(parent), m_MainQimageQueue(MainQimageQueue)
+	: QObject(parent), m_imageMailbox(imageMailbox)
 { 
 
-	m_videoPacketQueue = new QUEUE_DATA<AVPacketPtr>();
-    m_audioPacketQueue = new QUEUE_DATA<AVPacketPtr>();
+	m_videoPacketQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::SpscRing, 128);
+    m_audioPacketQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::SpscRing, 128);
 	m_dummyVideoFrameQueue = new QUEUE_DATA<AVFramePtr>();
+    // 视频包按帧组装并带关键帧标记，解码跟不上时丢到下一个 IDR
+    m_videoPacketQueue->setOverflowPolicy(OverflowPolicy::DropUntilKeyframe, CapacityUnit::Items, 60);
+    // 音频积压时丢最旧的，保证播放延迟有界
+    m_audioPacketQueue->setOverflowPolicy(OverflowPolicy::DropOldest, CapacityUnit::Items, 100);
+    // 拉流端不转码，解码出的帧没有消费者，上限为 0 即全部丢弃
+    m_dummyVideoFrameQueue->setOverflowPolicy(OverflowPolicy::DropNewest, CapacityUnit::Items, 0);
+    m_videoPacketQueue->setName("webrtcPull.videoPacket");
+    m_audioPacketQueue->setName("webrtcPull.audioPacket");
     m_networkManager = nullptr;
     m_networkManager = new QNetworkAccessManager(this);
     rtcPreload();
 
 
 	m_videoDecoder = new ffmpegVideoDecoder(m_videoPacketQueue,
-											m_MainQimageQueue, // 使用外部 QImage 队列
+											m_imageMailbox, // 使用外部显示信箱
 											m_dummyVideoFrameQueue);
+	// 实时通话不能接受帧线程的额外延迟
+	m_videoDecoder->setThreading(ffmpegVideoDecoder::Threading::Slice);
+	m_videoDecoder->setStageName("webrtcPull.videoDecoder");
 	m_audioPlayer = new AudioPlayer(m_audioPacketQueue);
 
 	m_videoDecodeThread = new QThread();
@@ -40,6 +57,10 @@ WebRTCPuller::WebRTCPuller(QUEUE_DATA<std::unique_ptr<QImage> >* MainQimageQueue
 
 WebRTCPuller::~WebRTCPuller()
 {
+	// 解包器随本对象析构，先断开播放线程对它的引用
+	if (m_audioPlayer) {
+		m_audioPlayer->setTimeStretchProvider(nullptr);
+	}
 	clear();
 	WRITE_LOG("WebRTCPuller (Player Module) destroyed.");
 }
@@ -57,7 +78,22 @@ bool WebRTCPuller::init(QString WebRTCUrl, QString audioDeviceName) {
 	//    LogQueue::GetInstance().print(file, function, line, "%s", message.c_str());
 	//});
     m_videoDepacketizer = new RTPDepacketizer(90000,m_videoPacketQueue,true,this);
+    m_videoDepacketizer->setStageName("webrtcPull.videoDepacketizer");
+    // 视频丢包先走 NACK/RTX 重传，比等 PLI 换关键帧便宜得多；NACK 由网络线程（收包时）或播放调度线程（断流期间重试）直接经视频轨道发出
+    m_videoDepacketizer->enableRetransmission(kLocalVideoSsrc, kH264RtxPayloadType,
+        [this](const uint8_t* data, size_t len) {
+            std::shared_ptr<rtc::Track> track = m_videoTrack;
+            if (track && track->isOpen()) {
+                track->send(reinterpret_cast<const std::byte*>(data), len);
+            }
+        });
     m_audioDepacketizer = new RTPDepacketizer(48000,m_audioPacketQueue,false,this);
+    m_audioDepacketizer->setStageName("webrtcPull.audioDepacketizer");
+    // 抖动缓冲深度调整时，由播放端变速吸收
+    RTPDepacketizer* audioDepacketizer = m_audioDepacketizer;
+    m_audioPlayer->setTimeStretchProvider([audioDepacketizer](int maxUs) {
+        return audioDepacketizer->takeTimeStretchUs(maxUs);
+    });
 	m_signalingUrl = WebRTCUrl;
 	m_streamUrl = WebRTCUrl;
 	m_rtcConfig.iceServers.clear();
@@ -84,9 +120,9 @@ void WebRTCPuller::initializePeerConnection()
         // video part
         rtc::Description::Video video("video");
         //rtc::Description::Video video("video", rtc::Description::Direction::SendOnly);
-        video.addH264Codec(96);
-        video.addRtxCodec(97, 96, 90000);
-        video.addSSRC(42, "video-send", "video-stream", "video-track");
+        video.addH264Codec(kH264PayloadType);
+        video.addRtxCodec(kH264RtxPayloadType, kH264PayloadType, 90000);
+        video.addSSRC(kLocalVideoSsrc, "video-send", "video-stream", "video-track");
         video.setDirection(rtc::Description::Direction::RecvOnly);
         m_videoTrack = m_peerConnection->addTrack(video);
         WRITE_LOG("Video RecvOnly track (H.264) added.");
@@ -102,7 +138,6 @@ void WebRTCPuller::initializePeerConnection()
             auto& data_bin = std::get<rtc::binary>(message);
             // data_bin 是 std::vector<byte> 或类似结构
             if (m_videoDepacketizer) {
-                 WRITE_LOG("Video Packet Received size=%d", data_bin.size());
                 m_videoDepacketizer->pushPacket(
                     reinterpret_cast<const uint8_t*>(data_bin.data()),
                     data_bin.size()
@@ -130,7 +165,6 @@ void WebRTCPuller::initializePeerConnection()
             auto& data_bin = std::get<rtc::binary>(message);
             // data_bin 是 std::vector<byte> 或类似结构
             if (m_audioDepacketizer) {
-                 WRITE_LOG("Audio Packet Received size=%d", data_bin.size());
                 m_audioDepacketizer->pushPacket(
                     reinterpret_cast<const uint8_t*>(data_bin.data()),
                     data_bin.size()
@@ -411,6 +445,12 @@ void WebRTCPuller::stopPulling() {
 
 
 
+void WebRTCPuller::setDisplaySize(const QSize& size) {
+    if (m_videoDecoder) {
+        m_videoDecoder->setTargetSize(size);
+    }
+}
+
 void WebRTCPuller::clear() { 
     WRITE_LOG("TO CLEAR THREAD");
 }
\ No newline at end of file
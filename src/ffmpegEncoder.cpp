@@ -9,6 +9,24 @@
 #include "log_global.h"
 #include "libavutil/opt.h"
 
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr int kFallbackCaptureFps = 25; // 采集端没有给出帧率时使用
+constexpr int64_t kDefaultVideoBitRate = 2000000; //2 Mbps，没有带宽估计时的固定码率
+constexpr double kMinBitsPerPixel = 0.04;  // 当前档低于此值降一档
+constexpr double kUpBitsPerPixel = 0.06;   // 上一档能达到此值才升
+constexpr int64_t kLayerHoldNs = 2000000000LL; // 两次切档至少间隔 2 秒
+}
+
+const ffmpegEncoder::VideoLayer ffmpegEncoder::kVideoLadder[kVideoLayerCount] = {
+    {1, 1, 1, 1},
+    {3, 4, 1, 1},
+    {1, 2, 4, 5},
+    {1, 2, 3, 5},
+};
+
 ffmpegEncoder::ffmpegEncoder(QUEUE_DATA<AVFramePtr> *frameQueue, QUEUE_DATA<AVPacketPtr> *packetQueue, QObject *parent)
     : m_frameQueue(frameQueue), m_packetQueue(packetQueue) {
 }
@@ -16,6 +34,11 @@ ffmpegEncoder::ffmpegEncoder(QUEUE_DATA<AVFramePtr> *frameQueue, QUEUE_DATA<AVPa
 ffmpegEncoder::~ffmpegEncoder() {
     clear();
 }
+
+AVCodecContext *ffmpegEncoder::getCodecContext() const {
+    std::lock_guard<std::mutex> lock(m_codecCtxMutex);
+    return m_codecCtx;
+}
 bool ffmpegEncoder::initAudioEncoderAAC(AVCodecParameters* aparams) {
 	WRITE_LOG("Initializing Audio AAC Encoder...");
     m_mediaType = AVMEDIA_TYPE_AUDIO;
@@ -104,34 +127,69 @@ bool ffmpegEncoder::initAudioEncoderOpus(AVCodecParameters *aparams) {
 bool ffmpegEncoder::initVideoEncoderH264(AVCodecParameters *vparams) {
 	WRITE_LOG("Initializing Video H.264 Encoder...");
     m_mediaType = AVMEDIA_TYPE_VIDEO;
+    m_sourceWidth = vparams->width;
+    m_sourceHeight = vparams->height;
+    // 采集端协商到 nv12 / yuv420p 时 x264 直接使用，省掉一次格式转换；其余输入转成 yuv420p
+    const bool rawInput = vparams->codec_id == AV_CODEC_ID_RAWVIDEO;
+    if (rawInput && (vparams->format == AV_PIX_FMT_NV12 || vparams->format == AV_PIX_FMT_YUV420P)) {
+        m_videoPixFmt = static_cast<AVPixelFormat>(vparams->format);
+    } else {
+        m_videoPixFmt = AV_PIX_FMT_YUV420P; // H.264常用格式
+    }
+    // 编码帧率跟随采集端协商的帧率
+    m_captureFps = vparams->framerate.num > 0 && vparams->framerate.den > 0
+                       ? std::max(1, static_cast<int>(std::lround(av_q2d(vparams->framerate))))
+                       : kFallbackCaptureFps;
+    m_videoLayer = 0;
+    m_appliedBitrate = 0;
+    m_frameCredit = 0;
+
+    AVCodecContext *codecCtx = openVideoCodec(m_sourceWidth, m_sourceHeight, m_captureFps, kDefaultVideoBitRate);
+    if (!codecCtx) {
+        return false;
+    }
+    installVideoCodec(codecCtx, false);
+    m_videoFrameCounter = 0;
+
+    emit encoderInitialized(m_codecCtx);
+    emit initializationSuccess();
+    WRITE_LOG("Video encoder initialized successfully (input %s).", av_get_pix_fmt_name(m_codecCtx->pix_fmt));
+    return true;
+}
+
+AVCodecContext *ffmpegEncoder::openVideoCodec(int width, int height, int fps, int64_t bitRate) {
     const AVCodec *codec = avcodec_find_encoder_by_name("libx264"); // 使用H.264 编码器
     if (!codec) {
         emit errorOccurred("Codec libx264 not found.");
-        return false;
+        return nullptr;
     }
 
-    m_codecCtx = avcodec_alloc_context3(codec);
-    if (!m_codecCtx) {
+    AVCodecContext *codecCtx = avcodec_alloc_context3(codec);
+    if (!codecCtx) {
         emit errorOccurred("Failed to allocate codec context.");
-        return false;
+        return nullptr;
     }
 
     // 设置视频编码参数
-    m_codecCtx->width = vparams->width;
-    m_codecCtx->height = vparams->height;
-    m_codecCtx->pix_fmt = AV_PIX_FMT_YUV420P; // H.264常用格式
-    m_codecCtx->time_base = {1,25}; //25 fps
-    m_codecCtx->framerate = {25,1};
-    m_codecCtx->bit_rate =2000000; //2 Mbps
-    m_codecCtx->gop_size =25;
-    m_codecCtx->max_b_frames = 0;//不设置B帧
-    m_codecCtx->has_b_frames = 0;
-    av_opt_set(m_codecCtx->priv_data, "preset", "ultrafast", 0);
-    av_opt_set(m_codecCtx->priv_data, "tune", "zerolatency", 0);
+    codecCtx->width = width;
+    codecCtx->height = height;
+    codecCtx->pix_fmt = m_videoPixFmt;
+    codecCtx->time_base = {1, fps};
+    codecCtx->framerate = {fps, 1};
+    codecCtx->bit_rate = bitRate;
+    // VBV 上限跟随码率：libx264 在 send_frame 时发现 bit_rate / rc_max_rate 变化会调用 x264_encoder_reconfig，
+    // 只有打开时就启用了 VBV，运行中的码率调整才能同时限住峰值
+    codecCtx->rc_max_rate = bitRate;
+    codecCtx->rc_buffer_size = static_cast<int>(bitRate);
+    codecCtx->gop_size = fps; // 1 秒一个关键帧
+    codecCtx->max_b_frames = 0;//不设置B帧
+    codecCtx->has_b_frames = 0;
+    av_opt_set(codecCtx->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(codecCtx->priv_data, "tune", "zerolatency", 0);
     //m_codecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; // 全局头
 
-    m_codecCtx->level = 31; // Level 3.1
-    m_codecCtx->refs = 1;   // 参考帧数
+    codecCtx->level = 31; // Level 3.1
+    codecCtx->refs = 1;   // 参考帧数
 
     //// 设置编码器参数
     AVDictionary* codec_options = nullptr;
@@ -144,25 +202,104 @@ bool ffmpegEncoder::initVideoEncoderH264(AVCodecParameters *vparams) {
     //av_dict_set(&codec_options, "x264-params", "annexb=1:repeat_headers=1", 0);
     //av_dict_set(&codec_options, "bsf", "h264_mp4toannexb", 0); // 转换为annexb格式
 
-    if (avcodec_open2(m_codecCtx, codec, nullptr) <0) {
+    if (avcodec_open2(codecCtx, codec, nullptr) <0) {
         emit errorOccurred("Failed to open video codec.");
-        //av_dict_free(&codec_options);
-        return false;
+        av_dict_free(&codec_options);
+        avcodec_free_context(&codecCtx);
+        return nullptr;
     }
+    av_dict_free(&codec_options);
 
-    // reset video frame counter
-    m_videoFrameCounter =0;
+    return codecCtx;
+}
 
-    //av_dict_free(&codec_options);
-    emit encoderInitialized(m_codecCtx);
-    emit initializationSuccess();
-    WRITE_LOG("Video encoder initialized successfully.");
+bool ffmpegEncoder::installVideoCodec(AVCodecContext *codecCtx, bool layerSwitch) {
+    std::lock_guard<std::mutex> lock(m_codecCtxMutex);
+    if (layerSwitch && !m_layerSwitching) {
+        // 重开编码器期间开始了 RTMP 推流，它已拿到当前上下文，继续用旧的
+        avcodec_free_context(&codecCtx);
+        return false;
+    }
+    if (m_codecCtx) {
+        // 运行中换档：帧计数换算到新的时间基，pts 保持连续递增
+        m_videoFrameCounter = av_rescale_q_rnd(m_videoFrameCounter, m_codecCtx->time_base, codecCtx->time_base,
+                                               static_cast<AVRounding>(AV_ROUND_UP | AV_ROUND_PASS_MINMAX));
+        avcodec_free_context(&m_codecCtx);
+    }
+    m_codecCtx = codecCtx;
     return true;
 }
 
+void ffmpegEncoder::setTargetBitrate(int bitrateBps) {
+    m_targetBitrate.store(bitrateBps, std::memory_order_relaxed);
+}
+
+void ffmpegEncoder::setLayerSwitchingEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_codecCtxMutex);
+    m_layerSwitching = enabled;
+}
+
+int ffmpegEncoder::layerFps(int layer) const {
+    const VideoLayer &l = kVideoLadder[layer];
+    return std::max(1, m_captureFps * l.fpsNum / l.fpsDen);
+}
+
+int ffmpegEncoder::chooseVideoLayer(int bitrateBps) const {
+    auto bitsPerPixel = [this, bitrateBps](int layer) {
+        const VideoLayer &l = kVideoLadder[layer];
+        const double pixels = static_cast<double>(m_sourceWidth * l.scaleNum / l.scaleDen) *
+                              (m_sourceHeight * l.scaleNum / l.scaleDen) * layerFps(layer);
+        return pixels > 0 ? bitrateBps / pixels : 0.0;
+    };
+    // 降级看当前档是否够用，升级要求上一档有余量，两个门限之间不动，避免来回切换
+    int layer = m_videoLayer;
+    while (layer + 1 < kVideoLayerCount && bitsPerPixel(layer) < kMinBitsPerPixel) {
+        ++layer;
+    }
+    while (layer > 0 && bitsPerPixel(layer - 1) >= kUpBitsPerPixel) {
+        --layer;
+    }
+    return layer;
+}
+
+void ffmpegEncoder::applyTargetBitrate() {
+    const int target = m_targetBitrate.load(std::memory_order_relaxed);
+    if (target <= 0) {
+        return;
+    }
+    bool layerSwitching;
+    {
+        std::lock_guard<std::mutex> lock(m_codecCtxMutex);
+        layerSwitching = m_layerSwitching;
+    }
+    const int layer = layerSwitching ? chooseVideoLayer(target) : m_videoLayer;
+    const int64_t now = QueueStats::nowNs();
+    if (layer != m_videoLayer && now - m_layerSwitchedNs >= kLayerHoldNs) {
+        // 分辨率和帧率 x264 不能在线修改，重开编码器；新编码器第一帧就是带 SPS/PPS 的 IDR，WebRTC 接收端无缝切换
+        const VideoLayer &l = kVideoLadder[layer];
+        const int width = (m_sourceWidth * l.scaleNum / l.scaleDen) & ~1;
+        const int height = (m_sourceHeight * l.scaleNum / l.scaleDen) & ~1;
+        const int fps = layerFps(layer);
+        AVCodecContext *codecCtx = openVideoCodec(width, height, fps, target);
+        if (codecCtx && installVideoCodec(codecCtx, true)) {
+            WRITE_LOG("Video layer %d -> %d: %dx%d@%d, %d kbps", m_videoLayer, layer, width, height, fps, target / 1000);
+            m_videoLayer = layer;
+            m_layerSwitchedNs = now;
+            m_appliedBitrate = target;
+            m_frameCredit = 0;
+            return;
+        }
+    }
+    if (target != m_appliedBitrate) {
+        // 下一次 avcodec_send_frame 时生效，VBV 缓冲大小保持打开时的值
+        m_codecCtx->bit_rate = target;
+        m_codecCtx->rc_max_rate = target;
+        m_appliedBitrate = target;
+    }
+}
+
 void ffmpegEncoder::ChangeEncodingState(bool isEncoding) { 
-    m_isEncoding = isEncoding;
-    if (m_isEncoding) {
+    if (isEncoding) {
         startEncoding();
     }
     else {
@@ -171,160 +308,178 @@ void ffmpegEncoder::ChangeEncodingState(bool isEncoding) {
 }
 /// TODO:这里使用编码开始时清空队列来保证音视频同步，这是极为简化的做法，后期完善
 void ffmpegEncoder::startEncoding() {
+    if (!m_codecCtx) {
+        WRITE_LOG("Encoder not initialized, cannot start encoding.");
+        return;
+    }
+    if (m_worker.isRunning()) {
+        return;
+    }
+    auto flush = [this]() { flushEncoder(); };
     if (m_mediaType == AVMEDIA_TYPE_VIDEO) {
         WRITE_LOG("Starting Video Encoding Loop...");
-        QMetaObject::invokeMethod(this, "doVideoEncodingWork", Qt::QueuedConnection);
-        QMetaObject::invokeMethod(this, "doVideoEncodingWork", Qt::QueuedConnection);
+        m_worker.startConsumer<AVFramePtr>(m_frameQueue, PipelineWorker::kDefaultBatch,
+                                           [this](AVFramePtr &frame) { encodeVideoFrame(frame.get()); }, flush);
     }
     else {
         WRITE_LOG("Starting Audio Encoding Loop...");
         WRITE_LOG("Clearing stale audio frames from queue before starting...");
         m_frameQueue->clear();
         m_audioSamplesCount = 0;
-        QMetaObject::invokeMethod(this, "doAudioEncodingWork", Qt::QueuedConnection);
+        m_worker.startConsumer<AVFramePtr>(m_frameQueue, PipelineWorker::kDefaultBatch,
+                                           [this](AVFramePtr &frame) { encodeAudioFrame(frame.get()); }, flush);
     }
 }
 
 void ffmpegEncoder::stopEncoding() {
-    flushEncoder();
     WRITE_LOG("Stopping encoding process for %s", (m_mediaType == AVMEDIA_TYPE_VIDEO ? "video" : "audio"));
+    // 编码线程先编完队列里已有的帧、冲洗编码器，join 返回时尾部的包都已进入发送队列
+    m_worker.stop(PipelineWorker::StopMode::Drain);
 }
-void ffmpegEncoder::doVideoEncodingWork() {
 
-    if (!m_isEncoding) {
-        WRITE_LOG("Video encoding loop finished.");
-        return;
+void ffmpegEncoder::encodeVideoFrame(AVFrame *frame) {
+    applyTargetBitrate();
+    // 低帧率档按比例丢掉采集帧
+    const int fps = layerFps(m_videoLayer);
+    if (fps < m_captureFps) {
+        m_frameCredit += static_cast<double>(fps) / m_captureFps;
+        if (m_frameCredit < 1) {
+            return;
+        }
+        m_frameCredit -= 1;
     }
+    const int64_t stageBegin = m_stageStats.begin();
+    // qDebug() << "Encoding Video frame: " << m_videoFrameCounter;
 
-    {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = true;
+    frame->pts = m_videoFrameCounter++;
+
+    if (m_forceKeyframe.exchange(false)) {// 获取并重置标志
+        WRITE_LOG("Requesting I-frame for video.");
+        frame->pict_type = AV_PICTURE_TYPE_I;//强制此帧为I帧
+    }
+    else {
+        frame->pict_type = AV_PICTURE_TYPE_NONE;//让编码器自行决定
     }
-    auto work_guard = [this]() {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = false;
-        m_workCond.wakeAll();
-        };
 
+    AVFrame *input = toEncoderFormat(frame);
+    int ret = input ? avcodec_send_frame(m_codecCtx, input) : AVERROR(EINVAL);
+    if (ret < 0) {
+        emit errorOccurred("Error sending video frame to encoder.");
+    }
+    else {
+        while (ret >= 0) {
+            AVPacketPtr packet(av_packet_alloc());
+            ret = avcodec_receive_packet(m_codecCtx, packet.get());
 
-    AVFramePtr frame;
-    if (m_frameQueue->dequeue(frame)) {
-        // qDebug() << "Encoding Video frame: " << m_videoFrameCounter;
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            }
+            else if (ret < 0) {
+                emit errorOccurred("Error receiving video packet.");
+                break;
+            }
+            // 关键帧检测
+            //if (packet->flags & AV_PKT_FLAG_KEY) {
+            //    WRITE_LOG("Encoder output KEYFRAME (Size: %d, PTS: %lld)", packet->size, packet->pts);
+            //}
+            if (packet->size <= 0 || packet->data == nullptr || packet->pts == AV_NOPTS_VALUE){
+                WRITE_LOG("Video Encoder generated an invalid packet (size=%d, pts=%lld), dropping it.",packet->size, packet->pts);
+                                        continue; // 丢弃这个包，继续尝试接收下一个
+            }
 
-        frame->pts = m_videoFrameCounter++;
+            packet->stream_index = 0; // 视频流是 0
+            // 时间基和时长供发送队列按媒体时长计容量
+            packet->time_base = m_codecCtx->time_base;
+            if (packet->duration <= 0) {
+                packet->duration = 1;
+            }
+            //WRITE_LOG("Enqueuing VIDEO packet: PTS=%lld, Size=%d, Key=%d",packet->pts, packet->size, (packet->flags & AV_PKT_FLAG_KEY));
 
-        if (m_forceKeyframe.exchange(false)) {// 获取并重置标志
-            WRITE_LOG("Requesting I-frame for video.");
-            frame->pict_type = AV_PICTURE_TYPE_I;//强制此帧为I帧
-        }
-        else {
-            frame->pict_type = AV_PICTURE_TYPE_NONE;//让编码器自行决定
+            m_packetQueue->enqueue(std::move(packet));
         }
+    }
+    m_stageStats.end(stageBegin);
+}
+
 
-        int ret = avcodec_send_frame(m_codecCtx, frame.get());
-        if (ret < 0) {
-            emit errorOccurred("Error sending video frame to encoder.");
+AVFrame *ffmpegEncoder::toEncoderFormat(AVFrame *frame) {
+    if (frame->format == m_codecCtx->pix_fmt && frame->width == m_codecCtx->width &&
+        frame->height == m_codecCtx->height) {
+        return frame;
+    }
+    m_swsCtx = sws_getCachedContext(m_swsCtx, frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                    m_codecCtx->width, m_codecCtx->height, m_codecCtx->pix_fmt,
+                                    SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!m_swsCtx) {
+        WRITE_LOG("Failed to create encoder input SwsContext.");
+        return nullptr;
+    }
+    if (!m_convertFrame || m_convertFrame->width != m_codecCtx->width || m_convertFrame->height != m_codecCtx->height) {
+        m_convertFrame.reset(av_frame_alloc());
+        if (!m_convertFrame) {
+            return nullptr;
         }
-        else {
-            while (ret >= 0) {
-                AVPacketPtr packet(av_packet_alloc());
-                ret = avcodec_receive_packet(m_codecCtx, packet.get());
-
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                }
-                else if (ret < 0) {
-                    emit errorOccurred("Error receiving video packet.");
-                    break;
-                }
-                // 关键帧检测
-                //if (packet->flags & AV_PKT_FLAG_KEY) {
-                //    WRITE_LOG("Encoder output KEYFRAME (Size: %d, PTS: %lld)", packet->size, packet->pts);
-                //}
-                if (packet->size <= 0 || packet->data == nullptr || packet->pts == AV_NOPTS_VALUE){
-                    WRITE_LOG("Video Encoder generated an invalid packet (size=%d, pts=%lld), dropping it.",packet->size, packet->pts);
-                                            continue; // 丢弃这个包，继续尝试接收下一个
-                }
-
-                packet->stream_index = 0; // 视频流是 0
-                //WRITE_LOG("Enqueuing VIDEO packet: PTS=%lld, Size=%d, Key=%d",packet->pts, packet->size, (packet->flags & AV_PKT_FLAG_KEY));
-
-                m_packetQueue->enqueue(std::move(packet));
-            }
+        m_convertFrame->format = m_codecCtx->pix_fmt;
+        m_convertFrame->width = m_codecCtx->width;
+        m_convertFrame->height = m_codecCtx->height;
+        if (av_frame_get_buffer(m_convertFrame.get(), 0) < 0) {
+            m_convertFrame.reset();
+            return nullptr;
         }
     }
-
-
-    work_guard(); 
-    if (m_isEncoding) {
-        QMetaObject::invokeMethod(this, "doVideoEncodingWork", Qt::QueuedConnection);
+    // 编码器还引用着上一帧时才会重新分配
+    if (av_frame_make_writable(m_convertFrame.get()) < 0) {
+        return nullptr;
     }
+    sws_scale(m_swsCtx, frame->data, frame->linesize, 0, frame->height,
+              m_convertFrame->data, m_convertFrame->linesize);
+    m_convertFrame->pts = frame->pts;
+    m_convertFrame->pict_type = frame->pict_type;
+    return m_convertFrame.get();
 }
 
+void ffmpegEncoder::encodeAudioFrame(AVFrame *frame) {
+    const int64_t stageBegin = m_stageStats.begin();
 
-void ffmpegEncoder::doAudioEncodingWork() {
-    if (!m_isEncoding) {
-        WRITE_LOG("Audio encoding loop finished.");
-        return;
-    }
+    frame->pts = m_audioSamplesCount;
+    m_audioSamplesCount += frame->nb_samples;
 
-    {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = true;
-    }
-    auto work_guard = [this]() {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = false;
-        m_workCond.wakeAll();
-        };
-
-    AVFramePtr frame;
-    if (m_frameQueue->dequeue(frame)) {
-
-        frame->pts = m_audioSamplesCount;
-        m_audioSamplesCount += frame->nb_samples;
-
-        int ret = avcodec_send_frame(m_codecCtx, frame.get());
-        if (ret < 0) {
-            char errbuf[1024] = { 0 };
-            av_strerror(ret, errbuf, sizeof(errbuf));
-            WRITE_LOG("Error sending audio frame: %s", errbuf);
-        }
-        else {
-            while (ret >= 0) {
-                AVPacketPtr packet(av_packet_alloc());
-                ret = avcodec_receive_packet(m_codecCtx, packet.get());
-
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                }
-                else if (ret < 0) {
-                    emit errorOccurred("Error receiving audio packet.");
-                    break;
-                }
-
-                if (packet->size <= 0 || packet->data == nullptr || packet->pts == AV_NOPTS_VALUE) {
-                    WRITE_LOG("Audio Encoder generated an invalid packet (size=%d, pts=%lld), dropping it.", packet->size, packet->pts);
-                    continue; // 丢弃这个包，继续尝试接收下一个
-                }
-
-                packet->stream_index = 1; // 音频流是 1
-                //WRITE_LOG("Enqueuing AUDIO packet: PTS=%lld, Size=%d", packet->pts, packet->size);
-
-                m_packetQueue->enqueue(std::move(packet));
-            }
-        }
+    int ret = avcodec_send_frame(m_codecCtx, frame);
+    if (ret < 0) {
+        char errbuf[1024] = { 0 };
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        WRITE_LOG("Error sending audio frame: %s", errbuf);
     }
     else {
-       //WRITE_LOG("No audio frame to encode.");//debug
-    }
+        while (ret >= 0) {
+            AVPacketPtr packet(av_packet_alloc());
+            ret = avcodec_receive_packet(m_codecCtx, packet.get());
 
-    work_guard();
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            }
+            else if (ret < 0) {
+                emit errorOccurred("Error receiving audio packet.");
+                break;
+            }
 
-    if (m_isEncoding) {
-        QMetaObject::invokeMethod(this, "doAudioEncodingWork", Qt::QueuedConnection);
+            if (packet->size <= 0 || packet->data == nullptr || packet->pts == AV_NOPTS_VALUE) {
+                WRITE_LOG("Audio Encoder generated an invalid packet (size=%d, pts=%lld), dropping it.", packet->size, packet->pts);
+                continue; // 丢弃这个包，继续尝试接收下一个
+            }
+
+            packet->stream_index = 1; // 音频流是 1
+            packet->time_base = m_codecCtx->time_base;
+            if (packet->duration <= 0) {
+                packet->duration = m_codecCtx->frame_size > 0 ? m_codecCtx->frame_size : frame->nb_samples;
+            }
+            //WRITE_LOG("Enqueuing AUDIO packet: PTS=%lld, Size=%d", packet->pts, packet->size);
+
+            m_packetQueue->enqueue(std::move(packet));
+        }
     }
-} 
+    m_stageStats.end(stageBegin);
+}
 
 // TODO:在其他的类中添加此逻辑
 void ffmpegEncoder::flushEncoder() {
@@ -353,17 +508,18 @@ void ffmpegEncoder::flushEncoder() {
 }
 
 void ffmpegEncoder::clear() {
+    m_worker.stop();
+
     {
-        QMutexLocker locker(&m_workMutex);
-        while (m_isDoingWork) {
-            m_workCond.wait(&m_workMutex);
+        std::lock_guard<std::mutex> lock(m_codecCtxMutex);
+        if (m_codecCtx) {
+            avcodec_free_context(&m_codecCtx);
+            m_codecCtx = nullptr;
         }
     }
-
-    if (m_codecCtx) {
-        avcodec_free_context(&m_codecCtx);
-        m_codecCtx = nullptr;
-    }
+    sws_freeContext(m_swsCtx);
+    m_swsCtx = nullptr;
+    m_convertFrame.reset();
     WRITE_LOG("ffmpegEncoder cleared.");
 }
 
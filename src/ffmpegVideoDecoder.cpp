@@ -1,26 +1,52 @@
 ﻿#include "ffmpegVideoDecoder.h"
+#include "DecoderThreadBudget.h"
 #include "logqueue.h"
 #include "log_global.h"
 
 ffmpegVideoDecoder::ffmpegVideoDecoder(QUEUE_DATA<AVPacketPtr> *packetQueue,
-                                       QUEUE_DATA<std::unique_ptr<QImage> > *imageQueue,
+                                       ImageMailbox *imageMailbox,
                                        QUEUE_DATA<AVFramePtr> *frameQueue, QObject *parent)
-    : QObject{parent}, m_packetQueue(packetQueue), m_frameQueue(frameQueue), m_QimageQueue(imageQueue) {
-    m_rgbFrame.reset(av_frame_alloc());
-    if (!m_rgbFrame) {
-        WRITE_LOG("FATAL: Failed to allocate m_rgbFrame in constructor.");
-        emit errorOccurred("FATAL: Failed to allocate m_rgbFrame in constructor.");
-    }
+    : QObject{parent}, m_packetQueue(packetQueue), m_frameQueue(frameQueue), m_imageMailbox(imageMailbox) {
 }
 
 ffmpegVideoDecoder::~ffmpegVideoDecoder() {
     clear();
 }
 
+void ffmpegVideoDecoder::setThreading(Threading threading, int maxThreads) {
+    m_threading = threading;
+    m_maxThreads = maxThreads > 0 ? maxThreads : 0;
+}
+
 bool ffmpegVideoDecoder::init(AVCodecParameters *params, AVRational inputTimeBase) {
     if (!params) {
         return false;
     }
+    // 拉流端换流时会重新 init，先停下解码循环再释放上一次的解码器和线程额度，调用方随后重新 start
+    stopDecoding();
+    closeCodec();
+    m_rawPassthrough = false;
+    if (!m_decodedFrame) {
+        m_decodedFrame.reset(av_frame_alloc());
+        if (!m_decodedFrame) {
+            WRITE_LOG("Failed to allocate decoded_frame.");
+            return false;
+        }
+    }
+    if (params->codec_id == AV_CODEC_ID_RAWVIDEO && params->format != AV_PIX_FMT_NONE &&
+        av_image_get_buffer_size(static_cast<AVPixelFormat>(params->format), params->width, params->height, 1) > 0) {
+        // 摄像头协商到原始格式时"解码"只是换个包装，rawvideo 解码器那一趟也省掉
+        m_rawPassthrough = true;
+        m_rawFormat = static_cast<AVPixelFormat>(params->format);
+        m_rawWidth = params->width;
+        m_rawHeight = params->height;
+        m_frameBasePts = AV_NOPTS_VALUE;
+        setupFrameTiming(params, inputTimeBase);
+        WRITE_LOG("Video decoder in raw passthrough mode (%s %dx%d, color conversion: %s).",
+                  av_get_pix_fmt_name(m_rawFormat), m_rawWidth, m_rawHeight,
+                  ColorConverter::isaName(m_colorConverter.isa()));
+        return true;
+    }
     m_codec = avcodec_find_decoder(params->codec_id);
     if (!m_codec) {
         WRITE_LOG("decodeCapture failed for codec id: %d", params->codec_id);
@@ -36,148 +62,221 @@ bool ffmpegVideoDecoder::init(AVCodecParameters *params, AVRational inputTimeBas
         avcodec_free_context(&m_codecCtx);
         return false;
     }
+
+    // 解码器不支持所选方式（如 rawvideo）时只占一个线程，不白占预算
+    const bool frameThreads = m_threading == Threading::Frame && (m_codec->capabilities & AV_CODEC_CAP_FRAME_THREADS);
+    const bool sliceThreads = m_threading == Threading::Slice && (m_codec->capabilities & AV_CODEC_CAP_SLICE_THREADS);
+    m_threadLease = DecoderThreadBudget::instance().acquire(frameThreads || sliceThreads ? m_maxThreads : 1);
+    m_codecCtx->thread_count = m_threadLease;
+    m_codecCtx->thread_type = frameThreads ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+
     if (avcodec_open2(m_codecCtx, m_codec, nullptr) < 0) {
         emit errorOccurred("avcodec_open2 failed");
-        avcodec_free_context(&m_codecCtx);
+        closeCodec();
         return false;
     }
     // reset base pts
     m_frameBasePts = AV_NOPTS_VALUE;
 
-    WRITE_LOG("Video decoder initialized successfully.");
-    m_inputTimeBase = inputTimeBase;
+    WRITE_LOG("Video decoder initialized successfully (%s, threads: %d %s, color conversion: %s).",
+              m_codec->name, m_codecCtx->thread_count,
+              m_codecCtx->active_thread_type == FF_THREAD_FRAME ? "frame"
+              : m_codecCtx->active_thread_type == FF_THREAD_SLICE ? "slice" : "none",
+              ColorConverter::isaName(m_colorConverter.isa()));
+    setupFrameTiming(params, inputTimeBase);
     return true;
+}
 
+void ffmpegVideoDecoder::setupFrameTiming(const AVCodecParameters *params, AVRational inputTimeBase) {
+    m_inputTimeBase = inputTimeBase;
+    m_frameRate = (params->framerate.num > 0 && params->framerate.den > 0) ? params->framerate : AVRational{0, 1};
+    m_frameTimeBase = m_frameRate.num > 0 ? av_inv_q(m_frameRate) : inputTimeBase;
+    m_lastFramePts = AV_NOPTS_VALUE;
+    m_lastFrameDuration = 0;
+    if (m_frameRate.num > 0) {
+        WRITE_LOG("Video decoder frame timing: %d/%d fps.", m_frameRate.num, m_frameRate.den);
+    } else {
+        WRITE_LOG("Video decoder frame timing: no frame rate, using input time base %d/%d.",
+                  inputTimeBase.num, inputTimeBase.den);
+    }
+}
+
+int64_t ffmpegVideoDecoder::frameDuration(const AVFrame *decodedFrame) {
+    if (m_frameRate.num > 0) {
+        return 1;
+    }
+    // 没有帧率：优先用解码器给出的时长，否则用与上一帧的 pts 差，乱序或重复时沿用上一次的值
+    int64_t duration = decodedFrame->duration;
+    if (duration <= 0 && decodedFrame->pts != AV_NOPTS_VALUE && m_lastFramePts != AV_NOPTS_VALUE &&
+        decodedFrame->pts > m_lastFramePts) {
+        duration = decodedFrame->pts - m_lastFramePts;
+    }
+    if (decodedFrame->pts != AV_NOPTS_VALUE) {
+        m_lastFramePts = decodedFrame->pts;
+    }
+    if (duration > 0) {
+        m_lastFrameDuration = duration;
+    }
+    return m_lastFrameDuration;
+}
 
+void ffmpegVideoDecoder::closeCodec() {
+    if (m_codecCtx) {
+        avcodec_free_context(&m_codecCtx);
+    }
+    if (m_threadLease > 0) {
+        DecoderThreadBudget::instance().release(m_threadLease);
+        m_threadLease = 0;
+    }
 }
 
 void ffmpegVideoDecoder::ChangeDecodingState(bool isDecoding) {
-    m_isDecoding = isDecoding;
-    if (m_isDecoding) {
-        if (!m_codecCtx) {
-            WRITE_LOG("Decoder not initialized, cannot start decoding.");
-            return;
-        }
-        QMetaObject::invokeMethod(this, "startDecoding", Qt::QueuedConnection);
+    if (isDecoding) {
+        startDecoding();
     } else {
         stopDecoding();
     }
-
 }
 
 void ffmpegVideoDecoder::startDecoding() {
-    WRITE_LOG("Starting video decoding loop...");
-    QMetaObject::invokeMethod(this, "doDecodingPacket", Qt::QueuedConnection);
+    if (!m_codecCtx && !m_rawPassthrough) {
+        WRITE_LOG("Decoder not initialized, cannot start decoding.");
+        return;
+    }
+    auto decode = [this](AVPacketPtr &packet) {
+        const int64_t stageBegin = m_stageStats.begin();
+        decodePacket(packet.get());
+        m_stageStats.end(stageBegin);
+    };
+    if (m_worker.startConsumer<AVPacketPtr>(m_packetQueue, PipelineWorker::kDefaultBatch, decode)) {
+        WRITE_LOG("Starting video decoding loop...");
+    }
 }
 
 void ffmpegVideoDecoder::stopDecoding() {
-    WRITE_LOG("Stopping video decoding loop...");
+    if (m_worker.isRunning()) {
+        WRITE_LOG("Stopping video decoding loop...");
+    }
+    m_worker.stop();
 }
 
-
-void ffmpegVideoDecoder::doDecodingPacket() {
-    if (!m_isDecoding) {
-        WRITE_LOG("Video decoding loop finished.");
-        return;
-    }
-    AVPacketPtr packet;
-    if (!m_packetQueue->dequeue(packet)) {
-        if (m_isDecoding) {
-            QMetaObject::invokeMethod(this, "doDecodingPacket", Qt::QueuedConnection);
+void ffmpegVideoDecoder::decodePacket(const AVPacket *packet) {
+    if (m_rawPassthrough) {
+        if (wrapRawPacket(packet, m_decodedFrame.get())) {
+            handleFrame(m_decodedFrame.get());
+            av_frame_unref(m_decodedFrame.get());
         }
-        WRITE_LOG("ffmpegDecoder::Deque Packet TimeOut");
         return;
-    } 
-    {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = true;
     }
-
-    auto work_guard = [this]() {
-        QMutexLocker locker(&m_workMutex);
-        m_isDoingWork = false;
-        m_workCond.wakeAll(); // 唤醒可能在clear()中等待的线程
-    };
-
-    AVFramePtr decodedFrame(av_frame_alloc());
-    if (!decodedFrame) {
-        WRITE_LOG("Failed to allocate decoded_frame.");
-        m_isDecoding = false;
-        work_guard();
+    if (!m_codecCtx || !m_decodedFrame) {
         return;
     }
-    if (avcodec_send_packet(m_codecCtx, packet.get()) != 0) {
-        WRITE_LOG("Failed to send packet to decoder.");
-        work_guard();
-        if (m_isDecoding) {
-            QMetaObject::invokeMethod(this, "doDecodingPacket", Qt::QueuedConnection);
-        }
-        return;
+    int ret = avcodec_send_packet(m_codecCtx, packet);
+    if (ret == AVERROR(EAGAIN)) {
+        // 输出没取空时解码器拒收新包；下面每次都会取空，正常不会走到这里
+        receiveFrames();
+        ret = avcodec_send_packet(m_codecCtx, packet);
     }
+    if (ret < 0 && ret != AVERROR_EOF) {
+        WRITE_LOG("Failed to send packet to decoder: %d", ret);
+    }
+    // 送包失败也要取：之前的包解出的帧可能还在解码器里
+    receiveFrames();
+}
 
-    int ret = avcodec_receive_frame(m_codecCtx, decodedFrame.get());
-
-    if (ret < 0) {
+void ffmpegVideoDecoder::receiveFrames() {
+    // 帧线程模式下一个包可能对应零帧或多帧，必须取到 EAGAIN 为止
+    while (true) {
+        const int ret = avcodec_receive_frame(m_codecCtx, m_decodedFrame.get());
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             return;
         }
-        WRITE_LOG("avcodec_receive_frame failed.");
-        return;
+        if (ret < 0) {
+            WRITE_LOG("avcodec_receive_frame failed: %d", ret);
+            return;
+        }
+        handleFrame(m_decodedFrame.get());
+        av_frame_unref(m_decodedFrame.get());
     }
+}
 
+bool ffmpegVideoDecoder::wrapRawPacket(const AVPacket *packet, AVFrame *frame) const {
+    const int needed = av_image_get_buffer_size(m_rawFormat, m_rawWidth, m_rawHeight, 1);
+    if (!packet->buf || packet->size < needed) {
+        WRITE_LOG("Raw video packet too small (%d < %d), dropped.", packet->size, needed);
+        return false;
+    }
+    if (av_image_fill_arrays(frame->data, frame->linesize, packet->data, m_rawFormat, m_rawWidth, m_rawHeight, 1) < 0) {
+        return false;
+    }
+    // 帧与包共享同一块内存：编码队列里的 clone 和显示转换都只是多一个引用
+    frame->buf[0] = av_buffer_ref(packet->buf);
+    if (!frame->buf[0]) {
+        av_frame_unref(frame);
+        return false;
+    }
+    frame->format = m_rawFormat;
+    frame->width = m_rawWidth;
+    frame->height = m_rawHeight;
+    frame->pts = packet->pts;
+    frame->pkt_dts = packet->dts;
+    frame->flags |= AV_FRAME_FLAG_KEY;
+    frame->pict_type = AV_PICTURE_TYPE_I;
+    return true;
+}
+
+void ffmpegVideoDecoder::handleFrame(AVFrame *decodedFrame) {
     if (m_frameBasePts == AV_NOPTS_VALUE && decodedFrame->pts != AV_NOPTS_VALUE) {
         m_frameBasePts = decodedFrame->pts;
     }
 
-    AVFramePtr sendFrame(av_frame_clone(decodedFrame.get()));
+    AVFramePtr sendFrame(av_frame_clone(decodedFrame));
     if (decodedFrame->pts != AV_NOPTS_VALUE) {
-            //将输入PTS转换为帧序号（假设编码器用帧序号）
-        int64_t pts_in_frames = av_rescale_q(
-            decodedFrame->pts - m_frameBasePts,
-            m_inputTimeBase,
-            { 1, 25 }  // 假设25fps
-        );
-        sendFrame->pts = pts_in_frames;
+        // 有帧率时换算成帧序号，否则只减去起点
+        sendFrame->pts = av_rescale_q_rnd(decodedFrame->pts - m_frameBasePts, m_inputTimeBase, m_frameTimeBase,
+                                          static_cast<AVRounding>(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
     }
     else {
         sendFrame->pts = AV_NOPTS_VALUE;
     }
-    if(m_isDecoding){
-        if (m_frameQueue->size() < 30) {
-            m_frameQueue->enqueue(std::move(sendFrame));
-        }
-        else {
-            // 队列满了（说明编码器没跑或太慢），丢弃这一帧以保护内存
-            // 这是一个"非阻塞"策略，防止影响预览
-            // WRITE_LOG("Warning: Encoder queue full, dropping frame to prevent memory bloat.");
-        }
+    sendFrame->time_base = m_frameTimeBase;
+    sendFrame->duration = frameDuration(decodedFrame);
+    if (!m_worker.cancelRequested()) {
+        // 编码器没跑或太慢时由队列的溢出策略丢帧，不会阻塞预览
+        m_frameQueue->enqueue(std::move(sendFrame));
     }
 
-    bool formatChanged = (m_swsSrcWidth != m_codecCtx->width ||
-                            m_swsSrcHeight != m_codecCtx->height ||
-                            m_swsSrcPixFmt != m_codecCtx->pix_fmt);
+    const QSize dstSize = displaySizeFor(decodedFrame->width, decodedFrame->height);
+    const int fastScale = fastPathScale(decodedFrame, dstSize);
+    if (fastScale > 0 && presentWithConverter(decodedFrame, fastScale)) {
+        return;
+    }
+
+    bool formatChanged = (m_swsSrcWidth != decodedFrame->width ||
+                            m_swsSrcHeight != decodedFrame->height ||
+                            m_swsSrcPixFmt != static_cast<AVPixelFormat>(decodedFrame->format) ||
+                            m_swsDstWidth != dstSize.width() ||
+                            m_swsDstHeight != dstSize.height());
     if (!m_swsCtx || formatChanged) {
-        WRITE_LOG("Re-initializing SwsContext due to format change.");
+        WRITE_LOG("Re-initializing SwsContext: %dx%d -> %dx%d.", decodedFrame->width, decodedFrame->height,
+                  dstSize.width(), dstSize.height());
         //释放旧资源
         sws_freeContext(m_swsCtx);
-        av_free(rgbBuffer);
-        rgbBuffer = nullptr;
 
         // 更新参数记录
-        m_swsSrcWidth = m_codecCtx->width;
-        m_swsSrcHeight = m_codecCtx->height;
-        m_swsSrcPixFmt = m_codecCtx->pix_fmt;
+        m_swsSrcWidth = decodedFrame->width;
+        m_swsSrcHeight = decodedFrame->height;
+        m_swsSrcPixFmt = static_cast<AVPixelFormat>(decodedFrame->format);
+        m_swsDstWidth = dstSize.width();
+        m_swsDstHeight = dstSize.height();
 
+        // 缩放和色彩转换一次完成，直接输出控件的物理像素尺寸；
+        // RGB32 与 QImage::Format_RGB32 内存布局一致，绘制时 Qt 不必再转换格式
         m_swsCtx = sws_getContext(m_swsSrcWidth, m_swsSrcHeight, m_swsSrcPixFmt,
-                                    m_swsSrcWidth, m_swsSrcHeight, AV_PIX_FMT_RGB24,
+                                    m_swsDstWidth, m_swsDstHeight, AV_PIX_FMT_RGB32,
                                     SWS_BILINEAR, nullptr, nullptr, nullptr);
 
-        if (m_swsCtx) {
-            int bufferSize = av_image_get_buffer_size(AV_PIX_FMT_RGB24, m_swsSrcWidth, m_swsSrcHeight,1);
-            rgbBuffer = (uint8_t *) av_malloc(bufferSize * sizeof(uint8_t));
-            av_image_fill_arrays(m_rgbFrame->data, m_rgbFrame->linesize, rgbBuffer, AV_PIX_FMT_RGB24,
-                                    m_swsSrcWidth, m_swsSrcHeight,1);
-        } else {
+        if (!m_swsCtx) {
             WRITE_LOG("FATAL: Failed to create SwsContext.");
             // 如果SwsContext创建失败，后续的转换也无法进行，可以跳出循环
             return;
@@ -188,41 +287,89 @@ void ffmpegVideoDecoder::doDecodingPacket() {
             WRITE_LOG("Error: Attempting to scale a NULL or invalid frame!");
             return; // 跳过这一帧的处理
         }
-        sws_scale(m_swsCtx, (const uint8_t * const*) decodedFrame->data, decodedFrame->linesize,
-                    0, m_codecCtx->height, m_rgbFrame->data, m_rgbFrame->linesize);
-
-        QImage tempImage(m_rgbFrame->data[0], m_codecCtx->width, m_codecCtx->height, QImage::Format_RGB888);
-        auto image = std::make_unique<QImage>(tempImage.copy()); //copy做深拷贝
-        if (m_QimageQueue->size() < 5) { 
-            m_QimageQueue->enqueue(std::move(image));//添加到图片队列，用于QT渲染
-            emit newFrameAvailable();
+        // 直接转换进池化缓冲区；它就是显示用的 QImage 的像素内存，之后不再拷贝
+        int stride = 0;
+        AVBufferRef *rgbBuffer = m_imagePool.get(m_swsDstWidth, m_swsDstHeight, 4, stride);
+        if (rgbBuffer) {
+            uint8_t *dstData[4] = {rgbBuffer->data, nullptr, nullptr, nullptr};
+            int dstLinesize[4] = {stride, 0, 0, 0};
+            sws_scale(m_swsCtx, (const uint8_t * const*) decodedFrame->data, decodedFrame->linesize,
+                        0, decodedFrame->height, dstData, dstLinesize);
+            QImage image = ImageBufferPool::wrap(rgbBuffer, m_swsDstWidth, m_swsDstHeight, stride,
+                                                 QImage::Format_RGB32);
+            // 信箱里还有没显示的帧时直接覆盖它，界面已经有一次重绘在路上，不必再通知
+            if (!image.isNull() && m_imageMailbox->publish(std::move(image))) {
+                emit newFrameAvailable();
+            }
+        } else {
+            WRITE_LOG("Failed to get display buffer from ImageBufferPool.");
         }
     }
-    av_frame_unref(decodedFrame.get());
+}
+
 
-    work_guard();
-    if (m_isDecoding) {
-        QMetaObject::invokeMethod(this, "doDecodingPacket", Qt::QueuedConnection);
+int ffmpegVideoDecoder::fastPathScale(const AVFrame *frame, const QSize &dstSize) const {
+    if (!ColorConverter::isSupported(frame)) {
+        return 0;
     }
+    int scale = 1;
+    for (int candidate : {4, 2}) {
+        if (ColorConverter::outputSize(frame->width, candidate) >= dstSize.width() &&
+            ColorConverter::outputSize(frame->height, candidate) >= dstSize.height()) {
+            scale = candidate;
+            break;
+        }
+    }
+    const qint64 outArea = static_cast<qint64>(ColorConverter::outputSize(frame->width, scale)) *
+                           ColorConverter::outputSize(frame->height, scale);
+    const qint64 dstArea = static_cast<qint64>(dstSize.width()) * dstSize.height();
+    return outArea <= dstArea * 2 ? scale : 0;
 }
 
+bool ffmpegVideoDecoder::presentWithConverter(const AVFrame *frame, int scale) {
+    const int width = ColorConverter::outputSize(frame->width, scale);
+    const int height = ColorConverter::outputSize(frame->height, scale);
+    int stride = 0;
+    AVBufferRef *rgbBuffer = m_imagePool.get(width, height, 4, stride);
+    if (!rgbBuffer) {
+        WRITE_LOG("Failed to get display buffer from ImageBufferPool.");
+        return false;
+    }
+    if (!m_colorConverter.convert(frame, scale, rgbBuffer->data, stride)) {
+        av_buffer_unref(&rgbBuffer);
+        return false;
+    }
+    QImage image = ImageBufferPool::wrap(rgbBuffer, width, height, stride, QImage::Format_RGB32);
+    if (!image.isNull() && m_imageMailbox->publish(std::move(image))) {
+        emit newFrameAvailable();
+    }
+    return true;
+}
 
-void ffmpegVideoDecoder::clear() {
-    m_isDecoding = false;
-    {
-        QMutexLocker locker(&m_workMutex);
-        // 如果doDecodingPacket的核心部分正在执行，则等待它完成
-        while (m_isDoingWork) {
-            m_workCond.wait(&m_workMutex);
-        }
+void ffmpegVideoDecoder::setTargetSize(const QSize &size) {
+    m_targetWidth.store(size.width() > 0 ? size.width() : 0, std::memory_order_relaxed);
+    m_targetHeight.store(size.height() > 0 ? size.height() : 0, std::memory_order_relaxed);
+}
+
+QSize ffmpegVideoDecoder::displaySizeFor(int srcWidth, int srcHeight) const {
+    const int targetWidth = m_targetWidth.load(std::memory_order_relaxed);
+    const int targetHeight = m_targetHeight.load(std::memory_order_relaxed);
+    if (targetWidth <= 0 || targetHeight <= 0 || (targetWidth >= srcWidth && targetHeight >= srcHeight)) {
+        return QSize(srcWidth, srcHeight);
     }
-    if (m_codecCtx) avcodec_free_context(&m_codecCtx);
+    // 控件比源小：按长宽比缩到控件内；比源大时由 QPainter 放大，解码端不做无用功
+    QSize size = QSize(srcWidth, srcHeight).scaled(targetWidth, targetHeight, Qt::KeepAspectRatio);
+    size.setWidth(qMax(2, size.width() & ~1));
+    size.setHeight(qMax(2, size.height() & ~1));
+    return size;
+}
+
+void ffmpegVideoDecoder::clear() {
+    // join 解码线程：正在解码的那个包处理完才返回
+    m_worker.stop();
+    closeCodec();
     if (m_swsCtx) sws_freeContext(m_swsCtx);
     m_swsCtx = nullptr;
-
-    if (rgbBuffer) {
-        av_free(rgbBuffer);
-        rgbBuffer = nullptr;
-    }
-    WRITE_LOG("ffmpegVideoDecoder cleared successfully.");
+    WRITE_LOG("ffmpegVideoDecoder cleared successfully (display buffers allocated: %llu).",
+              (unsigned long long) m_imagePool.allocatedCount());
 }
@@ -1,8 +1,30 @@
 ﻿#include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include <QCoreApplication>
 
 QRect MainWindow::pos = QRect(-1, -1, -1, -1);
 
+namespace {
+/**
+ *madebyYahei
+ *读取调试开关：命令行 --name=value / --name value 优先，其次环境变量
+ *只出现 --name 不带值时返回 "1"；都没有返回空串
+ */
+QString debugOption(const QString &name, const char *envName) {
+    const QStringList args = QCoreApplication::arguments();
+    const QString flag = "--" + name;
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i].startsWith(flag + "=")) {
+            return args[i].mid(flag.size() + 1);
+        }
+        if (args[i] == flag) {
+            return (i + 1 < args.size() && !args[i + 1].startsWith("--")) ? args[i + 1] : QString("1");
+        }
+    }
+    return qEnvironmentVariable(envName);
+}
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
       , ui(new Ui::MainWindow) {
@@ -39,13 +61,54 @@ MainWindow::MainWindow(QWidget *parent)
     mainip = 0; //主屏幕显示的用户IP图像
 
     // 初始化队列
-	m_videoPacketQueue = new QUEUE_DATA<AVPacketPtr>();//采集到的视频包队列
-    m_SmallQimageQueue = new QUEUE_DATA<std::unique_ptr<QImage> >();
-    m_videoFrameQueue = new QUEUE_DATA<AVFramePtr>();
-    m_audioPacketQueue = new QUEUE_DATA<AVPacketPtr>();
-    m_audioFrameQueue = new QUEUE_DATA<AVFramePtr>();
-    m_publishPacketQueue = new QUEUE_DATA<AVPacketPtr>();
-	m_MainQimageQueue = new QUEUE_DATA<std::unique_ptr<QImage> >(); //拉流得到的显示队列，暂时不开启线程
+    // 单生产者/单消费者的链路使用无锁环形队列；
+    // 发送队列（音视频两个编码器写入）是多生产者，保持加锁队列
+	m_videoPacketQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::SpscRing, 64);//采集到的视频包队列 Capture -> videoDecoder
+    m_videoFrameQueue = new QUEUE_DATA<AVFramePtr>(QueueBackend::SpscRing, 32); // videoDecoder -> videoEncoder
+    m_audioPacketQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::SpscRing, 128); // Capture -> audioDecoder
+    m_audioFrameQueue = new QUEUE_DATA<AVFramePtr>(QueueBackend::SpscRing); // audioDecoder -> audioEncoder
+    m_publishPacketQueue = new QUEUE_DATA<AVPacketPtr>(QueueBackend::Locked);
+    // 显示只要最新一帧：解码线程 -> UI 用三缓冲信箱，双方都不阻塞，界面重绘时取最新帧
+    // 信箱只允许一个生产者，两个拉流各用一个，主屏跟随当前启动的拉流切换
+    m_localImageMailbox = new ImageMailbox(); // videoDecoder -> UI
+    m_rtmpImageMailbox = new ImageMailbox(); // rtmpPuller -> UI
+    m_webrtcImageMailbox = new ImageMailbox(); // webrtcPuller -> UI
+
+    // 溢出策略：实时链路宁可丢也不能把背压一路传回采集设备
+    // 环形队列的槽位数是硬上限，消费者停摆时也只会占用这么多内存
+    // 采集包：设备缓冲区不能溢出，下游卡住时丢最旧的
+    m_videoPacketQueue->setOverflowPolicy(OverflowPolicy::DropOldest, CapacityUnit::Items, 60);
+    m_audioPacketQueue->setOverflowPolicy(OverflowPolicy::DropOldest, CapacityUnit::Items, 100);
+    // 解码帧 -> 编码器：最多积压约 1 秒（25fps），编码器没跑时不会无限占内存
+    m_videoFrameQueue->setOverflowPolicy(OverflowPolicy::DropOldest, CapacityUnit::DurationUs, 1000000);
+    // 发送队列：推流卡住超过 2 秒（音视频时长之和）就清空并等下一个关键帧，避免花屏
+    m_publishPacketQueue->setOverflowPolicy(OverflowPolicy::DropUntilKeyframe, CapacityUnit::DurationUs, 2000000);
+
+    // 队列命名后注册到遥测表；开启 --telemetry-json 时每 5 秒输出一次深度/速率/阻塞/驻留时间
+    m_videoPacketQueue->setName("local.videoPacket");
+    m_localImageMailbox->setName("local.previewImage");
+    m_videoFrameQueue->setName("local.videoFrame");
+    m_audioPacketQueue->setName("local.audioPacket");
+    m_audioFrameQueue->setName("local.audioFrame");
+    m_publishPacketQueue->setName("publish.packet");
+    m_rtmpImageMailbox->setName("rtmpPull.image");
+    m_webrtcImageMailbox->setName("webrtcPull.image");
+    m_videoLocalWidget->setFrameSource(m_localImageMailbox);
+    m_videoRemoteWidget->setFrameSource(m_webrtcImageMailbox);
+    // 默认关闭，避免正式运行时往工作目录写文件、往日志里刷遥测
+    // 用法：--telemetry-json=<路径> 或 CLOUDMEETING_TELEMETRY_JSON=<路径>，只给开关时写到 ./telemetry.json
+    QString telemetryPath = debugOption("telemetry-json", "CLOUDMEETING_TELEMETRY_JSON");
+    if (telemetryPath == "1") {
+        telemetryPath = "./telemetry.json";
+    }
+    if (!telemetryPath.isEmpty()) {
+        m_telemetryTimer = new QTimer(this);
+        connect(m_telemetryTimer, &QTimer::timeout, this, [telemetryPath]() {
+            TelemetryRegistry::instance().dump(true, telemetryPath);
+        });
+        m_telemetryTimer->start(5000);
+        WRITE_LOG("Telemetry dump enabled: %s", telemetryPath.toUtf8().constData());
+    }
 
     //// TODO: 创建工厂管理线程，加快启动速度
     // TODO: 创建视频与音频参数单例结构体，不传递vParams 和 aParams
@@ -53,12 +116,16 @@ MainWindow::MainWindow(QWidget *parent)
     // 视频采集线程
     m_VideoCaptureThread = new QThread(this);
     m_VideoCapture = new Capture(m_videoPacketQueue, nullptr);
+    // 与编码器的 25fps 一致；优先协商原始格式，省掉 MJPEG 解码
+    m_VideoCapture->setVideoCaptureFormat(1280, 720, 25);
+    m_VideoCapture->setStageName("local.videoCapture");
     m_VideoCapture->moveToThread(m_VideoCaptureThread);
     m_VideoCaptureThread->start();
     connect(m_VideoCapture, &Capture::videoDeviceOpenSuccessfully, this, &MainWindow::onVideoDeviceOpened);
     // 音频采集线程
     m_AudioCaptureThread = new QThread(this);
     m_AudioCapture = new Capture(nullptr, m_audioPacketQueue);
+    m_AudioCapture->setStageName("local.audioCapture");
     m_AudioCapture->moveToThread(m_AudioCaptureThread);
     m_AudioCaptureThread->start();
     connect(m_AudioCapture, &Capture::audioDeviceOpenSuccessfully, this, &MainWindow::onAudioDeviceOpened);
@@ -70,24 +137,28 @@ MainWindow::MainWindow(QWidget *parent)
     m_audioDecoderThread->start();
     //视频解码线程
     m_videoDecoderThread = new QThread(this);
-    m_videoDecoder = new ffmpegVideoDecoder(m_videoPacketQueue, m_SmallQimageQueue, m_videoFrameQueue);
+    m_videoDecoder = new ffmpegVideoDecoder(m_videoPacketQueue, m_localImageMailbox, m_videoFrameQueue);
+    m_videoDecoder->setStageName("local.videoDecoder");
     m_videoDecoder->moveToThread(m_videoDecoderThread);
     m_videoDecoderThread->start();
 
     // 音频编码线程
     m_audioEncoderThread = new QThread(this);
     m_audioEncoder = new ffmpegEncoder(m_audioFrameQueue, m_publishPacketQueue);
+    m_audioEncoder->setStageName("local.audioEncoder");
     m_audioEncoder->moveToThread(m_audioEncoderThread);
     m_audioEncoderThread->start();
     // 视频编码线程
     m_videoEncoderThread = new QThread(this);
     m_videoEncoder = new ffmpegEncoder(m_videoFrameQueue, m_publishPacketQueue);
+    m_videoEncoder->setStageName("local.videoEncoder");
     m_videoEncoder->moveToThread(m_videoEncoderThread);
     m_videoEncoderThread->start();
 
     //RTMP推流线程
     m_rtmpPublisherThread = new QThread(this);
     m_rtmpPublisher = new RtmpPublisher(m_publishPacketQueue);
+    m_rtmpPublisher->setStageName("publish.rtmpMux");
     m_rtmpPublisher->moveToThread(m_rtmpPublisherThread);
     m_rtmpPublisherThread->start();
 
@@ -98,34 +169,52 @@ MainWindow::MainWindow(QWidget *parent)
     m_webRTCPublisherThread->start();
     //QMetaObject::invokeMethod(m_webRTCPublisher, "initThread", Qt::QueuedConnection);// 为了初始化libdatachannel
     connect(m_webRTCPublisher, &WebRTCPublisher::PLIReceived, this, &MainWindow::on_PLIReceived_webrtcPublisher, Qt::QueuedConnection);//处理RTC->RTMP转码时的PLI请求
+    connect(m_webRTCPublisher, &WebRTCPublisher::targetBitrateChanged, m_videoEncoder, &ffmpegEncoder::setTargetBitrate, Qt::QueuedConnection);//带宽估计 -> 编码码率
 
     // RTMP拉流
     m_rtmpPullerThread = new QThread(this);
-    m_rtmpPuller = new RtmpPuller(m_MainQimageQueue);
+    m_rtmpPuller = new RtmpPuller(m_rtmpImageMailbox);
     m_rtmpPuller->moveToThread(m_rtmpPullerThread);
     m_rtmpPullerThread->start();
-    connect(m_rtmpPuller, &RtmpPuller::newFrameAvailable, this, &MainWindow::onNewRemoteFrameAvailable, Qt::QueuedConnection);
+    connect(m_rtmpPuller, &RtmpPuller::newFrameAvailable, m_videoRemoteWidget, &VideoWidget::onFrameReady, Qt::QueuedConnection);
 
     //WebRTC拉流
     m_webrtcPullerThread = new QThread(this);
-    m_webRTCPuller = new WebRTCPuller(m_MainQimageQueue);
+    m_webRTCPuller = new WebRTCPuller(m_webrtcImageMailbox);
     m_webRTCPuller->moveToThread(m_webrtcPullerThread);
     m_webrtcPullerThread->start();
     //QMetaObject::invokeMethod(m_webRTCPublisher, "initThread", Qt::QueuedConnection);// 为了初始化libdatachannel
-    connect(m_webRTCPuller, &WebRTCPuller::newFrameAvailable, this, &MainWindow::onNewRemoteFrameAvailable, Qt::QueuedConnection);
+    connect(m_webRTCPuller, &WebRTCPuller::newFrameAvailable, m_videoRemoteWidget, &VideoWidget::onFrameReady, Qt::QueuedConnection);
 
     //获取可用设备
     QStringList videoDevices = DeviceEnumerator::getDevices(MediaType::Video);
     ui->videoDeviceComboBox->addItems(videoDevices);
     QStringList audioDevices = DeviceEnumerator::getDevices(MediaType::Audio);
     ui->audioDevicecomboBox->addItems(audioDevices);
+    // 合成源放在最后，没有摄像头/麦克风的机器也能推流压测；只在调试版或 --synthetic-sources /
+    // CLOUDMEETING_SYNTHETIC_SOURCES=1 时出现，正式用户看不到
+#ifdef QT_DEBUG
+    const bool syntheticSources = true;
+#else
+    const bool syntheticSources = debugOption("synthetic-sources", "CLOUDMEETING_SYNTHETIC_SOURCES") == "1";
+#endif
+    if (syntheticSources) {
+        ui->videoDeviceComboBox->addItem("lavfi:testsrc2");
+        ui->audioDevicecomboBox->addItem("lavfi:sine");
+    }
 
 
     
     //// TODO：创建全局单例->参数管理器，解耦编码器参数传递
     //// 视频
-    connect(m_videoDecoder, &ffmpegVideoDecoder::newFrameAvailable, this, &MainWindow::onNewLocalFrameAvailable,
+    connect(m_videoDecoder, &ffmpegVideoDecoder::newFrameAvailable, m_videoLocalWidget, &VideoWidget::onFrameReady,
             Qt::QueuedConnection);
+    // 解码端直接输出控件的物理像素尺寸，小窗口只付小窗口的转换开销
+    connect(m_videoLocalWidget, &VideoWidget::displaySizeChanged, m_videoDecoder, &ffmpegVideoDecoder::setTargetSize,
+            Qt::DirectConnection);
+    connect(m_videoRemoteWidget, &VideoWidget::displaySizeChanged, m_rtmpPuller, &RtmpPuller::setDisplaySize);
+    connect(m_videoRemoteWidget, &VideoWidget::displaySizeChanged, m_webRTCPuller, &WebRTCPuller::setDisplaySize);
+    m_videoDecoder->setTargetSize(m_videoLocalWidget->displaySize());
     connect(m_videoEncoder, &ffmpegEncoder::initializationSuccess, this, &MainWindow::videoEncoderReady);
 
     //// 音频
@@ -152,6 +241,9 @@ MainWindow::MainWindow(QWidget *parent)
 }
 
 MainWindow::~MainWindow() {
+    if (m_telemetryTimer) {
+        m_telemetryTimer->stop();
+    }
     // 停止视频采集
     if (m_VideoCaptureThread && m_VideoCaptureThread->isRunning()) {
         QMetaObject::invokeMethod(m_VideoCapture, "closeDevice", Qt::BlockingQueuedConnection);
@@ -185,6 +277,14 @@ MainWindow::~MainWindow() {
         m_rtmpPullerThread->wait();
     }
 
+    WRITE_LOG("Queue drops: videoPacket=%llu audioPacket=%llu videoFrame=%llu previewSuperseded=%llu publish=%llu (%llu bytes)",
+              (unsigned long long) m_videoPacketQueue->droppedCount(),
+              (unsigned long long) m_audioPacketQueue->droppedCount(),
+              (unsigned long long) m_videoFrameQueue->droppedCount(),
+              (unsigned long long) m_localImageMailbox->supersededCount(),
+              (unsigned long long) m_publishPacketQueue->droppedCount(),
+              (unsigned long long) m_publishPacketQueue->droppedBytes());
+
     // 清理队列，确保在其他对象销毁前清理队列以避免wakeAll崩溃
     if (m_videoPacketQueue) {
         m_videoPacketQueue->clear();
@@ -323,6 +423,9 @@ void MainWindow::checkAndStartPublishing() {
     }
     if (m_isRtmpPublishRequested) {
         WRITE_LOG("Encoders ready, starting RTMP publish...");
+        // FLV 封装器持有编码器上下文并写出序列头，之后编码器不能再重开换分辨率/帧率，只调码率
+        m_videoEncoder->setLayerSwitchingEnabled(false);
+        m_rtmpPublishStarted = true;
         AVCodecContext* videoCtx = m_videoEncoder->getCodecContext();
         AVCodecContext* audioCtx = m_audioEncoder->getCodecContext();
         if (!videoCtx || !audioCtx) {
@@ -348,6 +451,8 @@ void MainWindow::checkAndStartPublishing() {
     }
     else if (m_isWebRtcPublishRequested) {
         WRITE_LOG("Encoders ready, starting WebRTC publish...");
+        // 只走 WebRTC 时编码器可以按带宽估计换档（新 IDR 自带 SPS/PPS）
+        m_videoEncoder->setLayerSwitchingEnabled(!m_rtmpPublishStarted);
         AVCodecContext* videoCtx = m_videoEncoder->getCodecContext();
         AVCodecContext* audioCtx = m_audioEncoder->getCodecContext();
         if (!videoCtx || !audioCtx) {
@@ -405,10 +510,12 @@ void MainWindow::on_joinmeetBtn_clicked() {
 }
 void MainWindow::onRtmpPullerInitSuccess() {
     WRITE_LOG("RTMP puller initialized.");
+    m_videoRemoteWidget->setFrameSource(m_rtmpImageMailbox);
     QMetaObject::invokeMethod(m_rtmpPuller, "startPulling", Qt::QueuedConnection);
 }
 void MainWindow::onWebRTCPullerInitSuccess() {
     WRITE_LOG("WebRTC puller initialized.");
+    m_videoRemoteWidget->setFrameSource(m_webrtcImageMailbox);
     QMetaObject::invokeMethod(m_webRTCPuller, "ChangePullingState", Qt::QueuedConnection,Q_ARG(bool,true));
 }
 //// 退出会议按钮
@@ -437,33 +544,13 @@ void MainWindow::onVideoDeviceOpened(AVCodecParameters *vParams, AVRational vTim
         qDebug("Initializing video pipeline");
         QMetaObject::invokeMethod(m_videoDecoder, "init", Qt::QueuedConnection,
             Q_ARG(AVCodecParameters*, m_videoParams),
-            Q_ARG(AVRational, m_audioTimeBase));
+            Q_ARG(AVRational, m_videoTimeBase));
         m_isVideoDecoderReady = true;
         QMetaObject::invokeMethod(m_videoDecoder, "ChangeDecodingState", Qt::QueuedConnection,
             Q_ARG(bool, m_isVideoDecoderReady));
     }
 }
 
-void MainWindow::onNewLocalFrameAvailable() {
-    // 这是在UI主线程中执行的
-    std::unique_ptr<QImage> image;
-    if (m_SmallQimageQueue->dequeue(image)) {
-        if (image && !image->isNull()) {
-            m_videoLocalWidget->updateFrame(image.get());
-        }
-    }
-}
-
-void MainWindow::onNewRemoteFrameAvailable() {
-    WRITE_LOG("New remote frame available.");
-    std::unique_ptr<QImage> image;
-    if (m_MainQimageQueue->dequeue(image)) {
-        if (image && !image->isNull()) {
-            m_videoRemoteWidget->updateFrame(image.get());
-        }
-    }
-}
-
 void MainWindow::handleError(const QString &errorText) {
     WRITE_LOG(errorText.toLocal8Bit());
 
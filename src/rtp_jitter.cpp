@@ -29,7 +29,9 @@
 ******************************************************************************/
 
 #include "rtp_jitter.h"
+#include <algorithm>
 #include <iostream>
+#include <thread>
 #include <cmath>
 #include <cstdint>
 #include "winsock2.h"
@@ -42,13 +44,19 @@
 using namespace std;
 
 
+
 /******************************************************************************
-*   Just call _init to get initialization "things" done.
+*   Allocates the ring and calls init to get initialization "things" done.
 *
 *   Returns n/a
 ******************************************************************************/
 RTPJitter::RTPJitter(const unsigned depth, const uint32 sample_rate /* = 8000 */)
+    : _ring(new slot[RING_CAPACITY])
 {
+    _adaptive = false;
+    _adaptive_min_ms = depth;
+    _adaptive_max_ms = depth;
+    _adaptive_percentile = 0.95;
     init(depth, sample_rate);
 }
 
@@ -62,168 +70,123 @@ RTPJitter::RTPJitter(const unsigned depth, const uint32 sample_rate /* = 8000 */
 ******************************************************************************/
 RTPJitter::~RTPJitter()
 {
-    rscoped_lock lock(_mutex);
-
-    _buffer.clear();
+    _clean_buffer();
 }
 
 
 /******************************************************************************
 *   Ensure a new empty buffer and associated parameters.  Reset buffer stats.
+*   Neither the producer nor the consumer may be running.
 *
 *   Returns none
 ******************************************************************************/
 void RTPJitter::init(const unsigned depth, const uint32 sample_rate /* = 8000 */)
 {
-    if (!_buffer.empty()) {
-        _clean_buffer();
-    }
+    _clean_buffer();
 
-    _first_buf_sequence = 0;
-    _last_buf_sequence = 0;
-    _last_pop_sequence = 0;
+    _have_sequence.store(false);
+    _read_seq.store(0);
+    _highest_seq.store(0);
+    _gap_arrival.store(UINT64_MAX);
+    _gap_scan_end = 0;
     set_depth(depth);
     _payload_sample_rate = sample_rate;
 
-    _buffering = true;
-    _buffering_timestamp = (timepoint::min)();
+    _buffering.store(true);
+    _loss_wait_ms.store(0);
     _reset_buffer_stats(sample_rate);
+
+    _have_timestamp = false;
+    _last_rtp_timestamp = 0;
+    _last_ext_timestamp = 0;
+    _epoch = stdclock::now();
+    _window_min_transit_us = INT64_MAX;
+    _prev_window_min_transit_us = INT64_MAX;
+    _window_start = _epoch;
+    _base_transit_us.store(INT64_MAX);
+    _reset_adaptive();
 }
 
 
 /******************************************************************************
-*   Adds the given packet to the end of the buffer, or inserts it earlier in
-*   the buffer if it is out of order.
+*   Stores the given packet in the ring slot of its extended sequence number.
+*   Arrival order does not matter: an out of order packet simply lands in its
+*   own slot.  A packet older than what the consumer has already played out
+*   (or given up on) is refused.
+*
+*   Producer side only.
 *
 *   Returns rtp jitter result code
 ******************************************************************************/
 RTPJitter::RESULT RTPJitter::push(rawrtp_ptr p)
 {
     RTPHeader  *rtp;
-    uint16      rtp_sequence = 0;
-    RESULT      rc = SUCCESS;
 
-    if ((p != nullptr)
-     && ((rtp = reinterpret_cast<PRTPHeader>(p->pData))))
+    if ((p == nullptr)
+     || (p->pData == nullptr)
+     || (p->nLen < sizeof(RTPHeader)))
     {
-        rscoped_lock lock(_mutex);
-
-        rtp_sequence = ntohs(rtp->sequence);
-
-        if (_depth_ms > _max_buffer_depth) {
-            LOGD("RTPJitter::push(): buffer overflow: buffer depth: %d  packet #%d", _depth_ms, rtp_sequence);
-            if (!_buffer.empty()) {
-                rc = BUFFER_OVERFLOW;
-                _stats.overflow_count++;
-
-                // we are overflowing ... drop the front packet
-                rawrtp_ptr old_packet = _buffer.front();
-                _buffer.pop_front();
-
-                // ֹ磺ǰ depth Сڰʱ䣬ֱӹ
-                if (_depth_ms >= old_packet->payload_ms) {
-                    _depth_ms -= old_packet->payload_ms;
-                }
-                else {
-                    _depth_ms = 0;
-                }
-                old_packet.reset();
-            }
-            else {
-                // Ϊյ depth ܴ˵״̬Ѿңǿ
-                _depth_ms = 0;
-            }
-            rc = BUFFER_OVERFLOW;
-            _stats.overflow_count++;
-
-            // we are overflowing ... drop the front packet
-            rawrtp_ptr old_packet = _buffer.front();
-            _buffer.pop_front();
-            _depth_ms -= old_packet->payload_ms;
-            old_packet.reset();
-        }
+        // we were given a null pointer ... is that bad enough?
+        return BAD_PACKET;
+    }
+    rtp = reinterpret_cast<PRTPHeader>(p->pData);
 
-        // if this is our first packet since init, start the buffering clock ...
-        if (_buffering && (_buffering_timestamp == (timepoint::min)())) {
-            _buffering_timestamp = stdclock::now();
-        }
+    uint64 ext_seq = _unwrap_sequence(ntohs(rtp->sequence));
+    p->ext_sequence = (int64)ext_seq;
 
-        // for every packet, update jitter stats
+    // for every packet, update jitter stats and the playout clock.  A
+    //  retransmission is late by design, so it is not a jitter sample.
+    if (!p->retransmitted) {
         _calc_jitter(rtp);
+    }
+    _update_playout_base(p.get(), rtp, stdclock::now());
+
+    if (!_have_sequence.load(std::memory_order_relaxed)) {
+        // first packet since init: it defines where playout starts
+        _read_seq.store(ext_seq, std::memory_order_relaxed);
+        _highest_seq.store(ext_seq, std::memory_order_relaxed);
+        _store(_ring[ext_seq & RING_MASK], p, ext_seq);
+        _have_sequence.store(true, std::memory_order_release);
+        return SUCCESS;
+    }
 
-        // TODO: sequence numbers are only 16 bits and will wrap around
-        //  fairly often.  We need to be sure we're not naive here.
-
-        // TODO: there's a problem here: when sequence numbers wrap around,
-        //  if either the max_int one, or the zero one, go missing, then
-        //  we will not recover (subsequent packets will be dropped as "bad")
-        //  until the sequence numbers wrap around AGAIN and one of those
-        //  packets are NOT dropped a second time.
-
-        if ((rtp_sequence >= _last_buf_sequence)
-         || ((rtp_sequence == 0) && (_last_buf_sequence == UINT16_MAX))
-         || (_last_pop_sequence == _first_buf_sequence))
-        {
-            // if this packet has a sequence number greater than
-            //  any other I've seen so far, then we can be certain
-            //  that this one belongs at the end.  As a caveat, I
-            //  suppose packets could arrive with the same sequnce
-            //  number.  If so, this goes right after the one we
-            //  already have -- in this case, it still goes on the
-            //  back end ... and we don't consider it to be out of
-            //  order.
-            _buffer.push_back(p);
-            _last_buf_sequence = rtp_sequence;
-            _depth_ms += p->payload_ms;
-
-            // if this is the only packet we have, it obviously
-            //  serves as both the first and last element.  Also,
-            //  we will set the _last_pop_sequence as well so when
-            //  we're popping, we don't think there was a dropped
-            //  packet i.e. _first_buf == _last_pop means all good.
-            if (_buffer.size() == 1) {
-                _first_buf_sequence = _last_pop_sequence = rtp_sequence;
-            }
-        } else {
-            LOGD("jitter.push(): ooo packet #%d", rtp_sequence);
-            ++_stats.ooo_count;
-            // This is an out-of-order packet.  One of two scenarios:
-            //
-            // 1. preceeds front packet by more than 1
-            //      - packet is too old to use, ignore it
-            // 2. immediately preceeds the front packet
-            //      - packet is just in time, stick on front
-            // 3. belogns in the middle of the buffer
-            //      - find the home and insert
-            // 4. sequence numbers have wrapped around to 0 again
-            //      -
-            if (rtp_sequence < (_first_buf_sequence - 1)) {
-                rc = BAD_PACKET;
-            } else if (rtp_sequence == (_first_buf_sequence - 1)) {
-                _buffer.push_front(p);
-                _first_buf_sequence = rtp_sequence;
-                _depth_ms += p->payload_ms;
-            } else {
-                // this packet has a sequence number that is strictly
-                //  less than the last packet in our buffer, and greater
-                //  than or equal to the first packet.  Either way, this
-                //  one can go is anywhere from index 1 to n-2
-                for (deque<rawrtp_ptr>::iterator i = _buffer.begin(); i != _buffer.end(); ++i) {
-                    RTPHeader *item = reinterpret_cast<PRTPHeader>((*i)->pData);
-                    if (rtp_sequence < item->sequence) {
-                        _buffer.insert(i, p);
-                        _depth_ms += p->payload_ms;
-                        break;
-                    }
-                }
-            }
-        }
+    uint64 highest = _highest_seq.load(std::memory_order_relaxed);
+    if (ext_seq < highest) {
+        _stats.ooo_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (ext_seq < _read_seq.load(std::memory_order_acquire)) {
+        // too late: already played out, or the gap was given up on.  Routine
+        //  with retransmission, so it is counted by the caller, not logged.
+        return BAD_PACKET;
+    }
 
-        // debug log
-        WRITE_LOG("RTPJitter::push seq=%u payload_ms=%u buffer_size=%d depth_ms=%d nominal=%d buffering=%d", rtp_sequence, p->payload_ms, (int)_buffer.size(), _depth_ms, _nominal_depth_ms, _buffering);
+    slot &s = _ring[ext_seq & RING_MASK];
+    uint64 tag = s.tag.load(std::memory_order_acquire);
+    if (tag == ext_seq + 1) {
+        return BAD_PACKET;      // duplicate
+    }
+    if ((tag != SLOT_EMPTY) && (tag != SLOT_BUSY) && (tag > ext_seq + 1)) {
+        return BAD_PACKET;      // the ring already moved a whole lap past this one
+    }
+
+    RESULT rc = _store(s, p, ext_seq) ? BUFFER_OVERFLOW : SUCCESS;
+    if (ext_seq > highest) {
+        _highest_seq.store(ext_seq, std::memory_order_release);
     } else {
-        // we were given a null pointer ... is that bad enough?
-        rc = BAD_PACKET;
+        _note_arrival(ext_seq);     // may fill a gap the consumer already looked at
+    }
+
+    // the consumer may have given up on this sequence while we were storing
+    //  it.  Its skip sweeps the gap after moving the read position, and we
+    //  check the read position after storing; whichever side claims the
+    //  slot first throws the packet away (see _skip_to).
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((ext_seq < _read_seq.load(std::memory_order_acquire)) && _claim(s, ext_seq + 1)) {
+        rawrtp_ptr stale = std::move(s.packet);
+        s.tag.store(SLOT_EMPTY, std::memory_order_release);
+        _depth_ms.fetch_sub(stale->payload_ms, std::memory_order_relaxed);
+        _depth_packets.fetch_sub(1, std::memory_order_relaxed);
+        return BAD_PACKET;
     }
     return rc;
 }
@@ -231,116 +194,115 @@ RTPJitter::RESULT RTPJitter::push(rawrtp_ptr p)
 
 
 /******************************************************************************
-*   Retrieves the RTP packet from the front of the buffer, or nothing if the
-*   expected packet is missing.
+*   Retrieves the next RTP packet in sequence once it is due, or reports the
+*   expected packet as lost once the next available packet is due.
+*
+*   A packet is released once the playout clock says it is due, i.e. its
+*   media time mapped to local time plus the nominal depth has passed.  The
+*   whole gap in front of the next available packet is skipped at once.
 *
 *   NOTE: be very careful in this routine -- I broke the "one entry, one exit"
 *   rule.
 *
+*   Consumer side only.
+*
 *   Returns rtp jitter result code
 ******************************************************************************/
 RTPJitter::RESULT RTPJitter::pop(rawrtp_ptr& packet)
 {
-    rawrtp_ptr bp;      // buffer packet tmp pointer
+    int64       media_us = 0;
 
-    rscoped_lock lock(_mutex);
+    if (!_have_sequence.load(std::memory_order_acquire)) {
+        _buffering.store(true, std::memory_order_relaxed);
+        _stats.empty_count.fetch_add(1, std::memory_order_relaxed);
+        return RTPJitter::BUFFER_EMPTY;
+    }
+    uint64 read_seq = _read_seq.load(std::memory_order_relaxed);
+    uint64 highest = _highest_seq.load(std::memory_order_acquire);
+    if (highest < read_seq) {
+        // the buffer is empty ... go back to buffering
+        _buffering.store(true, std::memory_order_relaxed);
+        _stats.empty_count.fetch_add(1, std::memory_order_relaxed);
+        return RTPJitter::BUFFER_EMPTY;
+    }
 
-    // first things first -- do we need to enter or exit the buffering state?
-    if (_buffer.empty()) {
-        // the buffer is empty ... do we need to go back to buffering?  If the
-        //  _buffering flag is not yet set, then yes.
-        if (!_buffering) {
-            _buffering = true;
+    // anything more than a ring behind the newest packet has been overwritten
+    if (highest - read_seq >= (uint64)RING_CAPACITY) {
+        _skip_to(read_seq, highest - RING_CAPACITY + 1);
+        return RTPJitter::DROPPED_PACKET;
+    }
+
+    slot &s = _ring[read_seq & RING_MASK];
+    if (_peek_media_us(read_seq, media_us)) {
+        // the expected packet is here.  Hand it out when due, or right away
+        //  (as a discard) if the buffer has grown past its maximum depth.
+        bool overflow = (_depth_ms.load(std::memory_order_relaxed) > _max_buffer_depth);
+        if (!overflow && (_due_time_us(media_us) > stdclock::now())) {
+            return RTPJitter::BUFFERING;
         }
-        _stats.empty_count++;
-    } else {
-        if (_buffering) {
-            // check the time... come out of buffering once the buffering
-            //  timer reaches the nominal jitter depth, or if we get a burst
-            //  of packets that deepens the buffer to the nominal depth.
-            //
-            // It's possible that packets came bursting in i.e. we've reached
-            //  our depth before the buffering delay expires.  In this case,
-            //  we also come out of the buffering state.
-            int buffer_time = clocks::duration_cast<clocks::milliseconds>(stdclock::now() - _buffering_timestamp).count();
-            if ((buffer_time >= _nominal_depth_ms)
-             || (_depth_ms >= _nominal_depth_ms))
-            {
-                _buffering = false;
-                _buffering_timestamp = (timepoint::min)();
-            } else {
-                // log buffering state
-                WRITE_LOG("RTPJitter::pop buffering buffer_time=%d depth_ms=%d nominal=%d buf_size=%d", buffer_time, _depth_ms, _nominal_depth_ms, (int)_buffer.size());
-            }
+        if (!_claim(s, read_seq + 1)) {
+            // the producer is recycling this slot; its push will wake us again
+            return RTPJitter::BUFFERING;
+        }
+        packet = std::move(s.packet);
+        s.tag.store(SLOT_EMPTY, std::memory_order_release);
+        _depth_ms.fetch_sub(packet->payload_ms, std::memory_order_relaxed);
+        _depth_packets.fetch_sub(1, std::memory_order_relaxed);
+        _read_seq.store(read_seq + 1, std::memory_order_release);
+
+        if (overflow) {
+            LOGD("RTPJitter::pop(): buffer overflow: dropping packet #%llu", (unsigned long long)read_seq);
+            _stats.overflow_count.fetch_add(1, std::memory_order_relaxed);
+            packet.reset();
+            return RTPJitter::DROPPED_PACKET;
         }
+        _buffering.store(false, std::memory_order_relaxed);
+        packet->use_redundant_payload = false;
+        return RTPJitter::SUCCESS;
     }
 
-    if (_buffering) {
+    // the expected packet is missing.  Wait for it until the next packet we
+    //  do have is due (and any retransmission has had time to arrive), then
+    //  give up on the whole gap in front of it.
+    uint64 seq = _first_stored_after(read_seq, highest, media_us);
+    if ((seq == 0) || (_gap_deadline_us(media_us) > stdclock::now())) {
         return RTPJitter::BUFFERING;
     }
 
-    // take a look at the packet at the front of the buffer
-    bp = _buffer.front();
-
-    // let's see if we should take what's on the front of the buffer, or
-    //  if we need to return nothing and indicate a dropped packet.
-    //  There's a lot of logic here, so tread lightly.
-    //
-    //  good sequences:
-    //      _last_pop and _first_buf are equal
-    //      _last_pop is one less than _first_buf
-    //      _last_pop is UINT16_MAX and _first_buf is 0
-    //      dynamic payloads and _last_pop is 2 less than _first_buf
-    if ((_last_pop_sequence == _first_buf_sequence)
-     || (_last_pop_sequence == (_first_buf_sequence - 1))
-     || ((_last_pop_sequence == UINT16_MAX) && (_first_buf_sequence == 0))
-     || ((bp->payload_type == RTP_PAYLOAD_DYNAMIC) && (_last_pop_sequence == (_first_buf_sequence - 2))))
-    {
-        packet = bp;
-        if ((bp->payload_type == RTP_PAYLOAD_DYNAMIC) && (_last_pop_sequence == (_first_buf_sequence - 2))) {
-            // "special" case where we hang onto the front packet in the buffer
-            //  but mark it becasue we expect to be able to reuse it.
-            packet->use_redundant_payload = true;
-        } else {
-            // "normal" case where we can remove the front packet
-            packet->use_redundant_payload = false;
-            _buffer.pop_front();
-            _depth_ms -= packet->payload_ms;
-        }
-
-        RTPHeader *p = reinterpret_cast<PRTPHeader>(packet->pData);
-        _last_pop_sequence = ntohs(p->sequence);
-
-        // did we just empty the buffer?  If so, reset the sequence counters
-        if (_buffer.empty()) {
-            _first_buf_sequence = _last_pop_sequence;
-        } else {
-            // now peek at the next packet to get it's sequence #
-            bp = _buffer.front();
-            p = reinterpret_cast<PRTPHeader>(bp->pData);
-            _first_buf_sequence = ntohs(p->sequence);
+    // "special" case where a single missing packet can be rebuilt from
+    //  the redundant block of the next (dynamic payload) packet.  We hang
+    //  onto that packet in the buffer but mark it because we expect to be
+    //  able to reuse it.
+    if (seq == read_seq + 1) {
+        slot &next = _ring[seq & RING_MASK];
+        if (_claim(next, seq + 1)) {
+            bool redundant = (next.packet->payload_type == RTP_PAYLOAD_DYNAMIC);
+            if (redundant) {
+                packet = next.packet;
+            }
+            next.tag.store(seq + 1, std::memory_order_release);
+            if (redundant) {
+                packet->use_redundant_payload = true;
+                _read_seq.store(seq, std::memory_order_release);
+                return RTPJitter::SUCCESS;
+            }
         }
-        WRITE_LOG("RTPJitter::pop SUCCESS seq=%u depth_ms=%d buf_size=%d", ntohs(p->sequence), _depth_ms, (int)_buffer.size());
-        return RTPJitter::SUCCESS;
-
-    } else {
-        ++_last_pop_sequence;
-        return RTPJitter::DROPPED_PACKET;
     }
+
+    _skip_to(read_seq, seq);
+    return RTPJitter::DROPPED_PACKET;
 }
 
 
 /******************************************************************************
-*   Empties the current buffer and reinitializes.  May block while waiting for
-*   any other thread accessing the buffer.
+*   Empties the current buffer and reinitializes.  Neither the producer nor
+*   the consumer may be running.
 *
 *   Returns rtp jitter result code
 ******************************************************************************/
 RTPJitter::RESULT RTPJitter::reset()
 {
-    rscoped_lock lock(_mutex);
-    _clean_buffer();
-    init(_nominal_depth_ms, _payload_sample_rate);
+    init(_nominal_depth_ms.load(), _payload_sample_rate);
 
     return SUCCESS;
 }
@@ -355,13 +317,11 @@ RTPJitter::RESULT RTPJitter::reset()
 ******************************************************************************/
 void RTPJitter::set_depth(const unsigned ms_depth, const unsigned max_depth /* = 0 */)
 {
-    rscoped_lock lock(_mutex);
-
-    _nominal_depth_ms = ms_depth;
+    _nominal_depth_ms.store(ms_depth);
     if (max_depth >= ms_depth) {
         _max_buffer_depth = max_depth;
     } else {
-        _max_buffer_depth = (_nominal_depth_ms * 2);
+        _max_buffer_depth = (ms_depth * 2);
     }
 }
 
@@ -371,8 +331,7 @@ void RTPJitter::set_depth(const unsigned ms_depth, const unsigned max_depth /* =
 ******************************************************************************/
 int RTPJitter::get_depth()
 {
-    rscoped_lock lock(_mutex);
-    return (_buffer.size());
+    return _depth_packets.load(std::memory_order_relaxed);
 }
 
 
@@ -381,8 +340,7 @@ int RTPJitter::get_depth()
 ******************************************************************************/
 int RTPJitter::get_depth_ms()
 {
-    rscoped_lock lock(_mutex);
-    return _depth_ms;
+    return _depth_ms.load(std::memory_order_relaxed);
 }
 
 
@@ -391,8 +349,7 @@ int RTPJitter::get_depth_ms()
 ******************************************************************************/
 int RTPJitter::get_nominal_depth()
 {
-    rscoped_lock lock(_mutex);
-    return _nominal_depth_ms;
+    return (int)_nominal_depth_ms.load(std::memory_order_relaxed);
 }
 
 
@@ -403,9 +360,416 @@ int RTPJitter::get_nominal_depth()
 ******************************************************************************/
 void RTPJitter::eot_detected()
 {
-    _first_buf_sequence = 0;
-    _last_buf_sequence = 0;
-    _last_pop_sequence = 0;
+    _clean_buffer();
+    _have_sequence.store(false);
+    _read_seq.store(0);
+    _highest_seq.store(0);
+    _gap_arrival.store(UINT64_MAX);
+    _gap_scan_end = 0;
+}
+
+
+/******************************************************************************
+*   Playout clock accessors.  next_due() is what a scheduler should sleep
+*   until; a push that lands in front of the buffer makes it earlier, so the
+*   producer compares due_time() of what it just pushed against that.
+******************************************************************************/
+timepoint RTPJitter::next_due()
+{
+    int64 media_us = 0;
+
+    if (!_have_sequence.load(std::memory_order_acquire)) {
+        return (timepoint::max)();
+    }
+    uint64 read_seq = _read_seq.load(std::memory_order_relaxed);
+    uint64 highest = _highest_seq.load(std::memory_order_acquire);
+    if (highest < read_seq) {
+        return (timepoint::max)();
+    }
+    if ((highest - read_seq >= (uint64)RING_CAPACITY)
+     || (_depth_ms.load(std::memory_order_relaxed) > _max_buffer_depth)) {
+        return stdclock::now();     // pop has a discard to do
+    }
+    if (_peek_media_us(read_seq, media_us)) {
+        return _due_time_us(media_us);
+    }
+    if (_first_stored_after(read_seq, highest, media_us) != 0) {
+        return _gap_deadline_us(media_us);
+    }
+    return (timepoint::max)();
+}
+
+
+timepoint RTPJitter::due_time(const rawrtp_ptr& packet)
+{
+    if (_payload_sample_rate == 0) {
+        return stdclock::now();
+    }
+    return _due_time_us(packet->ext_timestamp * 1000000LL / (int64)_payload_sample_rate);
+}
+
+
+/******************************************************************************
+*   Extends a 16-bit RTP sequence number to 64 bits relative to the newest one
+*   stored, so any packet within +/-32767 of it lands on the right lap.  The
+*   first packet starts on lap 1 so there is always room below it.
+*
+*   Returns extended sequence number
+******************************************************************************/
+uint64 RTPJitter::_unwrap_sequence(uint16 sequence)
+{
+    if (!_have_sequence.load(std::memory_order_relaxed)) {
+        return (uint64)sequence + 0x10000;
+    }
+    uint64 highest = _highest_seq.load(std::memory_order_relaxed);
+    int16 delta = (int16)(uint16)(sequence - (uint16)highest);
+    return highest + delta;
+}
+
+
+/******************************************************************************
+*   Takes exclusive ownership of a slot's packet by swapping its tag from
+*   expected_tag to SLOT_BUSY.  The owner must store a tag again afterwards.
+*
+*   Returns true if the slot was claimed
+******************************************************************************/
+bool RTPJitter::_claim(slot &s, uint64 expected_tag)
+{
+    if (!s.tag.compare_exchange_strong(expected_tag, SLOT_BUSY, std::memory_order_acquire)) {
+        return false;
+    }
+    // readers validating media_us against the tag must see BUSY first
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+
+/******************************************************************************
+*   Producer: puts a packet in its slot, waiting out a consumer that is in the
+*   middle of taking the previous occupant.
+*
+*   Returns true if an unplayed packet had to be discarded to make room
+******************************************************************************/
+bool RTPJitter::_store(slot &s, rawrtp_ptr &p, uint64 ext_seq)
+{
+    uint64 tag = s.tag.load(std::memory_order_acquire);
+    while ((tag == SLOT_BUSY) || !_claim(s, tag)) {
+        std::this_thread::yield();
+        tag = s.tag.load(std::memory_order_acquire);
+    }
+
+    rawrtp_ptr discarded = std::move(s.packet);
+    s.packet = p;
+    s.media_us.store((_payload_sample_rate > 0) ? (p->ext_timestamp * 1000000LL / (int64)_payload_sample_rate) : 0,
+                     std::memory_order_relaxed);
+    _depth_ms.fetch_add(p->payload_ms, std::memory_order_relaxed);
+    _depth_packets.fetch_add(1, std::memory_order_relaxed);
+    s.tag.store(ext_seq + 1, std::memory_order_release);
+
+    if (discarded) {
+        // the ring lapped a packet the consumer never got to
+        _depth_ms.fetch_sub(discarded->payload_ms, std::memory_order_relaxed);
+        _depth_packets.fetch_sub(1, std::memory_order_relaxed);
+        _stats.overflow_count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+
+/******************************************************************************
+*   Consumer: gives up on [from, to) and moves the read position to 'to'.  A
+*   packet the producer stored in the gap after we looked is discarded here,
+*   or by the producer's own check after its store -- never both, since both
+*   sides have to claim the slot.
+*
+*   Returns none
+******************************************************************************/
+void RTPJitter::_skip_to(uint64 from, uint64 to)
+{
+    _stats.lost_count.fetch_add((uint32)(to - from), std::memory_order_relaxed);
+    _read_seq.store(to, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (to - from > (uint64)RING_CAPACITY) {
+        from = to - RING_CAPACITY;
+    }
+    for (uint64 seq = from; seq < to; ++seq) {
+        slot &s = _ring[seq & RING_MASK];
+        if (_claim(s, seq + 1)) {
+            rawrtp_ptr stale = std::move(s.packet);
+            s.tag.store(SLOT_EMPTY, std::memory_order_release);
+            _depth_ms.fetch_sub(stale->payload_ms, std::memory_order_relaxed);
+            _depth_packets.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+/******************************************************************************
+*   Producer: an out of order packet was stored behind the newest one.  Keep
+*   the lowest such sequence for the consumer, which clears it each time it
+*   looks (see _first_stored_after).
+*
+*   Returns none
+******************************************************************************/
+void RTPJitter::_note_arrival(uint64 ext_seq)
+{
+    uint64 lowest = _gap_arrival.load(std::memory_order_relaxed);
+    while ((ext_seq < lowest)
+        && !_gap_arrival.compare_exchange_weak(lowest, ext_seq, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+    }
+}
+
+
+/******************************************************************************
+*   Consumer: finds the first packet stored behind read_seq.  The scan picks
+*   up where the previous call stopped; only a reported out of order arrival
+*   can move it back, so each sequence is looked at about once per gap
+*   instead of once per pop/next_due call.
+*
+*   The arrival is taken before scanning: a store the scan misses is reported
+*   after its tag is published, so it is picked up on the next call.
+*
+*   Returns the sequence (media time in media_us), or 0 if there is none
+******************************************************************************/
+uint64 RTPJitter::_first_stored_after(uint64 read_seq, uint64 highest, int64 &media_us)
+{
+    uint64 arrived = _gap_arrival.exchange(UINT64_MAX, std::memory_order_acq_rel);
+    if (_gap_scan_end <= read_seq) {
+        _gap_scan_end = read_seq + 1;
+    }
+    if ((arrived > read_seq) && (arrived < _gap_scan_end)) {
+        _gap_scan_end = arrived;
+    }
+    for (; _gap_scan_end <= highest; ++_gap_scan_end) {
+        if (_peek_media_us(_gap_scan_end, media_us)) {
+            return _gap_scan_end;
+        }
+    }
+    return 0;
+}
+
+
+/******************************************************************************
+*   Consumer: reads the media time of the packet stored for ext_seq without
+*   taking it.  The tag is checked again afterwards (seqlock style) in case
+*   the producer recycled the slot in between.
+*
+*   Returns true if the packet is present
+******************************************************************************/
+bool RTPJitter::_peek_media_us(uint64 ext_seq, int64 &media_us)
+{
+    slot &s = _ring[ext_seq & RING_MASK];
+    if (s.tag.load(std::memory_order_acquire) != ext_seq + 1) {
+        return false;
+    }
+    media_us = s.media_us.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (s.tag.load(std::memory_order_relaxed) == ext_seq + 1);
+}
+
+
+timepoint RTPJitter::_due_time_us(int64 media_us)
+{
+    int64 base_us = _base_transit_us.load(std::memory_order_relaxed);
+    if (base_us == INT64_MAX || _payload_sample_rate == 0) {
+        return stdclock::now();
+    }
+    int64 nominal_us = (int64)_nominal_depth_ms.load(std::memory_order_relaxed) * 1000;
+    return _epoch + clocks::microseconds(media_us + base_us + nominal_us);
+}
+
+
+/******************************************************************************
+*   When the packet behind a gap is due, it arrived about nominal depth ago
+*   (that is what "due" means).  The gap stays open until loss wait has passed
+*   since then, so a NACK sent on its arrival can still be answered.
+*
+*   Returns time at which the gap in front of this packet is given up
+******************************************************************************/
+timepoint RTPJitter::_gap_deadline_us(int64 media_us)
+{
+    timepoint due = _due_time_us(media_us);
+    int64 extra_ms = (int64)_loss_wait_ms.load(std::memory_order_relaxed)
+                   - (int64)_nominal_depth_ms.load(std::memory_order_relaxed);
+    return (extra_ms > 0) ? due + clocks::milliseconds(extra_ms) : due;
+}
+
+
+/******************************************************************************
+*   Unwraps the RTP timestamp of a new packet and tracks the minimum transit
+*   time (arrival - media time) over two consecutive windows, so the base
+*   follows slow clock drift and path changes without reacting to one
+*   unusually fast packet forever.
+*
+*   Returns none -- p->ext_timestamp and the base transit are updated.
+******************************************************************************/
+void RTPJitter::_update_playout_base(RTPPacket *p, RTPHeader *rtp, timepoint arrival)
+{
+    uint32 rtp_timestamp = ntohl(rtp->timestamp);
+    if (!_have_timestamp) {
+        _have_timestamp = true;
+        _last_ext_timestamp = rtp_timestamp;
+    } else {
+        _last_ext_timestamp += (int32)(rtp_timestamp - _last_rtp_timestamp);
+    }
+    // reordered packets may be older than the newest one seen
+    p->ext_timestamp = _last_ext_timestamp;
+    _last_rtp_timestamp = rtp_timestamp;
+
+    if (p->retransmitted) {
+        return;     // its transit includes a round trip; not a delay sample
+    }
+
+    int64 arrival_us = clocks::duration_cast<clocks::microseconds>(arrival - _epoch).count();
+    int64 media_us = (_payload_sample_rate > 0) ? (p->ext_timestamp * 1000000LL / (int64)_payload_sample_rate) : 0;
+    int64 transit_us = arrival_us - media_us;
+
+    if (arrival - _window_start >= clocks::milliseconds(PLAYOUT_WINDOW_MS)) {
+        _prev_window_min_transit_us = _window_min_transit_us;
+        _window_min_transit_us = INT64_MAX;
+        _window_start = arrival;
+    }
+    if (transit_us < _window_min_transit_us) {
+        _window_min_transit_us = transit_us;
+    }
+    int64 base_us = (std::min)(_window_min_transit_us, _prev_window_min_transit_us);
+    _base_transit_us.store(base_us, std::memory_order_relaxed);
+
+    if (_adaptive) {
+        _update_target_depth(transit_us - base_us, arrival);
+    }
+}
+
+
+/******************************************************************************
+*   Turns the adaptive depth on or off.  While adaptive, the nominal depth is
+*   owned by the estimator: it starts at the current nominal (clamped) and is
+*   only moved by _update_target_depth().
+*
+*   Returns nothing
+******************************************************************************/
+void RTPJitter::set_adaptive(bool enable, const unsigned min_ms /* = 20 */, const unsigned max_ms /* = 150 */, const double percentile /* = 0.95 */)
+{
+    _adaptive = enable;
+    _adaptive_min_ms = min_ms;
+    _adaptive_max_ms = (max_ms >= min_ms) ? max_ms : min_ms;
+    _adaptive_percentile = (std::max)(0.5, (std::min)(percentile, 0.999));
+    if (_adaptive) {
+        unsigned nominal = _nominal_depth_ms.load();
+        _nominal_depth_ms.store((std::max)(_adaptive_min_ms, (std::min)(nominal, _adaptive_max_ms)));
+        // leave room for the deepest target plus a burst behind it
+        _max_buffer_depth = (std::max)(_max_buffer_depth, (int)_adaptive_max_ms * 2);
+    }
+    _reset_adaptive();
+}
+
+
+/******************************************************************************
+*   Retrieves the depth the estimator is steering towards, in milliseconds.
+*   Equal to the nominal depth when not adaptive.
+******************************************************************************/
+int RTPJitter::get_target_depth()
+{
+    return (int)(_adaptive ? _target_depth_ms.load(std::memory_order_relaxed)
+                           : _nominal_depth_ms.load(std::memory_order_relaxed));
+}
+
+
+/******************************************************************************
+*   Hands out up to max_us of pending time-stretch work.  Each nominal depth
+*   step shifts every later due time by the same amount; the renderer plays
+*   that much slower (positive) or faster (negative) to absorb it without a
+*   gap or a pile-up.  Safe from any thread.
+*
+*   Returns microseconds to stretch, sign as above
+******************************************************************************/
+int RTPJitter::take_time_stretch_us(const int max_us)
+{
+    int64 debt = _stretch_debt_us.load(std::memory_order_relaxed);
+    int64 take;
+    do {
+        take = (std::max)((int64)-max_us, (std::min)(debt, (int64)max_us));
+    } while (!_stretch_debt_us.compare_exchange_weak(debt, debt - take, std::memory_order_relaxed));
+    return (int)take;
+}
+
+
+void RTPJitter::_add_stretch_debt(int64 us)
+{
+    int64 debt = _stretch_debt_us.load(std::memory_order_relaxed);
+    int64 next;
+    do {
+        next = (std::max)((int64)-MAX_STRETCH_DEBT_US, (std::min)(debt + us, (int64)MAX_STRETCH_DEBT_US));
+    } while (!_stretch_debt_us.compare_exchange_weak(debt, next, std::memory_order_relaxed));
+}
+
+
+void RTPJitter::_reset_adaptive()
+{
+    for (int i = 0; i < DELAY_BINS; ++i) {
+        _delay_hist[i] = 0.0;
+    }
+    _delay_hist_total = 0.0;
+    _delay_samples = 0;
+    _target_depth_ms.store(_nominal_depth_ms.load());
+    _last_shrink = stdclock::now();
+    _stretch_debt_us.store(0);
+}
+
+
+/******************************************************************************
+*   Adds one relative delay sample to the histogram and moves the nominal
+*   depth one step towards the requested percentile.  Growth is fast (a late
+*   packet is an audible gap now), shrinking is slow so one quiet second does
+*   not throw away the margin for the next burst.
+*
+*   Returns none
+******************************************************************************/
+void RTPJitter::_update_target_depth(int64 relative_delay_us, timepoint arrival)
+{
+    int bin = (int)(relative_delay_us / (DELAY_BIN_MS * 1000));
+    bin = (std::max)(0, (std::min)(bin, DELAY_BINS - 1));
+
+    for (int i = 0; i < DELAY_BINS; ++i) {
+        _delay_hist[i] *= DELAY_FORGET_FACTOR;
+    }
+    _delay_hist[bin] += (1.0 - DELAY_FORGET_FACTOR);
+    _delay_hist_total = _delay_hist_total * DELAY_FORGET_FACTOR + (1.0 - DELAY_FORGET_FACTOR);
+
+    if (++_delay_samples < ADAPT_WARMUP_PACKETS) {
+        return;
+    }
+
+    double wanted = _delay_hist_total * _adaptive_percentile;
+    double sum = 0.0;
+    int quantile_bin = DELAY_BINS - 1;
+    for (int i = 0; i < DELAY_BINS; ++i) {
+        sum += _delay_hist[i];
+        if (sum >= wanted) {
+            quantile_bin = i;
+            break;
+        }
+    }
+    unsigned target = (unsigned)((quantile_bin + 1) * DELAY_BIN_MS);
+    target = (std::max)(_adaptive_min_ms, (std::min)(target, _adaptive_max_ms));
+    _target_depth_ms.store(target, std::memory_order_relaxed);
+
+    unsigned nominal = _nominal_depth_ms.load(std::memory_order_relaxed);
+    int step = 0;
+    if (target > nominal) {
+        step = (std::min)((int)(target - nominal), GROW_STEP_MS);
+        _last_shrink = arrival;
+    } else if ((target < nominal)
+            && (arrival - _last_shrink >= clocks::milliseconds(SHRINK_INTERVAL_MS))) {
+        step = -1;
+        _last_shrink = arrival;
+    }
+    if (step != 0) {
+        _nominal_depth_ms.store(nominal + step, std::memory_order_relaxed);
+        _add_stretch_debt((int64)step * 1000);
+    }
 }
 
 
@@ -449,6 +813,8 @@ void RTPJitter::_calc_jitter(RTPHeader *rtp)
     _stats.prev_rx_timestamp = current_time;
     // is this a new high water mark for jitter?
     if (_stats.max_jitter < _stats.jitter) _stats.max_jitter = _stats.jitter;
+    _stats.jitter_out.store((uint32)_stats.jitter, std::memory_order_relaxed);
+    _stats.max_jitter_out.store((uint32)_stats.max_jitter, std::memory_order_relaxed);
 
 //    LOGD("RTPJitter::_calc_jitter(): interarrival_time_ms[%03d]  arrival[%u]  rtp->timestamp[%u]  transit[%d]  jitter[%d]  max_jitter[%.4f] ", interarrival_time_ms, arrival, ntohl(rtp->timestamp), transit, (uint32)_stats.jitter, _stats.max_jitter);
 }
@@ -461,8 +827,13 @@ void RTPJitter::_calc_jitter(RTPHeader *rtp)
 ******************************************************************************/
 void RTPJitter::_clean_buffer()
 {
-    _buffer.clear();
-    _depth_ms = 0;
+    for (int i = 0; i < RING_CAPACITY; ++i) {
+        _ring[i].packet.reset();
+        _ring[i].media_us.store(0, std::memory_order_relaxed);
+        _ring[i].tag.store(SLOT_EMPTY, std::memory_order_relaxed);
+    }
+    _depth_ms.store(0);
+    _depth_packets.store(0);
 }
 
 
@@ -536,9 +907,12 @@ void RTPJitter::_log(string s)
 ******************************************************************************/
 void RTPJitter::_reset_buffer_stats(uint32 sample_rate)
 {
-    _stats.ooo_count = 0;
-    _stats.empty_count = 0;
-    _stats.overflow_count = 0;
+    _stats.ooo_count.store(0);
+    _stats.empty_count.store(0);
+    _stats.overflow_count.store(0);
+    _stats.lost_count.store(0);
+    _stats.jitter_out.store(0);
+    _stats.max_jitter_out.store(0);
     _stats.jitter = 0.0;
     _stats.max_jitter = 0.0;
     _stats.prev_arrival = 0;
@@ -39,6 +39,11 @@ target("CloudMeeting")
             "strmiids", "uuid", "ole32", "gdi32", "oleaut32", "vfw32", "user32"
         )
     end
+    if is_plat("linux") then
+        -- 原生 ALSA 采集；V4L2 只需要内核头文件
+        add_syslinks("asound")
+        add_defines("CLOUDMEETING_HAVE_ALSA")
+    end
 
     after_install(function (target)
         print("Installing %s ...", target:name())